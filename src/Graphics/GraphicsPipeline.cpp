@@ -228,22 +228,28 @@ namespace gsim {
 			.basePipelineIndex = -1
 		};
 
-		// Create the pipeline
-		result = vkCreateGraphicsPipelines(device->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+		// Create the pipeline through the device's pipeline cache
+		result = vkCreateGraphicsPipelines(device->GetDevice(), device->GetPipelineCache()->GetPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan graphics pipeline! Error code: %s", string_VkResult(result));
 		
-		// Set the fence create info
-		VkFenceCreateInfo fenceInfo {
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		// Set the rendering timeline semaphore create info
+		VkSemaphoreTypeCreateInfo semaphoreTypeInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
 			.pNext = nullptr,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0
+		};
+		VkSemaphoreCreateInfo timelineInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &semaphoreTypeInfo,
+			.flags = 0
 		};
 
-		// Create the fence
-		result = vkCreateFence(device->GetDevice(), &fenceInfo, nullptr, &renderingFence);
+		// Create the rendering timeline semaphore
+		result = vkCreateSemaphore(device->GetDevice(), &timelineInfo, nullptr, &renderingTimeline);
 		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to create Vulkan rendering synchronization fence! Error code: %s", string_VkResult(result));
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan rendering timeline semaphore! Error code: %s", string_VkResult(result));
 		
 		// Set the semaphore create info
 		VkSemaphoreCreateInfo semaphoreInfo {
@@ -289,19 +295,19 @@ namespace gsim {
 		if(!swapChain->GetSwapChain())
 			return;
 
-		// Wait for the previous rendering operation to finish
-		VkResult result = vkWaitForFences(device->GetDevice(), 1, &renderingFence, VK_TRUE, UINT64_MAX);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to wait for Vulkan rendering fence! Error code: %s", string_VkResult(result));
-		
-		// Reset the rendering fence
-		result = vkResetFences(device->GetDevice(), 1, &renderingFence);
+		// Skip the frame if the previous rendering operation hasn't finished yet, so that the simulations never wait for the graphics
+		uint64_t renderedValue;
+		VkResult result = vkGetSemaphoreCounterValue(device->GetDevice(), renderingTimeline, &renderedValue);
 		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to reset Vulkan rendering fence! Error code: %s", string_VkResult(result));
+			GSIM_THROW_EXCEPTION("Failed to get Vulkan rendering timeline semaphore value! Error code: %s", string_VkResult(result));
+		if(renderedValue < renderingValue)
+			return;
 		
-		// Acquire the next swap chain image's index
+		// Acquire the next swap chain image's index, skipping the frame if no image is available yet
 		uint32_t imageIndex;
-		result = vkAcquireNextImageKHR(device->GetDevice(), swapChain->GetSwapChain(), UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		result = vkAcquireNextImageKHR(device->GetDevice(), swapChain->GetSwapChain(), 0, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		if(result == VK_TIMEOUT || result == VK_NOT_READY)
+			return;
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to acquire next Vulkan swap chain image! Error code: %s", string_VkResult(result));
 		
@@ -372,10 +378,12 @@ namespace gsim {
 		// Bind the graphics pipeline
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
+		// Take the latest particle buffer no longer used by the simulations, as the previous frame finished reading the current one
+		particleSystem->NextGraphicsIndex();
+
 		// Bind the particle buffer
 		VkDeviceSize offset = 0;
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(particleSystem->GetBuffers()[particleSystem->GetGrahpicsIndex()].posBuffer), &offset);
-		particleSystem->NextGraphicsIndex();
 
 		// Push the constants to the command buffer
 		PushConstants pushConstants {
@@ -395,23 +403,39 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to end recording Vulkan rendering command buffer! Error code: %s", string_VkResult(result));
 
-		// Set the submit info
-		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		// Set the semaphores to wait for, waiting on the GPU for the simulations writing the particle buffer, if any
+		VkSemaphore waitSemaphores[] { imageAvailableSemaphore, particleSystem->GetComputeTimeline() };
+		VkPipelineStageFlags waitStages[] { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+		uint64_t waitValues[] { 0, particleSystem->GetGraphicsTimelineValue() };
+		uint32_t waitSemaphoreCount = particleSystem->GetGraphicsTimelineValue() ? 2 : 1;
+
+		// Set the semaphores to signal, advancing the rendering timeline
+		VkSemaphore signalSemaphores[] { renderingFinishedSemaphores[imageIndex], renderingTimeline };
+		uint64_t signalValues[] { 0, ++renderingValue };
 
+		// Set the submit info
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo {
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreValueCount = waitSemaphoreCount,
+			.pWaitSemaphoreValues = waitValues,
+			.signalSemaphoreValueCount = 2,
+			.pSignalSemaphoreValues = signalValues
+		};
 		VkSubmitInfo submitInfo {
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = nullptr,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &imageAvailableSemaphore,
-			.pWaitDstStageMask = &waitStage,
+			.pNext = &timelineSubmitInfo,
+			.waitSemaphoreCount = waitSemaphoreCount,
+			.pWaitSemaphores = waitSemaphores,
+			.pWaitDstStageMask = waitStages,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &commandBuffer,
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = renderingFinishedSemaphores + imageIndex
+			.signalSemaphoreCount = 2,
+			.pSignalSemaphores = signalSemaphores
 		};
 
 		// Submit the command buffer to the graphics queue
-		result = vkQueueSubmit(device->GetGraphicsQueue(), 1, &submitInfo, renderingFence);
+		result = vkQueueSubmit(device->GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to submit Vulkan rendering command buffer for execution! Error code: %s", string_VkResult(result));
 		
@@ -436,13 +460,21 @@ namespace gsim {
 	}
 
 	GraphicsPipeline::~GraphicsPipeline() {
-		// Wait for the rendering fence
-		vkWaitForFences(device->GetDevice(), 1, &renderingFence, VK_TRUE, UINT64_MAX);
+		// Wait for the last rendering operation to finish
+		VkSemaphoreWaitInfo waitInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &renderingTimeline,
+			.pValues = &renderingValue
+		};
+		vkWaitSemaphores(device->GetDevice(), &waitInfo, UINT64_MAX);
 
 		// Destroy the pipeline's objects
 		vkFreeCommandBuffers(device->GetDevice(), device->GetGraphicsCommandPool(), 1, &commandBuffer);
 
-		vkDestroyFence(device->GetDevice(), renderingFence, nullptr);
+		vkDestroySemaphore(device->GetDevice(), renderingTimeline, nullptr);
 		vkDestroySemaphore(device->GetDevice(), imageAvailableSemaphore, nullptr);
 		for(uint32_t i = 0; i != swapChain->GetImageCount(); ++i)
 			vkDestroySemaphore(device->GetDevice(), renderingFinishedSemaphores[i], nullptr);
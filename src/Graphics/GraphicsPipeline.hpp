@@ -75,13 +75,13 @@ namespace gsim {
 		VkPipeline GetPipeline() {
 			return pipeline;
 		}
-		/// @brief Gets the Vulkan fence used to synchronise rendering operations.
-		/// @return A handle to the Vulkan rendering fence.
-		VkFence GetRenderingFence() {
-			return renderingFence;
+		/// @brief Gets the Vulkan timeline semaphore signaled by every finished rendering operation.
+		/// @return A handle to the Vulkan rendering timeline semaphore.
+		VkSemaphore GetRenderingTimeline() {
+			return renderingTimeline;
 		}
 
-		/// @brief Renders the system's particles.
+		/// @brief Renders the system's latest simulated particles, skipping the frame if the previous one is still rendering.
 		/// @param cameraPos The camera's position.
 		/// @param cameraSize The camera frustum's size.
 		void RenderParticles(Vec2 cameraPos, Vec2 cameraSize);
@@ -98,7 +98,8 @@ namespace gsim {
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 
-		VkFence renderingFence;
+		VkSemaphore renderingTimeline;
+		uint64_t renderingValue = 0;
 		VkSemaphore imageAvailableSemaphore;
 		VkSemaphore* renderingFinishedSemaphores;
 		VkCommandBuffer commandBuffer;
@@ -4,25 +4,36 @@
 #include "Graphics/GraphicsPipeline.hpp"
 #include "Particles/Particle.hpp"
 #include "Particles/ParticleSystem.hpp"
+#include "Particles/SnapshotWriter.hpp"
 #include "Platform/Window.hpp"
+#include "Platform/ThreadPool.hpp"
 #include "Simulation/BarnesHut/BarnesHutSimulation.hpp"
+#include "Simulation/BarnesHut/CpuBarnesHutSimulation.hpp"
+#include "Simulation/Direct/CpuDirectSimulation.hpp"
 #include "Simulation/Direct/DirectSimulation.hpp"
 #include "Vulkan/VulkanDevice.hpp"
 #include "Vulkan/VulkanInstance.hpp"
+#include "Vulkan/VulkanPipelineCache.hpp"
+#include "Vulkan/VulkanSubmissionRing.hpp"
 #include "Vulkan/VulkanSurface.hpp"
 #include "Vulkan/VulkanSwapChain.hpp"
 
+#include <signal.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <chrono>
 #include <exception>
 
 const char* const ARGS_HELP = 
 	"%s, version %u.%u.%u\n"
 	"Available parameters:\n"
 	"\t--log-file: The file to output all logs to. If unspecified, logs will not be outputted to a file.\n"
-	"\t--particles-in: The input file containing the starting variables of the particles. If not specified, the program will use the given generation parameters.\n"
+	"\t--particles-in: The input file containing the starting variables of the particles, either as a binary snapshot or as text. If not specified, the program will use the given generation parameters.\n"
 	"\t--particles-out: The optional output file in which the variables of the particles will be written once the simulation is finished.\n"
+	"\t--particles-out-format: The format of the particle output file. One of the following options:\n"
+	"\t\ttext: Writes one line per particle, holding its position, velocity and mass. Used by default.\n"
+	"\t\tbinary: Writes a versioned binary snapshot, holding the positions, velocities and masses as separate sections that can be loaded straight into the simulation's buffers.\n"
 	"\t--particle-count: The number of particles to generate. All generation parameters are ignored if an input file is specified.\n"
 	"\t--generate-type: The variant to use for the particle system generation. One of the following options:\n"
 	"\t\trandom: Randomly distribures particles within the generation confines.\n"
@@ -32,6 +43,7 @@ const char* const ARGS_HELP =
 	"\t--generate-size: The radius of the resulting generation's size.\n"
 	"\t--min-mass: The minimum mass of the generated particles.\n"
 	"\t--max-mass: The maximum mass of the generated particles.\n"
+	"\t--seed: The seed of the random engine used for the particle system generation. If not specified, the current time will be used.\n"
 	"\t--gravitational-const: The gravitational constant used for the simulation. Defaulted to 1.\n"
 	"\t--simulation-time: The time interval length, in seconds, simulated in one instance. Defaulted to 1e-3.\n"
 	"\t--simulation-speed: The speed factor at which the simulation is run. Defaulted to 1.\n"
@@ -41,16 +53,49 @@ const char* const ARGS_HELP =
 	"\t\tdirect-sum: The direct-sum method, calculating every interaction between particles.\n"
 	"\t\tbarnes-hut: The Barnes-Hut algorithm, organizing all particles in a quadtree.\n"
 	"\t--simulation-count: The number of simulations to run before closing the program. No limit will be used if this parameter isn't specified.\n"
+	"\t--backend: The backend to run the simulation on. One of the following options:\n"
+	"\t\tvulkan: Runs the simulation on the GPU, using the Vulkan API. Used by default.\n"
+	"\t\tcpu: Runs the simulation on all CPU cores, using the host's vector instructions. Supports both simulation algorithms and requires --no-graphics.\n"
+	"\t--thread-count: The number of threads used by the CPU backend. All hardware threads will be used if this parameter isn't specified.\n"
+	"\t--tree-depth: The depth of the Barnes-Hut quadtree, at most 12. If not specified, the smallest depth with at least one leaf per particle will be used.\n"
+	"\t--tree-build: The method used to build the Barnes-Hut quadtree on the GPU. One of the following options:\n"
+	"\t\tsparse: Builds only the occupied cells, from the particles' radix-sorted Morton keys. Used by default.\n"
+	"\t\tdense: Builds every cell of the full quadtree, one level at a time.\n"
+	"\t--leaf-capacity: The number of particles a leaf of a sparse Barnes-Hut quadtree can hold before it is refined past the tree's depth, up to a depth of 15. Set to 0 to never refine leaves. Defaulted to 16.\n"
+	"\t--force-walk: The tree traversal used by the Barnes-Hut force calculations on the GPU. One of the following options:\n"
+	"\t\tgroup: Walks the tree once per group of neighbouring particles against their bounding box, evaluating the accepted nodes in bulk. Used by default.\n"
+	"\t\tparticle: Walks the tree once per subgroup, opening every node required by any of its particles.\n"
+	"\t--reorder-interval: The number of simulations between two reorderings of the particle buffers in the sparse Barnes-Hut quadtree's order, improving memory locality during force calculations. Set to 0 to never reorder the particles. Defaulted to 0.\n"
+	"\t--tree-rebuild-interval: The number of simulations between two rebuilds of the sparse Barnes-Hut quadtree. In between, the tree's nodes are only refit to the particles' new positions, and a rebuild is forced once particles leave their cells. Defaulted to 1.\n"
+	"\t--leaf-accumulation: The accumulation of the particles into the leaves of the dense Barnes-Hut quadtree. One of the following options:\n"
+	"\t\tauto: Uses atomic accumulation, switching to sorted accumulation if the device lacks float atomics or the leaves get crowded. Used by default.\n"
+	"\t\tatomic: Adds every particle to its leaf with global atomics. Requires float atomics.\n"
+	"\t\tsorted: Sorts the particles by their leaves and sums every leaf's particles with a segmented reduction, without any atomics.\n"
+	"\t--in-flight-count: The number of simulation batches queued on the GPU at the same time, keeping it fed while the next batch is submitted, at most 8. Defaulted to 3.\n"
+	"\t--snapshot-every: The number of simulations between two binary particle snapshots, written in the background while the simulations keep running. Requires --snapshot-dir and --no-graphics to be specified.\n"
+	"\t--snapshot-dir: The existing directory the particle snapshots are written to, as snapshot_<simulation index>.gsim files.\n"
+	"\t--snapshot-codec: The codec used to encode binary particle snapshots, including --particles-out files. One of the following options:\n"
+	"\t\traw: Stores every particle uncompressed. Used by default.\n"
+	"\t\txor: Compresses every particle losslessly, storing only the bits that differ from the previous particle.\n"
+	"\t\tquantized: Rounds the positions relative to their bounding box to the given precision, compressing the velocities and masses losslessly.\n"
+	"\t--snapshot-precision: The maximum error of every position stored by the quantized snapshot codec.\n"
+	"\t--snapshot-queue-depth: The number of snapshots waiting to be written at the same time, at most 8. The simulations stall once the disk falls this far behind. Defaulted to 2.\n"
+	"\t--checkpoint: The file to atomically write checkpoints of the whole run state to, every --checkpoint-every simulations and once the program is terminated. Requires --no-graphics to be specified.\n"
+	"\t--checkpoint-every: The number of simulations between two checkpoints. If unspecified, checkpoints are only written once the program is terminated.\n"
+	"\t--resume: The checkpoint to resume the run from, restoring its particles, simulation count and all simulation parameters. Checkpoints are written back to it unless --checkpoint is specified. Requires --no-graphics to be specified.\n"
+	"\t--pipeline-cache-dir: The existing directory the compiled GPU pipelines are cached in, as one file per device and driver version, so later runs skip compiling them. If not specified, the pipelines are compiled on every run.\n"
 	"Available options:\n"
 	"\t--help: Displays the current message and exits the program.\n"
 	"\t--log-detailed: Outputs non-crucial logs that might be useful for debugging or additional information.\n"
 	"\t--no-graphics: Doesn't display the live positions of all particles, instead running the simulations in the background.\n"
-	"\t--benchmark: Benchmarks the required runtime for all simulations. Ignored if --no-graphics isn't specified.\n";
+	"\t--benchmark: Benchmarks the required runtime for all simulations. Ignored if --no-graphics isn't specified.\n"
+	"\t--quadrupole-moments: Applies the quadrupole moments of the sparse Barnes-Hut quadtree's nodes, allowing a larger accuracy parameter for the same force error.\n";
 
 struct ProgramInfo {
 	const char* logFile = nullptr;
 	const char* particlesInFile = nullptr;
 	const char* particlesOutFile = nullptr;
+	gsim::ParticleSystem::FileFormat particlesOutFormat = gsim::ParticleSystem::FILE_FORMAT_TEXT;
 	uint32_t particleCount = 0;
 	gsim::ParticleSystem::GenerateType generateType = gsim::ParticleSystem::GENERATE_TYPE_COUNT;
 	float generateSize = 0.0f;
@@ -63,10 +108,31 @@ struct ProgramInfo {
 	float accuracyParameter = 1.0f;
 	gsim::ParticleSystem::SimulationAlgorithm simulationAlgorithm = gsim::ParticleSystem::SIMULATION_ALGORITHM_COUNT;
 	uint64_t maxSimulationCount = UINT64_MAX;
+	gsim::ParticleSystem::SimulationBackend simulationBackend = gsim::ParticleSystem::SIMULATION_BACKEND_VULKAN;
+	uint32_t threadCount = 0;
+	uint32_t treeDepth = 0;
+	gsim::BarnesHutSimulation::TreeBuild treeBuild = gsim::BarnesHutSimulation::TREE_BUILD_SPARSE;
+	uint32_t leafCapacity = gsim::BarnesHutSimulation::DEFAULT_LEAF_CAPACITY;
+	uint32_t reorderInterval = 0;
+	gsim::BarnesHutSimulation::ForceWalk forceWalk = gsim::BarnesHutSimulation::FORCE_WALK_GROUP;
+	uint32_t treeRebuildInterval = 1;
+	gsim::BarnesHutSimulation::LeafAccumulation leafAccumulation = gsim::BarnesHutSimulation::LEAF_ACCUMULATION_AUTO;
+	uint32_t inFlightCount = gsim::VulkanSubmissionRing::DEFAULT_SUBMISSION_COUNT;
+	uint64_t snapshotInterval = 0;
+	const char* snapshotDir = nullptr;
+	uint32_t snapshotQueueDepth = gsim::SnapshotWriter::DEFAULT_QUEUE_DEPTH;
+	gsim::SnapshotCodec::Codec snapshotCodec = gsim::SnapshotCodec::CODEC_RAW;
+	float snapshotPrecision = 0.0f;
+	uint64_t seed = UINT64_MAX;
+	const char* checkpointFile = nullptr;
+	uint64_t checkpointInterval = 0;
+	const char* resumeFile = nullptr;
+	const char* pipelineCacheDir = nullptr;
 
 	bool logDetailed = false;
 	bool noGraphics = false;
 	bool benchmark = false;
+	bool quadrupoleMoments = false;
 
 	gsim::Logger* logger;
 	gsim::Window* window;
@@ -76,9 +142,13 @@ struct ProgramInfo {
 	gsim::VulkanSwapChain* swapChain;
 	gsim::ParticleSystem* particleSystem;
 	gsim::GraphicsPipeline* graphicsPipeline;
+	gsim::ThreadPool* threadPool = nullptr;
+	gsim::SnapshotWriter* snapshotWriter = nullptr;
 
 	gsim::DirectSimulation* directSim = nullptr;
 	gsim::BarnesHutSimulation* barnesHutSim = nullptr;
+	gsim::CpuDirectSimulation* cpuDirectSim = nullptr;
+	gsim::CpuBarnesHutSimulation* cpuBarnesHutSim = nullptr;
 
 	gsim::Vec2 cameraPos;
 	float cameraSize;
@@ -90,6 +160,84 @@ struct ProgramInfo {
 	uint64_t targetSimulationCount = 0;
 };
 
+static volatile sig_atomic_t terminationRequested = 0;
+
+static void TerminationHandler(int signalNumber) {
+	// Let the simulation loop write a checkpoint and exit
+	terminationRequested = 1;
+}
+static void WriteCheckpoint(ProgramInfo* programInfo) {
+	// Wait for the simulations in flight, as the checkpoint reads the particle buffers
+	if(programInfo->directSim) {
+		programInfo->directSim->WaitForSimulations();
+	} else if(programInfo->barnesHutSim) {
+		programInfo->barnesHutSim->WaitForSimulations();
+	}
+
+	// Wait for the queued snapshots to be written, as their copies may still read the particle buffers
+	if(programInfo->snapshotWriter)
+		programInfo->snapshotWriter->Flush();
+
+	// Set the checkpoint's run state; the Barnes-Hut simulation steps by the simulation time scaled by the simulation speed
+	double stepTime = programInfo->simulationTime;
+	if(programInfo->simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_BARNES_HUT)
+		stepTime *= programInfo->simulationSpeed;
+
+	gsim::ParticleSystem::CheckpointInfo checkpointInfo {
+		.simulationCount = programInfo->simulationCount,
+		.maxSimulationCount = programInfo->maxSimulationCount,
+		.checkpointInterval = programInfo->checkpointInterval,
+		.simulatedTime = programInfo->simulationCount * stepTime,
+		.gravitationalConst = programInfo->gravitationalConst,
+		.simulationTime = programInfo->simulationTime,
+		.simulationSpeed = programInfo->simulationSpeed,
+		.softeningLen = programInfo->softeningLen,
+		.accuracyParameter = programInfo->accuracyParameter,
+		.simulationAlgorithm = (uint32_t)programInfo->simulationAlgorithm,
+		.simulationBackend = (uint32_t)programInfo->simulationBackend,
+		.seed = (programInfo->seed == UINT64_MAX) ? 0 : (uint32_t)programInfo->seed,
+		.treeDepth = programInfo->treeDepth,
+		.treeBuild = (uint32_t)programInfo->treeBuild,
+		.leafCapacity = programInfo->leafCapacity,
+		.reorderInterval = programInfo->reorderInterval,
+		.forceWalk = (uint32_t)programInfo->forceWalk,
+		.quadrupoleMoments = programInfo->quadrupoleMoments,
+		.treeRebuildInterval = programInfo->treeRebuildInterval,
+		.leafAccumulation = (uint32_t)programInfo->leafAccumulation,
+		.leavesSorted = programInfo->barnesHutSim && programInfo->barnesHutSim->GetLeavesSorted(),
+		.inFlightCount = programInfo->inFlightCount
+	};
+
+	// Write the checkpoint
+	programInfo->particleSystem->SaveCheckpoint(programInfo->checkpointFile, checkpointInfo);
+	programInfo->logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Wrote checkpoint after %llu simulations (%g simulated seconds) to %s.", (unsigned long long)checkpointInfo.simulationCount, checkpointInfo.simulatedTime, programInfo->checkpointFile);
+
+	// Rebuild the Barnes-Hut tree at the next simulation, just like a run resumed from the checkpoint will
+	if(programInfo->barnesHutSim)
+		programInfo->barnesHutSim->RequireRebuild();
+}
+
+static void SavePipelineCache(ProgramInfo* programInfo) {
+	// Exit the function if the pipeline cache isn't stored on disk
+	gsim::VulkanPipelineCache* pipelineCache = programInfo->device->GetPipelineCache();
+	if(!pipelineCache->GetFilePath())
+		return;
+	
+	// Log the loaded cache's size
+	if(pipelineCache->GetLoadedSize()) {
+		programInfo->logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Loaded %llu bytes of cached pipelines from %s.", (unsigned long long)pipelineCache->GetLoadedSize(), pipelineCache->GetFilePath());
+	} else {
+		programInfo->logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "No matching pipeline cache was found at %s.", pipelineCache->GetFilePath());
+	}
+
+	// Write the cache once all pipelines were created, only warning on failure, as the run itself is unaffected
+	try {
+		if(pipelineCache->Save())
+			programInfo->logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Saved the newly compiled pipelines to %s.", pipelineCache->GetFilePath());
+	} catch(const gsim::Exception& exception) {
+		programInfo->logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_WARNING, "Failed to save the pipeline cache: %s", exception.GetMessage());
+	}
+}
 static void WindowDrawCallback(void* userData, void* args) {
 	// Get the program info
 	ProgramInfo* programInfo = (ProgramInfo*)userData;
@@ -171,6 +319,14 @@ int main(int argc, char** args) {
 			programInfo.particlesInFile = args[i] + 15;
 		} else if(!strncmp(args[i], "--particles-out=", 16)) {
 			programInfo.particlesOutFile = args[i] + 16;
+		} else if(!strncmp(args[i], "--particles-out-format=", 23)) {
+			if(!strcmp(args[i] + 23, "text")) {
+				programInfo.particlesOutFormat = gsim::ParticleSystem::FILE_FORMAT_TEXT;
+			} else if(!strcmp(args[i] + 23, "binary")) {
+				programInfo.particlesOutFormat = gsim::ParticleSystem::FILE_FORMAT_BINARY;
+			} else {
+				programInfo.particlesOutFormat = gsim::ParticleSystem::FILE_FORMAT_COUNT;
+			}
 		} else if(!strncmp(args[i], "--particle-count=", 17)) {
 			programInfo.particleCount = (uint32_t)strtoull(args[i] + 17, nullptr, 10);
 		} else if(!strncmp(args[i], "--generate-type=", 16)) {
@@ -189,6 +345,8 @@ int main(int argc, char** args) {
 			programInfo.minMass = strtof(args[i] + 11, nullptr);
 		} else if(!strncmp(args[i], "--max-mass=", 11)) {
 			programInfo.maxMass = strtof(args[i] + 11, nullptr);
+		} else if(!strncmp(args[i], "--seed=", 7)) {
+			programInfo.seed = (uint32_t)strtoul(args[i] + 7, nullptr, 10);
 		} else if(!strncmp(args[i], "--gravitational-const=", 22)) {
 			programInfo.gravitationalConst = strtof(args[i] + 22, nullptr);
 		} else if(!strncmp(args[i], "--simulation-time=", 18)) {
@@ -207,12 +365,86 @@ int main(int argc, char** args) {
 			}
 		} else if(!strncmp(args[i], "--simulation-count=", 19)) {
 			programInfo.maxSimulationCount = (uint64_t)strtoull(args[i] + 19, nullptr, 10);
+		} else if(!strncmp(args[i], "--backend=", 10)) {
+			if(!strcmp(args[i] + 10, "vulkan")) {
+				programInfo.simulationBackend = gsim::ParticleSystem::SIMULATION_BACKEND_VULKAN;
+			} else if(!strcmp(args[i] + 10, "cpu")) {
+				programInfo.simulationBackend = gsim::ParticleSystem::SIMULATION_BACKEND_CPU;
+			} else {
+				programInfo.simulationBackend = gsim::ParticleSystem::SIMULATION_BACKEND_COUNT;
+			}
+		} else if(!strncmp(args[i], "--thread-count=", 15)) {
+			programInfo.threadCount = (uint32_t)strtoul(args[i] + 15, nullptr, 10);
+		} else if(!strncmp(args[i], "--tree-depth=", 13)) {
+			programInfo.treeDepth = (uint32_t)strtoul(args[i] + 13, nullptr, 10);
+		} else if(!strncmp(args[i], "--tree-build=", 13)) {
+			if(!strcmp(args[i] + 13, "sparse")) {
+				programInfo.treeBuild = gsim::BarnesHutSimulation::TREE_BUILD_SPARSE;
+			} else if(!strcmp(args[i] + 13, "dense")) {
+				programInfo.treeBuild = gsim::BarnesHutSimulation::TREE_BUILD_DENSE;
+			} else {
+				programInfo.treeBuild = gsim::BarnesHutSimulation::TREE_BUILD_COUNT;
+			}
+		} else if(!strncmp(args[i], "--leaf-capacity=", 16)) {
+			programInfo.leafCapacity = (uint32_t)strtoul(args[i] + 16, nullptr, 10);
+		} else if(!strncmp(args[i], "--force-walk=", 13)) {
+			if(!strcmp(args[i] + 13, "group")) {
+				programInfo.forceWalk = gsim::BarnesHutSimulation::FORCE_WALK_GROUP;
+			} else if(!strcmp(args[i] + 13, "particle")) {
+				programInfo.forceWalk = gsim::BarnesHutSimulation::FORCE_WALK_PARTICLE;
+			} else {
+				programInfo.forceWalk = gsim::BarnesHutSimulation::FORCE_WALK_COUNT;
+			}
+		} else if(!strncmp(args[i], "--reorder-interval=", 19)) {
+			programInfo.reorderInterval = (uint32_t)strtoul(args[i] + 19, nullptr, 10);
+		} else if(!strncmp(args[i], "--tree-rebuild-interval=", 24)) {
+			programInfo.treeRebuildInterval = (uint32_t)strtoul(args[i] + 24, nullptr, 10);
+		} else if(!strncmp(args[i], "--leaf-accumulation=", 20)) {
+			if(!strcmp(args[i] + 20, "auto")) {
+				programInfo.leafAccumulation = gsim::BarnesHutSimulation::LEAF_ACCUMULATION_AUTO;
+			} else if(!strcmp(args[i] + 20, "atomic")) {
+				programInfo.leafAccumulation = gsim::BarnesHutSimulation::LEAF_ACCUMULATION_ATOMIC;
+			} else if(!strcmp(args[i] + 20, "sorted")) {
+				programInfo.leafAccumulation = gsim::BarnesHutSimulation::LEAF_ACCUMULATION_SORTED;
+			} else {
+				programInfo.leafAccumulation = gsim::BarnesHutSimulation::LEAF_ACCUMULATION_COUNT;
+			}
+		} else if(!strncmp(args[i], "--in-flight-count=", 18)) {
+			programInfo.inFlightCount = (uint32_t)strtoul(args[i] + 18, nullptr, 10);
+		} else if(!strncmp(args[i], "--snapshot-every=", 17)) {
+			programInfo.snapshotInterval = strtoull(args[i] + 17, nullptr, 10);
+		} else if(!strncmp(args[i], "--snapshot-dir=", 15)) {
+			programInfo.snapshotDir = args[i] + 15;
+		} else if(!strncmp(args[i], "--snapshot-codec=", 17)) {
+			if(!strcmp(args[i] + 17, "raw")) {
+				programInfo.snapshotCodec = gsim::SnapshotCodec::CODEC_RAW;
+			} else if(!strcmp(args[i] + 17, "xor")) {
+				programInfo.snapshotCodec = gsim::SnapshotCodec::CODEC_XOR;
+			} else if(!strcmp(args[i] + 17, "quantized")) {
+				programInfo.snapshotCodec = gsim::SnapshotCodec::CODEC_QUANTIZED;
+			} else {
+				programInfo.snapshotCodec = gsim::SnapshotCodec::CODEC_COUNT;
+			}
+		} else if(!strncmp(args[i], "--snapshot-precision=", 21)) {
+			programInfo.snapshotPrecision = strtof(args[i] + 21, nullptr);
+		} else if(!strncmp(args[i], "--snapshot-queue-depth=", 23)) {
+			programInfo.snapshotQueueDepth = (uint32_t)strtoul(args[i] + 23, nullptr, 10);
+		} else if(!strncmp(args[i], "--checkpoint=", 13)) {
+			programInfo.checkpointFile = args[i] + 13;
+		} else if(!strncmp(args[i], "--checkpoint-every=", 19)) {
+			programInfo.checkpointInterval = strtoull(args[i] + 19, nullptr, 10);
+		} else if(!strncmp(args[i], "--resume=", 9)) {
+			programInfo.resumeFile = args[i] + 9;
+		} else if(!strncmp(args[i], "--pipeline-cache-dir=", 21)) {
+			programInfo.pipelineCacheDir = args[i] + 21;
 		} else if(!strcmp(args[i], "--log-detailed")) {
 			programInfo.logDetailed = true;
 		} else if(!strcmp(args[i], "--no-graphics")) {
 			programInfo.noGraphics = true;
 		} else if(!strcmp(args[i], "--benchmark")) {
 			programInfo.benchmark = true;
+		} else if(!strcmp(args[i], "--quadrupole-moments")) {
+			programInfo.quadrupoleMoments = true;
 		}
 	}
 
@@ -220,6 +452,57 @@ int main(int argc, char** args) {
 	gsim::Logger::MessageLevelFlags messageLevelFlags = programInfo.logDetailed ? gsim::Logger::MESSAGE_LEVEL_ALL : gsim::Logger::MESSAGE_LEVEL_ESSENTIAL;
 	programInfo.logger = new gsim::Logger(programInfo.logFile, messageLevelFlags);
 
+	// Restore the run state of the given checkpoint, if the run is resumed
+	gsim::ParticleSystem::CheckpointInfo checkpointInfo;
+	if(programInfo.resumeFile) {
+		// Read the checkpoint's run state
+		if(!gsim::ParticleSystem::LoadCheckpointInfo(programInfo.resumeFile, checkpointInfo)) {
+			programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The file given to --resume must be a valid checkpoint!");
+		}
+		if(checkpointInfo.simulationAlgorithm >= gsim::ParticleSystem::SIMULATION_ALGORITHM_COUNT || checkpointInfo.simulationBackend >= gsim::ParticleSystem::SIMULATION_BACKEND_COUNT || checkpointInfo.treeBuild >= gsim::BarnesHutSimulation::TREE_BUILD_COUNT || checkpointInfo.forceWalk >= gsim::BarnesHutSimulation::FORCE_WALK_COUNT || checkpointInfo.leafAccumulation >= gsim::BarnesHutSimulation::LEAF_ACCUMULATION_COUNT) {
+			programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The checkpoint given to --resume holds invalid simulation parameters!");
+		}
+		if(checkpointInfo.graphicsIndex > 2 || checkpointInfo.computeInputIndex > 2 || checkpointInfo.computeOutputIndex > 2 || checkpointInfo.graphicsIndex + checkpointInfo.computeInputIndex + checkpointInfo.computeOutputIndex != 3 || checkpointInfo.computeInputIndex == checkpointInfo.computeOutputIndex) {
+			programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The checkpoint given to --resume holds invalid particle buffer indices!");
+		}
+		if(programInfo.particlesInFile) {
+			programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A particle input file can't be given when resuming from a checkpoint!");
+		}
+
+		// Load the particles straight from the checkpoint, which is an uncompressed binary snapshot
+		programInfo.particlesInFile = programInfo.resumeFile;
+
+		// Override all simulation parameters, as any change would make the resumed run diverge from the original one
+		programInfo.gravitationalConst = checkpointInfo.gravitationalConst;
+		programInfo.simulationTime = checkpointInfo.simulationTime;
+		programInfo.simulationSpeed = checkpointInfo.simulationSpeed;
+		programInfo.softeningLen = checkpointInfo.softeningLen;
+		programInfo.accuracyParameter = checkpointInfo.accuracyParameter;
+		programInfo.simulationAlgorithm = (gsim::ParticleSystem::SimulationAlgorithm)checkpointInfo.simulationAlgorithm;
+		programInfo.simulationBackend = (gsim::ParticleSystem::SimulationBackend)checkpointInfo.simulationBackend;
+		programInfo.seed = checkpointInfo.seed;
+		programInfo.treeDepth = checkpointInfo.treeDepth;
+		programInfo.treeBuild = (gsim::BarnesHutSimulation::TreeBuild)checkpointInfo.treeBuild;
+		programInfo.leafCapacity = checkpointInfo.leafCapacity;
+		programInfo.reorderInterval = checkpointInfo.reorderInterval;
+		programInfo.forceWalk = (gsim::BarnesHutSimulation::ForceWalk)checkpointInfo.forceWalk;
+		programInfo.quadrupoleMoments = checkpointInfo.quadrupoleMoments;
+		programInfo.treeRebuildInterval = checkpointInfo.treeRebuildInterval;
+		programInfo.leafAccumulation = (gsim::BarnesHutSimulation::LeafAccumulation)checkpointInfo.leafAccumulation;
+		programInfo.inFlightCount = checkpointInfo.inFlightCount;
+
+		// Continue the run where the checkpoint left off, keeping its limit and checkpoints unless others were given
+		programInfo.simulationCount = checkpointInfo.simulationCount;
+		if(programInfo.maxSimulationCount == UINT64_MAX)
+			programInfo.maxSimulationCount = checkpointInfo.maxSimulationCount;
+		if(!programInfo.checkpointFile)
+			programInfo.checkpointFile = programInfo.resumeFile;
+		if(!programInfo.checkpointInterval)
+			programInfo.checkpointInterval = checkpointInfo.checkpointInterval;
+		
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Resuming from checkpoint %s after %llu simulations (%g simulated seconds); all simulation parameters were restored from it.", programInfo.resumeFile, (unsigned long long)checkpointInfo.simulationCount, checkpointInfo.simulatedTime);
+	}
+
 	// Check if the given args are valid
 	if(!programInfo.particlesInFile && !(programInfo.particleCount && programInfo.generateType != gsim::ParticleSystem::GENERATE_TYPE_COUNT && programInfo.generateSize && programInfo.minMass && programInfo.maxMass)) {
 		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "If a particle input file is not provided, valid generation args must be provided!");
@@ -227,70 +510,222 @@ int main(int argc, char** args) {
 	if(programInfo.particlesInFile && (programInfo.particleCount || programInfo.generateType != gsim::ParticleSystem::GENERATE_TYPE_COUNT || programInfo.generateSize || programInfo.minMass || programInfo.maxMass)) {
 		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_WARNING, "A particle input file was provided, therefore the given generation args will be ignored.");
 	}
+	if(programInfo.particlesOutFormat == gsim::ParticleSystem::FILE_FORMAT_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid particle output file format must be given!");
+	}
 	if(programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_COUNT) {
 		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid simulation algorithm must be given!");
 	}
 	if(programInfo.noGraphics && programInfo.simulationCount == UINT64_MAX) {
 		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "If --no-graphics was specified, a valid simulation count must be given!");
 	}
+	if(programInfo.simulationBackend == gsim::ParticleSystem::SIMULATION_BACKEND_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid simulation backend must be given!");
+	}
+	if(programInfo.simulationBackend == gsim::ParticleSystem::SIMULATION_BACKEND_CPU && !programInfo.noGraphics) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The CPU backend requires --no-graphics to be specified!");
+	}
+	if(programInfo.treeDepth > gsim::BarnesHutSimulation::MAX_TREE_DEPTH) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The Barnes-Hut tree depth must be at most %u!", gsim::BarnesHutSimulation::MAX_TREE_DEPTH);
+	}
+	if(programInfo.treeBuild == gsim::BarnesHutSimulation::TREE_BUILD_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid Barnes-Hut tree construction method must be given!");
+	}
+	if(programInfo.forceWalk == gsim::BarnesHutSimulation::FORCE_WALK_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid Barnes-Hut force traversal must be given!");
+	}
+	if(!programInfo.treeRebuildInterval) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The Barnes-Hut tree rebuild interval must be at least 1!");
+	}
+	if(programInfo.leafAccumulation == gsim::BarnesHutSimulation::LEAF_ACCUMULATION_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid Barnes-Hut leaf accumulation method must be given!");
+	}
+	if(!programInfo.inFlightCount || programInfo.inFlightCount > gsim::VulkanSubmissionRing::MAX_SUBMISSION_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The in-flight batch count must be between 1 and %u!", gsim::VulkanSubmissionRing::MAX_SUBMISSION_COUNT);
+	}
+	if(programInfo.snapshotInterval && !programInfo.snapshotDir) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "If --snapshot-every was specified, a snapshot directory must be given!");
+	}
+	if(programInfo.snapshotInterval && !programInfo.noGraphics) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "Particle snapshots require --no-graphics to be specified!");
+	}
+	if(programInfo.snapshotCodec == gsim::SnapshotCodec::CODEC_COUNT) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "A valid snapshot codec must be given!");
+	}
+	if(programInfo.snapshotCodec == gsim::SnapshotCodec::CODEC_QUANTIZED && !(programInfo.snapshotPrecision > 0.0f)) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "If the quantized snapshot codec was specified, a positive snapshot precision must be given!");
+	}
+	if(!programInfo.snapshotQueueDepth || programInfo.snapshotQueueDepth > gsim::SnapshotWriter::MAX_QUEUE_DEPTH) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The snapshot queue depth must be between 1 and %u!", gsim::SnapshotWriter::MAX_QUEUE_DEPTH);
+	}
+	if(programInfo.checkpointInterval && !programInfo.checkpointFile) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "If --checkpoint-every was specified, a checkpoint file must be given!");
+	}
+	if((programInfo.checkpointFile || programInfo.resumeFile) && !programInfo.noGraphics) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "Checkpoints require --no-graphics to be specified!");
+	}
+	if(programInfo.simulationCount > programInfo.maxSimulationCount) {
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_FATAL_ERROR, "The checkpoint given to --resume is already past the simulation count!");
+	}
 	if(!programInfo.noGraphics && programInfo.benchmark) {
 		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_WARNING, "The --benchmark option will be ignored, as --no-graphics wasn't specified.");
 	}
 
+	// Seed the generation with the current time if no seed was given, logging it so that the run can be reproduced
+	if(!programInfo.particlesInFile && programInfo.seed == UINT64_MAX)
+		programInfo.seed = (uint32_t)time(nullptr);
+	if(!programInfo.particlesInFile)
+		programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Generating the particles with seed %u.", (uint32_t)programInfo.seed);
+
 	// Catch any exceptions thrown by the rest of the program
 	try {
 		if(programInfo.noGraphics) {
-			// Create the Vulkan components
-			programInfo.instance = new gsim::VulkanInstance(true, programInfo.logger);
-			programInfo.device = new gsim::VulkanDevice(programInfo.instance, nullptr);
+			if(programInfo.simulationBackend == gsim::ParticleSystem::SIMULATION_BACKEND_CPU) {
+				// Create the thread pool
+				programInfo.threadPool = new gsim::ThreadPool(programInfo.threadCount);
+				programInfo.device = nullptr;
 
-			// Log info about the Vulkan device
-			programInfo.device->LogDeviceInfo(programInfo.logger);
+				// Log info about the thread pool
+				programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Running the CPU backend on %u threads.", programInfo.threadPool->GetThreadCount());
+			} else {
+				// Create the Vulkan components
+				programInfo.instance = new gsim::VulkanInstance(true, programInfo.logger);
+				programInfo.device = new gsim::VulkanDevice(programInfo.instance, nullptr, programInfo.pipelineCacheDir);
+
+				// Log info about the Vulkan device
+				programInfo.device->LogDeviceInfo(programInfo.logger);
+			}
+
+			// Keep only the two particle buffer sets rotated by the simulations, as no graphics read a third one, sharing the masses and IDs unless the simulation reorders the particles
+			uint32_t bufferSetCount = 2;
+			bool massShared = programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM || !gsim::BarnesHutSimulation::GetParticlesReordered(programInfo.treeBuild, programInfo.reorderInterval);
 
 			// Create the particle system
 			if(programInfo.particlesInFile) {
-				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particlesInFile, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm);
+				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particlesInFile, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm, programInfo.simulationBackend, bufferSetCount, massShared);
 			} else {
-				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particleCount, programInfo.generateType, programInfo.generateSize, programInfo.minMass, programInfo.maxMass, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm);
+				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particleCount, programInfo.generateType, programInfo.generateSize, programInfo.minMass, programInfo.maxMass, (uint32_t)programInfo.seed, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm, programInfo.simulationBackend, bufferSetCount, massShared);
 			}
 
+			// Log the particle upload path
+			if(programInfo.device && programInfo.particleSystem->GetBufferMemoryMapped())
+				programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "The particle buffers are bound to host-mapped device-local memory, so no staging buffer was used.");
+
+			// Restore the checkpoint's buffer rotation before the simulation records any commands
+			if(programInfo.resumeFile)
+				programInfo.particleSystem->SetBufferIndices(checkpointInfo.graphicsIndex, checkpointInfo.computeInputIndex, checkpointInfo.computeOutputIndex);
+
 			// Create the simulation
-			if(programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM) {
-				programInfo.directSim = new gsim::DirectSimulation(programInfo.device, programInfo.particleSystem);
+			if(programInfo.simulationBackend == gsim::ParticleSystem::SIMULATION_BACKEND_CPU) {
+				if(programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM) {
+					programInfo.cpuDirectSim = new gsim::CpuDirectSimulation(programInfo.threadPool, programInfo.particleSystem);
+				} else {
+					programInfo.cpuBarnesHutSim = new gsim::CpuBarnesHutSimulation(programInfo.threadPool, programInfo.particleSystem, programInfo.treeDepth);
+				}
+			} else if(programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM) {
+				programInfo.directSim = new gsim::DirectSimulation(programInfo.device, programInfo.particleSystem, programInfo.inFlightCount);
 			} else {
-				programInfo.barnesHutSim = new gsim::BarnesHutSimulation(programInfo.device, programInfo.particleSystem);
+				programInfo.barnesHutSim = new gsim::BarnesHutSimulation(programInfo.device, programInfo.particleSystem, programInfo.treeDepth, programInfo.treeBuild, programInfo.leafCapacity, programInfo.reorderInterval, programInfo.forceWalk, programInfo.quadrupoleMoments, programInfo.treeRebuildInterval, programInfo.leafAccumulation, programInfo.inFlightCount);
+
+				// Restore the Barnes-Hut simulation's state, if the run is resumed
+				if(programInfo.resumeFile)
+					programInfo.barnesHutSim->RestoreState(checkpointInfo.simulationCount, checkpointInfo.leavesSorted);
 			}
 
-			// Store the clock start, for benchmarking
-			programInfo.clockStart = clock();
-			programInfo.simulationCount = 0;
-			programInfo.targetSimulationCount = 0;
+			// Save the pipeline cache, now that all pipelines were created
+			if(programInfo.device)
+				SavePipelineCache(&programInfo);
+
+			// Create the snapshot writer, if snapshots were requested
+			if(programInfo.snapshotInterval)
+				programInfo.snapshotWriter = new gsim::SnapshotWriter(programInfo.particleSystem, programInfo.snapshotDir, programInfo.snapshotInterval, programInfo.snapshotQueueDepth, programInfo.snapshotCodec, programInfo.snapshotPrecision);
+
+			// Log the device memory used by every subsystem before the run starts
+			if(programInfo.device)
+				programInfo.device->GetMemoryAllocator()->LogMemoryUsage(programInfo.logger);
+
+			// Store the start time, for benchmarking; a wall clock is used, as clock() adds up the time of all CPU threads on some platforms
+			std::chrono::steady_clock::time_point benchmarkStart = std::chrono::steady_clock::now();
+			uint64_t startSimulationCount = programInfo.simulationCount;
+			programInfo.targetSimulationCount = programInfo.simulationCount;
+
+			// Write a checkpoint once the program is asked to terminate or interrupted, if checkpoints were requested
+			if(programInfo.checkpointFile) {
+				signal(SIGTERM, TerminationHandler);
+				signal(SIGINT, TerminationHandler);
+			}
 
 			// Run all the simulations
+			bool terminated = false;
 			while(programInfo.simulationCount != programInfo.maxSimulationCount) {
 				// Run the simulations
-				if(programInfo.directSim) {
+				if(programInfo.cpuDirectSim) {
+					programInfo.cpuDirectSim->RunSimulations((uint32_t)(programInfo.targetSimulationCount - programInfo.simulationCount));
+				} else if(programInfo.cpuBarnesHutSim) {
+					programInfo.cpuBarnesHutSim->RunSimulations((uint32_t)(programInfo.targetSimulationCount - programInfo.simulationCount));
+
+					// Log the leaf occupancy over the simulations, if any was gathered
+					const gsim::BarnesHutSimulation::TreeStats& treeStats = programInfo.cpuBarnesHutSim->GetTreeStats();
+					if(treeStats.leafCount)
+						programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Barnes-Hut leaf occupancy over %u steps: %u max, %.2f mean.", programInfo.cpuBarnesHutSim->GetTreeStatsStepCount(), treeStats.maxOccupancy, (double)treeStats.particleCount / treeStats.leafCount);
+				} else if(programInfo.directSim) {
 					programInfo.directSim->RunSimulations((uint32_t)(programInfo.targetSimulationCount - programInfo.simulationCount));
 				} else {
 					programInfo.barnesHutSim->RunSimulations((uint32_t)(programInfo.targetSimulationCount - programInfo.simulationCount));
+
+					// Log the leaf occupancy over every step of the last finished batch, if any was gathered
+					const gsim::BarnesHutSimulation::TreeStats& treeStats = programInfo.barnesHutSim->GetTreeStats();
+					if(treeStats.leafCount)
+						programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Barnes-Hut leaf occupancy over %u steps: %u max, %.2f mean.", programInfo.barnesHutSim->GetTreeStatsStepCount(), treeStats.maxOccupancy, (double)treeStats.particleCount / treeStats.leafCount);
+					if(treeStats.escapedCount)
+						programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Barnes-Hut tree rebuild forced, as particles left their cells %u times over %u steps.", treeStats.escapedCount, programInfo.barnesHutSim->GetTreeStatsStepCount());
 				}
 				programInfo.simulationCount = programInfo.targetSimulationCount;
 
-				// Set the target simulation count
-				programInfo.targetSimulationCount = programInfo.simulationCount + 100;
+				// Capture a snapshot, if one is due and wasn't already captured before the run was resumed
+				bool resumedStart = programInfo.resumeFile && programInfo.simulationCount == startSimulationCount;
+				if(programInfo.snapshotWriter && !resumedStart && programInfo.snapshotWriter->IsCaptureDue(programInfo.simulationCount))
+					programInfo.snapshotWriter->Capture(programInfo.simulationCount);
+
+				// Write a checkpoint, if one is due or the program is asked to terminate
+				terminated = terminationRequested;
+				if(programInfo.checkpointFile && (terminated || (programInfo.checkpointInterval && programInfo.simulationCount != startSimulationCount && programInfo.simulationCount % programInfo.checkpointInterval == 0)))
+					WriteCheckpoint(&programInfo);
+				if(terminated)
+					break;
+
+				// Set the target simulation count at the next multiple of 100, so that a resumed run submits the same batches, stopping at the next snapshot and checkpoint
+				programInfo.targetSimulationCount = (programInfo.simulationCount / 100 + 1) * 100;
+				if(programInfo.snapshotWriter && programInfo.targetSimulationCount > programInfo.snapshotWriter->GetNextCaptureTarget(programInfo.simulationCount))
+					programInfo.targetSimulationCount = programInfo.snapshotWriter->GetNextCaptureTarget(programInfo.simulationCount);
+				if(programInfo.checkpointInterval && programInfo.targetSimulationCount > (programInfo.simulationCount / programInfo.checkpointInterval + 1) * programInfo.checkpointInterval)
+					programInfo.targetSimulationCount = (programInfo.simulationCount / programInfo.checkpointInterval + 1) * programInfo.checkpointInterval;
 				if(programInfo.targetSimulationCount > programInfo.maxSimulationCount)
 					programInfo.targetSimulationCount = programInfo.maxSimulationCount;
 			}
+			if(terminated)
+				programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_WARNING, "Terminated after %llu simulations; resume the run with --resume=%s.", (unsigned long long)programInfo.simulationCount, programInfo.checkpointFile);
 
-			// Wait for the device to idle
-			vkDeviceWaitIdle(programInfo.device->GetDevice());
+			// Wait for the simulations in flight and the device to idle
+			if(programInfo.directSim) {
+				programInfo.directSim->WaitForSimulations();
+			} else if(programInfo.barnesHutSim) {
+				programInfo.barnesHutSim->WaitForSimulations();
+			}
+			if(programInfo.device)
+				vkDeviceWaitIdle(programInfo.device->GetDevice());
+
+			// Wait for the queued snapshots to be written
+			if(programInfo.snapshotWriter) {
+				programInfo.snapshotWriter->Flush();
+				programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "Wrote %llu particle snapshots to %s.", (unsigned long long)programInfo.snapshotWriter->GetWrittenCount(), programInfo.snapshotDir);
+			}
 
 			// Output the benchmark info, if requested
 			if(programInfo.benchmark) {
 				// Calculate the total and average runtimes
-				clock_t clockDif = clock() - programInfo.clockStart;
-				float runtimeSec = (float)clockDif / CLOCKS_PER_SEC;
-				float runtimeAvgMs = runtimeSec * 1000 / programInfo.maxSimulationCount;
+				float runtimeSec = std::chrono::duration<float>(std::chrono::steady_clock::now() - benchmarkStart).count();
+				float runtimeAvgMs = runtimeSec * 1000 / (programInfo.simulationCount - startSimulationCount);
 
 				// Log the total runtime
 				if(runtimeSec >= 1) {
@@ -307,25 +742,61 @@ int main(int argc, char** args) {
 				} else {
 					programInfo.logger->LogMessageForced(gsim::Logger::MESSAGE_LEVEL_INFO, "Average runtime/simulation: %.1fus", (runtimeAvgMs * 1000));
 				}
+
+				// Log the force pass's node interactions, for comparing accuracy settings
+				if(programInfo.barnesHutSim && programInfo.barnesHutSim->GetTreeStats().interactionCount) {
+					double interactionsPerParticle = (double)programInfo.barnesHutSim->GetTreeStats().interactionCount * programInfo.device->GetSubgroupSize() / programInfo.particleSystem->GetAlignedParticleCount();
+					const char* expansion = programInfo.barnesHutSim->GetQuadrupoleMoments() ? "quadrupole" : "monopole";
+					programInfo.logger->LogMessageForced(gsim::Logger::MESSAGE_LEVEL_INFO, "Average interactions/particle: %.1f (%s nodes, accuracy parameter %g)", interactionsPerParticle, expansion, (double)programInfo.accuracyParameter);
+				}
+
+				// Log the GPU's idle gaps between consecutive batches, if the batches were timed
+				const gsim::VulkanSubmissionRing* submissionRing = nullptr;
+				if(programInfo.directSim) {
+					submissionRing = programInfo.directSim->GetSubmissionRing();
+				} else if(programInfo.barnesHutSim) {
+					submissionRing = programInfo.barnesHutSim->GetSubmissionRing();
+				}
+				if(submissionRing && submissionRing->GetTimingStats().submissionCount) {
+					const gsim::VulkanSubmissionRing::TimingStats& timingStats = submissionRing->GetTimingStats();
+					double idlePercent = timingStats.idleTime * 100 / (timingStats.busyTime + timingStats.idleTime);
+					programInfo.logger->LogMessageForced(gsim::Logger::MESSAGE_LEVEL_INFO, "GPU idle time between batches: %.3fms total, %.3fms longest, %.1f%% of the GPU runtime (%u batches in flight)", timingStats.idleTime * 1000, timingStats.maxIdleTime * 1000, idlePercent, submissionRing->GetSubmissionCount());
+				}
+
+				// Log the time the simulations stalled waiting for the disk, if snapshots were written
+				if(programInfo.snapshotWriter)
+					programInfo.logger->LogMessageForced(gsim::Logger::MESSAGE_LEVEL_INFO, "Snapshot stall time: %.3fms (%u snapshots queued at most)", programInfo.snapshotWriter->GetStallTime() * 1000, programInfo.snapshotWriter->GetQueueDepth());
 			}
 
 			// Destroy the simulation
-			if(programInfo.directSim) {
+			if(programInfo.cpuDirectSim) {
+				delete programInfo.cpuDirectSim;
+			} else if(programInfo.cpuBarnesHutSim) {
+				delete programInfo.cpuBarnesHutSim;
+			} else if(programInfo.directSim) {
 				delete programInfo.directSim;
 			} else {
 				delete programInfo.barnesHutSim;
 			}
 
-			// Save the particle infos, if an output file was provided
-			if(programInfo.particlesOutFile)
-				programInfo.particleSystem->SaveParticles(programInfo.particlesOutFile);
+			// Destroy the snapshot writer
+			if(programInfo.snapshotWriter)
+				delete programInfo.snapshotWriter;
+
+			// Save the particle infos, if an output file was provided and all simulations were run
+			if(programInfo.particlesOutFile && !terminated)
+				programInfo.particleSystem->SaveParticles(programInfo.particlesOutFile, programInfo.particlesOutFormat, programInfo.snapshotCodec, programInfo.snapshotPrecision);
 
 			// Destroy the particle system
 			delete programInfo.particleSystem;
 
-			// Destroy the Vulkan components
-			delete programInfo.device;
-			delete programInfo.instance;
+			// Destroy the backend components
+			if(programInfo.threadPool) {
+				delete programInfo.threadPool;
+			} else {
+				delete programInfo.device;
+				delete programInfo.instance;
+			}
 		} else {
 			// Create the window
 			programInfo.window = new gsim::Window(GSIM_PROJECT_NAME, 800, 800);
@@ -333,20 +804,28 @@ int main(int argc, char** args) {
 			// Create the Vulkan components
 			programInfo.instance = new gsim::VulkanInstance(true, programInfo.logger);
 			programInfo.surface = new gsim::VulkanSurface(programInfo.instance, programInfo.window);
-			programInfo.device = new gsim::VulkanDevice(programInfo.instance, programInfo.surface);
+			programInfo.device = new gsim::VulkanDevice(programInfo.instance, programInfo.surface, programInfo.pipelineCacheDir);
 			programInfo.swapChain = new gsim::VulkanSwapChain(programInfo.device, programInfo.surface);
 		
 			// Log info about the Vulkan objects
 			programInfo.device->LogDeviceInfo(programInfo.logger);
 			programInfo.swapChain->LogSwapChainInfo(programInfo.logger);
 
+			// Keep a third particle buffer set for the graphics, sharing the masses and IDs unless the simulation reorders the particles
+			uint32_t bufferSetCount = gsim::ParticleSystem::MAX_BUFFER_SET_COUNT;
+			bool massShared = programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM || !gsim::BarnesHutSimulation::GetParticlesReordered(programInfo.treeBuild, programInfo.reorderInterval);
+
 			// Create the particle system
 			if(programInfo.particlesInFile) {
-				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particlesInFile, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm);
+				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particlesInFile, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm, programInfo.simulationBackend, bufferSetCount, massShared);
 			} else {
-				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particleCount, programInfo.generateType, programInfo.generateSize, programInfo.minMass, programInfo.maxMass, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm);
+				programInfo.particleSystem = new gsim::ParticleSystem(programInfo.device, programInfo.particleCount, programInfo.generateType, programInfo.generateSize, programInfo.minMass, programInfo.maxMass, (uint32_t)programInfo.seed, programInfo.gravitationalConst, programInfo.simulationTime, programInfo.simulationSpeed, programInfo.softeningLen, programInfo.accuracyParameter, programInfo.simulationAlgorithm, programInfo.simulationBackend, bufferSetCount, massShared);
 			}
 
+			// Log the particle upload path
+			if(programInfo.particleSystem->GetBufferMemoryMapped())
+				programInfo.logger->LogMessage(gsim::Logger::MESSAGE_LEVEL_INFO, "The particle buffers are bound to host-mapped device-local memory, so no staging buffer was used.");
+
 			// Set the camera's starting info
 			programInfo.cameraPos = programInfo.particleSystem->GetCameraStartPos();
 			programInfo.cameraSize = programInfo.particleSystem->GetCameraStartSize();
@@ -355,11 +834,17 @@ int main(int argc, char** args) {
 			programInfo.graphicsPipeline = new gsim::GraphicsPipeline(programInfo.device, programInfo.swapChain, programInfo.particleSystem);
 
 			if(programInfo.simulationAlgorithm == gsim::ParticleSystem::SIMULATION_ALGORITHM_DIRECT_SUM) {
-				programInfo.directSim = new gsim::DirectSimulation(programInfo.device, programInfo.particleSystem);
+				programInfo.directSim = new gsim::DirectSimulation(programInfo.device, programInfo.particleSystem, programInfo.inFlightCount);
 			} else {
-				programInfo.barnesHutSim = new gsim::BarnesHutSimulation(programInfo.device, programInfo.particleSystem);
+				programInfo.barnesHutSim = new gsim::BarnesHutSimulation(programInfo.device, programInfo.particleSystem, programInfo.treeDepth, programInfo.treeBuild, programInfo.leafCapacity, programInfo.reorderInterval, programInfo.forceWalk, programInfo.quadrupoleMoments, programInfo.treeRebuildInterval, programInfo.leafAccumulation, programInfo.inFlightCount);
 			}
 
+			// Save the pipeline cache, now that all pipelines were created
+			SavePipelineCache(&programInfo);
+
+			// Log the device memory used by every subsystem before the run starts
+			programInfo.device->GetMemoryAllocator()->LogMemoryUsage(programInfo.logger);
+
 			// Add the event listeners
 			programInfo.window->GetDrawEvent().AddListener({ WindowDrawCallback, &programInfo });
 			programInfo.window->GetKeyEvent().AddListener({ WindowKeyCallback, &programInfo });
@@ -406,7 +891,7 @@ int main(int argc, char** args) {
 
 			// Save the particle infos, if an output file was provided
 			if(programInfo.particlesOutFile)
-				programInfo.particleSystem->SaveParticles(programInfo.particlesOutFile);
+				programInfo.particleSystem->SaveParticles(programInfo.particlesOutFile, programInfo.particlesOutFormat, programInfo.snapshotCodec, programInfo.snapshotPrecision);
 
 			// Destroy the particle system
 			delete programInfo.particleSystem;
@@ -1,21 +1,184 @@
 #include "ParticleSystem.hpp"
 #include "Debug/Exception.hpp"
+#include "Platform/AtomicFile.hpp"
+#include "Platform/ThreadPool.hpp"
 #include "Simulation/BarnesHut/BarnesHutSimulation.hpp"
+#include "Simulation/BarnesHut/CpuBarnesHutSimulation.hpp"
+#include "Simulation/Direct/CpuDirectSimulation.hpp"
 #include "Simulation/Direct/DirectSimulation.hpp"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
-#include <time.h>
+#include <charconv>
 #include <random>
 
 #include <vulkan/vk_enum_string_helper.h>
 
 namespace gsim {
+	// Constants
+	const size_t TEXT_CHUNK_SIZE = 1 << 20;
+	const size_t MAX_REPORTED_LINE_COUNT = 8;
+	const size_t TEXT_WRITE_CHUNK_SIZE = 16384;
+	const size_t MAX_FLOAT_TEXT_LEN = 16;
+	const size_t MAX_PARTICLE_TEXT_LEN = MAX_FLOAT_TEXT_LEN * 5;
+	const size_t UPLOAD_CHUNK_SIZE = 1 << 20;
+	const uint32_t UPLOAD_SLOT_COUNT = 3;
+
+	// Structs
+	struct TextChunk {
+		const char* begin;
+		const char* end;
+		size_t lineCount;
+		size_t lineOffset;
+		size_t particleCount;
+		size_t particleOffset;
+		size_t malformedCount;
+		size_t malformedLines[MAX_REPORTED_LINE_COUNT];
+	};
+	struct TextParse {
+		TextChunk* chunks;
+		Vec2* pos;
+		Vec2* vel;
+		float* mass;
+	};
+	struct TextWrite {
+		const Particle* particles;
+		size_t particleCount;
+		size_t firstChunk;
+		char** buffers;
+		size_t* bufferSizes;
+	};
+
 	// Internal helper functions
-	void ParticleSystem::GenerateParticlesRandom(Particle* particles, float generateSize, float minMass, float maxMass) {
+	static bool IsBlankChar(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+	static const char* GetLineEnd(const char* iter, const char* end) {
+		const char* lineEnd = (const char*)memchr(iter, '\n', end - iter);
+		return lineEnd ? lineEnd : end;
+	}
+	static bool IsBlankLine(const char* iter, const char* lineEnd) {
+		while(iter != lineEnd && IsBlankChar(*iter))
+			++iter;
+		return iter == lineEnd;
+	}
+	static bool ParseLine(const char* iter, const char* lineEnd, float* values) {
+		for(uint32_t i = 0; i != 5; ++i) {
+			// Skip the whitespace before the value, along with its optional plus sign, as std::from_chars doesn't accept either
+			while(iter != lineEnd && IsBlankChar(*iter))
+				++iter;
+			if(iter != lineEnd && *iter == '+')
+				++iter;
+			
+			// Parse the value, which must be followed by whitespace or the end of the line
+			std::from_chars_result result = std::from_chars(iter, lineEnd, values[i]);
+			if(result.ec != std::errc() || (result.ptr != lineEnd && !IsBlankChar(*result.ptr)))
+				return false;
+			iter = result.ptr;
+		}
+
+		// Make sure nothing but whitespace follows the values
+		return IsBlankLine(iter, lineEnd);
+	}
+	static void CountTextChunk(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		TextParse* parse = (TextParse*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Count the chunk's lines and the particles on its non-blank lines
+			TextChunk& chunk = parse->chunks[i];
+			chunk.lineCount = 0;
+			chunk.particleCount = 0;
+
+			for(const char* iter = chunk.begin; iter != chunk.end; ++chunk.lineCount) {
+				const char* lineEnd = GetLineEnd(iter, chunk.end);
+				if(!IsBlankLine(iter, lineEnd))
+					++chunk.particleCount;
+				
+				iter = (lineEnd == chunk.end) ? lineEnd : lineEnd + 1;
+			}
+		}
+	}
+	static void ParseTextChunk(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		TextParse* parse = (TextParse*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Parse every non-blank line straight into the chunk's part of the arrays
+			TextChunk& chunk = parse->chunks[i];
+			size_t lineIndex = chunk.lineOffset;
+			size_t particleIndex = chunk.particleOffset;
+			chunk.malformedCount = 0;
+
+			for(const char* iter = chunk.begin; iter != chunk.end; ++lineIndex) {
+				const char* lineEnd = GetLineEnd(iter, chunk.end);
+
+				if(!IsBlankLine(iter, lineEnd)) {
+					float values[5];
+					if(ParseLine(iter, lineEnd, values)) {
+						parse->pos[particleIndex] = { values[0], values[1] };
+						parse->vel[particleIndex] = { values[2], values[3] };
+						parse->mass[particleIndex] = values[4];
+					} else {
+						// Save the malformed line's number
+						if(chunk.malformedCount < MAX_REPORTED_LINE_COUNT)
+							chunk.malformedLines[chunk.malformedCount] = lineIndex + 1;
+						++chunk.malformedCount;
+					}
+
+					++particleIndex;
+				}
+				
+				iter = (lineEnd == chunk.end) ? lineEnd : lineEnd + 1;
+			}
+		}
+	}
+	static char* FormatFloat(char* iter, float value, char separator) {
+		// Write the shortest representation that parses back to the same value
+		iter = std::to_chars(iter, iter + MAX_FLOAT_TEXT_LEN - 1, value).ptr;
+		*iter++ = separator;
+		return iter;
+	}
+	static void FormatTextChunk(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		TextWrite* write = (TextWrite*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the chunk's particle range
+			size_t chunkIndex = write->firstChunk + i;
+			size_t particleBegin = chunkIndex * TEXT_WRITE_CHUNK_SIZE;
+			size_t particleEnd = (write->particleCount - particleBegin < TEXT_WRITE_CHUNK_SIZE) ? write->particleCount : particleBegin + TEXT_WRITE_CHUNK_SIZE;
+
+			// Format one line per particle into the chunk's buffer
+			char* iter = write->buffers[i];
+			for(size_t j = particleBegin; j != particleEnd; ++j) {
+				const Particle& particle = write->particles[j];
+				iter = FormatFloat(iter, particle.pos.x, ' ');
+				iter = FormatFloat(iter, particle.pos.y, ' ');
+				iter = FormatFloat(iter, particle.vel.x, ' ');
+				iter = FormatFloat(iter, particle.vel.y, ' ');
+				iter = FormatFloat(iter, particle.mass, '\n');
+			}
+
+			write->bufferSizes[i] = iter - write->buffers[i];
+		}
+	}
+	static bool IsSnapshotSectionValid(const ParticleSystem::SnapshotHeader& header, uint64_t offset, uint64_t size, uint32_t codec, uint64_t rawSize, size_t fileSize) {
+		// Check if the section lies within the file, after the header
+		if(codec >= SnapshotCodec::CODEC_COUNT || offset < header.headerSize || offset > fileSize || fileSize - offset < size)
+			return false;
+
+		// Uncompressed sections must hold every particle's components, aligned to their floats
+		if(codec == SnapshotCodec::CODEC_RAW)
+			return size == rawSize && !(offset & (alignof(float) - 1));
+		
+		// Compressed sections must be aligned to their 64-bit words
+		return !(offset & (alignof(uint64_t) - 1));
+	}
+
+	void ParticleSystem::GenerateParticlesRandom(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed) {
 		// Create the random engine and distribution
 		std::default_random_engine randomEngine;
-		randomEngine.seed((uint32_t)time(nullptr));
+		randomEngine.seed(seed);
 		std::uniform_real_distribution<float> distribution(0, 1);
 
 		// Generate every particle
@@ -34,10 +197,10 @@ namespace gsim {
 			particles[i].mass = distribution(randomEngine) * (maxMass - minMass) + minMass;
 		}
 	}
-	void ParticleSystem::GenerateParticlesGalaxy(Particle* particles, float generateSize, float minMass, float maxMass) {
+	void ParticleSystem::GenerateParticlesGalaxy(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed) {
 		// Create the random engine and distribution
 		std::default_random_engine randomEngine;
-		randomEngine.seed((uint32_t)time(nullptr));
+		randomEngine.seed(seed);
 		std::uniform_real_distribution<float> distribution(0, 1);
 
 		// Calculate the orbit velocity
@@ -63,10 +226,10 @@ namespace gsim {
 			particles[i].mass = distribution(randomEngine) * (maxMass - minMass) + minMass;
 		}
 	}
-	void ParticleSystem::GenerateParticlesGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass) {
+	void ParticleSystem::GenerateParticlesGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed) {
 		// Create the random engine and distribution
 		std::default_random_engine randomEngine;
-		randomEngine.seed((uint32_t)time(nullptr));
+		randomEngine.seed(seed);
 		std::uniform_real_distribution<float> distribution(0, 1);
 
 		// Calculate the orbit velocity
@@ -112,10 +275,10 @@ namespace gsim {
 			particles[i].mass = distribution(randomEngine) * (maxMass - minMass) + minMass;
 		}
 	}
-	void ParticleSystem::GenerateParticlesSymmetricalGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass) {
+	void ParticleSystem::GenerateParticlesSymmetricalGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed) {
 		// Create the random engine and distribution
 		std::default_random_engine randomEngine;
-		randomEngine.seed((uint32_t)time(nullptr));
+		randomEngine.seed(seed);
 		std::uniform_real_distribution<float> distribution(0, 1);
 
 		// Calculate the orbit velocity
@@ -147,77 +310,278 @@ namespace gsim {
 			particles[i + 1].mass = particles[i].mass;
 		}
 	}
-	void ParticleSystem::CreateVulkanObjects(const Particle* particles) {
-		// Set the staging buffer create info
-		uint32_t transferIndex = device->GetQueueFamilyIndices().transferIndex;
+	bool ParticleSystem::LoadSnapshot(const MappedFile& file, size_t particleCountAlignment) {
+		// Get the file's contents
+		const uint8_t* fileData = (const uint8_t*)file.GetData();
+		size_t fileSize = file.GetSize();
+
+		// Exit the function if the file doesn't start with a snapshot header, whose first version ended before the section encodings
+		const size_t V1_HEADER_SIZE = offsetof(SnapshotHeader, posCodec);
+		if(fileSize < V1_HEADER_SIZE || memcmp(fileData, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)))
+			return false;
+		
+		// Read the snapshot's header
+		SnapshotHeader header{};
+		memcpy(&header, fileData, V1_HEADER_SIZE);
+
+		size_t minHeaderSize = sizeof(SnapshotHeader);
+		if(header.version == 1) {
+			// Set the sizes of the first version's sections, which are always uncompressed
+			minHeaderSize = V1_HEADER_SIZE;
+			header.posSize = header.particleCount * sizeof(Vec2);
+			header.velSize = header.particleCount * sizeof(Vec2);
+			header.massSize = header.particleCount * sizeof(float);
+		} else if(header.version == SNAPSHOT_VERSION && fileSize >= sizeof(SnapshotHeader)) {
+			memcpy(&header, fileData, sizeof(SnapshotHeader));
+		} else if(header.version == SNAPSHOT_VERSION) {
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot header size!");
+		} else {
+			GSIM_THROW_EXCEPTION("Unsupported particle snapshot version %u! Expected version %u.", header.version, SNAPSHOT_VERSION);
+		}
 
-		VkBufferCreateInfo stagingBufferInfo {
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = 0,
-			.size = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)),
-			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-			.queueFamilyIndexCount = 1,
-			.pQueueFamilyIndices = &transferIndex
+		// Validate the snapshot's header
+		if(header.headerSize < minHeaderSize || header.headerSize > fileSize)
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot header size!");
+		if(!header.particleCount)
+			GSIM_THROW_EXCEPTION("The particle input file must contain at least one valid particle!");
+		if(header.particleCount >= UINT32_MAX)
+			GSIM_THROW_EXCEPTION("The particle snapshot contains too many particles!");
+		
+		// Validate the snapshot's sections, which must lie within the file and be aligned to their element types, or to 8 bytes if compressed
+		if(!IsSnapshotSectionValid(header, header.posOffset, header.posSize, header.posCodec, header.particleCount * sizeof(Vec2), fileSize))
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot position section!");
+		if(!IsSnapshotSectionValid(header, header.velOffset, header.velSize, header.velCodec, header.particleCount * sizeof(Vec2), fileSize))
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot velocity section!");
+		if(!IsSnapshotSectionValid(header, header.massOffset, header.massSize, header.massCodec, header.particleCount * sizeof(float), fileSize))
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot mass section!");
+		
+		// Set the particle counts
+		particleCount = (size_t)header.particleCount;
+		alignedParticleCount = (particleCount + particleCountAlignment - 1) & ~(particleCountAlignment - 1);
+
+		// Use the uncompressed sections straight from the mapped file
+		ParticleSource source {
+			.particles = nullptr,
+			.pos = (const Vec2*)(fileData + header.posOffset),
+			.vel = (const Vec2*)(fileData + header.velOffset),
+			.mass = (const float*)(fileData + header.massOffset)
 		};
 
-		// Create the staging buffer
-		VkBuffer stagingBuffer;
-		VkResult result = vkCreateBuffer(device->GetDevice(), &stagingBufferInfo, nullptr, &stagingBuffer);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to create Vulkan particle staging buffer! Error code: %s", string_VkResult(result));
+		// Allocate the arrays for the compressed sections, if there are any
+		bool compressed = header.posCodec != SnapshotCodec::CODEC_RAW || header.velCodec != SnapshotCodec::CODEC_RAW || header.massCodec != SnapshotCodec::CODEC_RAW;
+		void* decodedData = nullptr;
+		if(compressed) {
+			decodedData = malloc(particleCount * ((sizeof(Vec2) << 1) + sizeof(float)));
+			if(!decodedData)
+				GSIM_THROW_EXCEPTION("Failed to allocate decoded particle snapshot arrays!");
+		}
 
-		// Get the staging buffer's memory requirements
-		VkMemoryRequirements stagingMemRequirements;
-		vkGetBufferMemoryRequirements(device->GetDevice(), stagingBuffer, &stagingMemRequirements);
+		Vec2* decodedPos = (Vec2*)decodedData;
+		Vec2* decodedVel = decodedPos + particleCount;
+		float* decodedMass = (float*)(decodedVel + particleCount);
 
-		// Get the staging buffer's memory type index
-		uint32_t stagingMemTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingMemRequirements.memoryTypeBits);
-		if(stagingMemTypeIndex == UINT32_MAX)
-			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan particle staging buffer!");
+		// Decode the compressed sections on all hardware threads
+		ThreadPool threadPool(compressed ? 0 : 1);
+		bool decoded = true;
+
+		if(header.posCodec != SnapshotCodec::CODEC_RAW) {
+			decoded = SnapshotCodec::DecodeSection((SnapshotCodec::Codec)header.posCodec, fileData + header.posOffset, header.posSize, particleCount << 1, 2, header.blockLength, (float*)decodedPos, &threadPool);
+			source.pos = decodedPos;
+		}
+		if(!decoded) {
+			free(decodedData);
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot position section!");
+		}
+		if(header.velCodec != SnapshotCodec::CODEC_RAW) {
+			decoded = SnapshotCodec::DecodeSection((SnapshotCodec::Codec)header.velCodec, fileData + header.velOffset, header.velSize, particleCount << 1, 2, header.blockLength, (float*)decodedVel, &threadPool);
+			source.vel = decodedVel;
+		}
+		if(!decoded) {
+			free(decodedData);
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot velocity section!");
+		}
+		if(header.massCodec != SnapshotCodec::CODEC_RAW) {
+			decoded = SnapshotCodec::DecodeSection((SnapshotCodec::Codec)header.massCodec, fileData + header.massOffset, header.massSize, particleCount, 1, header.blockLength, decodedMass, &threadPool);
+			source.mass = decodedMass;
+		}
+		if(!decoded) {
+			free(decodedData);
+			GSIM_THROW_EXCEPTION("Invalid particle snapshot mass section!");
+		}
+
+		// Create the particle storage from the sections
+		CreateParticleStorage(source);
+
+		// Free the decoded arrays
+		free(decodedData);
+
+		return true;
+	}
+	void ParticleSystem::LoadText(const MappedFile& file, size_t particleCountAlignment) {
+		// Throw an exception if the file is empty
+		const char* fileData = (const char*)file.GetData();
+		const char* fileEnd = fileData + file.GetSize();
+		if(fileData == fileEnd)
+			GSIM_THROW_EXCEPTION("The particle input file must contain at least one valid particle!");
+
+		// Allocate the file's chunks
+		size_t chunkCount = (file.GetSize() + TEXT_CHUNK_SIZE - 1) / TEXT_CHUNK_SIZE;
+		TextChunk* chunks = (TextChunk*)malloc(chunkCount * sizeof(TextChunk));
+		if(!chunks)
+			GSIM_THROW_EXCEPTION("Failed to allocate particle text chunks!");
 		
-		// Set the memory alloc info
-		VkMemoryAllocateInfo stagingAllocInfo {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.allocationSize = stagingMemRequirements.size,
-			.memoryTypeIndex = stagingMemTypeIndex
+		// Split the file into chunks on line boundaries, extending every chunk to the end of the line its nominal end falls into
+		const char* chunkBegin = fileData;
+		for(size_t i = 0; i != chunkCount; ++i) {
+			const char* chunkEnd = fileEnd;
+			if(i != chunkCount - 1) {
+				const char* nominalEnd = fileData + (i + 1) * TEXT_CHUNK_SIZE;
+				if(nominalEnd > chunkBegin) {
+					chunkEnd = GetLineEnd(nominalEnd - 1, fileEnd);
+					if(chunkEnd != fileEnd)
+						++chunkEnd;
+				} else {
+					// Leave the chunk empty, as the previous chunk's last line covers it entirely
+					chunkEnd = chunkBegin;
+				}
+			}
+
+			chunks[i].begin = chunkBegin;
+			chunks[i].end = chunkEnd;
+			chunkBegin = chunkEnd;
+		}
+
+		// Count every chunk's lines and particles in parallel
+		ThreadPool threadPool(0);
+		TextParse parse {
+			.chunks = chunks,
+			.pos = nullptr,
+			.vel = nullptr,
+			.mass = nullptr
 		};
+		threadPool.ParallelFor(chunkCount, 1, CountTextChunk, &parse);
+
+		// Get every chunk's first line and particle index
+		size_t lineCount = 0;
+		for(size_t i = 0; i != chunkCount; ++i) {
+			chunks[i].lineOffset = lineCount;
+			chunks[i].particleOffset = particleCount;
+			lineCount += chunks[i].lineCount;
+			particleCount += chunks[i].particleCount;
+		}
 
-		// Allocate the staging buffer's memory
-		VkDeviceMemory stagingMemory;
-		result = vkAllocateMemory(device->GetDevice(), &stagingAllocInfo, nullptr, &stagingMemory);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle staging buffer memory! Error code: %s", string_VkResult(result));
-		
-		// Bind the staging buffer to its memory
-		result = vkBindBufferMemory(device->GetDevice(), stagingBuffer, stagingMemory, 0);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle staging buffer to its memory! Error code: %s", string_VkResult(result));
+		// Throw an exception if the file contains no particles
+		if(!particleCount) {
+			free(chunks);
+			GSIM_THROW_EXCEPTION("The particle input file must contain at least one valid particle!");
+		}
+		if(particleCount >= UINT32_MAX) {
+			free(chunks);
+			GSIM_THROW_EXCEPTION("The particle input file contains too many particles!");
+		}
 		
-		// Map the staging buffer's memory
-		void* stagingData;
-		result = vkMapMemory(device->GetDevice(), stagingMemory, 0, VK_WHOLE_SIZE, 0, &stagingData);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to map Vulkan particle staging buffer memory! Error code: %s", string_VkResult(result));
+		// Set the aligned particle count
+		alignedParticleCount = (particleCount + particleCountAlignment - 1) & ~(particleCountAlignment - 1);
+
+		// Allocate the component arrays in a single block
+		void* arrayData = malloc(particleCount * ((sizeof(Vec2) << 1) + sizeof(float)));
+		if(!arrayData) {
+			free(chunks);
+			GSIM_THROW_EXCEPTION("Failed to allocate particle arrays!");
+		}
 		
-		// Copy the particle infos to the staging buffer
-		Vec2* vec2Iter = (Vec2*)stagingData;
+		parse.pos = (Vec2*)arrayData;
+		parse.vel = parse.pos + particleCount;
+		parse.mass = (float*)(parse.vel + particleCount);
+
+		// Parse every chunk in parallel
+		threadPool.ParallelFor(chunkCount, 1, ParseTextChunk, &parse);
+
+		// Gather the malformed lines of all chunks, in order
+		size_t malformedCount = 0, reportedCount = 0;
+		size_t malformedLines[MAX_REPORTED_LINE_COUNT];
+		for(size_t i = 0; i != chunkCount; ++i) {
+			for(size_t j = 0; j != chunks[i].malformedCount && j != MAX_REPORTED_LINE_COUNT && reportedCount != MAX_REPORTED_LINE_COUNT; ++j)
+				malformedLines[reportedCount++] = chunks[i].malformedLines[j];
+			malformedCount += chunks[i].malformedCount;
+		}
 
-		for(size_t i = 0; i != alignedParticleCount; ++i, ++vec2Iter)
-			*vec2Iter = particles[i].pos;
+		free(chunks);
 
-		for(size_t i = 0; i != alignedParticleCount; ++i, ++vec2Iter)
-			*vec2Iter = particles[i].vel;
+		// Throw an exception listing the first malformed lines, if any were found
+		if(malformedCount) {
+			free(arrayData);
 
-		float* floatIter = (float*)vec2Iter;
+			char lineList[MAX_REPORTED_LINE_COUNT * 24] = "";
+			size_t listLen = 0;
+			for(size_t i = 0; i != reportedCount; ++i)
+				listLen += snprintf(lineList + listLen, sizeof(lineList) - listLen, i ? ", %zu" : "%zu", malformedLines[i]);
 
-		for(size_t i = 0; i != alignedParticleCount; ++i, ++floatIter)
-			*floatIter = particles[i].mass;
+			GSIM_THROW_EXCEPTION("The particle input file contains %zu malformed line(s), each of which must hold five numbers! Malformed lines: %s%s", malformedCount, lineList, (malformedCount > reportedCount) ? ", ..." : "");
+		}
 
-		// Unmap the staging buffer's memory
-		vkUnmapMemory(device->GetDevice(), stagingMemory);
+		// Create the particle storage
+		ParticleSource source {
+			.particles = nullptr,
+			.pos = parse.pos,
+			.vel = parse.vel,
+			.mass = parse.mass
+		};
+		CreateParticleStorage(source);
+
+		// Free the component arrays
+		free(arrayData);
+	}
+	void ParticleSystem::CreateParticleStorage(const ParticleSource& source) {
+		// Create the particle storage for the chosen backend
+		if(simulationBackend == SIMULATION_BACKEND_CPU) {
+			CreateArrays(source);
+		} else {
+			CreateVulkanObjects(source);
+		}
+
+		// Get the camera's starting info
+		GetCameraInfo(source);
+	}
+	void ParticleSystem::CopyParticles(const ParticleSource& source, size_t begin, size_t end, Vec2* pos, Vec2* vel, float* mass) {
+		// Get the range's real particles, as the rest are only used for alignment
+		size_t particleEnd = (end < particleCount) ? end : particleCount;
+		if(particleEnd < begin)
+			particleEnd = begin;
+		size_t count = particleEnd - begin;
+
+		if(source.particles) {
+			// Scatter the particle array into the component arrays
+			for(size_t i = 0; i != count; ++i) {
+				pos[i] = source.particles[begin + i].pos;
+				vel[i] = source.particles[begin + i].vel;
+				mass[i] = source.particles[begin + i].mass;
+			}
+		} else {
+			// Copy the component arrays as a whole, as they already share the destination's layout
+			memcpy(pos, source.pos + begin, count * sizeof(Vec2));
+			memcpy(vel, source.vel + begin, count * sizeof(Vec2));
+			memcpy(mass, source.mass + begin, count * sizeof(float));
+		}
+
+		// Fill the remaining particle infos
+		for(size_t i = count; i != end - begin; ++i) {
+			pos[i] = { 0, 0 };
+			vel[i] = { 0, 0 };
+			mass[i] = 0;
+		}
+	}
+	void ParticleSystem::CreateVulkanObjects(const ParticleSource& source) {
+		// Check if the buffer set count is valid
+		if(bufferSetCount != 2 && bufferSetCount != MAX_BUFFER_SET_COUNT)
+			GSIM_THROW_EXCEPTION("Invalid particle buffer set count %u! The count must be 2 or %u.", bufferSetCount, MAX_BUFFER_SET_COUNT);
+
+		// Rotate only the two compute buffers if there is no graphics buffer, leaving the graphics index past the existing sets
+		if(bufferSetCount != MAX_BUFFER_SET_COUNT) {
+			graphicsIndex = 2;
+			computeInputIndex = 0;
+			computeOutputIndex = 1;
+		}
 
 		// Set the particle position and velocity buffer create info
 		VkBufferCreateInfo posVelBufferInfo {
@@ -243,8 +607,21 @@ namespace gsim {
 			.pQueueFamilyIndices = device->GetQueueFamilyIndexArray()
 		};
 
+		// Set the particle ID buffer create info
+		VkBufferCreateInfo idBufferInfo {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.size = alignedParticleCount * sizeof(uint32_t),
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.sharingMode = (device->GetQueueFamilyIndexArraySize() == 1) ? VK_SHARING_MODE_EXCLUSIVE : VK_SHARING_MODE_CONCURRENT,
+			.queueFamilyIndexCount = device->GetQueueFamilyIndexArraySize(),
+			.pQueueFamilyIndices = device->GetQueueFamilyIndexArray()
+		};
+
 		// Create the particle buffers
-		for(uint32_t i = 0; i != 3; ++i) {
+		VkResult result;
+		for(uint32_t i = 0; i != bufferSetCount; ++i) {
 			// Create the position buffer
 			result = vkCreateBuffer(device->GetDevice(), &posVelBufferInfo, nullptr, &(buffers[i].posBuffer));
 			if(result != VK_SUCCESS)
@@ -255,162 +632,345 @@ namespace gsim {
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to create Vulkan particle buffers! Error code: %s", string_VkResult(result));
 
+			// Take the first set's mass and ID buffers if they are shared
+			if(massShared && i) {
+				buffers[i].massBuffer = buffers[0].massBuffer;
+				buffers[i].idBuffer = buffers[0].idBuffer;
+				continue;
+			}
+
 			// Create the mass buffer
 			result = vkCreateBuffer(device->GetDevice(), &massBufferInfo, nullptr, &(buffers[i].massBuffer));
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to create Vulkan particle buffers! Error code: %s", string_VkResult(result));
+
+			// Create the ID buffer
+			result = vkCreateBuffer(device->GetDevice(), &idBufferInfo, nullptr, &(buffers[i].idBuffer));
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to create Vulkan particle buffers! Error code: %s", string_VkResult(result));
 		}
 
 		// Get the buffers' memory requirements
-		VkMemoryRequirements posVelMemRequirements, massMemRequirements;
+		VkMemoryRequirements posVelMemRequirements, massMemRequirements, idMemRequirements;
 		vkGetBufferMemoryRequirements(device->GetDevice(), buffers[0].posBuffer, &posVelMemRequirements);
 		vkGetBufferMemoryRequirements(device->GetDevice(), buffers[0].massBuffer, &massMemRequirements);
+		vkGetBufferMemoryRequirements(device->GetDevice(), buffers[0].idBuffer, &idMemRequirements);
 
-		// Get the buffers' memory type index
-		uint32_t memTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, posVelMemRequirements.memoryTypeBits & massMemRequirements.memoryTypeBits);
-		if(memTypeIndex == UINT32_MAX)
-			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan particle buffer!");
-		
 		// Align the required sizes to the required alignment
 		VkDeviceSize maxAlignment = (posVelMemRequirements.alignment > massMemRequirements.alignment) ? posVelMemRequirements.alignment : massMemRequirements.alignment;
+		if(idMemRequirements.alignment > maxAlignment)
+			maxAlignment = idMemRequirements.alignment;
 		VkDeviceSize alignedPosVelSize = (posVelMemRequirements.size + maxAlignment - 1) & ~(maxAlignment - 1);
 		VkDeviceSize alignedMassSize = (massMemRequirements.size + maxAlignment - 1) & ~(maxAlignment - 1);
-		VkDeviceSize alignedSize = (alignedPosVelSize << 1) + alignedMassSize;
+		VkDeviceSize alignedIdSize = (idMemRequirements.size + maxAlignment - 1) & ~(maxAlignment - 1);
+		VkDeviceSize alignedSize = (alignedPosVelSize << 1) + (massShared ? 0 : alignedMassSize + alignedIdSize);
+		VkDeviceSize totalSize = alignedSize * bufferSetCount + (massShared ? alignedMassSize + alignedIdSize : 0);
 		
-		// Set the memory alloc info
-		VkMemoryAllocateInfo allocInfo {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.allocationSize = alignedSize * 3,
-			.memoryTypeIndex = memTypeIndex
+		// Prefer device-local memory the host can map, as on integrated GPUs, software implementations and resizable BAR, so that the particles are written without a staging buffer
+		const VkPhysicalDeviceMemoryProperties& memoryProperties = device->GetPhysicalDeviceMemoryProperties();
+		uint32_t memoryTypeBits = posVelMemRequirements.memoryTypeBits & massMemRequirements.memoryTypeBits & idMemRequirements.memoryTypeBits;
+		VkMemoryPropertyFlags mappedPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		uint32_t memTypeIndex = device->GetMemoryTypeIndex(mappedPropertyFlags | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, memoryTypeBits);
+		if(memTypeIndex == UINT32_MAX)
+			memTypeIndex = device->GetMemoryTypeIndex(mappedPropertyFlags, memoryTypeBits);
+		
+		// Skip mappable heaps without room for the buffers in their budget, like the 256 MB window of discrete GPUs without resizable BAR
+		VulkanMemoryAllocator* memoryAllocator = device->GetMemoryAllocator();
+		if(memTypeIndex != UINT32_MAX && !memoryAllocator->CheckBudget(memTypeIndex, totalSize))
+			memTypeIndex = UINT32_MAX;
+
+		// Set the memory requirements of all buffers together
+		VkMemoryRequirements memRequirements {
+			.size = totalSize,
+			.alignment = maxAlignment,
+			.memoryTypeBits = memoryTypeBits
 		};
 
-		// Allocare the buffers' memory
-		result = vkAllocateMemory(device->GetDevice(), &allocInfo, nullptr, &bufferMemory);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle buffer memory! Error code: %s", string_VkResult(result));
+		// Allocate the buffers' memory from the mappable memory type, if one was found
+		result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		if(memTypeIndex != UINT32_MAX)
+			result = memoryAllocator->Allocate(memRequirements, memTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_PARTICLES, bufferAllocation);
+		
+		// Fall back to any device-local memory if the mappable memory is missing or full
+		if(result != VK_SUCCESS) {
+			memTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memoryTypeBits);
+			if(memTypeIndex == UINT32_MAX)
+				GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan particle buffer!");
+			
+			result = memoryAllocator->Allocate(memRequirements, memTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_PARTICLES, bufferAllocation);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle buffer memory! Error code: %s", string_VkResult(result));
+		}
 		
-		// Bind the buffers to their memory
-		for(uint32_t i = 0; i != 3; ++i) {
+		// Bind the buffers to their memory, placing the shared mass and ID buffers after all sets
+		VkDeviceSize sharedOffset = bufferAllocation.offset + alignedSize * bufferSetCount;
+		for(uint32_t i = 0; i != bufferSetCount; ++i) {
 			// Bind the position buffer
-			result = vkBindBufferMemory(device->GetDevice(), buffers[i].posBuffer, bufferMemory, i * alignedSize);
+			VkDeviceSize offset = bufferAllocation.offset + i * alignedSize;
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i].posBuffer, bufferAllocation.memory, offset);
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle buffers to their memory! Error code: %s", string_VkResult(result));
 			
 			// Bind the velocity buffer
-			result = vkBindBufferMemory(device->GetDevice(), buffers[i].velBuffer, bufferMemory, i * alignedSize + alignedPosVelSize);
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i].velBuffer, bufferAllocation.memory, offset + alignedPosVelSize);
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle buffers to their memory! Error code: %s", string_VkResult(result));
 			
+			// Skip the shared mass and ID buffers, which are bound with the first set
+			if(massShared && i)
+				continue;
+			
 			// Bind the mass buffer
-			result = vkBindBufferMemory(device->GetDevice(), buffers[i].massBuffer, bufferMemory, i * alignedSize + (alignedPosVelSize << 1));
+			VkDeviceSize massOffset = massShared ? sharedOffset : offset + (alignedPosVelSize << 1);
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i].massBuffer, bufferAllocation.memory, massOffset);
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle buffers to their memory! Error code: %s", string_VkResult(result));
+			
+			// Bind the ID buffer
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i].idBuffer, bufferAllocation.memory, massOffset + alignedMassSize);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle buffers to their memory! Error code: %s", string_VkResult(result));
+		}
+
+		// Write the particles straight into every particle buffer if their memory is mappable, keeping it mapped for reading them back
+		VkMemoryPropertyFlags memoryPropertyFlags = memoryProperties.memoryTypes[memTypeIndex].propertyFlags;
+		if((memoryPropertyFlags & mappedPropertyFlags) == mappedPropertyFlags) {
+			// Get the buffers' memory, which the allocator keeps mapped
+			void* bufferData = bufferAllocation.mappedData;
+			bufferMemoryMapped = true;
+			bufferMemoryCached = memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+			for(uint32_t i = 0; i != bufferSetCount; ++i) {
+				// Get the buffers' mapped components, at their bound offsets
+				uint8_t* buffersData = (uint8_t*)bufferData + i * alignedSize;
+				uint8_t* massData = massShared ? (uint8_t*)bufferData + alignedSize * bufferSetCount : buffersData + (alignedPosVelSize << 1);
+				mappedBuffers[i].pos = (Vec2*)buffersData;
+				mappedBuffers[i].vel = (Vec2*)(buffersData + alignedPosVelSize);
+				mappedBuffers[i].mass = (float*)massData;
+				mappedBuffers[i].id = (uint32_t*)(massData + alignedMassSize);
+
+				// Write the particle infos, only ever writing to the mapped memory, as it may be uncached
+				CopyParticles(source, 0, alignedParticleCount, mappedBuffers[i].pos, mappedBuffers[i].vel, mappedBuffers[i].mass);
+				for(size_t j = 0; j != alignedParticleCount; ++j)
+					mappedBuffers[i].id[j] = (j < particleCount) ? (uint32_t)j : UINT32_MAX;
+			}
+
+			return;
 		}
 
+		// Get the upload's chunks, streaming large systems through a small ring of staging slots to bound the host memory used
+		size_t chunkParticleCount = (alignedParticleCount < UPLOAD_CHUNK_SIZE) ? alignedParticleCount : UPLOAD_CHUNK_SIZE;
+		size_t chunkCount = (alignedParticleCount + chunkParticleCount - 1) / chunkParticleCount;
+		uint32_t slotCount = (chunkCount < UPLOAD_SLOT_COUNT) ? (uint32_t)chunkCount : UPLOAD_SLOT_COUNT;
+		VkDeviceSize slotSize = chunkParticleCount * ((sizeof(Vec2) << 1) + sizeof(float) + sizeof(uint32_t));
+
+		// Set the staging buffer create info
+		uint32_t transferIndex = device->GetQueueFamilyIndices().transferIndex;
+
+		VkBufferCreateInfo stagingBufferInfo {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.size = slotSize * slotCount,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 1,
+			.pQueueFamilyIndices = &transferIndex
+		};
+
+		// Create the staging buffer
+		VkBuffer stagingBuffer;
+		result = vkCreateBuffer(device->GetDevice(), &stagingBufferInfo, nullptr, &stagingBuffer);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan particle staging buffer! Error code: %s", string_VkResult(result));
+
+		// Get the staging buffer's memory requirements
+		VkMemoryRequirements stagingMemRequirements;
+		vkGetBufferMemoryRequirements(device->GetDevice(), stagingBuffer, &stagingMemRequirements);
+
+		// Get the staging buffer's memory type index
+		uint32_t stagingMemTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingMemRequirements.memoryTypeBits);
+		if(stagingMemTypeIndex == UINT32_MAX)
+			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan particle staging buffer!");
+		
+		// Allocate the staging buffer's memory, aliasing the transient scratch memory
+		VulkanMemoryAllocator::Allocation stagingAllocation;
+		result = device->GetMemoryAllocator()->AllocateScratch(stagingMemRequirements, stagingMemTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_STAGING, stagingAllocation);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle staging buffer memory! Error code: %s", string_VkResult(result));
+		
+		// Bind the staging buffer to its memory
+		result = vkBindBufferMemory(device->GetDevice(), stagingBuffer, stagingAllocation.memory, stagingAllocation.offset);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle staging buffer to its memory! Error code: %s", string_VkResult(result));
+		
+		// Get the staging buffer's memory, which the allocator keeps mapped
+		void* stagingData = stagingAllocation.mappedData;
+
 		// Set the transfer command buffer alloc info
 		VkCommandBufferAllocateInfo commandBufferAllocInfo {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 			.pNext = nullptr,
 			.commandPool = device->GetTransferCommandPool(),
 			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1
+			.commandBufferCount = slotCount
 		};
 
-		// Allocate the transfer command buffer
-		VkCommandBuffer commandBuffer;
-		result = vkAllocateCommandBuffers(device->GetDevice(), &commandBufferAllocInfo, &commandBuffer);
+		// Allocate one transfer command buffer per staging slot
+		VkCommandBuffer commandBuffers[UPLOAD_SLOT_COUNT];
+		result = vkAllocateCommandBuffers(device->GetDevice(), &commandBufferAllocInfo, commandBuffers);
 		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle transfer command buffers! Error code: %s", string_VkResult(result));
 		
+		// Set the transfer fence create info
+		VkFenceCreateInfo transferFenceInfo {
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0
+		};
+
+		// Create one transfer fence per staging slot
+		VkFence transferFences[UPLOAD_SLOT_COUNT];
+		for(uint32_t i = 0; i != slotCount; ++i) {
+			result = vkCreateFence(device->GetDevice(), &transferFenceInfo, nullptr, transferFences + i);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to create Vulkan particle transfer fence! Error code: %s", string_VkResult(result));
+		}
+
 		// Set the command buffer begin info
 		VkCommandBufferBeginInfo commandBufferBeginInfo {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 			.pNext = nullptr,
-			.flags = 0,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 			.pInheritanceInfo = nullptr
 		};
 
-		// Begin recording the command buffer
-		result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
-		
-		// Set the copy regions for all particle components
-		VkBufferCopy posCopyRegion {
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = alignedParticleCount * sizeof(Vec2)
-		};
-		VkBufferCopy velCopyRegion {
-			.srcOffset = alignedParticleCount * sizeof(Vec2),
-			.dstOffset = 0,
-			.size = alignedParticleCount * sizeof(Vec2)
-		};
-		VkBufferCopy massCopyRegion {
-			.srcOffset = alignedParticleCount * (sizeof(Vec2) << 1),
-			.dstOffset = 0,
-			.size = alignedParticleCount * sizeof(float)
-		};
+		// Upload every chunk, filling the next slot while the previous ones are transferred
+		for(size_t chunk = 0; chunk != chunkCount; ++chunk) {
+			// Wait for the slot's previous transfer before overwriting its staging memory
+			uint32_t slot = (uint32_t)(chunk % slotCount);
+			if(chunk >= slotCount) {
+				result = vkWaitForFences(device->GetDevice(), 1, transferFences + slot, VK_TRUE, UINT64_MAX);
+				if(result != VK_SUCCESS)
+					GSIM_THROW_EXCEPTION("Failed to wait for Vulkan particle transfer command completion! Error code: %s", string_VkResult(result));
+				
+				result = vkResetFences(device->GetDevice(), 1, transferFences + slot);
+				if(result != VK_SUCCESS)
+					GSIM_THROW_EXCEPTION("Failed to reset Vulkan particle transfer fence! Error code: %s", string_VkResult(result));
+			}
 
-		// Transfer all particles from the staging buffer to all particle buffers
-		for(uint32_t i = 0; i != 3; ++i) {
-			vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].posBuffer, 1, &posCopyRegion);
-			vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].velBuffer, 1, &velCopyRegion);
-			vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].massBuffer, 1, &massCopyRegion);
-		}
-		
-		// End recording the command buffer
-		vkEndCommandBuffer(commandBuffer);
+			// Get the chunk's particle range
+			size_t begin = chunk * chunkParticleCount;
+			size_t end = (alignedParticleCount - begin < chunkParticleCount) ? alignedParticleCount : begin + chunkParticleCount;
+			size_t count = end - begin;
 
-		// Set the transfer fence create info
-		VkFenceCreateInfo transferFenceInfo {
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = 0
-		};
+			// Copy the chunk's particle infos to the slot
+			VkDeviceSize slotOffset = slot * slotSize;
+			Vec2* stagingPos = (Vec2*)((uint8_t*)stagingData + slotOffset);
+			Vec2* stagingVel = stagingPos + chunkParticleCount;
+			float* stagingMass = (float*)(stagingVel + chunkParticleCount);
+			uint32_t* stagingId = (uint32_t*)(stagingMass + chunkParticleCount);
 
-		// Create the transfer fence
-		VkFence transferFence;
-		result = vkCreateFence(device->GetDevice(), &transferFenceInfo, nullptr, &transferFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to create Vulkan particle transfer fence! Error code: %s", string_VkResult(result));
-		
-		// Set the submit info
-		VkSubmitInfo submitInfo {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = nullptr,
-			.waitSemaphoreCount = 0,
-			.pWaitSemaphores = nullptr,
-			.pWaitDstStageMask = nullptr,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &commandBuffer,
-			.signalSemaphoreCount = 0,
-			.pSignalSemaphores = nullptr
-		};
+			CopyParticles(source, begin, end, stagingPos, stagingVel, stagingMass);
 
-		// Submit the command buffer
-		result = vkQueueSubmit(device->GetTransferQueue(), 1, &submitInfo, transferFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to submit the Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
+			for(size_t i = begin; i != end; ++i)
+				stagingId[i - begin] = (i < particleCount) ? (uint32_t)i : UINT32_MAX;
+
+			// Begin recording the slot's command buffer
+			VkCommandBuffer commandBuffer = commandBuffers[slot];
+			result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
+			
+			// Set the copy regions for all of the chunk's particle components
+			VkBufferCopy posCopyRegion {
+				.srcOffset = slotOffset,
+				.dstOffset = begin * sizeof(Vec2),
+				.size = count * sizeof(Vec2)
+			};
+			VkBufferCopy velCopyRegion {
+				.srcOffset = slotOffset + chunkParticleCount * sizeof(Vec2),
+				.dstOffset = begin * sizeof(Vec2),
+				.size = count * sizeof(Vec2)
+			};
+			VkBufferCopy massCopyRegion {
+				.srcOffset = slotOffset + chunkParticleCount * (sizeof(Vec2) << 1),
+				.dstOffset = begin * sizeof(float),
+				.size = count * sizeof(float)
+			};
+			VkBufferCopy idCopyRegion {
+				.srcOffset = slotOffset + chunkParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)),
+				.dstOffset = begin * sizeof(uint32_t),
+				.size = count * sizeof(uint32_t)
+			};
+
+			// Transfer the chunk from the slot to all particle buffers, writing the shared mass and ID buffers only once
+			for(uint32_t i = 0; i != bufferSetCount; ++i) {
+				vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].posBuffer, 1, &posCopyRegion);
+				vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].velBuffer, 1, &velCopyRegion);
+				if(massShared && i)
+					continue;
+				
+				vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].massBuffer, 1, &massCopyRegion);
+				vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers[i].idBuffer, 1, &idCopyRegion);
+			}
+			
+			// End recording the command buffer
+			result = vkEndCommandBuffer(commandBuffer);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to end recording Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
+
+			// Set the submit info
+			VkSubmitInfo submitInfo {
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = nullptr,
+				.waitSemaphoreCount = 0,
+				.pWaitSemaphores = nullptr,
+				.pWaitDstStageMask = nullptr,
+				.commandBufferCount = 1,
+				.pCommandBuffers = &commandBuffer,
+				.signalSemaphoreCount = 0,
+				.pSignalSemaphores = nullptr
+			};
+
+			// Submit the command buffer, without waiting for it to finish
+			result = vkQueueSubmit(device->GetTransferQueue(), 1, &submitInfo, transferFences[slot]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to submit the Vulkan particle transfer command buffer! Error code: %s", string_VkResult(result));
+		}
 		
-		// Wait for the command buffer to finish execution
-		result = vkWaitForFences(device->GetDevice(), 1, &transferFence, VK_TRUE, UINT64_MAX);
+		// Wait for the transfers still in flight to finish
+		result = vkWaitForFences(device->GetDevice(), slotCount, transferFences, VK_TRUE, UINT64_MAX);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to wait for Vulkan particle transfer command completion! Error code: %s", string_VkResult(result));
 		
 		// Destroy all objects used for the transfer operation
-		vkFreeCommandBuffers(device->GetDevice(), device->GetTransferCommandPool(), 1, &commandBuffer);
-		vkFreeMemory(device->GetDevice(), stagingMemory, nullptr);
-		vkDestroyFence(device->GetDevice(), transferFence, nullptr);
+		vkFreeCommandBuffers(device->GetDevice(), device->GetTransferCommandPool(), slotCount, commandBuffers);
+		for(uint32_t i = 0; i != slotCount; ++i)
+			vkDestroyFence(device->GetDevice(), transferFences[i], nullptr);
 		vkDestroyBuffer(device->GetDevice(), stagingBuffer, nullptr);
+		device->GetMemoryAllocator()->Free(stagingAllocation);
+	}
+	void ParticleSystem::CreateArrays(const ParticleSource& source) {
+		// Allocate all host arrays in a single block
+		void* arrayData = malloc(alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)));
+		if(!arrayData)
+			GSIM_THROW_EXCEPTION("Failed to allocate particle arrays!");
+		
+		arrays.pos = (Vec2*)arrayData;
+		arrays.vel = arrays.pos + alignedParticleCount;
+		arrays.mass = (float*)(arrays.vel + alignedParticleCount);
+
+		// Copy the particle infos to the arrays
+		CopyParticles(source, 0, alignedParticleCount, arrays.pos, arrays.vel, arrays.mass);
 	}
-	void ParticleSystem::GetCameraInfo(const Particle* particles) {
+	void ParticleSystem::GetCameraInfo(const ParticleSource& source) {
 		Vec2 minCoords { INFINITY, INFINITY };
 		Vec2 maxCoords { -INFINITY, -INFINITY };
 
 		for(uint32_t i = 0; i != particleCount; ++i) {
-			Vec2 pos = particles[i].pos;
+			Vec2 pos = source.particles ? source.particles[i].pos : source.pos[i];
 
 			if(pos.x < minCoords.x)
 				minCoords.x = pos.x;
@@ -433,76 +993,117 @@ namespace gsim {
 			cameraStartSize = height;
 		}
 	}
+	void ParticleSystem::SaveText(FILE* fileOutput, const Particle* particles) {
+		// Allocate one buffer for every chunk formatted at the same time, two per thread
+		ThreadPool threadPool(0);
+		size_t chunkCount = (particleCount + TEXT_WRITE_CHUNK_SIZE - 1) / TEXT_WRITE_CHUNK_SIZE;
+		size_t roundChunkCount = (size_t)threadPool.GetThreadCount() << 1;
+		if(roundChunkCount > chunkCount)
+			roundChunkCount = chunkCount;
+
+		size_t bufferSize = TEXT_WRITE_CHUNK_SIZE * MAX_PARTICLE_TEXT_LEN;
+		char* bufferData = (char*)malloc(roundChunkCount * (bufferSize + sizeof(char*) + sizeof(size_t)));
+		if(!bufferData)
+			GSIM_THROW_EXCEPTION("Failed to allocate particle text buffers!");
+		
+		char** buffers = (char**)bufferData;
+		size_t* bufferSizes = (size_t*)(buffers + roundChunkCount);
+		for(size_t i = 0; i != roundChunkCount; ++i)
+			buffers[i] = (char*)(bufferSizes + roundChunkCount) + i * bufferSize;
+		
+		TextWrite write {
+			.particles = particles,
+			.particleCount = particleCount,
+			.firstChunk = 0,
+			.buffers = buffers,
+			.bufferSizes = bufferSizes
+		};
 
-	// Public functions
-	ParticleSystem::ParticleSystem(VulkanDevice* device, const char* filePath, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm) : device(device), particleCount(0), gravitationalConst(gravitationalConst), simulationTime(simulationTime), simulationSpeed(simulationSpeed), accuracyParameter(accuracyParameter), softeningLen(softeningLen) {
-		// Get the particle count alignment
-		size_t particleCountAlignment;
-		if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
-			particleCountAlignment = DirectSimulation::GetRequiredParticleAlignment();
-		} else if(simulationAlgorithm == SIMULATION_ALGORITHM_BARNES_HUT) {
-			particleCountAlignment = BarnesHutSimulation::GetRequiredParticleAlignment();
-		} else {
-			GSIM_THROW_EXCEPTION("Invalid simulation algorithm requested!");
+		// Format the chunks in parallel rounds, writing every round's buffers in order once it is done
+		bool written = true;
+		for(size_t i = 0; written && i < chunkCount; i += roundChunkCount) {
+			size_t currentChunkCount = (chunkCount - i < roundChunkCount) ? chunkCount - i : roundChunkCount;
+			write.firstChunk = i;
+			threadPool.ParallelFor(currentChunkCount, 1, FormatTextChunk, &write);
+
+			for(size_t j = 0; written && j != currentChunkCount; ++j)
+				written = fwrite(buffers[j], 1, bufferSizes[j], fileOutput) == bufferSizes[j];
 		}
 
-		// Open the given file
-		FILE* fileInput = fopen(filePath, "r");
-		if(!fileInput)
-			GSIM_THROW_EXCEPTION("Failed to open particle input file!");
-		
-		// Allocate a dynamic particle array
-		size_t particleCapacity = particleCountAlignment;
-		Particle* particles = (Particle*)malloc(sizeof(Particle) * particleCapacity);
-		if(!particles)
-			GSIM_THROW_EXCEPTION("Failed to allocate particle array!");
+		// Free the buffers
+		free(bufferData);
+
+		if(!written)
+			GSIM_THROW_EXCEPTION("Failed to write particle output file!");
+	}
+	void ParticleSystem::SaveSnapshot(FILE* fileOutput, const Particle* particles, SnapshotCodec::Codec snapshotCodec, float snapshotPrecision, const void* headerExtension, uint32_t headerExtensionSize) {
+		// Allocate the component arrays
+		void* componentData = malloc(particleCount * ((sizeof(Vec2) << 1) + sizeof(float)));
+		if(!componentData)
+			GSIM_THROW_EXCEPTION("Failed to allocate particle snapshot arrays!");
 		
-		// Load particles from the given file until none are left
-		Particle particle;
-		while(fscanf(fileInput, "%f%f%f%f%f", &particle.pos.x, &particle.pos.y, &particle.vel.x, &particle.vel.y, &particle.mass) == 5) {
-			// Check if there is room in the array for the new particle
-			++particleCount;
-			if(particleCount > particleCapacity) {
-				// Double the array's capacity
-				particleCapacity <<= 1;
-
-				// Reallocate the array
-				particles = (Particle*)realloc(particles, particleCapacity * sizeof(Particle));
-				if(!particles)
-					GSIM_THROW_EXCEPTION("Failed to reallocate particle array!");
-			}
+		Vec2* pos = (Vec2*)componentData;
+		Vec2* vel = pos + particleCount;
+		float* mass = (float*)(vel + particleCount);
 
-			// Add the new particle to the array
-			particles[particleCount - 1] = particle;
+		// Split the particles into their components
+		for(size_t i = 0; i != particleCount; ++i) {
+			pos[i] = particles[i].pos;
+			vel[i] = particles[i].vel;
+			mass[i] = particles[i].mass;
 		}
 
-		// Close the file
-		fclose(fileInput);
+		// Encode and write the snapshot on all hardware threads
+		ThreadPool threadPool(0);
+		SnapshotCodec codec(snapshotCodec, snapshotPrecision, &threadPool);
+		bool written = codec.WriteSnapshot(fileOutput, particleCount, pos, vel, mass, headerExtension, headerExtensionSize);
 
-		// Throw an exception if no particle was read from the file
-		if(!particleCount)
-			GSIM_THROW_EXCEPTION("The particle input file must contain at least one valid particle!");
-		
-		// Set the aligned particle count
-		alignedParticleCount = (particleCount + particleCountAlignment - 1) & ~(particleCountAlignment - 1);
+		// Free the component arrays
+		free(componentData);
 
-		// Fill the remaining particle infos
-		for(size_t i = particleCount; i != alignedParticleCount; ++i)
-			particles[i] = { 0, 0, 0, 0, 0 };
+		if(!written)
+			GSIM_THROW_EXCEPTION("Failed to write particle snapshot!");
+	}
 
-		// Create the Vulkan objects
-		CreateVulkanObjects(particles);
+	// Public functions
+	ParticleSystem::ParticleSystem(VulkanDevice* device, const char* filePath, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm, SimulationBackend simulationBackend, uint32_t bufferSetCount, bool massShared) : device(device), particleCount(0), gravitationalConst(gravitationalConst), simulationTime(simulationTime), simulationSpeed(simulationSpeed), accuracyParameter(accuracyParameter), softeningLen(softeningLen), simulationBackend(simulationBackend), bufferSetCount(bufferSetCount), massShared(massShared) {
+		// Get the particle count alignment
+		size_t particleCountAlignment;
+		if(simulationBackend == SIMULATION_BACKEND_CPU) {
+			if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
+				particleCountAlignment = CpuDirectSimulation::GetRequiredParticleAlignment();
+			} else if(simulationAlgorithm == SIMULATION_ALGORITHM_BARNES_HUT) {
+				particleCountAlignment = CpuBarnesHutSimulation::GetRequiredParticleAlignment();
+			} else {
+				GSIM_THROW_EXCEPTION("Invalid simulation algorithm requested for the CPU backend!");
+			}
+		} else if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
+			particleCountAlignment = DirectSimulation::GetRequiredParticleAlignment();
+		} else if(simulationAlgorithm == SIMULATION_ALGORITHM_BARNES_HUT) {
+			particleCountAlignment = BarnesHutSimulation::GetRequiredParticleAlignment();
+		} else {
+			GSIM_THROW_EXCEPTION("Invalid simulation algorithm requested!");
+		}
 
-		// Get the camera's starting info
-		GetCameraInfo(particles);
+		// Map the given file
+		MappedFile file(filePath);
 
-		// Free the particles array
-		free(particles);
+		// Load the file as a binary snapshot, falling back to the text format
+		if(!LoadSnapshot(file, particleCountAlignment))
+			LoadText(file, particleCountAlignment);
 	}
-	ParticleSystem::ParticleSystem(VulkanDevice* device, size_t particleCount, GenerateType generateType, float generateSize, float minMass, float maxMass, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm) : device(device), particleCount(particleCount), gravitationalConst(gravitationalConst), simulationTime(simulationTime), simulationSpeed(simulationSpeed), accuracyParameter(accuracyParameter), softeningLen(softeningLen) {
+	ParticleSystem::ParticleSystem(VulkanDevice* device, size_t particleCount, GenerateType generateType, float generateSize, float minMass, float maxMass, uint32_t seed, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm, SimulationBackend simulationBackend, uint32_t bufferSetCount, bool massShared) : device(device), particleCount(particleCount), gravitationalConst(gravitationalConst), simulationTime(simulationTime), simulationSpeed(simulationSpeed), accuracyParameter(accuracyParameter), softeningLen(softeningLen), simulationBackend(simulationBackend), bufferSetCount(bufferSetCount), massShared(massShared) {
 		// Get the particle count alignment
 		size_t particleCountAlignment;
-		if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
+		if(simulationBackend == SIMULATION_BACKEND_CPU) {
+			if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
+				particleCountAlignment = CpuDirectSimulation::GetRequiredParticleAlignment();
+			} else if(simulationAlgorithm == SIMULATION_ALGORITHM_BARNES_HUT) {
+				particleCountAlignment = CpuBarnesHutSimulation::GetRequiredParticleAlignment();
+			} else {
+				GSIM_THROW_EXCEPTION("Invalid simulation algorithm requested for the CPU backend!");
+			}
+		} else if(simulationAlgorithm == SIMULATION_ALGORITHM_DIRECT_SUM) {
 			particleCountAlignment = DirectSimulation::GetRequiredParticleAlignment();
 		} else if(simulationAlgorithm == SIMULATION_ALGORITHM_BARNES_HUT) {
 			particleCountAlignment = BarnesHutSimulation::GetRequiredParticleAlignment();
@@ -524,41 +1125,68 @@ namespace gsim {
 		alignedParticleCount = (particleCount + particleCountAlignment - 1) & ~(particleCountAlignment - 1);
 
 		// Allocate the particle array
-		Particle* particles = (Particle*)malloc(alignedParticleCount * sizeof(Particle));
+		Particle* particles = (Particle*)malloc(particleCount * sizeof(Particle));
 		if(!particles)
 			GSIM_THROW_EXCEPTION("Failed to allocate particle array!");
 		
 		// Generate the particles based on the generate type
 		switch(generateType) {
 		case GENERATE_TYPE_RANDOM:
-			GenerateParticlesRandom(particles, generateSize, minMass, maxMass);
+			GenerateParticlesRandom(particles, generateSize, minMass, maxMass, seed);
 			break;
 		case GENERATE_TYPE_GALAXY:
-			GenerateParticlesGalaxy(particles, generateSize, minMass, maxMass);
+			GenerateParticlesGalaxy(particles, generateSize, minMass, maxMass, seed);
 			break;
 		case GENERATE_TYPE_GALAXY_COLLISION:
-			GenerateParticlesGalaxyCollision(particles, generateSize, minMass, maxMass);
+			GenerateParticlesGalaxyCollision(particles, generateSize, minMass, maxMass, seed);
 			break;
 		case GENERATE_TYPE_SYMMETRICAL_GALAXY_COLLISION:
-			GenerateParticlesSymmetricalGalaxyCollision(particles, generateSize, minMass, maxMass);
+			GenerateParticlesSymmetricalGalaxyCollision(particles, generateSize, minMass, maxMass, seed);
 			break;
 		}
 
-		// Fill the remaining particle infos
-		for(size_t i = particleCount; i != alignedParticleCount; ++i)
-			particles[i] = { 0, 0, 0, 0, 0 };
-
-		// Create the Vulkan objects
-		CreateVulkanObjects(particles);
-
-		// Get the camera's starting info
-		GetCameraInfo(particles);
+		// Create the particle storage
+		ParticleSource source {
+			.particles = particles,
+			.pos = nullptr,
+			.vel = nullptr,
+			.mass = nullptr
+		};
+		CreateParticleStorage(source);
 
 		// Free the particles array
 		free(particles);
 	}
 	
 	void ParticleSystem::GetParticles(Particle* particles) {
+		// Copy the particle infos straight from the host arrays for the CPU backend
+		if(simulationBackend == SIMULATION_BACKEND_CPU) {
+			for(size_t i = 0; i != particleCount; ++i) {
+				particles[i].pos = arrays.pos[i];
+				particles[i].vel = arrays.vel[i];
+				particles[i].mass = arrays.mass[i];
+			}
+
+			return;
+		}
+
+		// Read the particle infos straight from the particle buffers if their memory is mapped and cached; reading uncached memory is slower than a staging copy
+		if(bufferMemoryMapped && bufferMemoryCached) {
+			const MappedBuffers& mapped = mappedBuffers[computeInputIndex];
+			for(size_t i = 0; i != alignedParticleCount; ++i) {
+				// Skip the particles used only for alignment
+				uint32_t id = mapped.id[i];
+				if(id >= particleCount)
+					continue;
+
+				particles[id].pos = mapped.pos[i];
+				particles[id].vel = mapped.vel[i];
+				particles[id].mass = mapped.mass[i];
+			}
+
+			return;
+		}
+
 		// Set the staging buffer create info
 		uint32_t transferIndex = device->GetQueueFamilyIndices().transferIndex;
 
@@ -566,7 +1194,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.size = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)),
+			.size = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float) + sizeof(uint32_t)),
 			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 			.queueFamilyIndexCount = 1,
@@ -588,22 +1216,14 @@ namespace gsim {
 		if(stagingMemTypeIndex == UINT32_MAX)
 			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan particle staging buffer!");
 		
-		// Set the memory alloc info
-		VkMemoryAllocateInfo stagingAllocInfo {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.allocationSize = stagingMemRequirements.size,
-			.memoryTypeIndex = stagingMemTypeIndex
-		};
-
-		// Allocate the staging buffer's memory
-		VkDeviceMemory stagingMemory;
-		result = vkAllocateMemory(device->GetDevice(), &stagingAllocInfo, nullptr, &stagingMemory);
+		// Allocate the staging buffer's memory, aliasing the transient scratch memory
+		VulkanMemoryAllocator::Allocation stagingAllocation;
+		result = device->GetMemoryAllocator()->AllocateScratch(stagingMemRequirements, stagingMemTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_STAGING, stagingAllocation);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle staging buffer memory! Error code: %s", string_VkResult(result));
 		
 		// Bind the staging buffer to its memory
-		result = vkBindBufferMemory(device->GetDevice(), stagingBuffer, stagingMemory, 0);
+		result = vkBindBufferMemory(device->GetDevice(), stagingBuffer, stagingAllocation.memory, stagingAllocation.offset);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to bind Vulkan particle staging buffer to its memory! Error code: %s", string_VkResult(result));
 		
@@ -651,11 +1271,17 @@ namespace gsim {
 			.dstOffset = alignedParticleCount * (sizeof(Vec2) << 1),
 			.size = alignedParticleCount * sizeof(float)
 		};
+		VkBufferCopy idCopyRegion {
+			.srcOffset = 0,
+			.dstOffset = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)),
+			.size = alignedParticleCount * sizeof(uint32_t)
+		};
 
 		// Transfer the latest particle infos to the staging buffer
 		vkCmdCopyBuffer(commandBuffer, buffers[computeInputIndex].posBuffer, stagingBuffer, 1, &posCopyRegion);
 		vkCmdCopyBuffer(commandBuffer, buffers[computeInputIndex].velBuffer, stagingBuffer, 1, &velCopyRegion);
 		vkCmdCopyBuffer(commandBuffer, buffers[computeInputIndex].massBuffer, stagingBuffer, 1, &massCopyRegion);
+		vkCmdCopyBuffer(commandBuffer, buffers[computeInputIndex].idBuffer, stagingBuffer, 1, &idCopyRegion);
 		
 		// End recording the command buffer
 		vkEndCommandBuffer(commandBuffer);
@@ -700,47 +1326,59 @@ namespace gsim {
 		vkFreeCommandBuffers(device->GetDevice(), device->GetTransferCommandPool(), 1, &commandBuffer);
 		vkDestroyFence(device->GetDevice(), transferFence, nullptr);
 
-		// Map the staging buffer's memory
-		void* stagingData;
-		result = vkMapMemory(device->GetDevice(), stagingMemory, 0, VK_WHOLE_SIZE, 0, &stagingData);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to map Vulkan particle staging buffer memory! Error code: %s", string_VkResult(result));
-
-		// Copy the staging buffer's data to the given particle array
-		Vec2* vec2Iter = (Vec2*)stagingData;
-		for(size_t i = 0; i != particleCount; ++i)
-			particles[i].pos = vec2Iter[i];
-		vec2Iter += alignedParticleCount;
-		for(size_t i = 0; i != particleCount; ++i)
-			particles[i].vel = vec2Iter[i];
-		float* floatIter = (float*)(vec2Iter + alignedParticleCount);
-		for(size_t i = 0; i != particleCount; ++i)
-			particles[i].mass = floatIter[i];
-
-		// Unmap the staging buffer's memory
-		vkUnmapMemory(device->GetDevice(), stagingMemory);
-
-		// Destroy the staging buffer
-		vkFreeMemory(device->GetDevice(), stagingMemory, nullptr);
+		// Get the staging buffer's memory, which the allocator keeps mapped
+		void* stagingData = stagingAllocation.mappedData;
+
+		// Copy the staging buffer's data to the given particle array, moving every particle back to its original index
+		Vec2* posIter = (Vec2*)stagingData;
+		Vec2* velIter = posIter + alignedParticleCount;
+		float* massIter = (float*)(velIter + alignedParticleCount);
+		uint32_t* idIter = (uint32_t*)(massIter + alignedParticleCount);
+
+		for(size_t i = 0; i != alignedParticleCount; ++i) {
+			// Skip the particles used only for alignment
+			uint32_t id = idIter[i];
+			if(id >= particleCount)
+				continue;
+
+			particles[id].pos = posIter[i];
+			particles[id].vel = velIter[i];
+			particles[id].mass = massIter[i];
+		}
+
+		// Destroy the staging buffer and release its memory
 		vkDestroyBuffer(device->GetDevice(), stagingBuffer, nullptr);
+		device->GetMemoryAllocator()->Free(stagingAllocation);
 	}
-	void ParticleSystem::SaveParticles(const char* filePath) {
-		// Open the file stream
-		FILE* fileOutput = fopen(filePath, "w");
-		if(!fileOutput)
-			GSIM_THROW_EXCEPTION("Failed to open particle output file!");
-
+	void ParticleSystem::SaveParticles(const char* filePath, FileFormat fileFormat, SnapshotCodec::Codec snapshotCodec, float snapshotPrecision) {
 		// Allocate the particle array
 		Particle* particles = (Particle*)malloc(particleCount * sizeof(Particle));
 		if(!particles)
 			GSIM_THROW_EXCEPTION("Failed to allocate particle array!");
-		
-		// Get all particles
-		GetParticles(particles);
 
-		// Save the particles to the file stream
-		for(size_t i = 0; i != particleCount; ++i)
-			fprintf(fileOutput, "%.7f %.7f %.7f %.7f %.7f\n", particles[i].pos.x, particles[i].pos.y, particles[i].vel.x, particles[i].vel.y, particles[i].mass);
+		// Open the file stream
+		FILE* fileOutput = fopen(filePath, (fileFormat == FILE_FORMAT_BINARY) ? "wb" : "w");
+		if(!fileOutput) {
+			free(particles);
+			GSIM_THROW_EXCEPTION("Failed to open particle output file!");
+		}
+
+		try {
+			// Get all particles
+			GetParticles(particles);
+
+			// Save the particles to the file stream in the given format
+			if(fileFormat == FILE_FORMAT_BINARY) {
+				SaveSnapshot(fileOutput, particles, snapshotCodec, snapshotPrecision, nullptr, 0);
+			} else {
+				SaveText(fileOutput, particles);
+			}
+		} catch(...) {
+			// Close the file stream and free the particle array before passing the exception on
+			fclose(fileOutput);
+			free(particles);
+			throw;
+		}
 		
 		// Close the file stream
 		fclose(fileOutput);
@@ -749,13 +1387,71 @@ namespace gsim {
 		free(particles);
 	}
 
+	void ParticleSystem::SaveCheckpoint(const char* filePath, CheckpointInfo checkpointInfo) {
+		// Fill in the checkpoint info's format and the current buffer rotation
+		memcpy(checkpointInfo.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		checkpointInfo.version = CHECKPOINT_VERSION;
+		checkpointInfo.size = sizeof(CheckpointInfo);
+		checkpointInfo.graphicsIndex = (uint32_t)graphicsIndex;
+		checkpointInfo.computeInputIndex = (uint32_t)computeInputIndex;
+		checkpointInfo.computeOutputIndex = (uint32_t)computeOutputIndex;
+
+		// Allocate the particle array
+		Particle* particles = (Particle*)malloc(particleCount * sizeof(Particle));
+		if(!particles)
+			GSIM_THROW_EXCEPTION("Failed to allocate particle array!");
+		
+		try {
+			// Get all particles
+			GetParticles(particles);
+
+			// Write the particles uncompressed to a temporary file, keeping them bit-exact and loadable straight into the simulation's buffers
+			AtomicFile file(filePath);
+			SaveSnapshot(file.GetFile(), particles, SnapshotCodec::CODEC_RAW, 0.0f, &checkpointInfo, sizeof(CheckpointInfo));
+
+			// Replace the previous checkpoint
+			file.Commit();
+		} catch(...) {
+			// Free the particle array before passing the exception on, as the temporary file removes itself
+			free(particles);
+			throw;
+		}
+
+		// Free the particle array
+		free(particles);
+	}
+	bool ParticleSystem::LoadCheckpointInfo(const char* filePath, CheckpointInfo& checkpointInfo) {
+		// Open the file stream
+		FILE* fileInput = fopen(filePath, "rb");
+		if(!fileInput)
+			return false;
+		
+		// Read the snapshot header and the checkpoint info right after it
+		SnapshotHeader header;
+		bool read = fread(&header, sizeof(SnapshotHeader), 1, fileInput) == 1 && fread(&checkpointInfo, sizeof(CheckpointInfo), 1, fileInput) == 1;
+		fclose(fileInput);
+
+		// Check if the file is a checkpoint of the current format
+		return read && !memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) && header.version == SNAPSHOT_VERSION && header.headerSize >= sizeof(SnapshotHeader) + sizeof(CheckpointInfo) && !memcmp(checkpointInfo.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) && checkpointInfo.version == CHECKPOINT_VERSION && checkpointInfo.size == sizeof(CheckpointInfo);
+	}
+
 	ParticleSystem::~ParticleSystem() {
+		// Free the host arrays for the CPU backend
+		if(simulationBackend == SIMULATION_BACKEND_CPU) {
+			free(arrays.pos);
+			return;
+		}
+
 		// Destroy all Vulkan objects
-		vkFreeMemory(device->GetDevice(), bufferMemory, nullptr);
-		for(uint32_t i = 0; i != 3; ++i) {
+		for(uint32_t i = 0; i != bufferSetCount; ++i) {
 			vkDestroyBuffer(device->GetDevice(), buffers[i].posBuffer, nullptr);
 			vkDestroyBuffer(device->GetDevice(), buffers[i].velBuffer, nullptr);
+			if(massShared && i)
+				continue;
+			
 			vkDestroyBuffer(device->GetDevice(), buffers[i].massBuffer, nullptr);
+			vkDestroyBuffer(device->GetDevice(), buffers[i].idBuffer, nullptr);
 		}
+		device->GetMemoryAllocator()->Free(bufferAllocation);
 	}
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "Particle.hpp"
+#include "SnapshotCodec.hpp"
+#include "Platform/MappedFile.hpp"
 #include "Vulkan/VulkanDevice.hpp"
 #include <stdint.h>
+#include <stdio.h>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
 
@@ -32,6 +35,116 @@ namespace gsim {
 			/// @brief The number of implemented simulation algorithms.
 			SIMULATION_ALGORITHM_COUNT
 		};
+		/// @brief An enum containing all implemented simulation backends.
+		enum SimulationBackend {
+			/// @brief Runs the simulation on the GPU, using the Vulkan API.
+			SIMULATION_BACKEND_VULKAN,
+			/// @brief Runs the simulation on all CPU cores, using the host's vector instructions.
+			SIMULATION_BACKEND_CPU,
+			/// @brief The number of implemented simulation backends.
+			SIMULATION_BACKEND_COUNT
+		};
+		/// @brief An enum containing all supported particle file formats.
+		enum FileFormat {
+			/// @brief One line of whitespace-separated text per particle, holding its position, velocity and mass.
+			FILE_FORMAT_TEXT,
+			/// @brief A versioned binary snapshot, holding a header followed by the position, velocity and mass sections, either in the simulation's memory layout or compressed.
+			FILE_FORMAT_BINARY,
+			/// @brief The number of supported particle file formats.
+			FILE_FORMAT_COUNT
+		};
+		/// @brief A struct containing the header of a binary particle snapshot, stored in native byte order.
+		struct SnapshotHeader {
+			/// @brief The snapshot's magic number, always equal to SNAPSHOT_MAGIC.
+			char magic[8];
+			/// @brief The snapshot format's version, equal to SNAPSHOT_VERSION for the current format.
+			uint32_t version;
+			/// @brief The header's size, in bytes.
+			uint32_t headerSize;
+			/// @brief The number of particles in the snapshot.
+			uint64_t particleCount;
+			/// @brief The offset in the file, in bytes, of the particles' positions, stored as consecutive Vec2 structs when uncompressed.
+			uint64_t posOffset;
+			/// @brief The offset in the file, in bytes, of the particles' velocities, stored as consecutive Vec2 structs when uncompressed.
+			uint64_t velOffset;
+			/// @brief The offset in the file, in bytes, of the particles' masses, stored as consecutive floats when uncompressed.
+			uint64_t massOffset;
+			/// @brief The position section's encoding, as a SnapshotCodec::Codec value.
+			uint32_t posCodec;
+			/// @brief The velocity section's encoding, as a SnapshotCodec::Codec value.
+			uint32_t velCodec;
+			/// @brief The mass section's encoding, as a SnapshotCodec::Codec value.
+			uint32_t massCodec;
+			/// @brief The number of float values in every independently encoded block of the compressed sections.
+			uint32_t blockLength;
+			/// @brief The position section's size, in bytes.
+			uint64_t posSize;
+			/// @brief The velocity section's size, in bytes.
+			uint64_t velSize;
+			/// @brief The mass section's size, in bytes.
+			uint64_t massSize;
+		};
+		/// @brief A struct containing the run state stored right after the snapshot header of a checkpoint, in native byte order.
+		struct CheckpointInfo {
+			/// @brief The checkpoint's magic number, always equal to CHECKPOINT_MAGIC.
+			char magic[8];
+			/// @brief The checkpoint format's version, equal to CHECKPOINT_VERSION for the current format.
+			uint32_t version;
+			/// @brief The checkpoint info's size, in bytes.
+			uint32_t size;
+			/// @brief The number of simulations run before the checkpoint was written.
+			uint64_t simulationCount;
+			/// @brief The total number of simulations to run, or UINT64_MAX if there is no limit.
+			uint64_t maxSimulationCount;
+			/// @brief The number of simulations between two checkpoints, or 0 if checkpoints are only written on termination.
+			uint64_t checkpointInterval;
+			/// @brief The simulated time, in seconds, passed before the checkpoint was written.
+			double simulatedTime;
+			/// @brief The gravitational constant used for the simulation.
+			float gravitationalConst;
+			/// @brief The time interval length, in seconds, simulated in one instance.
+			float simulationTime;
+			/// @brief The speed factor at which the simulation is run.
+			float simulationSpeed;
+			/// @brief The softening length used to soften the extreme forces that would usually result from close interactions.
+			float softeningLen;
+			/// @brief The accuracy parameter used to calibrate force approximation.
+			float accuracyParameter;
+			/// @brief The simulation algorithm, as a SimulationAlgorithm value.
+			uint32_t simulationAlgorithm;
+			/// @brief The simulation backend, as a SimulationBackend value.
+			uint32_t simulationBackend;
+			/// @brief The seed the particles were generated with, or 0 if they were loaded from a file.
+			uint32_t seed;
+			/// @brief The requested depth of the Barnes-Hut quadtree, or 0 if it was chosen from the particle count.
+			uint32_t treeDepth;
+			/// @brief The method used to build the Barnes-Hut quadtree, as a BarnesHutSimulation::TreeBuild value.
+			uint32_t treeBuild;
+			/// @brief The number of particles a leaf of a sparse Barnes-Hut quadtree can hold before it is refined.
+			uint32_t leafCapacity;
+			/// @brief The number of simulations between two reorderings of the particle buffers.
+			uint32_t reorderInterval;
+			/// @brief The Barnes-Hut force traversal, as a BarnesHutSimulation::ForceWalk value.
+			uint32_t forceWalk;
+			/// @brief Whether the quadtree's nodes apply their quadrupole moments.
+			uint32_t quadrupoleMoments;
+			/// @brief The number of simulations between two rebuilds of the sparse Barnes-Hut quadtree.
+			uint32_t treeRebuildInterval;
+			/// @brief The accumulation of the particles into the leaves of a dense quadtree, as a BarnesHutSimulation::LeafAccumulation value.
+			uint32_t leafAccumulation;
+			/// @brief Whether the particles were being sorted into the leaves of a dense quadtree.
+			uint32_t leavesSorted;
+			/// @brief The number of simulation batches queued on the GPU at the same time.
+			uint32_t inFlightCount;
+			/// @brief The index of the particle buffer used for graphics.
+			uint32_t graphicsIndex;
+			/// @brief The index of the particle buffer input for computations.
+			uint32_t computeInputIndex;
+			/// @brief The index of the particle buffer in which computation outputs are stored.
+			uint32_t computeOutputIndex;
+			/// @brief Reserved for future use, always 0.
+			uint32_t reserved;
+		};
 		/// @brief A struct containing all buffers for the particle infos.
 		struct ParticleBuffers {
 			/// @brief A buffer storing the particle positions.
@@ -40,14 +153,38 @@ namespace gsim {
 			VkBuffer velBuffer;
 			/// @brief A buffer storing the particle masses.
 			VkBuffer massBuffer;
+			/// @brief A buffer storing the original index of every stored particle, as simulations may reorder the particles.
+			VkBuffer idBuffer;
 		};
+		/// @brief A struct containing all host arrays for the particle infos, used by the CPU backend.
+		struct ParticleArrays {
+			/// @brief An array storing the particle positions.
+			Vec2* pos;
+			/// @brief An array storing the particle velocities.
+			Vec2* vel;
+			/// @brief An array storing the particle masses.
+			float* mass;
+		};
+
+		/// @brief The magic number at the start of every binary particle snapshot.
+		static constexpr char SNAPSHOT_MAGIC[8] = { 'G', 'S', 'I', 'M', 'S', 'N', 'A', 'P' };
+		/// @brief The current version of the binary particle snapshot format.
+		static const uint32_t SNAPSHOT_VERSION = 2;
+		/// @brief The alignment, in bytes, of every section in a binary particle snapshot.
+		static const uint64_t SNAPSHOT_SECTION_ALIGNMENT = 64;
+		/// @brief The magic number at the start of every checkpoint's info.
+		static constexpr char CHECKPOINT_MAGIC[8] = { 'G', 'S', 'I', 'M', 'C', 'K', 'P', 'T' };
+		/// @brief The current version of the checkpoint info format.
+		static const uint32_t CHECKPOINT_VERSION = 1;
+		/// @brief The maximum number of rotating particle buffer sets, with one read by the graphics while the simulations write the other two.
+		static const uint32_t MAX_BUFFER_SET_COUNT = 3;
 
 		ParticleSystem() = delete;
 		ParticleSystem(const ParticleSystem&) = delete;
 		ParticleSystem(ParticleSystem&&) noexcept = delete;
 
-		/// @brief Loads a particle system from the given file.
-		/// @param device The Vulkan device to use for Vulkan-specific components.
+		/// @brief Loads a particle system from the given file, detecting whether it is a binary snapshot or a text file.
+		/// @param device The Vulkan device to use for Vulkan-specific components, or nullptr if the CPU backend is used.
 		/// @param filePath The path of the file to load the system from.
 		/// @param gravitationalConst The gravitational constant used for the simulation.
 		/// @param simulationTime The time interval length, in seconds, simulated in one instance.
@@ -55,21 +192,28 @@ namespace gsim {
 		/// @param softeningLen The softening length used to soften the extreme forces that would usually result from close interactions.
 		/// @param accuracyParameter The accuracy parameter used to calibrate force approximation. Only used for Barnes-Hut simulations.
 		/// @param simulationAlgorithm The simulation algorithm used to calculate the gravitational forces.
-		ParticleSystem(VulkanDevice* device, const char* filePath, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm);
+		/// @param simulationBackend The backend the simulation will run on.
+		/// @param bufferSetCount The number of rotating particle buffer sets, either MAX_BUFFER_SET_COUNT if the particles are drawn, or 2 if they aren't. Ignored for the CPU backend.
+		/// @param massShared Whether all buffer sets share a single mass and ID buffer, which is only valid if the simulation never reorders the particles. Ignored for the CPU backend.
+		ParticleSystem(VulkanDevice* device, const char* filePath, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm, SimulationBackend simulationBackend, uint32_t bufferSetCount, bool massShared);
 		/// @brief Generates a particle system based on the given parameters.
-		/// @param device The Vulkan device to use for Vulkan-specific components.
+		/// @param device The Vulkan device to use for Vulkan-specific components, or nullptr if the CPU backend is used.
 		/// @param particleCount The number of particles in the system.
 		/// @param generateType The variant to use for the system generation.
 		/// @param generateSize The radius of the resulting generation's size.
 		/// @param minMass The minimum possible value of the particles' mass.
 		/// @param maxMass The maximum possible value of the particles' mass.
+		/// @param seed The seed of the random engine used for the generation.
 		/// @param gravitationalConst The gravitational constant used for the simulation.
 		/// @param simulationTime The time interval length, in seconds, simulated in one instance.
 		/// @param simulationSpeed The speed factor at which the simulation is run.
 		/// @param softeningLen The softening length used to soften the extreme forces that would usually result from close interactions.
 		/// @param accuracyParameter The accuracy parameter used to calibrate force approximation. Only used for Barnes-Hut simulations.
 		/// @param simulationAlgorithm The simulation algorithm used to calculate the gravitational forces.
-		ParticleSystem(VulkanDevice* device, size_t particleCount, GenerateType generateType, float generateSize, float minMass, float maxMass, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm);
+		/// @param simulationBackend The backend the simulation will run on.
+		/// @param bufferSetCount The number of rotating particle buffer sets, either MAX_BUFFER_SET_COUNT if the particles are drawn, or 2 if they aren't. Ignored for the CPU backend.
+		/// @param massShared Whether all buffer sets share a single mass and ID buffer, which is only valid if the simulation never reorders the particles. Ignored for the CPU backend.
+		ParticleSystem(VulkanDevice* device, size_t particleCount, GenerateType generateType, float generateSize, float minMass, float maxMass, uint32_t seed, float gravitationalConst, float simulationTime, float simulationSpeed, float softeningLen, float accuracyParameter, SimulationAlgorithm simulationAlgorithm, SimulationBackend simulationBackend, uint32_t bufferSetCount, bool massShared);
 
 		ParticleSystem& operator=(const ParticleSystem&) = delete;
 		ParticleSystem& operator=(ParticleSystem&&) noexcept = delete;
@@ -121,6 +265,12 @@ namespace gsim {
 			return accuracyParameter;
 		}
 
+		/// @brief Gets the backend the simulation runs on.
+		/// @return The backend the simulation runs on.
+		SimulationBackend GetSimulationBackend() const {
+			return simulationBackend;
+		}
+
 		/// @brief Gets the camera's starting position.
 		/// @return The camera's starting position.
 		Vec2 GetCameraStartPos() const {
@@ -133,18 +283,38 @@ namespace gsim {
 		}
 
 		/// @brief Gets the Vulkan buffers storing the particle infos.
-		/// @return A pointer to the array of particle buffers.
+		/// @return A pointer to the array of particle buffers, holding GetBufferSetCount() sets.
 		ParticleBuffers* GetBuffers() {
 			return buffers;
 		}
+		/// @brief Gets the number of rotating particle buffer sets.
+		/// @return MAX_BUFFER_SET_COUNT if one set is read by the graphics, or 2 if only the simulations use the sets.
+		uint32_t GetBufferSetCount() const {
+			return bufferSetCount;
+		}
+		/// @brief Checks if all buffer sets share a single mass and ID buffer, as the simulation never reorders the particles.
+		/// @return True if the mass and ID buffers are shared, otherwise false.
+		bool GetMassShared() const {
+			return massShared;
+		}
 		/// @brief Gets the Vulkan device memory block the buffers are bound to.
 		/// @return The Vulkan device memory block the buffers are bound to.
 		VkDeviceMemory GetBufferMemory() {
-			return bufferMemory;
+			return bufferAllocation.memory;
+		}
+		/// @brief Checks if the particle buffers are bound to device-local memory mapped by the host, which lets the particles be uploaded without a staging buffer.
+		/// @return True if the particle buffers' memory is mapped, otherwise false.
+		bool GetBufferMemoryMapped() const {
+			return bufferMemoryMapped;
+		}
+		/// @brief Gets the host arrays storing the particle infos. Only valid for the CPU backend.
+		/// @return A struct containing the host particle arrays.
+		ParticleArrays GetArrays() {
+			return arrays;
 		}
 
 		/// @brief Gets the index of the particle buffer to use for graphics.
-		/// @return The index of the particle buffer to use for graphics.
+		/// @return The index of the particle buffer to use for graphics, which doesn't exist if there are only two buffer sets.
 		size_t GetGrahpicsIndex() const {
 			return graphicsIndex;
 		}
@@ -158,12 +328,74 @@ namespace gsim {
 		size_t GetComputeOutputIndex() const {
 			return computeOutputIndex;
 		}
-		/// @brief Saves the index of the next buffer to use for graphics.
+		/// @brief Gets the timeline semaphore signaled by the simulations on the compute queue.
+		/// @return A handle to the compute timeline semaphore, or VK_NULL_HANDLE if no simulations were submitted yet.
+		VkSemaphore GetComputeTimeline() {
+			return computeTimeline;
+		}
+		/// @brief Gets the compute timeline value reached once all submitted simulations finish.
+		/// @return The compute timeline value reached once the compute input buffer is fully written.
+		uint64_t GetComputeTimelineValue() const {
+			return computeTimelineValue;
+		}
+		/// @brief Gets the compute timeline value reached once the buffer used for graphics is fully written.
+		/// @return The compute timeline value the graphics must wait for before reading their buffer.
+		uint64_t GetGraphicsTimelineValue() const {
+			return graphicsTimelineValue;
+		}
+		/// @brief Saves the compute timeline value reached once all submitted simulations finish.
+		/// @param semaphore The timeline semaphore signaled by the simulations.
+		/// @param value The value reached once the last submitted simulation finishes.
+		void SetComputeTimeline(VkSemaphore semaphore, uint64_t value) {
+			computeTimeline = semaphore;
+			computeTimelineValue = value;
+		}
+		/// @brief Gets the timeline semaphore signaled by the transfers reading the particle buffers, such as snapshot copies.
+		/// @return A handle to the transfer timeline semaphore, or VK_NULL_HANDLE if no transfers were submitted yet.
+		VkSemaphore GetTransferTimeline() {
+			return transferTimeline;
+		}
+		/// @brief Gets the transfer timeline value reached once all submitted transfers finish.
+		/// @return The transfer timeline value the simulations must wait for before writing the particle buffers, or 0 if no transfers were submitted yet.
+		uint64_t GetTransferTimelineValue() const {
+			return transferTimelineValue;
+		}
+		/// @brief Saves the transfer timeline value reached once all submitted transfers finish, which the next simulations wait for on the GPU.
+		/// @param semaphore The timeline semaphore signaled by the transfers.
+		/// @param value The value reached once the last submitted transfer finishes.
+		void SetTransferTimeline(VkSemaphore semaphore, uint64_t value) {
+			transferTimeline = semaphore;
+			transferTimelineValue = value;
+		}
+		/// @brief Saves the index of the next buffer to use for graphics, if any simulations were submitted since the last call. Requires MAX_BUFFER_SET_COUNT buffer sets.
 		void NextGraphicsIndex() {
+			// Keep the current buffer if no simulations were submitted, as the compute output buffer would then hold older particles
+			if(computeTimelineValue == graphicsTimelineValue)
+				return;
+
 			// Arrange the indices to keep the simulations up-to-date and the graphics only one simulation behind
 			size_t aux = graphicsIndex;
 			graphicsIndex = computeOutputIndex;
 			computeOutputIndex = aux;
+
+			// The new graphics buffer is fully written once the last submitted simulation finishes, and isn't written by any later simulation
+			graphicsTimelineValue = computeTimelineValue;
+		}
+		/// @brief Sets the indices of all particle buffers, restoring the rotation of a checkpoint. Simulations must be created afterwards.
+		/// @param graphicsIndex The index of the particle buffer to use for graphics.
+		/// @param computeInputIndex The index of the particle buffer to input for computations.
+		/// @param computeOutputIndex The index of the particle buffer in which computation outputs will be stored.
+		void SetBufferIndices(size_t graphicsIndex, size_t computeInputIndex, size_t computeOutputIndex) {
+			// Only keep the order of the compute buffers if there is no graphics buffer, as every set holds the same particles after loading
+			if(bufferSetCount != MAX_BUFFER_SET_COUNT) {
+				this->computeInputIndex = (computeInputIndex < computeOutputIndex) ? 0 : 1;
+				this->computeOutputIndex = 1 - this->computeInputIndex;
+				return;
+			}
+
+			this->graphicsIndex = graphicsIndex;
+			this->computeInputIndex = computeInputIndex;
+			this->computeOutputIndex = computeOutputIndex;
 		}
 		/// @brief Saves the indices of the next buffers to use for computations.
 		void NextComputeIndices() {
@@ -178,17 +410,49 @@ namespace gsim {
 		void GetParticles(Particle* particles);
 		/// @brief Saves the system's particle infos to a file.
 		/// @param filePath The path of the file to save the infos to.
-		void SaveParticles(const char* filePath);
+		/// @param fileFormat The format to save the infos in.
+		/// @param snapshotCodec The codec used to encode binary snapshots. Ignored for text files.
+		/// @param snapshotPrecision The maximum error of every quantized position. Only used by the quantized codec.
+		void SaveParticles(const char* filePath, FileFormat fileFormat, SnapshotCodec::Codec snapshotCodec, float snapshotPrecision);
+		/// @brief Atomically saves a checkpoint of the system, as an uncompressed binary snapshot whose header is extended by the run state. All simulations must be finished.
+		/// @param filePath The path of the checkpoint file, which is only replaced once the new checkpoint is fully written.
+		/// @param checkpointInfo The run state to store. Its magic number, version, size and buffer indices are filled in.
+		void SaveCheckpoint(const char* filePath, CheckpointInfo checkpointInfo);
+		/// @brief Reads the run state of the given checkpoint.
+		/// @param filePath The path of the checkpoint file.
+		/// @param checkpointInfo A reference to the struct in which the run state will be written.
+		/// @return True if the file is a valid checkpoint, otherwise false.
+		static bool LoadCheckpointInfo(const char* filePath, CheckpointInfo& checkpointInfo);
 
 		/// @brief Destroys the particle system.
 		~ParticleSystem();
 	private:
-		void GenerateParticlesRandom(Particle* particles, float generateSize, float minMass, float maxMass);
-		void GenerateParticlesGalaxy(Particle* particles, float generateSize, float minMass, float maxMass);
-		void GenerateParticlesGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass);
-		void GenerateParticlesSymmetricalGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass);
-		void CreateVulkanObjects(const Particle* particles);
-		void GetCameraInfo(const Particle* particles);
+		struct ParticleSource {
+			const Particle* particles;
+			const Vec2* pos;
+			const Vec2* vel;
+			const float* mass;
+		};
+		struct MappedBuffers {
+			Vec2* pos;
+			Vec2* vel;
+			float* mass;
+			uint32_t* id;
+		};
+
+		void GenerateParticlesRandom(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed);
+		void GenerateParticlesGalaxy(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed);
+		void GenerateParticlesGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed);
+		void GenerateParticlesSymmetricalGalaxyCollision(Particle* particles, float generateSize, float minMass, float maxMass, uint32_t seed);
+		bool LoadSnapshot(const MappedFile& file, size_t particleCountAlignment);
+		void LoadText(const MappedFile& file, size_t particleCountAlignment);
+		void CreateParticleStorage(const ParticleSource& source);
+		void CopyParticles(const ParticleSource& source, size_t begin, size_t end, Vec2* pos, Vec2* vel, float* mass);
+		void CreateVulkanObjects(const ParticleSource& source);
+		void CreateArrays(const ParticleSource& source);
+		void GetCameraInfo(const ParticleSource& source);
+		void SaveText(FILE* fileOutput, const Particle* particles);
+		void SaveSnapshot(FILE* fileOutput, const Particle* particles, SnapshotCodec::Codec snapshotCodec, float snapshotPrecision, const void* headerExtension, uint32_t headerExtensionSize);
 
 		VulkanDevice* device;
 
@@ -199,15 +463,28 @@ namespace gsim {
 		float simulationSpeed;
 		float softeningLen;
 		float accuracyParameter;
+		SimulationBackend simulationBackend;
 
 		Vec2 cameraStartPos;
 		float cameraStartSize;
 		
-		ParticleBuffers buffers[3];
-		VkDeviceMemory bufferMemory;
+		ParticleBuffers buffers[MAX_BUFFER_SET_COUNT]{};
+		uint32_t bufferSetCount;
+		bool massShared;
+		VulkanMemoryAllocator::Allocation bufferAllocation;
+		MappedBuffers mappedBuffers[MAX_BUFFER_SET_COUNT]{};
+		bool bufferMemoryMapped = false;
+		bool bufferMemoryCached = false;
+		ParticleArrays arrays;
 
 		size_t graphicsIndex = 0;
 		size_t computeInputIndex = 1;
 		size_t computeOutputIndex = 2;
+
+		VkSemaphore computeTimeline = VK_NULL_HANDLE;
+		uint64_t computeTimelineValue = 0;
+		uint64_t graphicsTimelineValue = 0;
+		VkSemaphore transferTimeline = VK_NULL_HANDLE;
+		uint64_t transferTimelineValue = 0;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,539 @@
+#include "SnapshotCodec.hpp"
+#include "ParticleSystem.hpp"
+#include "Debug/Exception.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <bit>
+
+namespace gsim {
+	// Constants
+	const size_t MAX_XOR_BITS_PER_VALUE = 44;
+	const size_t XOR_BLOCK_WORD_CAPACITY = (SnapshotCodec::BLOCK_LENGTH * MAX_XOR_BITS_PER_VALUE + 63) / 64;
+
+	// Structs
+	struct BitWriter {
+		uint64_t* iter;
+		uint64_t word;
+		uint32_t freeBitCount;
+	};
+	struct BitReader {
+		const uint64_t* iter;
+		const uint64_t* end;
+		uint64_t word;
+		uint32_t bitCount;
+	};
+	struct BlockEncode {
+		const float* values;
+		size_t valueCount;
+		uint32_t stride;
+		uint64_t* blockData;
+		uint64_t* blockSizes;
+		float* blockBounds;
+		SnapshotCodec::QuantizedHeader quantized;
+	};
+	struct BlockDecode {
+		const uint64_t* data;
+		size_t wordCount;
+		const uint64_t* blockEnds;
+		size_t valueCount;
+		uint32_t stride;
+		uint32_t blockLength;
+		SnapshotCodec::QuantizedHeader quantized;
+		float* values;
+		std::atomic<bool> failed;
+	};
+
+	// Internal helper functions
+	static void WriteBits(BitWriter& writer, uint32_t bits, uint32_t count) {
+		// Append the bits to the current word if they fit, otherwise fill it and start the next word with the remaining bits
+		if(count < writer.freeBitCount) {
+			writer.word |= (uint64_t)bits << (writer.freeBitCount - count);
+			writer.freeBitCount -= count;
+		} else {
+			uint32_t remaining = count - writer.freeBitCount;
+			*writer.iter++ = writer.word | ((uint64_t)bits >> remaining);
+			writer.word = remaining ? (uint64_t)bits << (64 - remaining) : 0;
+			writer.freeBitCount = 64 - remaining;
+		}
+	}
+	static void FlushBits(BitWriter& writer) {
+		// Store the last partially filled word
+		if(writer.freeBitCount != 64)
+			*writer.iter++ = writer.word;
+	}
+	static bool ReadBits(BitReader& reader, uint32_t count, uint32_t& bits) {
+		// Take the bits from the current word if it holds enough, otherwise combine its remaining bits with the next word's first bits
+		if(count <= reader.bitCount) {
+			bits = count ? (uint32_t)(reader.word >> (64 - count)) : 0;
+			reader.word <<= count;
+			reader.bitCount -= count;
+			return true;
+		}
+		if(reader.iter == reader.end)
+			return false;
+		
+		uint32_t remaining = count - reader.bitCount;
+		uint64_t high = reader.bitCount ? reader.word >> (64 - reader.bitCount) : 0;
+		uint64_t next = *reader.iter++;
+
+		bits = (uint32_t)((high << remaining) | (next >> (64 - remaining)));
+		reader.word = next << remaining;
+		reader.bitCount = 64 - remaining;
+		return true;
+	}
+
+	static void GetBlockBounds(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		BlockEncode* encode = (BlockEncode*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the block's position range
+			size_t valueBegin = i * SnapshotCodec::BLOCK_LENGTH;
+			size_t valueEnd = (encode->valueCount - valueBegin < SnapshotCodec::BLOCK_LENGTH) ? encode->valueCount : valueBegin + SnapshotCodec::BLOCK_LENGTH;
+
+			// Get the bounding box of the block's positions, marking it as invalid if any position isn't finite
+			float* bounds = encode->blockBounds + (i << 2);
+			bounds[0] = INFINITY;
+			bounds[1] = INFINITY;
+			bounds[2] = -INFINITY;
+			bounds[3] = -INFINITY;
+
+			for(size_t j = valueBegin; j != valueEnd; j += 2) {
+				float x = encode->values[j];
+				float y = encode->values[j + 1];
+				if(!isfinite(x) || !isfinite(y)) {
+					bounds[0] = NAN;
+					break;
+				}
+
+				bounds[0] = fminf(bounds[0], x);
+				bounds[1] = fminf(bounds[1], y);
+				bounds[2] = fmaxf(bounds[2], x);
+				bounds[3] = fmaxf(bounds[3], y);
+			}
+		}
+	}
+	static bool GetQuantizedHeader(const float* blockBounds, size_t blockCount, float precision, SnapshotCodec::QuantizedHeader& quantized) {
+		// Get the bounding box of all positions, exiting the function if any position isn't finite
+		float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+		for(size_t i = 0; i != blockCount; ++i) {
+			const float* bounds = blockBounds + (i << 2);
+			if(isnan(bounds[0]))
+				return false;
+
+			minX = fminf(minX, bounds[0]);
+			minY = fminf(minY, bounds[1]);
+			maxX = fmaxf(maxX, bounds[2]);
+			maxY = fmaxf(maxY, bounds[3]);
+		}
+
+		// Round every position to its nearest step, keeping the error within the precision
+		quantized.originX = minX;
+		quantized.originY = minY;
+		quantized.step = (double)precision * 2;
+		quantized.reserved = 0;
+
+		// Exit the function if the largest quantized value doesn't fit in 32 bits
+		double maxValue = round(fmax(maxX - quantized.originX, maxY - quantized.originY) / quantized.step);
+		if(maxValue > UINT32_MAX)
+			return false;
+		
+		quantized.bitCount = 32 - (uint32_t)std::countl_zero((uint32_t)maxValue);
+		return true;
+	}
+	static void EncodeQuantizedBlocks(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		BlockEncode* encode = (BlockEncode*)userData;
+		const SnapshotCodec::QuantizedHeader& quantized = encode->quantized;
+		uint32_t maxValue = (uint32_t)(((uint64_t)1 << quantized.bitCount) - 1);
+
+		// Exit the function if every position rounds to the bounding box's minimum, storing no bits at all
+		if(!quantized.bitCount)
+			return;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the block's value range; as the block length is a multiple of 64, every block starts at a word boundary
+			size_t valueBegin = i * SnapshotCodec::BLOCK_LENGTH;
+			size_t valueEnd = (encode->valueCount - valueBegin < SnapshotCodec::BLOCK_LENGTH) ? encode->valueCount : valueBegin + SnapshotCodec::BLOCK_LENGTH;
+
+			BitWriter writer {
+				.iter = encode->blockData + valueBegin / 64 * quantized.bitCount,
+				.word = 0,
+				.freeBitCount = 64
+			};
+
+			// Pack every position's components relative to the bounding box's minimum
+			for(size_t j = valueBegin; j != valueEnd; j += 2) {
+				uint32_t x = (uint32_t)llround((encode->values[j] - quantized.originX) / quantized.step);
+				uint32_t y = (uint32_t)llround((encode->values[j + 1] - quantized.originY) / quantized.step);
+
+				WriteBits(writer, (x < maxValue) ? x : maxValue, quantized.bitCount);
+				WriteBits(writer, (y < maxValue) ? y : maxValue, quantized.bitCount);
+			}
+
+			FlushBits(writer);
+		}
+	}
+	static void EncodeXorBlocks(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		BlockEncode* encode = (BlockEncode*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the block's value range
+			size_t valueBegin = i * SnapshotCodec::BLOCK_LENGTH;
+			size_t valueEnd = (encode->valueCount - valueBegin < SnapshotCodec::BLOCK_LENGTH) ? encode->valueCount : valueBegin + SnapshotCodec::BLOCK_LENGTH;
+
+			uint64_t* blockBegin = encode->blockData + i * XOR_BLOCK_WORD_CAPACITY;
+			BitWriter writer {
+				.iter = blockBegin,
+				.word = 0,
+				.freeBitCount = 64
+			};
+
+			// Encode every value's XOR with the previous value of the same component, starting every block from zero
+			uint32_t previous[2]{};
+			uint32_t windowLead = 0;
+			uint32_t windowLen = 0;
+
+			for(size_t j = valueBegin; j != valueEnd; ++j) {
+				uint32_t value;
+				memcpy(&value, encode->values + j, sizeof(uint32_t));
+
+				uint32_t& prediction = previous[j & (encode->stride - 1)];
+				uint32_t delta = value ^ prediction;
+				prediction = value;
+
+				// Store a single zero bit for repeated values
+				if(!delta) {
+					WriteBits(writer, 0, 1);
+					continue;
+				}
+
+				// Reuse the previous window of meaningful bits if it covers the delta, otherwise store the new window first
+				uint32_t lead = (uint32_t)std::countl_zero(delta);
+				uint32_t trail = (uint32_t)std::countr_zero(delta);
+
+				if(windowLen && lead >= windowLead && trail >= 32 - windowLead - windowLen) {
+					WriteBits(writer, 2, 2);
+					WriteBits(writer, delta >> (32 - windowLead - windowLen), windowLen);
+				} else {
+					windowLead = lead;
+					windowLen = 32 - lead - trail;
+
+					WriteBits(writer, 3, 2);
+					WriteBits(writer, (windowLead << 5) | (windowLen - 1), 10);
+					WriteBits(writer, delta >> trail, windowLen);
+				}
+			}
+
+			FlushBits(writer);
+			encode->blockSizes[i] = writer.iter - blockBegin;
+		}
+	}
+	static void DecodeQuantizedBlocks(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		BlockDecode* decode = (BlockDecode*)userData;
+		const SnapshotCodec::QuantizedHeader& quantized = decode->quantized;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the block's value range
+			size_t valueBegin = i * decode->blockLength;
+			size_t valueEnd = (decode->valueCount - valueBegin < decode->blockLength) ? decode->valueCount : valueBegin + decode->blockLength;
+
+			BitReader reader {
+				.iter = decode->data + valueBegin / 64 * quantized.bitCount,
+				.end = decode->data + decode->wordCount,
+				.word = 0,
+				.bitCount = 0
+			};
+
+			// Unpack every position's components relative to the bounding box's minimum
+			for(size_t j = valueBegin; j != valueEnd; j += 2) {
+				uint32_t x, y;
+				if(!ReadBits(reader, quantized.bitCount, x) || !ReadBits(reader, quantized.bitCount, y)) {
+					decode->failed = true;
+					return;
+				}
+
+				decode->values[j] = (float)(quantized.originX + x * quantized.step);
+				decode->values[j + 1] = (float)(quantized.originY + y * quantized.step);
+			}
+		}
+	}
+	static void DecodeXorBlocks(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		BlockDecode* decode = (BlockDecode*)userData;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the block's value range and its words, which must lie within the section
+			size_t valueBegin = i * decode->blockLength;
+			size_t valueEnd = (decode->valueCount - valueBegin < decode->blockLength) ? decode->valueCount : valueBegin + decode->blockLength;
+
+			uint64_t blockBegin = i ? decode->blockEnds[i - 1] : 0;
+			uint64_t blockEnd = decode->blockEnds[i];
+			if(((blockBegin | blockEnd) & 7) || blockBegin > blockEnd || blockEnd > decode->wordCount * sizeof(uint64_t)) {
+				decode->failed = true;
+				return;
+			}
+
+			BitReader reader {
+				.iter = decode->data + blockBegin / sizeof(uint64_t),
+				.end = decode->data + blockEnd / sizeof(uint64_t),
+				.word = 0,
+				.bitCount = 0
+			};
+
+			// Decode every value's XOR with the previous value of the same component
+			uint32_t previous[2]{};
+			uint32_t windowLead = 0;
+			uint32_t windowLen = 0;
+
+			for(size_t j = valueBegin; j != valueEnd; ++j) {
+				uint32_t& prediction = previous[j & (decode->stride - 1)];
+				uint32_t control, bits;
+
+				if(!ReadBits(reader, 1, control)) {
+					decode->failed = true;
+					return;
+				}
+
+				if(control) {
+					// Read the delta's new window of meaningful bits, if one is stored
+					if(!ReadBits(reader, 1, control)) {
+						decode->failed = true;
+						return;
+					}
+					if(control) {
+						if(!ReadBits(reader, 10, bits)) {
+							decode->failed = true;
+							return;
+						}
+
+						windowLead = bits >> 5;
+						windowLen = (bits & 31) + 1;
+						if(windowLead + windowLen > 32) {
+							decode->failed = true;
+							return;
+						}
+					} else if(!windowLen) {
+						decode->failed = true;
+						return;
+					}
+
+					// Read the delta's meaningful bits
+					if(!ReadBits(reader, windowLen, bits)) {
+						decode->failed = true;
+						return;
+					}
+					prediction ^= bits << (32 - windowLead - windowLen);
+				}
+
+				memcpy(decode->values + j, &prediction, sizeof(uint32_t));
+			}
+		}
+	}
+
+	static uint64_t AlignSection(uint64_t offset) {
+		return (offset + ParticleSystem::SNAPSHOT_SECTION_ALIGNMENT - 1) & ~(ParticleSystem::SNAPSHOT_SECTION_ALIGNMENT - 1);
+	}
+	static bool WritePadding(FILE* fileOutput, size_t size) {
+		static const uint8_t padding[ParticleSystem::SNAPSHOT_SECTION_ALIGNMENT]{};
+		return fwrite(padding, 1, size, fileOutput) == size;
+	}
+
+	bool SnapshotCodec::ReserveBlocks(size_t blockCount, size_t wordCount) {
+		// Grow the block data, keeping the old data if the allocation fails
+		if(wordCount > blockDataCapacity) {
+			uint64_t* newBlockData = (uint64_t*)realloc(blockData, wordCount * sizeof(uint64_t));
+			if(!newBlockData)
+				return false;
+			
+			blockData = newBlockData;
+			blockDataCapacity = wordCount;
+		}
+
+		// Grow the per-block arrays
+		if(blockCount > blockCapacity) {
+			uint64_t* newBlockSizes = (uint64_t*)realloc(blockSizes, blockCount * sizeof(uint64_t));
+			if(!newBlockSizes)
+				return false;
+			blockSizes = newBlockSizes;
+
+			float* newBlockBounds = (float*)realloc(blockBounds, (blockCount << 2) * sizeof(float));
+			if(!newBlockBounds)
+				return false;
+			blockBounds = newBlockBounds;
+
+			blockCapacity = blockCount;
+		}
+
+		return true;
+	}
+	bool SnapshotCodec::WriteSection(FILE* fileOutput, const float* values, size_t valueCount, uint32_t stride, uint32_t& sectionCodec, uint64_t& sectionSize) {
+		// Write raw sections straight from the given values
+		if(sectionCodec == CODEC_RAW) {
+			sectionSize = valueCount * sizeof(float);
+			return fwrite(values, sizeof(float), valueCount, fileOutput) == valueCount;
+		}
+
+		// Reserve enough space for encoding every block at its largest possible size
+		size_t blockCount = (valueCount + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+		if(!ReserveBlocks(blockCount, blockCount * XOR_BLOCK_WORD_CAPACITY))
+			return false;
+		
+		BlockEncode encode {
+			.values = values,
+			.valueCount = valueCount,
+			.stride = stride,
+			.blockData = blockData,
+			.blockSizes = blockSizes,
+			.blockBounds = blockBounds,
+			.quantized = {}
+		};
+
+		if(sectionCodec == CODEC_QUANTIZED) {
+			// Quantize and pack the positions relative to their bounding box
+			threadPool->ParallelFor(blockCount, 1, GetBlockBounds, &encode);
+			if(GetQuantizedHeader(blockBounds, blockCount, precision, encode.quantized)) {
+				threadPool->ParallelFor(blockCount, 1, EncodeQuantizedBlocks, &encode);
+
+				size_t wordCount = (valueCount * encode.quantized.bitCount + 63) / 64;
+				sectionSize = sizeof(QuantizedHeader) + wordCount * sizeof(uint64_t);
+				return fwrite(&encode.quantized, sizeof(QuantizedHeader), 1, fileOutput) == 1 && fwrite(blockData, sizeof(uint64_t), wordCount, fileOutput) == wordCount;
+			}
+
+			// Fall back to lossless compression if the positions can't be quantized at the given precision
+			sectionCodec = CODEC_XOR;
+		}
+
+		// Encode every block
+		threadPool->ParallelFor(blockCount, 1, EncodeXorBlocks, &encode);
+
+		// Turn the block sizes into every block's end offset, in bytes, relative to the first block
+		uint64_t blockEnd = 0;
+		for(size_t i = 0; i != blockCount; ++i) {
+			blockEnd += blockSizes[i] * sizeof(uint64_t);
+			blockSizes[i] = blockEnd;
+		}
+
+		// Write the block end offsets, followed by the blocks
+		bool written = fwrite(blockSizes, sizeof(uint64_t), blockCount, fileOutput) == blockCount;
+		for(size_t i = 0; written && i != blockCount; ++i) {
+			size_t wordCount = (blockSizes[i] - (i ? blockSizes[i - 1] : 0)) / sizeof(uint64_t);
+			written = fwrite(blockData + i * XOR_BLOCK_WORD_CAPACITY, sizeof(uint64_t), wordCount, fileOutput) == wordCount;
+		}
+
+		sectionSize = blockCount * sizeof(uint64_t) + blockEnd;
+		return written;
+	}
+
+	// Public functions
+	SnapshotCodec::SnapshotCodec(Codec codec, float precision, ThreadPool* threadPool) : codec(codec), precision(precision), threadPool(threadPool) {
+		// Check if the given parameters are valid
+		if(codec >= CODEC_COUNT)
+			GSIM_THROW_EXCEPTION("Invalid snapshot codec requested!");
+		if(codec == CODEC_QUANTIZED && !(precision > 0 && isfinite(precision)))
+			GSIM_THROW_EXCEPTION("The quantized snapshot codec requires a positive precision!");
+	}
+
+	bool SnapshotCodec::WriteSnapshot(FILE* fileOutput, size_t particleCount, const Vec2* pos, const Vec2* vel, const float* mass, const void* headerExtension, uint32_t headerExtensionSize) {
+		// Set the snapshot's header; the section offsets and sizes are filled in as the sections are written
+		ParticleSystem::SnapshotHeader header {
+			.version = ParticleSystem::SNAPSHOT_VERSION,
+			.headerSize = (uint32_t)sizeof(ParticleSystem::SnapshotHeader) + headerExtensionSize,
+			.particleCount = particleCount,
+			.posCodec = codec,
+			.velCodec = (codec == CODEC_RAW) ? CODEC_RAW : CODEC_XOR,
+			.massCodec = (codec == CODEC_RAW) ? CODEC_RAW : CODEC_XOR,
+			.blockLength = BLOCK_LENGTH
+		};
+		memcpy(header.magic, ParticleSystem::SNAPSHOT_MAGIC, sizeof(ParticleSystem::SNAPSHOT_MAGIC));
+
+		// Reserve the header and write its extension, padded up to the position section
+		bool written = fwrite(&header, sizeof(ParticleSystem::SnapshotHeader), 1, fileOutput) == 1;
+		if(headerExtensionSize)
+			written = written && fwrite(headerExtension, headerExtensionSize, 1, fileOutput) == 1;
+		header.posOffset = AlignSection(header.headerSize);
+		written = written && WritePadding(fileOutput, header.posOffset - header.headerSize);
+
+		// Write the position section, padded up to the velocity section
+		written = written && WriteSection(fileOutput, (const float*)pos, particleCount << 1, 2, header.posCodec, header.posSize);
+		header.velOffset = AlignSection(header.posOffset + header.posSize);
+		written = written && WritePadding(fileOutput, header.velOffset - header.posOffset - header.posSize);
+
+		// Write the velocity section, padded up to the mass section
+		written = written && WriteSection(fileOutput, (const float*)vel, particleCount << 1, 2, header.velCodec, header.velSize);
+		header.massOffset = AlignSection(header.velOffset + header.velSize);
+		written = written && WritePadding(fileOutput, header.massOffset - header.velOffset - header.velSize);
+
+		// Write the mass section
+		written = written && WriteSection(fileOutput, mass, particleCount, 1, header.massCodec, header.massSize);
+
+		// Write the final header over the reserved one
+		return written && !fseek(fileOutput, 0, SEEK_SET) && fwrite(&header, sizeof(ParticleSystem::SnapshotHeader), 1, fileOutput) == 1;
+	}
+	bool SnapshotCodec::DecodeSection(Codec sectionCodec, const void* data, size_t size, size_t valueCount, uint32_t stride, uint32_t blockLength, float* values, ThreadPool* threadPool) {
+		// Copy raw sections as they are
+		if(sectionCodec == CODEC_RAW) {
+			if(size != valueCount * sizeof(float))
+				return false;
+			
+			memcpy(values, data, size);
+			return true;
+		}
+
+		// Check if the section's blocks are valid
+		if(!blockLength || blockLength % 64 || (stride != 1 && stride != 2))
+			return false;
+		
+		size_t blockCount = (valueCount + blockLength - 1) / blockLength;
+		BlockDecode decode {
+			.data = nullptr,
+			.wordCount = 0,
+			.blockEnds = nullptr,
+			.valueCount = valueCount,
+			.stride = stride,
+			.blockLength = blockLength,
+			.quantized = {},
+			.values = values,
+			.failed = false
+		};
+
+		if(sectionCodec == CODEC_QUANTIZED) {
+			// Read the quantized section's header, which must describe positions that fit in the section
+			if(stride != 2 || size < sizeof(QuantizedHeader))
+				return false;
+			memcpy(&decode.quantized, data, sizeof(QuantizedHeader));
+
+			if(decode.quantized.bitCount > 32 || !isfinite(decode.quantized.originX) || !isfinite(decode.quantized.originY) || !(decode.quantized.step > 0 && isfinite(decode.quantized.step)))
+				return false;
+			
+			decode.data = (const uint64_t*)((const uint8_t*)data + sizeof(QuantizedHeader));
+			decode.wordCount = (valueCount * decode.quantized.bitCount + 63) / 64;
+			if((size - sizeof(QuantizedHeader)) / sizeof(uint64_t) < decode.wordCount)
+				return false;
+			
+			// Unpack every block
+			threadPool->ParallelFor(blockCount, 1, DecodeQuantizedBlocks, &decode);
+		} else if(sectionCodec == CODEC_XOR) {
+			// Get the block end offsets, followed by the blocks
+			if(size / sizeof(uint64_t) < blockCount)
+				return false;
+			
+			decode.blockEnds = (const uint64_t*)data;
+			decode.data = decode.blockEnds + blockCount;
+			decode.wordCount = size / sizeof(uint64_t) - blockCount;
+
+			// Decode every block
+			threadPool->ParallelFor(blockCount, 1, DecodeXorBlocks, &decode);
+		} else {
+			return false;
+		}
+
+		return !decode.failed;
+	}
+
+	SnapshotCodec::~SnapshotCodec() {
+		// Free the block arrays
+		free(blockData);
+		free(blockSizes);
+		free(blockBounds);
+	}
+}
\ No newline at end of file
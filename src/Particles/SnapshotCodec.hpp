@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Particle.hpp"
+#include "Platform/ThreadPool.hpp"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace gsim {
+	/// @brief An encoder of binary particle snapshots, compressing every section in independent blocks on a thread pool.
+	class SnapshotCodec {
+	public:
+		/// @brief An enum containing all supported snapshot codecs, also stored as every section's encoding.
+		enum Codec {
+			/// @brief Stores every section uncompressed, in the simulation's memory layout.
+			CODEC_RAW,
+			/// @brief Compresses every section losslessly, XORing every float with the previous one of the same component and storing only the differing bits.
+			CODEC_XOR,
+			/// @brief Quantizes the positions relative to their bounding box at the given precision and bit-packs them, compressing the other sections losslessly.
+			CODEC_QUANTIZED,
+			/// @brief The number of supported snapshot codecs.
+			CODEC_COUNT
+		};
+		/// @brief A struct containing the header of a quantized position section.
+		struct QuantizedHeader {
+			/// @brief The X component of the positions' bounding box's minimum.
+			double originX;
+			/// @brief The Y component of the positions' bounding box's minimum.
+			double originY;
+			/// @brief The distance between two consecutive quantized values.
+			double step;
+			/// @brief The number of bits every quantized value is stored in.
+			uint32_t bitCount;
+			/// @brief Reserved for future use, always equal to 0.
+			uint32_t reserved;
+		};
+
+		/// @brief The number of float values in every independently encoded block. Always a multiple of 64.
+		static const uint32_t BLOCK_LENGTH = 16384;
+
+		SnapshotCodec() = delete;
+		SnapshotCodec(const SnapshotCodec&) = delete;
+		SnapshotCodec(SnapshotCodec&&) noexcept = delete;
+
+		/// @brief Creates a snapshot codec.
+		/// @param codec The codec used to encode the snapshots.
+		/// @param precision The maximum error of every quantized position. Only used by the quantized codec.
+		/// @param threadPool The thread pool to encode the blocks on.
+		SnapshotCodec(Codec codec, float precision, ThreadPool* threadPool);
+
+		SnapshotCodec& operator=(const SnapshotCodec&) = delete;
+		SnapshotCodec& operator=(SnapshotCodec&&) = delete;
+
+		/// @brief Gets the codec used to encode the snapshots.
+		/// @return The codec used to encode the snapshots.
+		Codec GetCodec() const {
+			return codec;
+		}
+		/// @brief Gets the maximum error of every quantized position.
+		/// @return The maximum error of every quantized position.
+		float GetPrecision() const {
+			return precision;
+		}
+
+		/// @brief Encodes and writes a binary particle snapshot from the given component arrays.
+		/// @param fileOutput The file stream to write the snapshot to, opened in binary mode. Must be seekable.
+		/// @param particleCount The number of particles to write.
+		/// @param pos The particles' positions.
+		/// @param vel The particles' velocities.
+		/// @param mass The particles' masses.
+		/// @param headerExtension The data stored right after the snapshot's header and counted in its size, or nullptr if the header isn't extended.
+		/// @param headerExtensionSize The size of the header extension, in bytes.
+		/// @return True if the whole snapshot was written, otherwise false.
+		bool WriteSnapshot(FILE* fileOutput, size_t particleCount, const Vec2* pos, const Vec2* vel, const float* mass, const void* headerExtension, uint32_t headerExtensionSize);
+		/// @brief Decodes a section of a binary particle snapshot.
+		/// @param sectionCodec The section's encoding.
+		/// @param data The section's data, aligned to 8 bytes.
+		/// @param size The section's size, in bytes.
+		/// @param valueCount The number of float values in the section.
+		/// @param stride The number of floats per element, either 1 or 2, with every float predicted from the one a stride before it.
+		/// @param blockLength The number of float values in every encoded block.
+		/// @param values The array the decoded values will be written to.
+		/// @param threadPool The thread pool to decode the blocks on.
+		/// @return True if the section is valid, otherwise false.
+		static bool DecodeSection(Codec sectionCodec, const void* data, size_t size, size_t valueCount, uint32_t stride, uint32_t blockLength, float* values, ThreadPool* threadPool);
+
+		/// @brief Destroys the snapshot codec.
+		~SnapshotCodec();
+	private:
+		bool ReserveBlocks(size_t blockCount, size_t wordCount);
+		bool WriteSection(FILE* fileOutput, const float* values, size_t valueCount, uint32_t stride, uint32_t& sectionCodec, uint64_t& sectionSize);
+
+		Codec codec;
+		float precision;
+		ThreadPool* threadPool;
+
+		uint64_t* blockData = nullptr;
+		size_t blockDataCapacity = 0;
+		uint64_t* blockSizes = nullptr;
+		float* blockBounds = nullptr;
+		size_t blockCapacity = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,436 @@
+#include "SnapshotWriter.hpp"
+#include "Debug/Exception.hpp"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+namespace gsim {
+	// Constants
+	const size_t MAX_FILE_NAME_LEN = 48;
+
+	// Internal helper functions
+	void SnapshotWriter::CreateVulkanObjects() {
+		// Set the staging buffer create info
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+		uint32_t transferIndex = device->GetQueueFamilyIndices().transferIndex;
+
+		VkBufferCreateInfo stagingBufferInfo {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.size = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float) + sizeof(uint32_t)),
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 1,
+			.pQueueFamilyIndices = &transferIndex
+		};
+
+		// Create a staging buffer for every slot
+		for(uint32_t i = 0; i != queueDepth; ++i) {
+			VkResult result = vkCreateBuffer(device->GetDevice(), &stagingBufferInfo, nullptr, stagingBuffers + i);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to create Vulkan snapshot staging buffer! Error code: %s", string_VkResult(result));
+		}
+
+		// Get the staging buffers' memory requirements
+		VkMemoryRequirements stagingMemRequirements;
+		vkGetBufferMemoryRequirements(device->GetDevice(), stagingBuffers[0], &stagingMemRequirements);
+
+		// Get the staging buffers' memory type index, preferring cached memory, as the writer thread reads it back
+		uint32_t stagingMemTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, stagingMemRequirements.memoryTypeBits);
+		if(stagingMemTypeIndex == UINT32_MAX)
+			stagingMemTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingMemRequirements.memoryTypeBits);
+		if(stagingMemTypeIndex == UINT32_MAX)
+			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan snapshot staging buffers!");
+		
+		// Set the memory requirements of all staging buffers together
+		VkDeviceSize alignedStagingSize = (stagingMemRequirements.size + stagingMemRequirements.alignment - 1) & ~(stagingMemRequirements.alignment - 1);
+
+		VkMemoryRequirements memRequirements {
+			.size = alignedStagingSize * queueDepth,
+			.alignment = stagingMemRequirements.alignment,
+			.memoryTypeBits = stagingMemRequirements.memoryTypeBits
+		};
+
+		// Allocate the staging buffers' memory, which the allocator keeps mapped for the writer's whole lifetime
+		VkResult result = device->GetMemoryAllocator()->Allocate(memRequirements, stagingMemTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_SNAPSHOTS, stagingAllocation);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan snapshot staging buffer memory! Error code: %s", string_VkResult(result));
+		
+		// Bind the staging buffers to their memory
+		for(uint32_t i = 0; i != queueDepth; ++i) {
+			result = vkBindBufferMemory(device->GetDevice(), stagingBuffers[i], stagingAllocation.memory, stagingAllocation.offset + i * alignedStagingSize);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to bind Vulkan snapshot staging buffers to their memory! Error code: %s", string_VkResult(result));
+		}
+
+		for(uint32_t i = 0; i != queueDepth; ++i)
+			slots[i].data = (uint8_t*)stagingAllocation.mappedData + i * alignedStagingSize;
+		
+		// Set the transfer timeline semaphore create info
+		VkSemaphoreTypeCreateInfo semaphoreTypeInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.pNext = nullptr,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0
+		};
+		VkSemaphoreCreateInfo semaphoreInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &semaphoreTypeInfo,
+			.flags = 0
+		};
+
+		// Create the transfer timeline semaphore
+		result = vkCreateSemaphore(device->GetDevice(), &semaphoreInfo, nullptr, &transferTimeline);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan snapshot timeline semaphore! Error code: %s", string_VkResult(result));
+
+		// Allocate the arrays the particles are moved back to their original order in
+		size_t particleCount = particleSystem->GetParticleCount();
+		hostData = malloc(particleCount * ((sizeof(Vec2) << 1) + sizeof(float)));
+		if(!hostData)
+			GSIM_THROW_EXCEPTION("Failed to allocate snapshot particle arrays!");
+		
+		writePos = (Vec2*)hostData;
+		writeVel = writePos + particleCount;
+		writeMass = (float*)(writeVel + particleCount);
+	}
+	void SnapshotWriter::RecordCopyCommands() {
+		// Set the command buffer alloc info, with one command buffer for every particle buffer a slot may copy
+		VkCommandBufferAllocateInfo allocInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = device->GetTransferCommandPool(),
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = particleSystem->GetBufferSetCount()
+		};
+
+		// Set the command buffer begin info
+		VkCommandBufferBeginInfo beginInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.pInheritanceInfo = nullptr
+		};
+
+		// Set the copy regions for all particle components
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		VkBufferCopy posCopyRegion {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = alignedParticleCount * sizeof(Vec2)
+		};
+		VkBufferCopy velCopyRegion {
+			.srcOffset = 0,
+			.dstOffset = alignedParticleCount * sizeof(Vec2),
+			.size = alignedParticleCount * sizeof(Vec2)
+		};
+		VkBufferCopy massCopyRegion {
+			.srcOffset = 0,
+			.dstOffset = alignedParticleCount * (sizeof(Vec2) << 1),
+			.size = alignedParticleCount * sizeof(float)
+		};
+		VkBufferCopy idCopyRegion {
+			.srcOffset = 0,
+			.dstOffset = alignedParticleCount * ((sizeof(Vec2) << 1) + sizeof(float)),
+			.size = alignedParticleCount * sizeof(uint32_t)
+		};
+
+		// Make the copies visible to the writer thread once the transfer finishes
+		VkMemoryBarrier hostBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+		};
+
+		ParticleSystem::ParticleBuffers* buffers = particleSystem->GetBuffers();
+		for(uint32_t i = 0; i != queueDepth; ++i) {
+			// Allocate the slot's command buffers
+			VkResult result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, copyCommandBuffers[i]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to allocate Vulkan snapshot command buffers! Error code: %s", string_VkResult(result));
+
+			for(uint32_t j = 0; j != particleSystem->GetBufferSetCount(); ++j) {
+				// Record the copy of the particle buffer to the slot's staging buffer
+				result = vkBeginCommandBuffer(copyCommandBuffers[i][j], &beginInfo);
+				if(result != VK_SUCCESS)
+					GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan snapshot command buffer! Error code: %s", string_VkResult(result));
+
+				vkCmdCopyBuffer(copyCommandBuffers[i][j], buffers[j].posBuffer, stagingBuffers[i], 1, &posCopyRegion);
+				vkCmdCopyBuffer(copyCommandBuffers[i][j], buffers[j].velBuffer, stagingBuffers[i], 1, &velCopyRegion);
+				vkCmdCopyBuffer(copyCommandBuffers[i][j], buffers[j].massBuffer, stagingBuffers[i], 1, &massCopyRegion);
+				vkCmdCopyBuffer(copyCommandBuffers[i][j], buffers[j].idBuffer, stagingBuffers[i], 1, &idCopyRegion);
+				vkCmdPipelineBarrier(copyCommandBuffers[i][j], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+				result = vkEndCommandBuffer(copyCommandBuffers[i][j]);
+				if(result != VK_SUCCESS)
+					GSIM_THROW_EXCEPTION("Failed to end recording Vulkan snapshot command buffer! Error code: %s", string_VkResult(result));
+			}
+		}
+	}
+	void SnapshotWriter::CreateHostSlots() {
+		// Allocate every slot's arrays in a single block
+		size_t slotSize = particleSystem->GetParticleCount() * ((sizeof(Vec2) << 1) + sizeof(float));
+		hostData = malloc(slotSize * queueDepth);
+		if(!hostData)
+			GSIM_THROW_EXCEPTION("Failed to allocate snapshot particle arrays!");
+		
+		for(uint32_t i = 0; i != queueDepth; ++i)
+			slots[i].data = (uint8_t*)hostData + i * slotSize;
+	}
+	void SnapshotWriter::WriterMain() {
+		while(true) {
+			// Wait for the next queued slot, exiting once the writer is stopping and no slots are left
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queueCondition.wait(lock, [&]() { return stopping || queuedCount; });
+
+				if(!queuedCount)
+					return;
+			}
+
+			// Write the slot's snapshot
+			Slot& slot = slots[nextWriteSlot];
+			bool written = WriteSlot(slot);
+
+			// Free the slot, saving the first failed write
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if(written) {
+					++writtenCount;
+				} else if(!writeFailed) {
+					writeFailed = true;
+					failedSimulationIndex = slot.simulationIndex;
+				}
+
+				slot.queued = false;
+				--queuedCount;
+				nextWriteSlot = (nextWriteSlot + 1) % queueDepth;
+			}
+			slotCondition.notify_all();
+		}
+	}
+	bool SnapshotWriter::WriteSlot(const Slot& slot) {
+		size_t particleCount = particleSystem->GetParticleCount();
+		const Vec2* pos;
+		const Vec2* vel;
+		const float* mass;
+
+		if(particleSystem->GetSimulationBackend() == ParticleSystem::SIMULATION_BACKEND_CPU) {
+			// Use the slot's arrays directly, as the CPU backend keeps the particles in their original order
+			pos = (const Vec2*)slot.data;
+			vel = pos + particleCount;
+			mass = (const float*)(vel + particleCount);
+		} else {
+			// Wait for the slot's copy to finish
+			VkSemaphoreWaitInfo waitInfo {
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+				.pNext = nullptr,
+				.flags = 0,
+				.semaphoreCount = 1,
+				.pSemaphores = &transferTimeline,
+				.pValues = &slot.transferValue
+			};
+			if(vkWaitSemaphores(device->GetDevice(), &waitInfo, UINT64_MAX) != VK_SUCCESS)
+				return false;
+			
+			// Move every particle back to its original index, skipping the particles used only for alignment
+			size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+			const Vec2* stagingPos = (const Vec2*)slot.data;
+			const Vec2* stagingVel = stagingPos + alignedParticleCount;
+			const float* stagingMass = (const float*)(stagingVel + alignedParticleCount);
+			const uint32_t* stagingId = (const uint32_t*)(stagingMass + alignedParticleCount);
+
+			for(size_t i = 0; i != alignedParticleCount; ++i) {
+				uint32_t id = stagingId[i];
+				if(id >= particleCount)
+					continue;
+
+				writePos[id] = stagingPos[i];
+				writeVel[id] = stagingVel[i];
+				writeMass[id] = stagingMass[i];
+			}
+
+			pos = writePos;
+			vel = writeVel;
+			mass = writeMass;
+		}
+
+		// Open the snapshot's file
+		snprintf(filePath + directoryLen, MAX_FILE_NAME_LEN, "/snapshot_%012llu.gsim", (unsigned long long)slot.simulationIndex);
+
+		FILE* fileOutput = fopen(filePath, "wb");
+		if(!fileOutput)
+			return false;
+		
+		// Write the snapshot and close the file
+		bool written = codec->WriteSnapshot(fileOutput, particleCount, pos, vel, mass, nullptr, 0);
+		return !fclose(fileOutput) && written;
+	}
+	void SnapshotWriter::CheckWriteError() {
+		// Throw an exception if the writer thread failed to write a snapshot
+		std::lock_guard<std::mutex> lock(mutex);
+		if(writeFailed)
+			GSIM_THROW_EXCEPTION("Failed to write the particle snapshot of simulation %llu!", (unsigned long long)failedSimulationIndex);
+	}
+
+	// Public functions
+	SnapshotWriter::SnapshotWriter(ParticleSystem* particleSystem, const char* directory, uint64_t interval, uint32_t queueDepth, SnapshotCodec::Codec codec, float precision) : particleSystem(particleSystem), device(particleSystem->GetDevice()), interval(interval), queueDepth(queueDepth) {
+		// Check if the given parameters are valid
+		if(!interval)
+			GSIM_THROW_EXCEPTION("The snapshot interval must be at least 1!");
+		if(!queueDepth || queueDepth > MAX_QUEUE_DEPTH)
+			GSIM_THROW_EXCEPTION("Invalid snapshot queue depth %u! The depth must be between 1 and %u.", queueDepth, MAX_QUEUE_DEPTH);
+		
+		// Copy the directory to the start of the snapshot file path
+		directoryLen = strlen(directory);
+		filePath = (char*)malloc(directoryLen + MAX_FILE_NAME_LEN);
+		if(!filePath)
+			GSIM_THROW_EXCEPTION("Failed to allocate snapshot file path!");
+		memcpy(filePath, directory, directoryLen);
+
+		// Create the slots for the chosen backend
+		if(particleSystem->GetSimulationBackend() == ParticleSystem::SIMULATION_BACKEND_CPU) {
+			CreateHostSlots();
+		} else {
+			CreateVulkanObjects();
+			RecordCopyCommands();
+		}
+
+		// Create the codec, encoding on all hardware threads unless the snapshots are uncompressed
+		threadPool = new ThreadPool((codec == SnapshotCodec::CODEC_RAW) ? 1 : 0);
+		this->codec = new SnapshotCodec(codec, precision, threadPool);
+
+		// Start the writer thread
+		writer = std::thread(&SnapshotWriter::WriterMain, this);
+	}
+
+	bool SnapshotWriter::IsCaptureDue(uint64_t simulationCount) const {
+		return simulationCount % interval == 0;
+	}
+	uint64_t SnapshotWriter::GetNextCaptureTarget(uint64_t simulationCount) const {
+		return (simulationCount / interval + 1) * interval;
+	}
+	void SnapshotWriter::Capture(uint64_t simulationCount) {
+		// Wait for the slot to be written, if the disk fell behind and the queue is full
+		Slot& slot = slots[nextCaptureSlot];
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if(slot.queued) {
+				std::chrono::steady_clock::time_point stallStart = std::chrono::steady_clock::now();
+				slotCondition.wait(lock, [&]() { return !slot.queued; });
+				stallTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+			}
+		}
+		CheckWriteError();
+
+		slot.simulationIndex = simulationCount;
+
+		if(particleSystem->GetSimulationBackend() == ParticleSystem::SIMULATION_BACKEND_CPU) {
+			// Copy the host arrays to the slot, as the simulation only writes them while running
+			size_t particleCount = particleSystem->GetParticleCount();
+			ParticleSystem::ParticleArrays arrays = particleSystem->GetArrays();
+
+			Vec2* pos = (Vec2*)slot.data;
+			Vec2* vel = pos + particleCount;
+			float* mass = (float*)(vel + particleCount);
+
+			memcpy(pos, arrays.pos, particleCount * sizeof(Vec2));
+			memcpy(vel, arrays.vel, particleCount * sizeof(Vec2));
+			memcpy(mass, arrays.mass, particleCount * sizeof(float));
+		} else {
+			// Take the compute input buffer, holding the last submitted simulation's output
+			size_t bufferIndex = particleSystem->GetComputeInputIndex();
+			uint64_t computeValue = particleSystem->GetComputeTimelineValue();
+
+			// Set the timeline semaphore submit info, waiting for the simulations to finish writing the buffer, if any were submitted
+			VkSemaphore computeTimeline = particleSystem->GetComputeTimeline();
+			uint32_t waitSemaphoreCount = computeValue ? 1 : 0;
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			slot.transferValue = ++transferValue;
+
+			VkTimelineSemaphoreSubmitInfo timelineInfo {
+				.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+				.pNext = nullptr,
+				.waitSemaphoreValueCount = waitSemaphoreCount,
+				.pWaitSemaphoreValues = &computeValue,
+				.signalSemaphoreValueCount = 1,
+				.pSignalSemaphoreValues = &slot.transferValue
+			};
+
+			// Set the submit info
+			VkSubmitInfo submitInfo {
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = &timelineInfo,
+				.waitSemaphoreCount = waitSemaphoreCount,
+				.pWaitSemaphores = &computeTimeline,
+				.pWaitDstStageMask = &waitStage,
+				.commandBufferCount = 1,
+				.pCommandBuffers = &copyCommandBuffers[nextCaptureSlot][bufferIndex],
+				.signalSemaphoreCount = 1,
+				.pSignalSemaphores = &transferTimeline
+			};
+
+			// Submit the copy to the transfer queue
+			VkResult result = vkQueueSubmit(device->GetTransferQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to submit Vulkan snapshot command buffer! Error code: %s", string_VkResult(result));
+			
+			// Let the next simulations wait for the copy on the GPU before writing the buffer again, instead of waiting for it here
+			particleSystem->SetTransferTimeline(transferTimeline, slot.transferValue);
+		}
+
+		// Queue the slot for the writer thread
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.queued = true;
+			++queuedCount;
+		}
+		queueCondition.notify_one();
+
+		nextCaptureSlot = (nextCaptureSlot + 1) % queueDepth;
+	}
+	void SnapshotWriter::Flush() {
+		// Wait for the writer thread to write all queued slots
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slotCondition.wait(lock, [&]() { return !queuedCount; });
+		}
+		CheckWriteError();
+	}
+
+	SnapshotWriter::~SnapshotWriter() {
+		// Stop the writer thread once all queued slots are written
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+		writer.join();
+
+		// Destroy the Vulkan objects, if they were created
+		if(particleSystem->GetSimulationBackend() != ParticleSystem::SIMULATION_BACKEND_CPU) {
+			for(uint32_t i = 0; i != queueDepth; ++i) {
+				vkFreeCommandBuffers(device->GetDevice(), device->GetTransferCommandPool(), particleSystem->GetBufferSetCount(), copyCommandBuffers[i]);
+				vkDestroyBuffer(device->GetDevice(), stagingBuffers[i], nullptr);
+			}
+			device->GetMemoryAllocator()->Free(stagingAllocation);
+			vkDestroySemaphore(device->GetDevice(), transferTimeline, nullptr);
+		}
+
+		// Destroy the codec
+		delete codec;
+		delete threadPool;
+
+		// Free the host arrays and the file path
+		free(hostData);
+		free(filePath);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "ParticleSystem.hpp"
+#include "SnapshotCodec.hpp"
+#include "Platform/ThreadPool.hpp"
+#include "Vulkan/VulkanDevice.hpp"
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+namespace gsim {
+	/// @brief A periodic writer of binary particle snapshots, copying the particles into a ring of host buffers and writing them to disk on a background thread.
+	class SnapshotWriter {
+	public:
+		/// @brief The maximum number of snapshots that may be queued for writing at the same time.
+		static const uint32_t MAX_QUEUE_DEPTH = 8;
+		/// @brief The default number of snapshots that may be queued for writing at the same time.
+		static const uint32_t DEFAULT_QUEUE_DEPTH = 2;
+
+		SnapshotWriter() = delete;
+		SnapshotWriter(const SnapshotWriter&) = delete;
+		SnapshotWriter(SnapshotWriter&&) noexcept = delete;
+
+		/// @brief Creates a snapshot writer for the given particle system.
+		/// @param particleSystem The particle system to capture.
+		/// @param directory The existing directory to write the snapshots to.
+		/// @param interval The number of simulations between two snapshots.
+		/// @param queueDepth The number of snapshots that may be queued for writing at the same time, at most MAX_QUEUE_DEPTH. Capturing blocks once the queue is full.
+		/// @param codec The codec used to encode the snapshots, on threads owned by the writer.
+		/// @param precision The maximum error of every quantized position. Only used by the quantized codec.
+		SnapshotWriter(ParticleSystem* particleSystem, const char* directory, uint64_t interval, uint32_t queueDepth, SnapshotCodec::Codec codec, float precision);
+
+		SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+		SnapshotWriter& operator=(SnapshotWriter&&) = delete;
+
+		/// @brief Gets the particle system captured by the writer.
+		/// @return A pointer to the particle system.
+		ParticleSystem* GetParticleSystem() {
+			return particleSystem;
+		}
+		/// @brief Gets the particle system captured by the writer.
+		/// @return A const pointer to the particle system.
+		const ParticleSystem* GetParticleSystem() const {
+			return particleSystem;
+		}
+		/// @brief Gets the number of simulations between two snapshots.
+		/// @return The number of simulations between two snapshots.
+		uint64_t GetInterval() const {
+			return interval;
+		}
+		/// @brief Gets the number of snapshots that may be queued for writing at the same time.
+		/// @return The number of snapshots that may be queued for writing at the same time.
+		uint32_t GetQueueDepth() const {
+			return queueDepth;
+		}
+		/// @brief Gets the number of snapshots written so far.
+		/// @return The number of snapshots written so far.
+		uint64_t GetWrittenCount() const {
+			return writtenCount;
+		}
+		/// @brief Gets the total time spent waiting for a free queue slot, as the disk fell behind.
+		/// @return The total time, in seconds, spent waiting for a free queue slot.
+		double GetStallTime() const {
+			return stallTime;
+		}
+
+		/// @brief Checks if a snapshot is due after the given number of simulations.
+		/// @param simulationCount The number of simulations submitted so far.
+		/// @return True if Capture should be called, otherwise false.
+		bool IsCaptureDue(uint64_t simulationCount) const;
+		/// @brief Gets the next simulation count after which a snapshot is due. Simulation batches must not run past it.
+		/// @param simulationCount The number of simulations submitted so far.
+		/// @return The next simulation count after which a snapshot is due.
+		uint64_t GetNextCaptureTarget(uint64_t simulationCount) const;
+		/// @brief Captures the particles and queues them for writing, waiting for a free queue slot if the queue is full.
+		/// @param simulationCount The number of simulations submitted so far. A snapshot must be due.
+		void Capture(uint64_t simulationCount);
+		/// @brief Waits for all queued snapshots to be written.
+		void Flush();
+
+		/// @brief Destroys the snapshot writer, waiting for all queued snapshots to be written.
+		~SnapshotWriter();
+	private:
+		struct Slot {
+			void* data;
+			uint64_t simulationIndex;
+			uint64_t transferValue;
+			bool queued;
+		};
+
+		void CreateVulkanObjects();
+		void RecordCopyCommands();
+		void CreateHostSlots();
+		void WriterMain();
+		bool WriteSlot(const Slot& slot);
+		void CheckWriteError();
+
+		ParticleSystem* particleSystem;
+		VulkanDevice* device;
+		char* filePath;
+		size_t directoryLen;
+		uint64_t interval;
+		uint32_t queueDepth;
+
+		Slot slots[MAX_QUEUE_DEPTH]{};
+		uint32_t nextCaptureSlot = 0;
+		uint32_t nextWriteSlot = 0;
+		uint32_t queuedCount = 0;
+		uint64_t writtenCount = 0;
+		double stallTime = 0;
+
+		VkBuffer stagingBuffers[MAX_QUEUE_DEPTH]{};
+		VulkanMemoryAllocator::Allocation stagingAllocation;
+		VkCommandBuffer copyCommandBuffers[MAX_QUEUE_DEPTH][ParticleSystem::MAX_BUFFER_SET_COUNT];
+		VkSemaphore transferTimeline = VK_NULL_HANDLE;
+		uint64_t transferValue = 0;
+
+		void* hostData = nullptr;
+		Vec2* writePos = nullptr;
+		Vec2* writeVel = nullptr;
+		float* writeMass = nullptr;
+
+		ThreadPool* threadPool = nullptr;
+		SnapshotCodec* codec = nullptr;
+		std::thread writer;
+		std::mutex mutex;
+		std::condition_variable queueCondition;
+		std::condition_variable slotCondition;
+		bool stopping = false;
+		bool writeFailed = false;
+		uint64_t failedSimulationIndex = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "AtomicFile.hpp"
+#include "Debug/Exception.hpp"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(WIN32) || defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace gsim {
+	// Constants
+	const size_t MAX_TEMP_SUFFIX_SIZE = 32;
+	const uint32_t MAX_TEMP_ATTEMPT_COUNT = 64;
+
+	// Internal helper functions
+	static bool SyncFile(FILE* file) {
+		// Write the stream's buffer and the OS's cached pages to the disk
+		if(fflush(file))
+			return false;
+#if defined(WIN32) || defined(_WIN32)
+		return !_commit(_fileno(file));
+#else
+		return !fsync(fileno(file));
+#endif
+	}
+	static FILE* CreateUniqueFile(char* tempPath, size_t tempPathLen) {
+		// Try new suffixes until one isn't taken, as every writer, even in another process, must own its temporary file
+		static std::atomic<uint32_t> tempCounter = 0;
+		for(uint32_t i = 0; i != MAX_TEMP_ATTEMPT_COUNT; ++i) {
+#if defined(WIN32) || defined(_WIN32)
+			snprintf(tempPath + tempPathLen, MAX_TEMP_SUFFIX_SIZE, ".%u.%u.tmp", (uint32_t)_getpid(), tempCounter.fetch_add(1, std::memory_order_relaxed));
+			int fileDescriptor = _open(tempPath, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+			snprintf(tempPath + tempPathLen, MAX_TEMP_SUFFIX_SIZE, ".%u.%u.tmp", (uint32_t)getpid(), tempCounter.fetch_add(1, std::memory_order_relaxed));
+			int fileDescriptor = open(tempPath, O_CREAT | O_EXCL | O_WRONLY, 0666);
+#endif
+			if(fileDescriptor == -1) {
+				if(errno == EEXIST)
+					continue;
+				return nullptr;
+			}
+
+			// Wrap the descriptor in a stream, removing the file if that fails
+#if defined(WIN32) || defined(_WIN32)
+			FILE* file = _fdopen(fileDescriptor, "wb");
+			if(!file)
+				_close(fileDescriptor);
+#else
+			FILE* file = fdopen(fileDescriptor, "wb");
+			if(!file)
+				close(fileDescriptor);
+#endif
+			if(!file)
+				remove(tempPath);
+			return file;
+		}
+
+		return nullptr;
+	}
+	static bool MoveOverFile(const char* tempPath, const char* filePath) {
+#if defined(WIN32) || defined(_WIN32)
+		// Move the temporary file over the destination, only returning once the move reached the disk
+		return MoveFileExA(tempPath, filePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+		// Rename the temporary file over the destination, which is atomic within a file system
+		if(rename(tempPath, filePath))
+			return false;
+		
+		// Sync the parent directory, so that the rename itself survives a crash; failing to do so only risks the old file reappearing
+		const char* nameStart = strrchr(filePath, '/');
+		int directoryDescriptor;
+		if(nameStart) {
+			size_t directoryLen = nameStart == filePath ? 1 : nameStart - filePath;
+			char* directoryPath = (char*)malloc(directoryLen + 1);
+			if(!directoryPath)
+				return true;
+			memcpy(directoryPath, filePath, directoryLen);
+			directoryPath[directoryLen] = 0;
+
+			directoryDescriptor = open(directoryPath, O_RDONLY);
+			free(directoryPath);
+		} else {
+			directoryDescriptor = open(".", O_RDONLY);
+		}
+		if(directoryDescriptor != -1) {
+			fsync(directoryDescriptor);
+			close(directoryDescriptor);
+		}
+
+		return true;
+#endif
+	}
+
+	// Public functions
+	AtomicFile::AtomicFile(const char* filePath) {
+		// Allocate both paths in a single block
+		size_t filePathLen = strlen(filePath);
+		this->filePath = (char*)malloc(((filePathLen + 1) << 1) + MAX_TEMP_SUFFIX_SIZE);
+		if(!this->filePath)
+			GSIM_THROW_EXCEPTION("Failed to allocate atomic file paths!");
+		tempPath = this->filePath + filePathLen + 1;
+
+		// Set the paths, placing the temporary file next to the destination so that the rename never crosses file systems
+		memcpy(this->filePath, filePath, filePathLen + 1);
+		memcpy(tempPath, filePath, filePathLen);
+
+		// Create a temporary file no other writer uses, suffixed with the process ID and a counter
+		file = CreateUniqueFile(tempPath, filePathLen);
+		if(!file) {
+			free(this->filePath);
+			GSIM_THROW_EXCEPTION("Failed to create temporary file for \"%s\"!", filePath);
+		}
+	}
+
+	void AtomicFile::Commit() {
+		// Sync and close the temporary file before it replaces the destination, so that a crash never leaves a partial file behind
+		bool synced = SyncFile(file);
+		bool closed = !fclose(file);
+		file = nullptr;
+		if(!synced || !closed) {
+			remove(tempPath);
+			GSIM_THROW_EXCEPTION("Failed to write temporary file \"%s\"!", tempPath);
+		}
+		
+		// Replace the destination file
+		if(!MoveOverFile(tempPath, filePath)) {
+			remove(tempPath);
+			GSIM_THROW_EXCEPTION("Failed to replace file \"%s\"!", filePath);
+		}
+	}
+
+	AtomicFile::~AtomicFile() {
+		// Close and remove the temporary file, if it wasn't committed
+		if(file) {
+			fclose(file);
+			remove(tempPath);
+		}
+
+		// Free the paths
+		free(filePath);
+	}
+}
\ No newline at end of file
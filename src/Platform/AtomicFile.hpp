@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdio.h>
+
+namespace gsim {
+	/// @brief A binary file written to a temporary path next to its destination and renamed over it once complete, so that readers only ever see the old or the whole new file.
+	class AtomicFile {
+	public:
+		AtomicFile() = delete;
+		AtomicFile(const AtomicFile&) = delete;
+		AtomicFile(AtomicFile&&) noexcept = delete;
+
+		/// @brief Creates a temporary file for writing, unique to this writer, which replaces the given file once committed.
+		/// @param filePath The path of the file to replace.
+		AtomicFile(const char* filePath);
+
+		AtomicFile& operator=(const AtomicFile&) = delete;
+		AtomicFile& operator=(AtomicFile&&) = delete;
+
+		/// @brief Gets the stream of the temporary file.
+		/// @return A pointer to the temporary file's stream, opened in binary mode.
+		FILE* GetFile() {
+			return file;
+		}
+
+		/// @brief Flushes the temporary file to the disk and renames it over the destination file.
+		void Commit();
+
+		/// @brief Closes and removes the temporary file, if it wasn't committed.
+		~AtomicFile();
+	private:
+		char* filePath;
+		char* tempPath;
+		FILE* file;
+	};
+}
\ No newline at end of file
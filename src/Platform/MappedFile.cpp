@@ -0,0 +1,94 @@
+#include "MappedFile.hpp"
+#include "Debug/Exception.hpp"
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gsim {
+	// Public functions
+#if defined(WIN32) || defined(_WIN32)
+	MappedFile::MappedFile(const char* filePath) {
+		// Open the file
+		fileHandle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(fileHandle == INVALID_HANDLE_VALUE)
+			GSIM_THROW_EXCEPTION("Failed to open file \"%s\" for mapping!", filePath);
+		
+		// Get the file's size
+		LARGE_INTEGER fileSize;
+		if(!GetFileSizeEx(fileHandle, &fileSize)) {
+			CloseHandle(fileHandle);
+			GSIM_THROW_EXCEPTION("Failed to get the size of file \"%s\"!", filePath);
+		}
+		size = (size_t)fileSize.QuadPart;
+
+		// Exit the function if the file is empty, as empty files can't be mapped
+		if(!size)
+			return;
+
+		// Create the file mapping
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(!mappingHandle) {
+			CloseHandle(fileHandle);
+			GSIM_THROW_EXCEPTION("Failed to create mapping for file \"%s\"!", filePath);
+		}
+
+		// Map the whole file
+		data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if(!data) {
+			CloseHandle(mappingHandle);
+			CloseHandle(fileHandle);
+			GSIM_THROW_EXCEPTION("Failed to map file \"%s\"!", filePath);
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		// Unmap the file and close its handles
+		if(data)
+			UnmapViewOfFile(data);
+		if(mappingHandle)
+			CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+	}
+#else
+	MappedFile::MappedFile(const char* filePath) {
+		// Open the file
+		int fileDescriptor = open(filePath, O_RDONLY);
+		if(fileDescriptor == -1)
+			GSIM_THROW_EXCEPTION("Failed to open file \"%s\" for mapping!", filePath);
+		
+		// Get the file's size
+		struct stat fileStat;
+		if(fstat(fileDescriptor, &fileStat) == -1) {
+			close(fileDescriptor);
+			GSIM_THROW_EXCEPTION("Failed to get the size of file \"%s\"!", filePath);
+		}
+		size = (size_t)fileStat.st_size;
+
+		// Map the whole file, as empty files can't be mapped
+		if(size) {
+			void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+			if(mapping == MAP_FAILED) {
+				close(fileDescriptor);
+				GSIM_THROW_EXCEPTION("Failed to map file \"%s\"!", filePath);
+			}
+
+			// Let the kernel read ahead, as the file is copied front to back
+			madvise(mapping, size, MADV_SEQUENTIAL);
+			data = mapping;
+		}
+
+		// Close the file descriptor, as the mapping keeps the file open
+		close(fileDescriptor);
+	}
+
+	MappedFile::~MappedFile() {
+		// Unmap the file
+		if(data)
+			munmap((void*)data, size);
+	}
+#endif
+}
\ No newline at end of file
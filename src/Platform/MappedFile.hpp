@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(WIN32) || defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace gsim {
+	/// @brief A read-only view of a whole file mapped into memory, letting the OS page its contents in on demand.
+	class MappedFile {
+	public:
+		MappedFile() = delete;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+
+		/// @brief Maps the given file into memory.
+		/// @param filePath The path of the file to map.
+		MappedFile(const char* filePath);
+
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) = delete;
+
+		/// @brief Gets the file's mapped contents.
+		/// @return A pointer to the file's contents, or nullptr if the file is empty.
+		const void* GetData() const {
+			return data;
+		}
+		/// @brief Gets the file's size.
+		/// @return The file's size, in bytes.
+		size_t GetSize() const {
+			return size;
+		}
+
+		/// @brief Unmaps the file.
+		~MappedFile();
+	private:
+		const void* data = nullptr;
+		size_t size = 0;
+
+#if defined(WIN32) || defined(_WIN32)
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;
+		HANDLE mappingHandle = NULL;
+#endif
+	};
+}
\ No newline at end of file
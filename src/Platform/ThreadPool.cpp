@@ -0,0 +1,157 @@
+#include "ThreadPool.hpp"
+#include "Debug/Exception.hpp"
+#include <stdlib.h>
+#include <new>
+
+namespace gsim {
+	// Internal helper functions
+	void ThreadPool::WorkerMain(uint32_t threadIndex) {
+		uint64_t lastGeneration = 0;
+
+		while(true) {
+			// Wait for a new task to be posted
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				startCondition.wait(lock, [&]() { return stopping || taskGeneration != lastGeneration; });
+
+				// Exit the thread if the pool is being destroyed
+				if(stopping)
+					return;
+				lastGeneration = taskGeneration;
+			}
+
+			// Run the current task
+			RunTask(threadIndex);
+
+			// Notify the calling thread if this was the last active worker
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!--activeWorkerCount)
+					finishCondition.notify_one();
+			}
+		}
+	}
+	void ThreadPool::RunTask(uint32_t threadIndex) {
+		// Process grains from the thread's own range, stealing from other threads once it runs out
+		uint64_t grain;
+		while(PopGrain(threadIndex, grain) || (StealGrains(threadIndex) && PopGrain(threadIndex, grain))) {
+			size_t begin = (size_t)grain * taskGrainSize;
+			size_t end = begin + taskGrainSize;
+			if(end > taskCount)
+				end = taskCount;
+
+			taskCallback(taskUserData, begin, end, threadIndex);
+		}
+	}
+	bool ThreadPool::PopGrain(uint32_t threadIndex, uint64_t& grain) {
+		// Claim the first grain of the thread's range; ranges store their first grain in the upper and their end in the lower 32 bits
+		std::atomic<uint64_t>& range = workRanges[threadIndex].range;
+		uint64_t oldRange = range.load(std::memory_order_acquire);
+
+		while(true) {
+			uint64_t begin = oldRange >> 32;
+			uint64_t end = oldRange & UINT32_MAX;
+			if(begin >= end)
+				return false;
+
+			if(range.compare_exchange_weak(oldRange, ((begin + 1) << 32) | end, std::memory_order_acq_rel)) {
+				grain = begin;
+				return true;
+			}
+		}
+	}
+	bool ThreadPool::StealGrains(uint32_t threadIndex) {
+		// Look for a victim with grains left, starting with the next thread
+		for(uint32_t i = 1; i != threadCount; ++i) {
+			std::atomic<uint64_t>& victimRange = workRanges[(threadIndex + i) % threadCount].range;
+			uint64_t oldRange = victimRange.load(std::memory_order_acquire);
+
+			while(true) {
+				uint64_t begin = oldRange >> 32;
+				uint64_t end = oldRange & UINT32_MAX;
+				if(begin >= end)
+					break;
+
+				// Take the back half of the victim's range, leaving the grains it's likely to touch next
+				uint64_t middle = begin + ((end - begin) >> 1);
+				if(victimRange.compare_exchange_weak(oldRange, (begin << 32) | middle, std::memory_order_acq_rel)) {
+					workRanges[threadIndex].range.store((middle << 32) | end, std::memory_order_release);
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Public functions
+	ThreadPool::ThreadPool(uint32_t threadCount) : threadCount(threadCount) {
+		// Use all hardware threads if no thread count was given
+		if(!this->threadCount)
+			this->threadCount = std::thread::hardware_concurrency();
+		if(!this->threadCount)
+			this->threadCount = 1;
+
+		// Allocate the worker and work range arrays
+		workers = (std::thread*)malloc(sizeof(std::thread) * (this->threadCount - 1));
+		if(!workers && this->threadCount != 1)
+			GSIM_THROW_EXCEPTION("Failed to allocate thread pool worker array!");
+		workRanges = new WorkRange[this->threadCount];
+
+		// Start the workers; the calling thread acts as the worker with index 0
+		for(uint32_t i = 1; i != this->threadCount; ++i)
+			new(workers + i - 1) std::thread(&ThreadPool::WorkerMain, this, i);
+	}
+
+	void ThreadPool::ParallelFor(size_t count, size_t grainSize, TaskCallback callback, void* userData) {
+		// Run the task on the calling thread only if there is nothing to split
+		if(threadCount == 1 || count <= grainSize) {
+			for(size_t begin = 0; begin < count; begin += grainSize)
+				callback(userData, begin, (begin + grainSize < count) ? (begin + grainSize) : count, 0);
+			return;
+		}
+
+		// Post the task to the workers
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			taskCount = count;
+			taskGrainSize = grainSize;
+			taskCallback = callback;
+			taskUserData = userData;
+
+			// Give every thread an equal contiguous part of the grains
+			uint64_t grainCount = (count + grainSize - 1) / grainSize;
+			for(uint32_t i = 0; i != threadCount; ++i)
+				workRanges[i].range.store(((grainCount * i / threadCount) << 32) | (grainCount * (i + 1) / threadCount), std::memory_order_relaxed);
+
+			activeWorkerCount = threadCount - 1;
+			++taskGeneration;
+		}
+		startCondition.notify_all();
+
+		// Help with the task on the calling thread
+		RunTask(0);
+
+		// Wait for all workers to finish
+		std::unique_lock<std::mutex> lock(mutex);
+		finishCondition.wait(lock, [&]() { return !activeWorkerCount; });
+	}
+
+	ThreadPool::~ThreadPool() {
+		// Signal all workers to stop
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		startCondition.notify_all();
+
+		// Join and destroy all workers
+		for(uint32_t i = 0; i != threadCount - 1; ++i) {
+			workers[i].join();
+			workers[i].~thread();
+		}
+		free(workers);
+		delete[] workRanges;
+	}
+}
\ No newline at end of file
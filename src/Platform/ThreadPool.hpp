@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace gsim {
+	/// @brief A pool of persistent worker threads used to run data-parallel loops, balanced using work-stealing.
+	class ThreadPool {
+	public:
+		/// @brief A parallel task callback, called for a contiguous range of indices.
+		typedef void(*TaskCallback)(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+
+		ThreadPool() = delete;
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+
+		/// @brief Creates a thread pool.
+		/// @param threadCount The number of threads to run tasks on, including the calling thread, or 0 to use all hardware threads.
+		ThreadPool(uint32_t threadCount);
+
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) = delete;
+
+		/// @brief Gets the number of threads tasks are run on, including the calling thread.
+		/// @return The number of threads tasks are run on, including the calling thread.
+		uint32_t GetThreadCount() const {
+			return threadCount;
+		}
+
+		/// @brief Runs the given callback over the given index range, split between all threads, and waits for it to finish.
+		/// Every thread starts with its own contiguous part of the range and steals half of another thread's remaining part once it runs out.
+		/// @param count The number of indices to process.
+		/// @param grainSize The number of indices a thread claims at once. Must be larger than zero. Every callback receives one grain, starting at a multiple of the grain size.
+		/// @param callback The callback to run for every claimed index range.
+		/// @param userData The data to be passed to the callback as a parameter.
+		void ParallelFor(size_t count, size_t grainSize, TaskCallback callback, void* userData);
+
+		/// @brief Destroys the thread pool.
+		~ThreadPool();
+	private:
+		struct alignas(64) WorkRange {
+			std::atomic<uint64_t> range;
+		};
+
+		void WorkerMain(uint32_t threadIndex);
+		void RunTask(uint32_t threadIndex);
+		bool PopGrain(uint32_t threadIndex, uint64_t& grain);
+		bool StealGrains(uint32_t threadIndex);
+
+		uint32_t threadCount;
+		std::thread* workers;
+		WorkRange* workRanges;
+
+		std::mutex mutex;
+		std::condition_variable startCondition;
+		std::condition_variable finishCondition;
+		uint64_t taskGeneration = 0;
+		uint32_t activeWorkerCount = 0;
+		bool stopping = false;
+
+		size_t taskCount;
+		size_t taskGrainSize;
+		TaskCallback taskCallback;
+		void* taskUserData;
+	};
+}
\ No newline at end of file
@@ -8,6 +8,14 @@ namespace gsim {
 	// Constants
 	const uint32_t WORKGROUP_SIZE_PARTICLE = 128;
 	const uint32_t WORKGROUP_SIZE_TREE = 64;
+	const uint32_t TREE_DESCRIPTOR_COUNT = (BarnesHutSimulation::MAX_TREE_DEPTH + 1) << 2;
+	const uint32_t SORT_DESCRIPTOR_COUNT = 10;
+	const uint32_t SORT_BLOCK_SIZE = 1024;
+	const uint32_t SORT_RADIX_BITS = 4;
+	const uint32_t SORT_RADIX_SIZE = 1 << SORT_RADIX_BITS;
+	const uint32_t PARTICLE_ORDER_KEEP = 0;
+	const uint32_t PARTICLE_ORDER_TRACK = 1;
+	const uint32_t PARTICLE_ORDER_SORT = 2;
 
 	// Structs
 	struct SpecializationConstants {
@@ -19,13 +27,22 @@ namespace gsim {
 		float gravitationalConst;
 		float softeningLenSqr;
 		float accuracyParameterSqr;
-		float simulationSize;
 
 		uint32_t particleCount;
 		uint32_t treeSize;
+		uint32_t treeDepth;
+		uint32_t sortBlockSize;
+		uint32_t keyDepth;
+		uint32_t leafCapacity;
+		uint32_t particleOrder;
+		uint32_t forceWalk;
+		VkBool32 quadrupoleMoments;
 	};
 
 	// Shader sources
+	const uint32_t BOUNDS_SHADER_SOURCE[] {
+#include "Shaders/BoundsShader.comp.u32"
+	};
 	const uint32_t CLEAR_SHADER_SOURCE[] {
 #include "Shaders/ClearShader.comp.u32"
 	};
@@ -47,38 +64,123 @@ namespace gsim {
 	const uint32_t TREE_SORT_SHADER_SOURCE[] {
 #include "Shaders/TreeSortShader.comp.u32"
 	};
+	const uint32_t KEY_SHADER_SOURCE[] {
+#include "Shaders/KeyShader.comp.u32"
+	};
+	const uint32_t RADIX_COUNT_SHADER_SOURCE[] {
+#include "Shaders/RadixCountShader.comp.u32"
+	};
+	const uint32_t RADIX_SCATTER_SHADER_SOURCE[] {
+#include "Shaders/RadixScatterShader.comp.u32"
+	};
+	const uint32_t SCAN_SHADER_SOURCE[] {
+#include "Shaders/ScanShader.comp.u32"
+	};
+	const uint32_t NODE_COUNT_SHADER_SOURCE[] {
+#include "Shaders/NodeCountShader.comp.u32"
+	};
+	const uint32_t NODE_OFFSET_SHADER_SOURCE[] {
+#include "Shaders/NodeOffsetShader.comp.u32"
+	};
+	const uint32_t NODE_EMIT_SHADER_SOURCE[] {
+#include "Shaders/NodeEmitShader.comp.u32"
+	};
+	const uint32_t NODE_REDUCE_SHADER_SOURCE[] {
+#include "Shaders/NodeReduceShader.comp.u32"
+	};
+	const uint32_t NODE_REFIT_SHADER_SOURCE[] {
+#include "Shaders/NodeRefitShader.comp.u32"
+	};
+	const uint32_t LEAF_REDUCE_SHADER_SOURCE[] {
+#include "Shaders/LeafReduceShader.comp.u32"
+	};
+	const uint32_t LEAF_GATHER_SHADER_SOURCE[] {
+#include "Shaders/LeafGatherShader.comp.u32"
+	};
 
 	// Internal helper functions
+	static VkMemoryRequirements GetCombinedRequirements(uint32_t bufferCount, const VkMemoryRequirements* memRequirements, uint32_t memoryTypeBits, VkDeviceSize* offsets) {
+		VkMemoryRequirements combinedRequirements {
+			.size = 0,
+			.alignment = 1,
+			.memoryTypeBits = memoryTypeBits
+		};
+
+		for(uint32_t i = 0; i != bufferCount; ++i) {
+			// Align the buffer's offset to its own alignment
+			VkDeviceSize alignment = memRequirements[i].alignment ? memRequirements[i].alignment : 1;
+			offsets[i] = (combinedRequirements.size + alignment - 1) & ~(alignment - 1);
+			combinedRequirements.size = offsets[i] + memRequirements[i].size;
+
+			// Keep the largest alignment, so that every offset stays aligned wherever the memory is placed
+			if(alignment > combinedRequirements.alignment)
+				combinedRequirements.alignment = alignment;
+		}
+
+		return combinedRequirements;
+	}
+
 	void BarnesHutSimulation::CreateBuffers() {
 		// Get the compute family index
 		uint32_t computeIndex = device->GetQueueFamilyIndices().computeIndex;
 
+		// Calculate the maximum node count, as every level holds at most one node for every two particles
+		VkDeviceSize nodeCap = 0;
+		for(uint32_t i = 0; i <= keyDepth; ++i) {
+			VkDeviceSize levelSize = (VkDeviceSize)1 << (i << 1);
+			VkDeviceSize levelNodeCap = particleSystem->GetAlignedParticleCount() >> 1;
+			nodeCap += levelSize < levelNodeCap ? levelSize : levelNodeCap;
+		}
+
 		// Calculate the required buffer capacity
-		VkDeviceSize bufferCap = particleSystem->GetAlignedParticleCount() + 1398101;
+		VkDeviceSize bufferCap = particleSystem->GetAlignedParticleCount() + nodeCap;
+
+		// Calculate the sparse tree construction buffer capacities, keeping them minimal if the tree is built densely, apart from the sort buffers used by sorted leaf accumulation
+		VkDeviceSize sortCap = 1;
+		VkDeviceSize blockSumCap = 1;
+		VkDeviceSize levelNodeCap = 1;
+		if(treeBuild == TREE_BUILD_SPARSE || leafAccumulation != LEAF_ACCUMULATION_ATOMIC) {
+			sortCap = particleSystem->GetAlignedParticleCount();
+			blockSumCap = (VkDeviceSize)SORT_RADIX_SIZE * sortBlockCount;
+		}
+		if(treeBuild == TREE_BUILD_SPARSE)
+			levelNodeCap = nodeCap;
+
+		// Only store the nodes' quadrupole moments if they are applied
+		VkDeviceSize nodeQuadCap = quadrupoleMoments ? bufferCap : 1;
 
 		// Save the buffer sizes to an array
 		VkDeviceSize bufferSizes[] {
-			sizeof(uint32_t) * bufferCap, // countBuffer
-			sizeof(float) * bufferCap,    // radiusBuffer
-			sizeof(Vec2) * bufferCap,     // nodePosBuffer
-			sizeof(float) * bufferCap,    // nodeMassBuffer
-			sizeof(uint32_t) * bufferCap  // srcBuffer
+			sizeof(uint32_t) * bufferCap,               // countBuffer
+			sizeof(float) * bufferCap,                  // radiusBuffer
+			sizeof(Vec2) * bufferCap,                   // nodePosBuffer
+			sizeof(float) * bufferCap,                  // nodeMassBuffer
+			sizeof(uint32_t) * bufferCap,               // srcBuffer
+			sizeof(Vec2u) * 2,                          // boundsBuffer
+			sizeof(uint32_t) * sortCap,                 // sortKeyBuffers[0]
+			sizeof(uint32_t) * sortCap,                 // sortKeyBuffers[1]
+			sizeof(uint32_t) * sortCap,                 // sortValueBuffer
+			sizeof(uint32_t) * (sortCap + 1),           // nodeOffsetBuffer
+			sizeof(uint32_t) * blockSumCap,             // blockSumBuffer
+			sizeof(uint32_t) * levelNodeCap,            // levelNodeBuffer
+			sizeof(uint32_t) * (MAX_REFINED_DEPTH + 1), // levelCountBuffer
+			sizeof(TreeStats),                          // treeStatsBuffer
+			sizeof(Vec4) * nodeQuadCap                  // nodeQuadBuffer
 		};
 
 		// Create the buffers and get their infos
-		VkBuffer buffers[5];
-		VkMemoryRequirements memRequirements[5];
-		VkDeviceSize alignment = 1;
+		VkBuffer buffers[15];
+		VkMemoryRequirements memRequirements[15];
 		uint32_t memoryTypeBits = 0xffffffffu;
 
-		for(uint32_t i = 0; i != 5; ++i) {
+		for(uint32_t i = 0; i != 15; ++i) {
 			// Set the buffer info
 			VkBufferCreateInfo bufferInfo {
 				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 				.pNext = nullptr,
 				.flags = 0,
 				.size = bufferSizes[i],
-				.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 				.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 				.queueFamilyIndexCount = 1,
 				.pQueueFamilyIndices = &computeIndex
@@ -93,44 +195,28 @@ namespace gsim {
 			vkGetBufferMemoryRequirements(device->GetDevice(), buffers[i], memRequirements + i);
 
 			// Set the global memory's new info
-			if(memRequirements[i].alignment)
-				alignment = memRequirements[i].alignment;
 			memoryTypeBits &= memRequirements[i].memoryTypeBits;
 		}
 
-		// Set the allocated memory's size
-		VkDeviceSize memorySize = 0;
-		for(uint32_t i = 0; i != 5; ++i) {
-			memRequirements[i].size = (memRequirements[i].size + alignment - 1) & ~(alignment - 1);
-			memorySize += memRequirements[i].size;
-		}
+		// Place every buffer at an offset aligned to its own alignment, aligning the whole memory to the largest one
+		VkDeviceSize offsets[15];
+		VkMemoryRequirements memoryRequirements = GetCombinedRequirements(15, memRequirements, memoryTypeBits, offsets);
 
 		// Get the memory type's index
 		uint32_t memoryTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memoryTypeBits);
 		if(memoryTypeIndex == UINT32_MAX)
 			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan Barnes-Hut simulation buffers!");
 		
-		// Set the alloc info
-		VkMemoryAllocateInfo allocInfo {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.allocationSize = memorySize,
-			.memoryTypeIndex = memoryTypeIndex
-		};
-
 		// Allocate the buffer memory
-		VkResult result = vkAllocateMemory(device->GetDevice(), &allocInfo, nullptr, &bufferMemory);
+		VkResult result = device->GetMemoryAllocator()->Allocate(memoryRequirements, memoryTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_SIMULATION, bufferAllocation);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan Barnes-Hut buffer memory! Error code: %s", string_VkResult(result));
 		
 		// Bind the buffers to their memory
-		VkDeviceSize offset = 0;
-		for(uint32_t i = 0; i != 5; ++i) {
-			result = vkBindBufferMemory(device->GetDevice(), buffers[i], bufferMemory, offset);
+		for(uint32_t i = 0; i != 15; ++i) {
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i], bufferAllocation.memory, bufferAllocation.offset + offsets[i]);
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to bind Vulkan Barnes-Hut simulation buffers to their memory! Error code: %s", string_VkResult(result));
-
-			offset += memRequirements[i].size;
 		}
 
 		// Assign all buffers
@@ -139,6 +225,16 @@ namespace gsim {
 		nodePosBuffer = buffers[2];
 		nodeMassBuffer = buffers[3];
 		srcBuffer = buffers[4];
+		boundsBuffer = buffers[5];
+		sortKeyBuffers[0] = buffers[6];
+		sortKeyBuffers[1] = buffers[7];
+		sortValueBuffer = buffers[8];
+		nodeOffsetBuffer = buffers[9];
+		blockSumBuffer = buffers[10];
+		levelNodeBuffer = buffers[11];
+		levelCountBuffer = buffers[12];
+		treeStatsBuffer = buffers[13];
+		nodeQuadBuffer = buffers[14];
 	}
 	void BarnesHutSimulation::CreateTreeBuffers() {
 		// Get the compute family index
@@ -153,13 +249,15 @@ namespace gsim {
 		};
 
 		// Create the buffers and get their infos
-		VkBuffer buffers[44];
-		VkMemoryRequirements memRequirements[44];
-		VkDeviceSize alignment = 1;
+		uint32_t levelCount = treeLevelCount;
+		uint32_t bufferCount = levelCount << 2;
+
+		VkBuffer buffers[TREE_DESCRIPTOR_COUNT];
+		VkMemoryRequirements memRequirements[TREE_DESCRIPTOR_COUNT];
 		uint32_t memoryTypeBits = 0xffffffffu;
 
 		for(uint32_t i = 0, ind = 0; i != 4; ++i) {
-			for(uint32_t j = 0; j != 11; ++j, ++ind) {
+			for(uint32_t j = 0; j != levelCount; ++j, ++ind) {
 				// Set the buffer info
 				VkBufferCreateInfo bufferInfo {
 					.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -181,56 +279,84 @@ namespace gsim {
 				vkGetBufferMemoryRequirements(device->GetDevice(), buffers[ind], memRequirements + ind);
 
 				// Set the global memory's new info
-				if(memRequirements[ind].alignment)
-					alignment = memRequirements[ind].alignment;
 				memoryTypeBits &= memRequirements[ind].memoryTypeBits;
 			}
 		}
 
-		// Set the allocated memory's size
-		VkDeviceSize memorySize = 0;
-		for(uint32_t i = 0; i != 44; ++i) {
-			memRequirements[i].size = (memRequirements[i].size + alignment - 1) & ~(alignment - 1);
-			memorySize += memRequirements[i].size;
-		}
+		// Place every buffer at an offset aligned to its own alignment, aligning the whole memory to the largest one
+		VkDeviceSize offsets[TREE_DESCRIPTOR_COUNT];
+		VkMemoryRequirements memoryRequirements = GetCombinedRequirements(bufferCount, memRequirements, memoryTypeBits, offsets);
 
 		// Get the memory type's index
 		uint32_t memoryTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memoryTypeBits);
 		if(memoryTypeIndex == UINT32_MAX)
 			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan Barnes-Hut simulation buffers!");
 		
-		// Set the alloc info
-		VkMemoryAllocateInfo allocInfo {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = nullptr,
-			.allocationSize = memorySize,
-			.memoryTypeIndex = memoryTypeIndex
-		};
-
 		// Allocate the buffer memory
-		VkResult result = vkAllocateMemory(device->GetDevice(), &allocInfo, nullptr, &treeBufferMemory);
+		VkResult result = device->GetMemoryAllocator()->Allocate(memoryRequirements, memoryTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_SIMULATION, treeBufferAllocation);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan Barnes-Hut buffer memory! Error code: %s", string_VkResult(result));
 		
 		// Bind the buffers to their memory
-		VkDeviceSize offset = 0;
-		for(uint32_t i = 0; i != 44; ++i) {
-			result = vkBindBufferMemory(device->GetDevice(), buffers[i], treeBufferMemory, offset);
+		for(uint32_t i = 0; i != bufferCount; ++i) {
+			result = vkBindBufferMemory(device->GetDevice(), buffers[i], treeBufferAllocation.memory, treeBufferAllocation.offset + offsets[i]);
 			if(result != VK_SUCCESS)
 				GSIM_THROW_EXCEPTION("Failed to bind Vulkan Barnes-Hut simulation buffers to their memory! Error code: %s", string_VkResult(result));
-
-			offset += memRequirements[i].size;
 		}
 
 		// Assign all buffers
-		for(uint32_t i = 0; i != 11; ++i)
+		for(uint32_t i = 0; i != levelCount; ++i)
 			treeCountBuffers[i] = buffers[i];
-		for(uint32_t i = 0; i != 11; ++i)
-			treeStartBuffers[i] = buffers[11 + i];
-		for(uint32_t i = 0; i != 11; ++i)
-			treePosBuffers[i] = buffers[22 + i];
-		for(uint32_t i = 0; i != 11; ++i)
-			treeMassBuffers[i] = buffers[33 + i];
+		for(uint32_t i = 0; i != levelCount; ++i)
+			treeStartBuffers[i] = buffers[levelCount + i];
+		for(uint32_t i = 0; i != levelCount; ++i)
+			treePosBuffers[i] = buffers[(levelCount << 1) + i];
+		for(uint32_t i = 0; i != levelCount; ++i)
+			treeMassBuffers[i] = buffers[levelCount * 3 + i];
+	}
+	void BarnesHutSimulation::CreateStatsBuffer() {
+		// Set the stats readback buffer create info
+		uint32_t computeIndex = device->GetQueueFamilyIndices().computeIndex;
+
+		VkBufferCreateInfo bufferInfo {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.size = sizeof(TreeStats) * VulkanSubmissionRing::MAX_SUBMISSION_COUNT,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 1,
+			.pQueueFamilyIndices = &computeIndex
+		};
+
+		// Create the stats readback buffer
+		VkResult result = vkCreateBuffer(device->GetDevice(), &bufferInfo, nullptr, &statsReadbackBuffer);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan Barnes-Hut stats readback buffer! Error code: %s", string_VkResult(result));
+
+		// Get the stats readback buffer's memory requirements
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device->GetDevice(), statsReadbackBuffer, &memRequirements);
+
+		// Get the stats readback buffer's memory type index
+		uint32_t memoryTypeIndex = device->GetMemoryTypeIndex(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memRequirements.memoryTypeBits);
+		if(memoryTypeIndex == UINT32_MAX)
+			GSIM_THROW_EXCEPTION("Failed to find supported memory type for Vulkan Barnes-Hut stats readback buffer!");
+		
+		// Allocate the stats readback buffer's memory, which the allocator keeps mapped for the simulation's lifetime
+		result = device->GetMemoryAllocator()->Allocate(memRequirements, memoryTypeIndex, VulkanMemoryAllocator::MEMORY_USAGE_SIMULATION, statsReadbackAllocation);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan Barnes-Hut stats readback buffer memory! Error code: %s", string_VkResult(result));
+		
+		// Bind the stats readback buffer to its memory
+		result = vkBindBufferMemory(device->GetDevice(), statsReadbackBuffer, statsReadbackAllocation.memory, statsReadbackAllocation.offset);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to bind Vulkan Barnes-Hut stats readback buffer to its memory! Error code: %s", string_VkResult(result));
+		statsReadbackData = (TreeStats*)statsReadbackAllocation.mappedData;
+		
+		// Clear every submission's stats, as no step has run yet
+		for(uint32_t i = 0; i != VulkanSubmissionRing::MAX_SUBMISSION_COUNT; ++i)
+			statsReadbackData[i] = {};
 	}
 	void BarnesHutSimulation::CreateDescriptorPool() {
 		// Set the paraticle descriptor set layout bindings
@@ -255,6 +381,13 @@ namespace gsim {
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 3,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
 			}
 		};
 
@@ -263,7 +396,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.bindingCount = 3,
+			.bindingCount = 4,
 			.pBindings = particleSetLayoutBindings
 		};
 
@@ -312,28 +445,91 @@ namespace gsim {
 			{
 				.binding = 5,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 11,
+				.descriptorCount = MAX_TREE_DEPTH + 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
 			},
 			{
 				.binding = 6,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 11,
+				.descriptorCount = MAX_TREE_DEPTH + 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
 			},
 			{
 				.binding = 7,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 11,
+				.descriptorCount = MAX_TREE_DEPTH + 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
 			},
 			{
 				.binding = 8,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 11,
+				.descriptorCount = MAX_TREE_DEPTH + 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 9,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 10,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 2,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 11,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 2,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 12,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 13,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 14,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 15,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 16,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = nullptr
+			},
+			{
+				.binding = 17,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
 			}
@@ -344,7 +540,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.bindingCount = 9,
+			.bindingCount = 18,
 			.pBindings = barnesHutSetLayoutBindings
 		};
 
@@ -353,10 +549,13 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan Barnes-Hut buffer descriptor set layout! Error code: %s", string_VkResult(result));
 		
-		// Set the descriptor pool size
+		// Set the descriptor pool size, with one particle descriptor set per particle buffer set
+		uint32_t bufferSetCount = particleSystem->GetBufferSetCount();
+		uint32_t particleWriteCount = bufferSetCount << 2;
+
 		VkDescriptorPoolSize descriptorPoolSize {
 			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 58
+			.descriptorCount = particleWriteCount + 6 + TREE_DESCRIPTOR_COUNT + SORT_DESCRIPTOR_COUNT
 		};
 
 		// Set the descriptor pool create info
@@ -364,7 +563,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.maxSets = 4,
+			.maxSets = bufferSetCount + 1,
 			.poolSizeCount = 1,
 			.pPoolSizes = &descriptorPoolSize
 		};
@@ -374,32 +573,45 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan compute pipeline descriptor pool! Error code: %s", string_VkResult(result));
 
-		// Set the descriptor set alloc info
+		// Set the descriptor set alloc info, allocating only the particle sets of existing particle buffer sets
 		VkDescriptorSetLayout setLayouts[] { particleSetLayout, particleSetLayout, particleSetLayout, barnesHutSetLayout };
 
 		VkDescriptorSetAllocateInfo descriptorSetInfo {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 			.pNext = nullptr,
 			.descriptorPool = descriptorPool,
-			.descriptorSetCount = 4,
-			.pSetLayouts = setLayouts
+			.descriptorSetCount = bufferSetCount + 1,
+			.pSetLayouts = setLayouts + ParticleSystem::MAX_BUFFER_SET_COUNT - bufferSetCount
 		};
 
-		// Allocate the descriptor sets
-		result = vkAllocateDescriptorSets(device->GetDevice(), &descriptorSetInfo, descriptorSets);
+		// Allocate the descriptor sets, keeping the Barnes-Hut set last
+		VkDescriptorSet allocatedSets[4];
+		result = vkAllocateDescriptorSets(device->GetDevice(), &descriptorSetInfo, allocatedSets);
 		if(result != VK_SUCCESS)	
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan compute pipeline descriptor sets! Error code: %s", string_VkResult(result));
 		
-		// Set the descriptor buffer infos
-		VkBuffer buffers[] {
-			particleSystem->GetBuffers()[0].posBuffer, particleSystem->GetBuffers()[0].velBuffer, particleSystem->GetBuffers()[0].massBuffer,
-			particleSystem->GetBuffers()[1].posBuffer, particleSystem->GetBuffers()[1].velBuffer, particleSystem->GetBuffers()[1].massBuffer,
-			particleSystem->GetBuffers()[2].posBuffer, particleSystem->GetBuffers()[2].velBuffer, particleSystem->GetBuffers()[2].massBuffer,
+		for(uint32_t i = 0; i != bufferSetCount; ++i)
+			descriptorSets[i] = allocatedSets[i];
+		descriptorSets[3] = allocatedSets[bufferSetCount];
+		
+		// Set the descriptor buffer infos, binding the shared mass and ID buffers to every particle set if the particle buffer sets share them
+		const ParticleSystem::ParticleBuffers* particleBuffers = particleSystem->GetBuffers();
+		VkBuffer buffers[17]{};
+		for(uint32_t i = 0, ind = 0; i != bufferSetCount; ++i) {
+			buffers[ind++] = particleBuffers[i].posBuffer;
+			buffers[ind++] = particleBuffers[i].velBuffer;
+			buffers[ind++] = particleBuffers[i].massBuffer;
+			buffers[ind++] = particleBuffers[i].idBuffer;
+		}
+
+		VkBuffer barnesHutBuffers[] {
 			countBuffer, radiusBuffer, nodePosBuffer, nodeMassBuffer, srcBuffer
 		};
+		for(uint32_t i = 0; i != 5; ++i)
+			buffers[12 + i] = barnesHutBuffers[i];
 
-		VkDescriptorBufferInfo bufferInfos[58];
-		for(uint32_t i = 0; i != 14; ++i) {
+		VkDescriptorBufferInfo bufferInfos[18 + TREE_DESCRIPTOR_COUNT + SORT_DESCRIPTOR_COUNT];
+		for(uint32_t i = 0; i != 17; ++i) {
 			bufferInfos[i] = {
 				.buffer = buffers[i],
 				.offset = 0,
@@ -407,26 +619,46 @@ namespace gsim {
 			};
 		}
 
-		// Set the descriptor tree buffer infos
+		// Set the descriptor tree buffer infos, filling the levels past the tree's buffers with the root's buffers, as they will never be accessed
 		VkBuffer* treeBuffers[] {
 			treeCountBuffers, treeStartBuffers, treePosBuffers, treeMassBuffers
 		};
 
-		for(uint32_t i = 0, ind = 14; i != 4; ++i) {
-			for(uint32_t j = 0; j != 11; ++j, ++ind) {
+		for(uint32_t i = 0, ind = 17; i != 4; ++i) {
+			for(uint32_t j = 0; j != MAX_TREE_DEPTH + 1; ++j, ++ind) {
 				bufferInfos[ind] = {
-					.buffer = treeBuffers[i][j],
+					.buffer = treeBuffers[i][j < treeLevelCount ? j : 0],
 					.offset = 0,
 					.range = VK_WHOLE_SIZE
 				};
 			}
 		}
 
+		// Set the descriptor bounds buffer info
+		bufferInfos[17 + TREE_DESCRIPTOR_COUNT] = {
+			.buffer = boundsBuffer,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE
+		};
+
+		// Set the descriptor sort buffer infos, using the sorted source buffer as the sort's first value buffer
+		VkBuffer sortBuffers[] {
+			sortKeyBuffers[0], sortKeyBuffers[1], srcBuffer, sortValueBuffer, nodeOffsetBuffer, blockSumBuffer, levelNodeBuffer, levelCountBuffer, treeStatsBuffer, nodeQuadBuffer
+		};
+
+		for(uint32_t i = 0, ind = 18 + TREE_DESCRIPTOR_COUNT; i != SORT_DESCRIPTOR_COUNT; ++i, ++ind) {
+			bufferInfos[ind] = {
+				.buffer = sortBuffers[i],
+				.offset = 0,
+				.range = VK_WHOLE_SIZE
+			};
+		}
+
 		// Set the descriptor set writes
-		VkWriteDescriptorSet setWrites[58];
+		VkWriteDescriptorSet setWrites[18 + TREE_DESCRIPTOR_COUNT + SORT_DESCRIPTOR_COUNT];
 
-		for(uint32_t i = 0, ind = 0; i != 3; ++i) {
-			for(uint32_t j = 0; j != 3; ++j, ++ind) {
+		for(uint32_t i = 0, ind = 0; i != bufferSetCount; ++i) {
+			for(uint32_t j = 0; j != 4; ++j, ++ind) {
 				setWrites[ind] = {
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.pNext = nullptr,
@@ -441,7 +673,7 @@ namespace gsim {
 				};
 			}
 		}
-		for(uint32_t i = 0, ind = 9; i != 5; ++i, ++ind) {
+		for(uint32_t i = 0, ind = 12; i != 5; ++i, ++ind) {
 			setWrites[ind] = {
 				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 				.pNext = nullptr,
@@ -455,8 +687,8 @@ namespace gsim {
 				.pTexelBufferView = nullptr
 			};
 		}
-		for(uint32_t i = 0, ind = 14; i != 4; ++i) {
-			for(uint32_t j = 0; j != 11; ++j, ++ind) {
+		for(uint32_t i = 0, ind = 17; i != 4; ++i) {
+			for(uint32_t j = 0; j != MAX_TREE_DEPTH + 1; ++j, ++ind) {
 				setWrites[ind] = {
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.pNext = nullptr,
@@ -472,34 +704,96 @@ namespace gsim {
 			}
 		}
 
-		// Update the descriptor sets
-		vkUpdateDescriptorSets(device->GetDevice(), 58, setWrites, 0, nullptr);
+		setWrites[17 + TREE_DESCRIPTOR_COUNT] = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.pNext = nullptr,
+			.dstSet = descriptorSets[3],
+			.dstBinding = 9,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pImageInfo = nullptr,
+			.pBufferInfo = bufferInfos + 17 + TREE_DESCRIPTOR_COUNT,
+			.pTexelBufferView = nullptr
+		};
+
+		uint32_t sortBindings[SORT_DESCRIPTOR_COUNT] { 10, 10, 11, 11, 12, 13, 14, 15, 16, 17 };
+		uint32_t sortArrayElements[SORT_DESCRIPTOR_COUNT] { 0, 1, 0, 1, 0, 0, 0, 0, 0, 0 };
+
+		for(uint32_t i = 0, ind = 18 + TREE_DESCRIPTOR_COUNT; i != SORT_DESCRIPTOR_COUNT; ++i, ++ind) {
+			setWrites[ind] = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = nullptr,
+				.dstSet = descriptorSets[3],
+				.dstBinding = sortBindings[i],
+				.dstArrayElement = sortArrayElements[i],
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pImageInfo = nullptr,
+				.pBufferInfo = bufferInfos + ind,
+				.pTexelBufferView = nullptr
+			};
+		}
+
+		// Update the particle descriptor sets and the Barnes-Hut descriptor set
+		vkUpdateDescriptorSets(device->GetDevice(), particleWriteCount, setWrites, 0, nullptr);
+		vkUpdateDescriptorSets(device->GetDevice(), 6 + TREE_DESCRIPTOR_COUNT + SORT_DESCRIPTOR_COUNT, setWrites + 12, 0, nullptr);
 	}
 	void BarnesHutSimulation::CreateShaderModules() {
 		// Save the shader sources and source sizes to arrays
 		const uint32_t* shaderSources[] {
+			BOUNDS_SHADER_SOURCE,
 			CLEAR_SHADER_SOURCE,
 			FORCE_SHADER_SOURCE,
 			INIT_SHADER_SOURCE,
 			PARTICLE_SORT_SHADER_SOURCE,
 			TREE_INIT_SHADER_SOURCE,
 			TREE_MOVE_SHADER_SOURCE,
-			TREE_SORT_SHADER_SOURCE
+			TREE_SORT_SHADER_SOURCE,
+			KEY_SHADER_SOURCE,
+			RADIX_COUNT_SHADER_SOURCE,
+			RADIX_SCATTER_SHADER_SOURCE,
+			SCAN_SHADER_SOURCE,
+			NODE_COUNT_SHADER_SOURCE,
+			NODE_OFFSET_SHADER_SOURCE,
+			NODE_EMIT_SHADER_SOURCE,
+			NODE_REDUCE_SHADER_SOURCE,
+			NODE_REFIT_SHADER_SOURCE,
+			LEAF_REDUCE_SHADER_SOURCE,
+			LEAF_GATHER_SHADER_SOURCE
 		};
 		size_t shaderSourceSizes[] {
+			sizeof(BOUNDS_SHADER_SOURCE),
 			sizeof(CLEAR_SHADER_SOURCE),
 			sizeof(FORCE_SHADER_SOURCE),
 			sizeof(INIT_SHADER_SOURCE),
 			sizeof(PARTICLE_SORT_SHADER_SOURCE),
 			sizeof(TREE_INIT_SHADER_SOURCE),
 			sizeof(TREE_MOVE_SHADER_SOURCE),
-			sizeof(TREE_SORT_SHADER_SOURCE)
+			sizeof(TREE_SORT_SHADER_SOURCE),
+			sizeof(KEY_SHADER_SOURCE),
+			sizeof(RADIX_COUNT_SHADER_SOURCE),
+			sizeof(RADIX_SCATTER_SHADER_SOURCE),
+			sizeof(SCAN_SHADER_SOURCE),
+			sizeof(NODE_COUNT_SHADER_SOURCE),
+			sizeof(NODE_OFFSET_SHADER_SOURCE),
+			sizeof(NODE_EMIT_SHADER_SOURCE),
+			sizeof(NODE_REDUCE_SHADER_SOURCE),
+			sizeof(NODE_REFIT_SHADER_SOURCE),
+			sizeof(LEAF_REDUCE_SHADER_SOURCE),
+			sizeof(LEAF_GATHER_SHADER_SOURCE)
 		};
 
 		// Create all shader modules
-		VkShaderModule shaders[7];
+		VkShaderModule shaders[19];
+
+		for(uint32_t i = 0; i != 19; ++i) {
+			// Skip the atomic leaf accumulation shader if float atomics are unsupported, as its module can't be used on the device
+			if(i == 3 && !device->GetFloatAtomicsSupported()) {
+				shaders[i] = VK_NULL_HANDLE;
+				continue;
+			}
 
-		for(uint32_t i = 0; i != 7; ++i) {
 			// Set the shader module create info
 			VkShaderModuleCreateInfo shaderInfo {
 				.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -516,13 +810,25 @@ namespace gsim {
 		}
 
 		// Save the created shader modules
-		clearShader = shaders[0];
-		forceShader = shaders[1];
-		initShader = shaders[2];
-		particleSortShader = shaders[3];
-		treeInitShader = shaders[4];
-		treeMoveShader = shaders[5];
-		treeSortShader = shaders[6];
+		boundsShader = shaders[0];
+		clearShader = shaders[1];
+		forceShader = shaders[2];
+		initShader = shaders[3];
+		particleSortShader = shaders[4];
+		treeInitShader = shaders[5];
+		treeMoveShader = shaders[6];
+		treeSortShader = shaders[7];
+		keyShader = shaders[8];
+		radixCountShader = shaders[9];
+		radixScatterShader = shaders[10];
+		scanShader = shaders[11];
+		nodeCountShader = shaders[12];
+		nodeOffsetShader = shaders[13];
+		nodeEmitShader = shaders[14];
+		nodeReduceShader = shaders[15];
+		nodeRefitShader = shaders[16];
+		leafReduceShader = shaders[17];
+		leafGatherShader = shaders[18];
 	}
 	void BarnesHutSimulation::CreatePipelines() {
 		// Set the descriptor set layouts
@@ -576,9 +882,15 @@ namespace gsim {
 			.gravitationalConst = particleSystem->GetGravitationalConst(),
 			.softeningLenSqr = particleSystem->GetSofteningLen() * particleSystem->GetSofteningLen(),
 			.accuracyParameterSqr = particleSystem->GetAccuracyParameter() * particleSystem->GetAccuracyParameter(),
-			.simulationSize = 500,
 			.particleCount = (uint32_t)particleSystem->GetAlignedParticleCount(),
-			.treeSize = 1024
+			.treeSize = (uint32_t)1 << treeDepth,
+			.treeDepth = treeDepth,
+			.sortBlockSize = SORT_BLOCK_SIZE,
+			.keyDepth = keyDepth,
+			.leafCapacity = leafCapacity,
+			.particleOrder = reorderInterval ? PARTICLE_ORDER_TRACK : PARTICLE_ORDER_KEEP,
+			.forceWalk = (uint32_t)forceWalk,
+			.quadrupoleMoments = quadrupoleMoments
 		};
 
 		// Set the specialization map entries
@@ -620,53 +932,126 @@ namespace gsim {
 			},
 			{
 				.constantID = 7,
-				.offset = offsetof(SpecializationConstants, simulationSize),
-				.size = sizeof(float)
+				.offset = offsetof(SpecializationConstants, particleCount),
+				.size = sizeof(uint32_t)
 			},
 			{
 				.constantID = 8,
-				.offset = offsetof(SpecializationConstants, particleCount),
+				.offset = offsetof(SpecializationConstants, treeSize),
 				.size = sizeof(uint32_t)
 			},
 			{
 				.constantID = 9,
-				.offset = offsetof(SpecializationConstants, treeSize),
+				.offset = offsetof(SpecializationConstants, treeDepth),
+				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 10,
+				.offset = offsetof(SpecializationConstants, sortBlockSize),
 				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 11,
+				.offset = offsetof(SpecializationConstants, keyDepth),
+				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 12,
+				.offset = offsetof(SpecializationConstants, leafCapacity),
+				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 13,
+				.offset = offsetof(SpecializationConstants, particleOrder),
+				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 14,
+				.offset = offsetof(SpecializationConstants, forceWalk),
+				.size = sizeof(uint32_t)
+			},
+			{
+				.constantID = 15,
+				.offset = offsetof(SpecializationConstants, quadrupoleMoments),
+				.size = sizeof(VkBool32)
 			}
 		};
 
 		// Set the specialization info
 		VkSpecializationInfo specializationInfo {
-			.mapEntryCount = 10,
+			.mapEntryCount = 16,
 			.pMapEntries = specializationEntries,
 			.dataSize = sizeof(SpecializationConstants),
 			.pData = &specializationConst
 		};
+
+		// Set the specialization info of the force pipeline variant which writes the particles in their sorted order
+		SpecializationConstants reorderSpecializationConst = specializationConst;
+		reorderSpecializationConst.particleOrder = PARTICLE_ORDER_SORT;
+
+		VkSpecializationInfo reorderSpecializationInfo {
+			.mapEntryCount = 16,
+			.pMapEntries = specializationEntries,
+			.dataSize = sizeof(SpecializationConstants),
+			.pData = &reorderSpecializationConst
+		};
 		
 		// Save the shader modules and pipeline layouts in arrays
 		VkShaderModule shaders[] {
+			boundsShader,
 			clearShader,
 			forceShader,
 			initShader,
 			particleSortShader,
 			treeInitShader,
 			treeMoveShader,
-			treeSortShader
+			treeSortShader,
+			keyShader,
+			radixCountShader,
+			radixScatterShader,
+			scanShader,
+			nodeCountShader,
+			nodeOffsetShader,
+			nodeEmitShader,
+			nodeReduceShader,
+			forceShader,
+			nodeRefitShader,
+			leafReduceShader,
+			leafGatherShader
 		};
 		VkPipelineLayout pipelineLayouts[] {
+			bufferPipelineLayout, // boundsPipeline
 			bufferPipelineLayout, // clearPipeline
 			bufferPipelineLayout, // forcePipeline
 			bufferPipelineLayout, // initPipeline
 			bufferPipelineLayout, // particleSortPipeline
 			treePipelineLayout,   // treeInitPipeline
 			treePipelineLayout,   // treeMovePipeline
-			treePipelineLayout    // treeSortPipeline
+			treePipelineLayout,   // treeSortPipeline
+			bufferPipelineLayout, // keyPipeline
+			treePipelineLayout,   // radixCountPipeline
+			treePipelineLayout,   // radixScatterPipeline
+			treePipelineLayout,   // scanPipeline
+			treePipelineLayout,   // nodeCountPipeline
+			treePipelineLayout,   // nodeOffsetPipeline
+			bufferPipelineLayout, // nodeEmitPipeline
+			treePipelineLayout,   // nodeReducePipeline
+			bufferPipelineLayout, // forceReorderPipeline
+			bufferPipelineLayout, // nodeRefitPipeline
+			bufferPipelineLayout, // leafReducePipeline
+			bufferPipelineLayout  // leafGatherPipeline
 		};
 
-		// Set the pipeline create infos
-		VkComputePipelineCreateInfo pipelineInfos[7];
-		for(uint32_t i = 0; i != 7; ++i) {
-			pipelineInfos[i] = {
+		// Set the pipeline create infos, skipping the pipelines whose shader modules weren't created
+		VkComputePipelineCreateInfo pipelineInfos[20];
+		uint32_t pipelineIndices[20];
+		uint32_t pipelineCount = 0;
+		for(uint32_t i = 0; i != 20; ++i) {
+			if(!shaders[i])
+				continue;
+
+			pipelineIndices[pipelineCount] = i;
+			pipelineInfos[pipelineCount++] = {
 				.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
 				.pNext = nullptr,
 				.flags = 0,
@@ -677,7 +1062,7 @@ namespace gsim {
 					.stage = VK_SHADER_STAGE_COMPUTE_BIT,
 					.module = shaders[i],
 					.pName = "main",
-					.pSpecializationInfo = &specializationInfo
+					.pSpecializationInfo = i == 16 ? &reorderSpecializationInfo : &specializationInfo
 				},
 				.layout = pipelineLayouts[i],
 				.basePipelineHandle =  VK_NULL_HANDLE,
@@ -685,33 +1070,46 @@ namespace gsim {
 			};
 		}
 
-		// Create the pipelines
-		VkPipeline pipelines[7];
-		result = vkCreateComputePipelines(device->GetDevice(), VK_NULL_HANDLE, 7, pipelineInfos, nullptr, pipelines);
+		// Create the pipelines on worker threads through the device's pipeline cache
+		VkPipeline createdPipelines[20];
+		result = device->GetPipelineCache()->CreateComputePipelines(pipelineCount, pipelineInfos, createdPipelines);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan Barnes-Hut simulation pipelines! Error code: %s", string_VkResult(result));
 		
+		// Move the created pipelines to their indices, leaving the skipped ones null
+		VkPipeline pipelines[20]{};
+		for(uint32_t i = 0; i != pipelineCount; ++i)
+			pipelines[pipelineIndices[i]] = createdPipelines[i];
+		
 		// Save the created pipelines
-		clearPipeline = pipelines[0];
-		forcePipeline = pipelines[1];
-		initPipeline = pipelines[2];
-		particleSortPipeline = pipelines[3];
-		treeInitPipeline = pipelines[4];
-		treeMovePipeline = pipelines[5];
-		treeSortPipeline = pipelines[6];
+		boundsPipeline = pipelines[0];
+		clearPipeline = pipelines[1];
+		forcePipeline = pipelines[2];
+		initPipeline = pipelines[3];
+		particleSortPipeline = pipelines[4];
+		treeInitPipeline = pipelines[5];
+		treeMovePipeline = pipelines[6];
+		treeSortPipeline = pipelines[7];
+		keyPipeline = pipelines[8];
+		radixCountPipeline = pipelines[9];
+		radixScatterPipeline = pipelines[10];
+		scanPipeline = pipelines[11];
+		nodeCountPipeline = pipelines[12];
+		nodeOffsetPipeline = pipelines[13];
+		nodeEmitPipeline = pipelines[14];
+		nodeReducePipeline = pipelines[15];
+		forceReorderPipeline = pipelines[16];
+		nodeRefitPipeline = pipelines[17];
+		leafReducePipeline = pipelines[18];
+		leafGatherPipeline = pipelines[19];
 	}
-	void BarnesHutSimulation::CreateCommandObjects() {
-		// Set the simulation fence create info
-		VkFenceCreateInfo fenceInfo {
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT
-		};
-
-		// Create the simulation fence
-		VkResult result = vkCreateFence(device->GetDevice(), &fenceInfo, nullptr, &simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to create Vulkan simulation synchronization fence! Error code: %s", string_VkResult(result));
+	void BarnesHutSimulation::CreateCommandObjects(uint32_t submissionCount) {
+		// Create the submission ring, with no batches in flight
+		submissionRing = new VulkanSubmissionRing(device, submissionCount);
+		for(uint32_t i = 0; i != VulkanSubmissionRing::MAX_SUBMISSION_COUNT; ++i) {
+			submittedBatches[i] = UINT32_MAX;
+			submittedStepCounts[i] = 0;
+		}
 		
 		// Set the command buffer alloc info
 		VkCommandBufferAllocateInfo allocInfo {
@@ -719,13 +1117,33 @@ namespace gsim {
 			.pNext = nullptr,
 			.commandPool = device->GetComputeCommandPool(),
 			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 2
+			.commandBufferCount = RECORDED_BATCH_COUNT
 		};
 
 		// Allocate the command buffers
-		result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, commandBuffers);
+		VkCommandBuffer commandBuffers[RECORDED_BATCH_COUNT];
+		VkResult result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, commandBuffers);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan simulation command buffers! Error code: %s", string_VkResult(result));
+		
+		// Set the recorded batches, leaving them all empty
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT; ++i) {
+			recordedBatches[i] = {
+				.commandBuffer = commandBuffers[i],
+				.inputIndex = SIZE_MAX,
+				.outputIndex = SIZE_MAX,
+				.simulationCount = 0,
+				.rebuildPhase = 0,
+				.reorderPhase = 0,
+				.leavesSorted = false
+			};
+		}
+
+		// Allocate the stats copy command buffers
+		allocInfo.commandBufferCount = submissionCount;
+		result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, statsCopyCommandBuffers);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan Barnes-Hut stats copy command buffers! Error code: %s", string_VkResult(result));
 	}
 	void BarnesHutSimulation::RecordSecondaryCommandBuffers() {
 		// Set the command buffer alloc info
@@ -734,14 +1152,19 @@ namespace gsim {
 			.pNext = nullptr,
 			.commandPool = device->GetComputeCommandPool(),
 			.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-			.commandBufferCount = 1
+			.commandBufferCount = 3
 		};
 
-		// Allocate the command buffer
-		VkResult result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, &treeCommandBuffer);
+		// Allocate the command buffers
+		VkCommandBuffer secondaryCommandBuffers[3];
+		VkResult result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, secondaryCommandBuffers);
 		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan simulation tree construction command buffer! Error code: %s", string_VkResult(result));
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan simulation tree construction command buffers! Error code: %s", string_VkResult(result));
 		
+		treeCommandBuffer = secondaryCommandBuffers[0];
+		treeReduceCommandBuffer = secondaryCommandBuffers[1];
+		leafSortCommandBuffer = secondaryCommandBuffers[2];
+
 		// Set the command buffer inheritance info
 		VkCommandBufferInheritanceInfo inheritanceInfo {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
@@ -762,11 +1185,34 @@ namespace gsim {
 			.pInheritanceInfo = &inheritanceInfo
 		};
 
-		// Begin recording the command buffer
-		result = vkBeginCommandBuffer(treeCommandBuffer, &beginInfo);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan simulation tree construction command buffer! Error code: %s", string_VkResult(result));
+		// Begin recording the command buffers
+		for(uint32_t i = 0; i != 3; ++i) {
+			result = vkBeginCommandBuffer(secondaryCommandBuffers[i], &beginInfo);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan simulation tree construction command buffers! Error code: %s", string_VkResult(result));
+		}
 
+		// Record the tree construction commands, leaving the reduction command buffer empty for dense trees
+		if(treeBuild == TREE_BUILD_SPARSE) {
+			RecordSparseTreeCommands();
+		} else {
+			RecordDenseTreeCommands();
+		}
+
+		// Record the leaf key sorting if the leaves of a dense tree may be accumulated from sorted keys, otherwise leaving its command buffer empty
+		if(treeBuild != TREE_BUILD_SPARSE && leafAccumulation != LEAF_ACCUMULATION_ATOMIC) {
+			vkCmdBindDescriptorSets(leafSortCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, treePipelineLayout, 0, 1, descriptorSets + 3, 0, nullptr);
+			RecordKeySort(leafSortCommandBuffer);
+		}
+
+		// End recording the command buffers
+		for(uint32_t i = 0; i != 3; ++i) {
+			result = vkEndCommandBuffer(secondaryCommandBuffers[i]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to end recording Vulkan simulation tree construction command buffers! Error code: %s", string_VkResult(result));
+		}
+	}
+	void BarnesHutSimulation::RecordDenseTreeCommands() {
 		// Set the memory barrier info
 		VkMemoryBarrier memoryBarrier {
 			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
@@ -779,7 +1225,7 @@ namespace gsim {
 		vkCmdBindDescriptorSets(treeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, treePipelineLayout, 0, 1, descriptorSets + 3, 0, nullptr);
 
 		// Record the tree initiation
-		for(uint32_t i = 9; i != UINT32_MAX; --i) {
+		for(uint32_t i = treeDepth - 1; i != UINT32_MAX; --i) {
 			// Push the current depth
 			vkCmdPushConstants(treeCommandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
 
@@ -794,7 +1240,7 @@ namespace gsim {
 		}
 
 		// Record the tree sorting
-		for(uint32_t i = 0; i != 10; ++i) {
+		for(uint32_t i = 0; i != treeDepth; ++i) {
 			// Push the current depth
 			vkCmdPushConstants(treeCommandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
 
@@ -809,7 +1255,7 @@ namespace gsim {
 		}
 
 		// Record the tree moving
-		for(uint32_t i = 0; i != 11; ++i) {
+		for(uint32_t i = 0; i <= treeDepth; ++i) {
 			// Push the current depth
 			vkCmdPushConstants(treeCommandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
 
@@ -823,38 +1269,134 @@ namespace gsim {
 		}
 
 		vkCmdPipelineBarrier(treeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
-
-		// End recording the command buffer
-		result = vkEndCommandBuffer(treeCommandBuffer);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to end recording Vulkan simulation tree construction command buffer! Error code: %s", string_VkResult(result));
 	}
+	void BarnesHutSimulation::RecordSparseTreeCommands() {
+		// Set the memory barrier info
+		VkMemoryBarrier memoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
 
-	// Public functions
-	size_t BarnesHutSimulation::GetRequiredParticleAlignment() {
-		return 64;
+		// Bind the simulation descriptor set
+		vkCmdBindDescriptorSets(treeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, treePipelineLayout, 0, 1, descriptorSets + 3, 0, nullptr);
+
+		// Sort the particles' keys
+		RecordKeySort(treeCommandBuffer);
+
+		// Count the nodes starting at every block
+		vkCmdBindPipeline(treeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nodeCountPipeline);
+		vkCmdDispatch(treeCommandBuffer, sortBlockCount, 1, 1);
+		vkCmdPipelineBarrier(treeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Scan the block node counts
+		vkCmdPushConstants(treeCommandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &sortBlockCount);
+		vkCmdBindPipeline(treeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scanPipeline);
+		vkCmdDispatch(treeCommandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(treeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Calculate every particle's node offset
+		vkCmdBindPipeline(treeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nodeOffsetPipeline);
+		vkCmdDispatch(treeCommandBuffer, sortBlockCount, 1, 1);
+		vkCmdPipelineBarrier(treeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// Bind the simulation descriptor set to the reduction command buffer
+		vkCmdBindDescriptorSets(treeReduceCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, treePipelineLayout, 0, 1, descriptorSets + 3, 0, nullptr);
+		vkCmdBindPipeline(treeReduceCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nodeReducePipeline);
+
+		// Record the node reduction, from the deepest refined level up
+		for(uint32_t i = keyDepth; i != UINT32_MAX; --i) {
+			vkCmdPushConstants(treeReduceCommandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
+			vkCmdDispatch(treeReduceCommandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+			vkCmdPipelineBarrier(treeReduceCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
 	}
+	void BarnesHutSimulation::RecordKeySort(VkCommandBuffer commandBuffer) {
+		// Set the memory barrier info
+		VkMemoryBarrier memoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
 
-	BarnesHutSimulation::BarnesHutSimulation(VulkanDevice* device, ParticleSystem* particleSystem) : device(device), particleSystem(particleSystem) {
-		// Create all components
-		CreateBuffers();
-		CreateTreeBuffers();
-		CreateDescriptorPool();
-		CreateShaderModules();
-		CreatePipelines();
-		CreateCommandObjects();
-		RecordSecondaryCommandBuffers();
+		// Get the number of radix passes covering every key bit, including the bit marking particles outside the tree,
+		// rounded up to an even number so that the sorted keys and sources end up in their first buffers
+		uint32_t sortPassCount = ((keyDepth << 1) + (SORT_RADIX_BITS << 1)) / (SORT_RADIX_BITS << 1) << 1;
+		uint32_t digitCount = SORT_RADIX_SIZE * sortBlockCount;
+
+		// Record the key sorting
+		for(uint32_t i = 0; i != sortPassCount; ++i) {
+			// Count the current digit in every block
+			vkCmdPushConstants(commandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixCountPipeline);
+			vkCmdDispatch(commandBuffer, sortBlockCount, 1, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			// Scan the digit counts
+			vkCmdPushConstants(commandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &digitCount);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scanPipeline);
+			vkCmdDispatch(commandBuffer, 1, 1, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			// Scatter the keys by the current digit
+			vkCmdPushConstants(commandBuffer, treePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &i);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, radixScatterPipeline);
+			vkCmdDispatch(commandBuffer, sortBlockCount, 1, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
 	}
 
-	void BarnesHutSimulation::RunSimulations(uint32_t simulationCount) {
-		// Exit the function if no simulations will be recorded
-		if(!simulationCount)
-			return;
+	void BarnesHutSimulation::RecordStatsCopies() {
+		// Set the memory barrier infos
+		VkMemoryBarrier copyBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+		};
+		VkMemoryBarrier readbackBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+		};
 
-		// Set the new command buffer index
-		commandBufferIndex ^= 1;
-		VkCommandBuffer commandBuffer = commandBuffers[commandBufferIndex];
+		// Set the command buffer begin info
+		VkCommandBufferBeginInfo beginInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.pInheritanceInfo = nullptr
+		};
 
+		for(uint32_t i = 0; i != submissionRing->GetSubmissionCount(); ++i) {
+			// Begin recording the command buffer
+			VkResult result = vkBeginCommandBuffer(statsCopyCommandBuffers[i], &beginInfo);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan Barnes-Hut stats copy command buffer! Error code: %s", string_VkResult(result));
+
+			// Copy the batch's tree stats to the submission's part of the readback buffer
+			VkBufferCopy statsCopy {
+				.srcOffset = 0,
+				.dstOffset = sizeof(TreeStats) * i,
+				.size = sizeof(TreeStats)
+			};
+
+			vkCmdPipelineBarrier(statsCopyCommandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+			vkCmdCopyBuffer(statsCopyCommandBuffers[i], treeStatsBuffer, statsReadbackBuffer, 1, &statsCopy);
+
+			// Make the copy visible to the host, and keep the next batch in flight from clearing the stats before they are copied
+			vkCmdPipelineBarrier(statsCopyCommandBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+
+			// End recording the command buffer
+			result = vkEndCommandBuffer(statsCopyCommandBuffers[i]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to end recording Vulkan Barnes-Hut stats copy command buffer! Error code: %s", string_VkResult(result));
+		}
+	}
+	void BarnesHutSimulation::RecordBatch(VkCommandBuffer commandBuffer, uint32_t simulationCount, uint32_t rebuildPhase, uint32_t reorderPhase) {
 		// Reset the command buffer
 		VkResult result = vkResetCommandBuffer(commandBuffer, 0);
 		if(result != VK_SUCCESS)
@@ -864,7 +1406,7 @@ namespace gsim {
 		VkCommandBufferBeginInfo beginInfo {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 			.pNext = nullptr,
-			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
 			.pInheritanceInfo = nullptr
 		};
 
@@ -873,108 +1415,399 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
 
-		// Set the memory barrier info
+		// Set the memory barrier infos
 		VkMemoryBarrier memoryBarrier {
 			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
 			.pNext = nullptr,
 			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
 			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
 		};
+		VkMemoryBarrier fillBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
+		};
+		VkMemoryBarrier filledBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		// Reset the tree stats once, so that the leaf stats accumulate over every step of the batch
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, treeStatsBuffer, 0, VK_WHOLE_SIZE, 0);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &filledBarrier, 0, nullptr, 0, nullptr);
 
-		// Record every simulation
+		// Record every simulation, advancing the batch's own copies of the compute indices and step phases
+		size_t inputIndex = particleSystem->GetComputeInputIndex();
+		size_t outputIndex = particleSystem->GetComputeOutputIndex();
 		for(uint32_t i = 0; i != simulationCount; ++i) {
 			// Bind the descriptor sets
-			VkDescriptorSet commandSets[] { descriptorSets[particleSystem->GetComputeInputIndex()], descriptorSets[particleSystem->GetComputeOutputIndex()], descriptorSets[3] };
+			VkDescriptorSet commandSets[] { descriptorSets[inputIndex], descriptorSets[outputIndex], descriptorSets[3] };
 			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
 
-			// Clear the previous tree
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clearPipeline);
-			vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			// Rebuild the tree once every rebuild interval or if it was requested, otherwise only refitting the previous tree's nodes
+			bool rebuild = rebuildPhase >= treeRebuildInterval;
+			if(rebuild)
+				rebuildPhase = 0;
+			++rebuildPhase;
+
+			// Reset the step's interaction count, which would overflow if summed over large batches,
+			// along with the simulation bounds and the level node counts if a sparse tree is rebuilt
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+			if(treeBuild == TREE_BUILD_SPARSE && rebuild) {
+				vkCmdFillBuffer(commandBuffer, boundsBuffer, 0, sizeof(Vec2u), 0xffffffff);
+				vkCmdFillBuffer(commandBuffer, boundsBuffer, sizeof(Vec2u), sizeof(Vec2u), 0);
+				vkCmdFillBuffer(commandBuffer, levelCountBuffer, 0, VK_WHOLE_SIZE, 0);
+			}
+			vkCmdFillBuffer(commandBuffer, treeStatsBuffer, offsetof(TreeStats, interactionCount), sizeof(uint32_t), 0);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &filledBarrier, 0, nullptr, 0, nullptr);
+
+			if(treeBuild != TREE_BUILD_SPARSE) {
+				// Clear the previous tree
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clearPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 
-			// Write the particle datas into the tree
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, initPipeline);
-			vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			// Calculate the bounds of the simulated particles, keeping the previous tree's bounds for refits
+			if(rebuild) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, boundsPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 
-			// Build the tree
-			vkCmdExecuteCommands(commandBuffer, 1, &treeCommandBuffer);
+			if(treeBuild == TREE_BUILD_SPARSE) {
+				if(rebuild) {
+					// Calculate the particles' keys
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, keyPipeline);
+					vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+					// Sort the keys and lay out the tree's nodes
+					vkCmdExecuteCommands(commandBuffer, 1, &treeCommandBuffer);
+
+					// Rebind the descriptor sets
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
+
+					// Write the particles and nodes into the tree
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nodeEmitPipeline);
+					vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				} else {
+					// Move the tree's particles to their new positions, checking if any left their cells
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, nodeRefitPipeline);
+					vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				}
+
+				// Calculate the nodes' masses and centers
+				vkCmdExecuteCommands(commandBuffer, 1, &treeReduceCommandBuffer);
+
+				// Rebind the descriptor sets
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
+			} else if(leavesSorted) {
+				// Calculate the particles' keys, which are the indices of their leaves
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, keyPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+				// Sort the keys, grouping every leaf's particles
+				vkCmdExecuteCommands(commandBuffer, 1, &leafSortCommandBuffer);
+
+				// Rebind the descriptor sets
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
+
+				// Sum every leaf's particles in each subgroup
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, leafReducePipeline);
+				vkCmdDispatch(commandBuffer, (uint32_t)(particleSystem->GetAlignedParticleCount() / device->GetSubgroupSize()), 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+				// Combine every leaf's subgroup sums and write them into the tree
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, leafGatherPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			} else {
+				// Write the particle datas into the tree
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, initPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 
-			// Rebind the descriptor sets
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
+			if(treeBuild != TREE_BUILD_SPARSE) {
+				// Build the tree
+				vkCmdExecuteCommands(commandBuffer, 1, &treeCommandBuffer);
 
-			// Sort the particles
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleSortPipeline);
-			vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				// Rebind the descriptor sets
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bufferPipelineLayout, 0, 3, commandSets, 0, nullptr);
 
-			// Calculate and apply the forces
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, forcePipeline);
+				// Sort the particles
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleSortPipeline);
+				vkCmdDispatch(commandBuffer, WORKGROUP_SIZE_PARTICLE, 1, 1);
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+
+			// Calculate and apply the forces, moving the particles to their sorted order once every reorder interval
+			bool reorder = reorderInterval && !reorderPhase;
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reorder ? forceReorderPipeline : forcePipeline);
 			vkCmdDispatch(commandBuffer, (uint32_t)(particleSystem->GetAlignedParticleCount() / device->GetSubgroupSize()), 1, 1);
 			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
-			// Get the new indices
-			particleSystem->NextComputeIndices();
+			// Get the new indices and reorder phase
+			size_t aux = inputIndex;
+			inputIndex = outputIndex;
+			outputIndex = aux;
+
+			if(reorderInterval)
+				reorderPhase = (reorderPhase + 1) % reorderInterval;
+		}
+
+		// Make the last simulation's output visible to the host, if it reads the particle buffers' mapped memory directly
+		if(particleSystem->GetBufferMemoryMapped()) {
+			VkMemoryBarrier hostBarrier {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
 		}
 
 		// End recording the command buffer
 		result = vkEndCommandBuffer(commandBuffer);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to end recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+	}
+	bool BarnesHutSimulation::IsBatchInFlight(uint32_t batchIndex) const {
+		// Check if any submission in flight runs the batch
+		for(uint32_t i = 0; i != submissionRing->GetSubmissionCount(); ++i)
+			if(submittedBatches[i] == batchIndex)
+				return true;
+		
+		return false;
+	}
+	void BarnesHutSimulation::ReadTreeStats(uint32_t submissionIndex) {
+		// Save the tree stats of the submission's finished batch, rebuilding the tree at the next batch if any particles left their cells
+		treeStats = statsReadbackData[submissionIndex];
+		treeStatsStepCount = submittedStepCounts[submissionIndex];
+		if(treeStats.escapedCount)
+			rebuildRequired = true;
+
+		// Switch automatic leaf accumulation to sorting once the dense tree's leaves get crowded enough for the atomics to contend, and back once they empty out
+		if(treeBuild != TREE_BUILD_SPARSE && leafAccumulation == LEAF_ACCUMULATION_AUTO) {
+			if(treeStats.maxOccupancy >= SORTED_LEAF_OCCUPANCY)
+				leavesSorted = true;
+			else if(treeStats.maxOccupancy < SORTED_LEAF_OCCUPANCY >> 1)
+				leavesSorted = false;
+		}
+	}
 
-		// Wait for the simulation fence
-		result = vkWaitForFences(device->GetDevice(), 1, &simulationFence, VK_TRUE, UINT64_MAX);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to wait for Vulkan simulation fence! Error code: %s", string_VkResult(result));
+	// Public functions
+	size_t BarnesHutSimulation::GetRequiredParticleAlignment() {
+		return 64;
+	}
+	uint32_t BarnesHutSimulation::GetDefaultTreeDepth(size_t particleCount) {
+		// Find the first depth with at least as many leaves as particles
+		uint32_t treeDepth = 1;
+		while(treeDepth != MAX_TREE_DEPTH && ((size_t)1 << (treeDepth << 1)) < particleCount)
+			++treeDepth;
 		
-		// Reset the simulation fence
-		result = vkResetFences(device->GetDevice(), 1, &simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to reset Vulkan simulation fence! Error code: %s", string_VkResult(result));
+		return treeDepth;
+	}
+	bool BarnesHutSimulation::GetParticlesReordered(TreeBuild treeBuild, uint32_t reorderInterval) {
+		// Only the sparse tree reorders the particles, as only its sorted sources cover every particle
+		return treeBuild == TREE_BUILD_SPARSE && reorderInterval;
+	}
 
-		// Set the submit info
-		VkSubmitInfo submitInfo {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = nullptr,
-			.waitSemaphoreCount = 0,
-			.pWaitSemaphores = nullptr,
-			.pWaitDstStageMask = nullptr,
-			.commandBufferCount = 1,
-			.pCommandBuffers = commandBuffers + commandBufferIndex,
-			.signalSemaphoreCount = 0,
-			.pSignalSemaphores = nullptr
-		};
+	BarnesHutSimulation::BarnesHutSimulation(VulkanDevice* device, ParticleSystem* particleSystem, uint32_t treeDepth, TreeBuild treeBuild, uint32_t leafCapacity, uint32_t reorderInterval, ForceWalk forceWalk, bool quadrupoleMoments, uint32_t treeRebuildInterval, LeafAccumulation leafAccumulation, uint32_t submissionCount) : device(device), particleSystem(particleSystem), treeDepth(treeDepth), treeBuild(treeBuild), leafCapacity(leafCapacity), reorderInterval(reorderInterval), forceWalk(forceWalk), quadrupoleMoments(quadrupoleMoments), treeRebuildInterval(treeRebuildInterval), leafAccumulation(leafAccumulation) {
+		// Choose the tree depth, if it wasn't given
+		if(!this->treeDepth)
+			this->treeDepth = GetDefaultTreeDepth(particleSystem->GetParticleCount());
+		if(this->treeDepth > MAX_TREE_DEPTH)
+			GSIM_THROW_EXCEPTION("Invalid Barnes-Hut tree depth requested! The maximum supported depth is %u.", MAX_TREE_DEPTH);
+		if(treeBuild >= TREE_BUILD_COUNT)
+			GSIM_THROW_EXCEPTION("Invalid Barnes-Hut tree construction method requested!");
+
+		// Only refine the leaves of sparse trees, quantizing their keys at the deepest refined level
+		if(treeBuild != TREE_BUILD_SPARSE)
+			this->leafCapacity = 0;
+		keyDepth = this->leafCapacity ? MAX_REFINED_DEPTH : this->treeDepth;
+
+		// Only reorder the particles for sparse trees, as only their sorted sources cover every particle
+		if(!GetParticlesReordered(treeBuild, reorderInterval))
+			this->reorderInterval = 0;
+		if(this->reorderInterval && particleSystem->GetMassShared())
+			GSIM_THROW_EXCEPTION("Barnes-Hut particle reordering requested, but the particle buffer sets share their mass and ID buffers!");
+
+		// Only apply quadrupole moments for sparse trees, as they are accumulated by the sparse reduction
+		if(treeBuild != TREE_BUILD_SPARSE)
+			this->quadrupoleMoments = false;
+
+		// Only refit sparse trees between rebuilds, as the dense build has no separate reduction to rerun
+		if(!treeRebuildInterval)
+			GSIM_THROW_EXCEPTION("Invalid Barnes-Hut tree rebuild interval requested! The interval must be at least 1.");
+		if(treeBuild != TREE_BUILD_SPARSE)
+			this->treeRebuildInterval = 1;
+
+		// Sort the particles into the leaves of dense trees if float atomics are unsupported, as the sparse build always accumulates sorted keys
+		if(leafAccumulation >= LEAF_ACCUMULATION_COUNT)
+			GSIM_THROW_EXCEPTION("Invalid Barnes-Hut leaf accumulation method requested!");
+		if(treeBuild == TREE_BUILD_SPARSE) {
+			this->leafAccumulation = LEAF_ACCUMULATION_SORTED;
+		} else if(!device->GetFloatAtomicsSupported()) {
+			if(leafAccumulation == LEAF_ACCUMULATION_ATOMIC)
+				GSIM_THROW_EXCEPTION("Atomic Barnes-Hut leaf accumulation requested, but the Vulkan device doesn't support float atomics!");
+			this->leafAccumulation = LEAF_ACCUMULATION_SORTED;
+		}
+		leavesSorted = this->leafAccumulation == LEAF_ACCUMULATION_SORTED;
 
-		// Submit the command buffer to the compute queue
-		result = vkQueueSubmit(device->GetComputeQueue(), 1, &submitInfo, simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to submit Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+		// Only keep the root's level buffers for sparse trees, as they are written directly in their final layout
+		treeLevelCount = treeBuild == TREE_BUILD_SPARSE ? 1 : this->treeDepth + 1;
+		sortBlockCount = (uint32_t)((particleSystem->GetAlignedParticleCount() + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE);
+
+		// Create all components
+		CreateBuffers();
+		CreateTreeBuffers();
+		CreateStatsBuffer();
+		CreateDescriptorPool();
+		CreateShaderModules();
+		CreatePipelines();
+		CreateCommandObjects(submissionCount);
+		RecordSecondaryCommandBuffers();
+		RecordStatsCopies();
+	}
+
+	void BarnesHutSimulation::RunSimulations(uint32_t simulationCount) {
+		// Exit the function if no simulations will be run
+		if(!simulationCount)
+			return;
+
+		// Acquire the next submission, waiting for its previous batch to finish and reading back its tree stats
+		uint32_t submissionIndex = submissionRing->AcquireSubmission();
+		if(submittedBatches[submissionIndex] != UINT32_MAX) {
+			ReadTreeStats(submissionIndex);
+			submittedBatches[submissionIndex] = UINT32_MAX;
+		}
+
+		// Get the batch's starting state, which decides the commands of all of its steps
+		size_t inputIndex = particleSystem->GetComputeInputIndex();
+		size_t outputIndex = particleSystem->GetComputeOutputIndex();
+		uint32_t rebuildPhase = rebuildRequired ? treeRebuildInterval : stepsSinceRebuild;
+		uint32_t reorderPhase = reorderInterval ? (uint32_t)(simulationIndex % reorderInterval) : 0;
+
+		// Look for a recorded batch starting from the same state with the same number of simulations
+		uint32_t batchIndex = UINT32_MAX;
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT && batchIndex == UINT32_MAX; ++i) {
+			const RecordedBatch& batch = recordedBatches[i];
+			if(batch.inputIndex == inputIndex && batch.outputIndex == outputIndex && batch.simulationCount == simulationCount && batch.rebuildPhase == rebuildPhase && batch.reorderPhase == reorderPhase && batch.leavesSorted == leavesSorted)
+				batchIndex = i;
+		}
+
+		// Record the batch if it wasn't recorded yet, replacing the oldest batch that isn't in flight
+		if(batchIndex == UINT32_MAX) {
+			batchIndex = nextRecordedBatch;
+			while(IsBatchInFlight(batchIndex))
+				batchIndex = (batchIndex + 1) % RECORDED_BATCH_COUNT;
+			nextRecordedBatch = (batchIndex + 1) % RECORDED_BATCH_COUNT;
+
+			RecordedBatch& batch = recordedBatches[batchIndex];
+			RecordBatch(batch.commandBuffer, simulationCount, rebuildPhase, reorderPhase);
+
+			batch.inputIndex = inputIndex;
+			batch.outputIndex = outputIndex;
+			batch.simulationCount = simulationCount;
+			batch.rebuildPhase = rebuildPhase;
+			batch.reorderPhase = reorderPhase;
+			batch.leavesSorted = leavesSorted;
+		}
+
+		// Advance the simulation's state past the batch's steps
+		for(uint32_t i = 0; i != simulationCount; ++i) {
+			if(rebuildRequired || stepsSinceRebuild >= treeRebuildInterval) {
+				rebuildRequired = false;
+				stepsSinceRebuild = 0;
+			}
+			++stepsSinceRebuild;
+
+			particleSystem->NextComputeIndices();
+			++simulationIndex;
+		}
+
+		// Submit the batch, followed by the copy of its tree stats, once the transfers reading the particle buffers finish
+		VkCommandBuffer submitCommandBuffers[] { recordedBatches[batchIndex].commandBuffer, statsCopyCommandBuffers[submissionIndex] };
+		submissionRing->Submit(submissionIndex, 2, submitCommandBuffers, particleSystem->GetTransferTimeline(), particleSystem->GetTransferTimelineValue());
+		submittedBatches[submissionIndex] = batchIndex;
+		submittedStepCounts[submissionIndex] = simulationCount;
+		lastSubmission = submissionIndex;
+
+		// Let the graphics wait for the batch on the GPU before reading its buffers
+		particleSystem->SetComputeTimeline(submissionRing->GetTimelineSemaphore(), submissionRing->GetSubmittedValue());
+	}
+	void BarnesHutSimulation::WaitForSimulations() {
+		// Wait for all batches in flight
+		submissionRing->WaitIdle();
+		for(uint32_t i = 0; i != VulkanSubmissionRing::MAX_SUBMISSION_COUNT; ++i)
+			submittedBatches[i] = UINT32_MAX;
+
+		// Read back the tree stats of the last batch
+		if(lastSubmission != UINT32_MAX)
+			ReadTreeStats(lastSubmission);
+	}
+
+	void BarnesHutSimulation::RestoreState(uint64_t simulationIndex, bool leavesSorted) {
+		// Restore the reorder phase and the automatic leaf accumulation, which only leaves its starting method under automatic accumulation
+		this->simulationIndex = simulationIndex;
+		if(treeBuild != TREE_BUILD_SPARSE && leafAccumulation == LEAF_ACCUMULATION_AUTO)
+			this->leavesSorted = leavesSorted;
+		
+		// Rebuild the tree at the first simulation, as it isn't stored in the checkpoint
+		rebuildRequired = true;
 	}
 
 	BarnesHutSimulation::~BarnesHutSimulation() {
-		// Wait for the simulation fence
-		vkWaitForFences(device->GetDevice(), 1, &simulationFence, VK_TRUE, UINT64_MAX);
+		// Wait for all batches in flight
+		submissionRing->WaitIdle();
 
-		// Free the secondary command buffer
+		// Free the secondary command buffers
 		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 1, &treeCommandBuffer);
+		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 1, &treeReduceCommandBuffer);
+		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 1, &leafSortCommandBuffer);
 
 		// Destroy the command objects
-		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 2, commandBuffers);
-		vkDestroyFence(device->GetDevice(), simulationFence, nullptr);
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT; ++i)
+			vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 1, &recordedBatches[i].commandBuffer);
+		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), submissionRing->GetSubmissionCount(), statsCopyCommandBuffers);
+		delete submissionRing;
 
 		// Destroy the pipelines and their layouts
+		vkDestroyPipeline(device->GetDevice(), boundsPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), clearPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), forcePipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), forceReorderPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), initPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), particleSortPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), treeInitPipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), treeMovePipeline, nullptr);
 		vkDestroyPipeline(device->GetDevice(), treeSortPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), keyPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), radixCountPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), radixScatterPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), scanPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), nodeCountPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), nodeOffsetPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), nodeEmitPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), nodeReducePipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), nodeRefitPipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), leafReducePipeline, nullptr);
+		vkDestroyPipeline(device->GetDevice(), leafGatherPipeline, nullptr);
 
 		vkDestroyPipelineLayout(device->GetDevice(), bufferPipelineLayout, nullptr);
 		vkDestroyPipelineLayout(device->GetDevice(), treePipelineLayout, nullptr);
 
 		// Destroy the shader modules
+		vkDestroyShaderModule(device->GetDevice(), boundsShader, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), clearShader, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), forceShader, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), initShader, nullptr);
@@ -982,6 +1815,17 @@ namespace gsim {
 		vkDestroyShaderModule(device->GetDevice(), treeInitShader, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), treeMoveShader, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), treeSortShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), keyShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), radixCountShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), radixScatterShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), scanShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), nodeCountShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), nodeOffsetShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), nodeEmitShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), nodeReduceShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), nodeRefitShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), leafReduceShader, nullptr);
+		vkDestroyShaderModule(device->GetDevice(), leafGatherShader, nullptr);
 
 		// Destroy the descriptor pool and its set layouts
 		vkDestroyDescriptorPool(device->GetDevice(), descriptorPool, nullptr);
@@ -989,16 +1833,16 @@ namespace gsim {
 		vkDestroyDescriptorSetLayout(device->GetDevice(), barnesHutSetLayout, nullptr);
 
 		// Destroy the tree buffers and free the tree buffer memory
-		for(uint32_t i = 0; i != 11; ++i)
+		for(uint32_t i = 0; i != treeLevelCount; ++i)
 			vkDestroyBuffer(device->GetDevice(), treeCountBuffers[i], nullptr);
-		for(uint32_t i = 0; i != 11; ++i)
+		for(uint32_t i = 0; i != treeLevelCount; ++i)
 			vkDestroyBuffer(device->GetDevice(), treeStartBuffers[i], nullptr);
-		for(uint32_t i = 0; i != 11; ++i)
+		for(uint32_t i = 0; i != treeLevelCount; ++i)
 			vkDestroyBuffer(device->GetDevice(), treePosBuffers[i], nullptr);
-		for(uint32_t i = 0; i != 11; ++i)
+		for(uint32_t i = 0; i != treeLevelCount; ++i)
 			vkDestroyBuffer(device->GetDevice(), treeMassBuffers[i], nullptr);
 		
-		vkFreeMemory(device->GetDevice(), treeBufferMemory, nullptr);
+		device->GetMemoryAllocator()->Free(treeBufferAllocation);
 
 		// Destroy the buffers and free the buffer memory
 		vkDestroyBuffer(device->GetDevice(), countBuffer, nullptr);
@@ -1006,7 +1850,21 @@ namespace gsim {
 		vkDestroyBuffer(device->GetDevice(), nodePosBuffer, nullptr);
 		vkDestroyBuffer(device->GetDevice(), nodeMassBuffer, nullptr);
 		vkDestroyBuffer(device->GetDevice(), srcBuffer, nullptr);
-
-		vkFreeMemory(device->GetDevice(), bufferMemory, nullptr);
+		vkDestroyBuffer(device->GetDevice(), boundsBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), sortKeyBuffers[0], nullptr);
+		vkDestroyBuffer(device->GetDevice(), sortKeyBuffers[1], nullptr);
+		vkDestroyBuffer(device->GetDevice(), sortValueBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), nodeOffsetBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), blockSumBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), levelNodeBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), levelCountBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), treeStatsBuffer, nullptr);
+		vkDestroyBuffer(device->GetDevice(), nodeQuadBuffer, nullptr);
+
+		device->GetMemoryAllocator()->Free(bufferAllocation);
+
+		// Destroy the stats readback buffer and free its memory
+		vkDestroyBuffer(device->GetDevice(), statsReadbackBuffer, nullptr);
+		device->GetMemoryAllocator()->Free(statsReadbackAllocation);
 	}
 }
\ No newline at end of file
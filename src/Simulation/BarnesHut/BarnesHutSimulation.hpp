@@ -2,6 +2,7 @@
 
 #include "Particles/ParticleSystem.hpp"
 #include "Vulkan/VulkanDevice.hpp"
+#include "Vulkan/VulkanSubmissionRing.hpp"
 #include <stdint.h>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
@@ -10,9 +11,73 @@ namespace gsim {
 	/// @brief A particle simulation which uses the Barnes-Hut algorithm.
 	class BarnesHutSimulation {
 	public:
+		/// @brief An enum containing all implemented quadtree construction methods.
+		enum TreeBuild {
+			/// @brief Builds every cell of the full quadtree, one level at a time.
+			TREE_BUILD_DENSE,
+			/// @brief Builds only the occupied cells of the quadtree, from the particles' radix-sorted Morton keys.
+			TREE_BUILD_SPARSE,
+			/// @brief The number of implemented quadtree construction methods.
+			TREE_BUILD_COUNT
+		};
+		/// @brief An enum containing all implemented tree traversals of the force pass.
+		enum ForceWalk {
+			/// @brief Walks the tree once per subgroup, opening every node required by any of its particles.
+			FORCE_WALK_PARTICLE,
+			/// @brief Walks the tree once per group of neighbouring particles against their bounding box, evaluating the accepted nodes in bulk.
+			FORCE_WALK_GROUP,
+			/// @brief The number of implemented tree traversals.
+			FORCE_WALK_COUNT
+		};
+		/// @brief An enum containing all implemented accumulations of the particles into the leaves of dense quadtrees.
+		enum LeafAccumulation {
+			/// @brief Uses atomic accumulation, switching to sorted accumulation if float atomics are unsupported or the leaves get crowded.
+			LEAF_ACCUMULATION_AUTO,
+			/// @brief Adds every particle to its leaf with global atomics, including float atomic addition.
+			LEAF_ACCUMULATION_ATOMIC,
+			/// @brief Sorts the particles by their leaves and sums every leaf's particles with a segmented reduction, without any atomics.
+			LEAF_ACCUMULATION_SORTED,
+			/// @brief The number of implemented leaf accumulations.
+			LEAF_ACCUMULATION_COUNT
+		};
+
+		/// @brief A struct containing the tree statistics of a simulation batch, with the leaf statistics accumulated over every step of the batch.
+		struct TreeStats {
+			/// @brief The highest number of particles held by a single leaf at any step.
+			uint32_t maxOccupancy;
+			/// @brief The number of leaves summed over the steps, counting every node whose children are all particles.
+			uint32_t leafCount;
+			/// @brief The number of particles held by the leaves, summed over the steps.
+			uint32_t particleCount;
+			/// @brief The number of nodes evaluated by the force pass's subgroups at the batch's last step, each evaluated node being applied to every particle of the subgroup.
+			uint32_t interactionCount;
+			/// @brief The number of particles outside the cells they were sorted into at the tree's last rebuild, summed over the refitted steps.
+			uint32_t escapedCount;
+		};
+
+		/// @brief The maximum supported depth of the simulation's quadtree.
+		static const uint32_t MAX_TREE_DEPTH = 12;
+		/// @brief The maximum depth to which the overfull leaves of sparse quadtrees are refined.
+		static const uint32_t MAX_REFINED_DEPTH = 15;
+		/// @brief The default maximum number of particles held by a leaf before it is refined.
+		static const uint32_t DEFAULT_LEAF_CAPACITY = 16;
+		/// @brief The leaf occupancy at which automatic leaf accumulation switches to sorted accumulation, switching back below half of it.
+		static const uint32_t SORTED_LEAF_OCCUPANCY = 64;
+		/// @brief The number of simulation batches whose recorded command buffers are kept for resubmission, enough for one to never be in flight.
+		static const uint32_t RECORDED_BATCH_COUNT = VulkanSubmissionRing::MAX_SUBMISSION_COUNT;
+
 		/// @brief Gets the particle alignment required for the simulation to run.
 		/// @return The particle alignment required for the simulation to run.
 		static size_t GetRequiredParticleAlignment();
+		/// @brief Gets the default quadtree depth for the given particle count, giving the tree at least one leaf per particle.
+		/// @param particleCount The number of simulated particles.
+		/// @return The default quadtree depth.
+		static uint32_t GetDefaultTreeDepth(size_t particleCount);
+		/// @brief Checks if the simulation reorders the particles with the given parameters, writing their masses and IDs to new indices, which keeps the particle buffer sets from sharing them.
+		/// @param treeBuild The method used to build the quadtree.
+		/// @param reorderInterval The number of simulations between two reorderings of the particle buffers.
+		/// @return True if the particles are reordered, otherwise false.
+		static bool GetParticlesReordered(TreeBuild treeBuild, uint32_t reorderInterval);
 
 		BarnesHutSimulation() = delete;
 		BarnesHutSimulation(const BarnesHutSimulation&) = delete;
@@ -21,7 +86,16 @@ namespace gsim {
 		/// @brief Creates a particle simulation which uses the Barnes-Hut algorithm.
 		/// @param device The Vulkan device to create the compute pipeline in.
 		/// @param particleSystem The particle system whose particles to simulate.
-		BarnesHutSimulation(VulkanDevice* device, ParticleSystem* particleSystem);
+		/// @param treeDepth The depth of the simulation's quadtree, or 0 to choose it from the particle count.
+		/// @param treeBuild The method used to build the simulation's quadtree.
+		/// @param leafCapacity The number of particles a leaf of a sparse quadtree can hold before it is refined past the tree's depth, or 0 to never refine leaves.
+		/// @param reorderInterval The number of simulations between two reorderings of the particle buffers in the sparse quadtree's order, or 0 to never reorder them.
+		/// @param forceWalk The tree traversal used to calculate the forces.
+		/// @param quadrupoleMoments True if the nodes of a sparse quadtree should apply their quadrupole moments, otherwise false.
+		/// @param treeRebuildInterval The number of simulations between two rebuilds of a sparse quadtree, which is only refit to the particles' new positions in between.
+		/// @param leafAccumulation The accumulation of the particles into the leaves of a dense quadtree.
+		/// @param submissionCount The number of simulation batches that may be in flight at the same time.
+		BarnesHutSimulation(VulkanDevice* device, ParticleSystem* particleSystem, uint32_t treeDepth, TreeBuild treeBuild, uint32_t leafCapacity, uint32_t reorderInterval, ForceWalk forceWalk, bool quadrupoleMoments, uint32_t treeRebuildInterval, LeafAccumulation leafAccumulation, uint32_t submissionCount);
 
 		BarnesHutSimulation& operator=(const BarnesHutSimulation&) = delete;
 		BarnesHutSimulation& operator=(BarnesHutSimulation&&) = delete;
@@ -46,43 +120,168 @@ namespace gsim {
 		const ParticleSystem* GetParticleSystem() const {
 			return particleSystem;
 		}
+		/// @brief Gets the depth of the simulation's quadtree.
+		/// @return The depth of the simulation's quadtree.
+		uint32_t GetTreeDepth() const {
+			return treeDepth;
+		}
+		/// @brief Gets the method used to build the simulation's quadtree.
+		/// @return The method used to build the simulation's quadtree.
+		TreeBuild GetTreeBuild() const {
+			return treeBuild;
+		}
+		/// @brief Gets the number of particles a leaf can hold before it is refined past the tree's depth.
+		/// @return The number of particles a leaf can hold before it is refined, or 0 if leaves are never refined.
+		uint32_t GetLeafCapacity() const {
+			return leafCapacity;
+		}
+		/// @brief Gets the number of simulations between two reorderings of the particle buffers.
+		/// @return The number of simulations between two reorderings, or 0 if the particles are never reordered.
+		uint32_t GetReorderInterval() const {
+			return reorderInterval;
+		}
+		/// @brief Gets the tree traversal used to calculate the forces.
+		/// @return The tree traversal used to calculate the forces.
+		ForceWalk GetForceWalk() const {
+			return forceWalk;
+		}
+		/// @brief Checks if the nodes apply their quadrupole moments.
+		/// @return True if the nodes apply their quadrupole moments, otherwise false.
+		bool GetQuadrupoleMoments() const {
+			return quadrupoleMoments;
+		}
+		/// @brief Gets the number of simulations between two rebuilds of the quadtree.
+		/// @return The number of simulations between two rebuilds of the quadtree.
+		uint32_t GetTreeRebuildInterval() const {
+			return treeRebuildInterval;
+		}
+		/// @brief Gets the accumulation of the particles into the leaves of a dense quadtree.
+		/// @return The accumulation of the particles into the leaves of a dense quadtree.
+		LeafAccumulation GetLeafAccumulation() const {
+			return leafAccumulation;
+		}
+		/// @brief Checks if the particles are currently accumulated into the leaves of a dense quadtree by sorting them.
+		/// @return True if the particles are sorted into the leaves, otherwise false.
+		bool GetLeavesSorted() const {
+			return leavesSorted;
+		}
+		/// @brief Gets the number of simulations submitted so far, which decides when the particles are reordered.
+		/// @return The number of simulations submitted so far.
+		uint64_t GetSimulationIndex() const {
+			return simulationIndex;
+		}
+		/// @brief Gets the tree statistics of the last finished simulation batch.
+		/// @return The tree statistics, with no leaves or interactions if none were gathered yet.
+		const TreeStats& GetTreeStats() const {
+			return treeStats;
+		}
+		/// @brief Gets the number of steps the leaf statistics were accumulated over.
+		/// @return The number of simulations in the last finished batch, or 0 if no batch finished yet.
+		uint32_t GetTreeStatsStepCount() const {
+			return treeStatsStepCount;
+		}
+		/// @brief Gets the ring of simulation batch submissions.
+		/// @return A pointer to the submission ring object.
+		VulkanSubmissionRing* GetSubmissionRing() {
+			return submissionRing;
+		}
+		/// @brief Gets the ring of simulation batch submissions.
+		/// @return A const pointer to the submission ring object.
+		const VulkanSubmissionRing* GetSubmissionRing() const {
+			return submissionRing;
+		}
 
-		/// @brief Runs the given number of simulations.
+		/// @brief Runs the given number of simulations, only waiting for earlier simulations once the submission ring is full.
 		/// @param simulationCount The number of simulations to run.
 		void RunSimulations(uint32_t simulationCount);
+		/// @brief Waits for all simulations in flight to finish, reading back the tree statistics of the last one.
+		void WaitForSimulations();
+		/// @brief Restores the state of a checkpointed simulation before any simulations are run, rebuilding the tree at the first one.
+		/// @param simulationIndex The number of simulations submitted before the checkpoint.
+		/// @param leavesSorted Whether the particles were being sorted into the leaves of a dense quadtree.
+		void RestoreState(uint64_t simulationIndex, bool leavesSorted);
+		/// @brief Rebuilds the tree at the next simulation, as a restored simulation would. Used at checkpoints, so that resumed runs match the original.
+		void RequireRebuild() {
+			rebuildRequired = true;
+		}
 
 		/// @brief Destroys the Barnes-Hut simulation.
 		~BarnesHutSimulation();
 	private:
+		struct RecordedBatch {
+			VkCommandBuffer commandBuffer;
+			size_t inputIndex;
+			size_t outputIndex;
+			uint32_t simulationCount;
+			uint32_t rebuildPhase;
+			uint32_t reorderPhase;
+			bool leavesSorted;
+		};
+
 		void CreateBuffers();
 		void CreateTreeBuffers();
+		void CreateStatsBuffer();
 		void CreateDescriptorPool();
 		void CreateShaderModules();
 		void CreatePipelines();
-		void CreateCommandObjects();
+		void CreateCommandObjects(uint32_t submissionCount);
 		void RecordSecondaryCommandBuffers();
+		void RecordDenseTreeCommands();
+		void RecordSparseTreeCommands();
+		void RecordKeySort(VkCommandBuffer commandBuffer);
+		void RecordStatsCopies();
+		void RecordBatch(VkCommandBuffer commandBuffer, uint32_t simulationCount, uint32_t rebuildPhase, uint32_t reorderPhase);
+		bool IsBatchInFlight(uint32_t batchIndex) const;
+		void ReadTreeStats(uint32_t submissionIndex);
 
 		VulkanDevice* device;
 		ParticleSystem* particleSystem;
+		uint32_t treeDepth;
+		TreeBuild treeBuild;
+		uint32_t leafCapacity;
+		uint32_t reorderInterval;
+		ForceWalk forceWalk;
+		bool quadrupoleMoments;
+		uint32_t treeRebuildInterval;
+		LeafAccumulation leafAccumulation;
+		uint32_t keyDepth;
+		uint32_t treeLevelCount;
+		uint32_t sortBlockCount;
 
 		VkBuffer countBuffer;
 		VkBuffer radiusBuffer;
 		VkBuffer nodePosBuffer;
 		VkBuffer nodeMassBuffer;
 		VkBuffer srcBuffer;
-		VkDeviceMemory bufferMemory;
+		VkBuffer boundsBuffer;
+		VkBuffer sortKeyBuffers[2];
+		VkBuffer sortValueBuffer;
+		VkBuffer nodeOffsetBuffer;
+		VkBuffer blockSumBuffer;
+		VkBuffer levelNodeBuffer;
+		VkBuffer levelCountBuffer;
+		VkBuffer treeStatsBuffer;
+		VkBuffer nodeQuadBuffer;
+		VulkanMemoryAllocator::Allocation bufferAllocation;
+
+		VkBuffer statsReadbackBuffer;
+		VulkanMemoryAllocator::Allocation statsReadbackAllocation;
+		TreeStats* statsReadbackData;
+		TreeStats treeStats{};
+		uint32_t treeStatsStepCount = 0;
 
-		VkBuffer treeCountBuffers[11];
-		VkBuffer treeStartBuffers[11];
-		VkBuffer treePosBuffers[11];
-		VkBuffer treeMassBuffers[11];
-		VkDeviceMemory treeBufferMemory;
+		VkBuffer treeCountBuffers[MAX_TREE_DEPTH + 1];
+		VkBuffer treeStartBuffers[MAX_TREE_DEPTH + 1];
+		VkBuffer treePosBuffers[MAX_TREE_DEPTH + 1];
+		VkBuffer treeMassBuffers[MAX_TREE_DEPTH + 1];
+		VulkanMemoryAllocator::Allocation treeBufferAllocation;
 
 		VkDescriptorSetLayout particleSetLayout;
 		VkDescriptorSetLayout barnesHutSetLayout;
 		VkDescriptorPool descriptorPool;
 		VkDescriptorSet descriptorSets[4];
 
+		VkShaderModule boundsShader;
 		VkShaderModule clearShader;
 		VkShaderModule forceShader;
 		VkShaderModule initShader;
@@ -90,22 +289,56 @@ namespace gsim {
 		VkShaderModule treeInitShader;
 		VkShaderModule treeMoveShader;
 		VkShaderModule treeSortShader;
+		VkShaderModule keyShader;
+		VkShaderModule radixCountShader;
+		VkShaderModule radixScatterShader;
+		VkShaderModule scanShader;
+		VkShaderModule nodeCountShader;
+		VkShaderModule nodeOffsetShader;
+		VkShaderModule nodeEmitShader;
+		VkShaderModule nodeReduceShader;
+		VkShaderModule nodeRefitShader;
+		VkShaderModule leafReduceShader;
+		VkShaderModule leafGatherShader;
 
 		VkPipelineLayout bufferPipelineLayout;
 		VkPipelineLayout treePipelineLayout;
 
+		VkPipeline boundsPipeline;
 		VkPipeline clearPipeline;
 		VkPipeline forcePipeline;
+		VkPipeline forceReorderPipeline;
 		VkPipeline initPipeline;
 		VkPipeline particleSortPipeline;
 		VkPipeline treeInitPipeline;
 		VkPipeline treeMovePipeline;
 		VkPipeline treeSortPipeline;
+		VkPipeline keyPipeline;
+		VkPipeline radixCountPipeline;
+		VkPipeline radixScatterPipeline;
+		VkPipeline scanPipeline;
+		VkPipeline nodeCountPipeline;
+		VkPipeline nodeOffsetPipeline;
+		VkPipeline nodeEmitPipeline;
+		VkPipeline nodeReducePipeline;
+		VkPipeline nodeRefitPipeline;
+		VkPipeline leafReducePipeline;
+		VkPipeline leafGatherPipeline;
 
-		VkFence simulationFence;
-		VkCommandBuffer commandBuffers[2];
-		uint32_t commandBufferIndex = 0;
+		VulkanSubmissionRing* submissionRing;
+		RecordedBatch recordedBatches[RECORDED_BATCH_COUNT];
+		uint32_t nextRecordedBatch = 0;
+		uint32_t submittedBatches[VulkanSubmissionRing::MAX_SUBMISSION_COUNT];
+		uint32_t submittedStepCounts[VulkanSubmissionRing::MAX_SUBMISSION_COUNT];
+		uint32_t lastSubmission = UINT32_MAX;
+		uint64_t simulationIndex = 0;
+		uint32_t stepsSinceRebuild = 0;
+		bool rebuildRequired = true;
+		bool leavesSorted = false;
 
 		VkCommandBuffer treeCommandBuffer;
+		VkCommandBuffer treeReduceCommandBuffer;
+		VkCommandBuffer leafSortCommandBuffer;
+		VkCommandBuffer statsCopyCommandBuffers[VulkanSubmissionRing::MAX_SUBMISSION_COUNT];
 	};
 }
\ No newline at end of file
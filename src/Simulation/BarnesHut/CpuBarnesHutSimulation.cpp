@@ -0,0 +1,661 @@
+#include "CpuBarnesHutSimulation.hpp"
+#include "Debug/Exception.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <bit>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+namespace gsim {
+	// Constants
+	const size_t PARTICLE_ALIGNMENT = 16;
+	const float MIN_SIMULATION_SIZE = 0.001f;
+
+	const uint32_t RADIX_BITS = 11;
+	const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+	const size_t MIN_GRAIN_SIZE = 4096;
+	const size_t TREE_GRAIN_SIZE = 1024;
+	const size_t FORCE_GRAIN_SIZE = 4;
+
+#if defined(__AVX512F__)
+	const size_t GROUP_SIZE = 16;
+#elif defined(__AVX2__) && defined(__FMA__)
+	const size_t GROUP_SIZE = 8;
+#else
+	const size_t GROUP_SIZE = 1;
+#endif
+
+	// Internal helper functions
+	static int32_t GetFirstDifferentLevel(int32_t treeDepth, uint32_t key1, uint32_t key2) {
+		// Get the level of the highest differing bit pair
+		return treeDepth - (int32_t)((std::bit_width(key1 ^ key2) - 1) >> 1);
+	}
+	static void GetNodeLevels(int32_t treeDepth, const uint32_t* keys, size_t keyCount, size_t index, int32_t& firstLevel, int32_t& lastLevel) {
+		// The particle starts all cells below the first level at which it differs from the previous particle
+		if(!index) {
+			firstLevel = 0;
+		} else if(keys[index - 1] == keys[index]) {
+			firstLevel = treeDepth + 1;
+		} else {
+			firstLevel = GetFirstDifferentLevel(treeDepth, keys[index - 1], keys[index]);
+		}
+
+		// The started cells contain at least two particles, requiring a node, up to the last level shared with the next particle
+		if(index + 1 == keyCount) {
+			lastLevel = -1;
+		} else if(keys[index] == keys[index + 1]) {
+			lastLevel = treeDepth;
+		} else {
+			lastLevel = GetFirstDifferentLevel(treeDepth, keys[index], keys[index + 1]) - 1;
+		}
+	}
+	static size_t GetCellEnd(int32_t treeDepth, const uint32_t* keys, size_t keyCount, size_t index, int32_t level) {
+		// Gallop forward until a key outside the cell is found
+		uint32_t shift = (uint32_t)(treeDepth - level) << 1;
+		uint32_t prefix = keys[index] >> shift;
+
+		size_t low = index, high = index + 1, step = 1;
+		while(high < keyCount && (keys[high] >> shift) == prefix) {
+			low = high;
+			step <<= 1;
+			high = index + step;
+		}
+		if(high > keyCount)
+			high = keyCount;
+
+		// Binary search the cell's end in the found interval
+		while(high - low > 1) {
+			size_t middle = (low + high) >> 1;
+			if((keys[middle] >> shift) == prefix) {
+				low = middle;
+			} else {
+				high = middle;
+			}
+		}
+
+		return high;
+	}
+
+	void CpuBarnesHutSimulation::ComputeBounds(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		const Vec2* posIn = simulation->pos[simulation->inputIndex];
+
+		// Extend the thread's bounds with the range's massive particles
+		Vec2 boundsMin = simulation->threadBounds[threadIndex << 1];
+		Vec2 boundsMax = simulation->threadBounds[(threadIndex << 1) + 1];
+
+		for(size_t i = begin; i != end; ++i) {
+			if(simulation->mass[i] != 0 && isfinite(posIn[i].x) && isfinite(posIn[i].y)) {
+				boundsMin = { fminf(boundsMin.x, posIn[i].x), fminf(boundsMin.y, posIn[i].y) };
+				boundsMax = { fmaxf(boundsMax.x, posIn[i].x), fmaxf(boundsMax.y, posIn[i].y) };
+			}
+		}
+
+		simulation->threadBounds[threadIndex << 1] = boundsMin;
+		simulation->threadBounds[(threadIndex << 1) + 1] = boundsMax;
+	}
+	void CpuBarnesHutSimulation::ComputeKeys(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		Vec2* posIn = simulation->pos[simulation->inputIndex];
+		Vec2* posOut = simulation->pos[simulation->inputIndex ^ 1];
+		Vec2* velIn = simulation->vel[simulation->inputIndex];
+		Vec2* velOut = simulation->vel[simulation->inputIndex ^ 1];
+
+		float treeSize = (float)(1 << simulation->treeDepth);
+
+		for(size_t i = begin; i != end; ++i) {
+			// Get the current particle's leaf
+			Vec2 relPos { ((posIn[i].x - simulation->simulationCenter.x) / simulation->simulationSize + 1) * 0.5f * treeSize, ((posIn[i].y - simulation->simulationCenter.y) / simulation->simulationSize + 1) * 0.5f * treeSize };
+			uint32_t key;
+
+			if(relPos.x >= 0 && relPos.x < treeSize && relPos.y >= 0 && relPos.y < treeSize) {
+				uint32_t indX = (uint32_t)relPos.x;
+				uint32_t indY = (uint32_t)relPos.y;
+
+				// Interleave the leaf's coordinates into its Morton key
+				indX = (indX | (indX << 8)) & 0x00ff00ff;
+				indX = (indX | (indX << 4)) & 0x0f0f0f0f;
+				indX = (indX | (indX << 2)) & 0x33333333;
+				indX = (indX | (indX << 1)) & 0x55555555;
+
+				indY = (indY | (indY << 8)) & 0x00ff00ff;
+				indY = (indY | (indY << 4)) & 0x0f0f0f0f;
+				indY = (indY | (indY << 2)) & 0x33333333;
+				indY = (indY | (indY << 1)) & 0x55555555;
+
+				key = indX | (indY << 1);
+			} else {
+				// Remove the particle from the simulation, as it lies outside the bounds of every massive particle
+				key = 1 << (simulation->treeDepth << 1);
+
+				posOut[i] = posIn[i];
+				velOut[i] = velIn[i];
+				simulation->mass[i] = 0;
+			}
+
+			simulation->keys[0][i] = key;
+			simulation->indices[0][i] = (uint32_t)i;
+		}
+	}
+	void CpuBarnesHutSimulation::CountKeyDigits(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+
+		// Count the digits in the current chunk
+		uint32_t* digitCounts = simulation->digitOffsets + (begin / simulation->keyGrainSize) * RADIX_SIZE;
+		for(uint32_t i = 0; i != RADIX_SIZE; ++i)
+			digitCounts[i] = 0;
+		for(size_t i = begin; i != end; ++i)
+			++digitCounts[(simulation->keys[0][i] >> simulation->digitShift) & (RADIX_SIZE - 1)];
+	}
+	void CpuBarnesHutSimulation::ScatterKeys(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+
+		// Move the chunk's keys to their sorted positions, keeping their relative order
+		uint32_t* digitOffsets = simulation->digitOffsets + (begin / simulation->keyGrainSize) * RADIX_SIZE;
+		for(size_t i = begin; i != end; ++i) {
+			uint32_t dstIndex = digitOffsets[(simulation->keys[0][i] >> simulation->digitShift) & (RADIX_SIZE - 1)]++;
+			simulation->keys[1][dstIndex] = simulation->keys[0][i];
+			simulation->indices[1][dstIndex] = simulation->indices[0][i];
+		}
+	}
+	void CpuBarnesHutSimulation::SumNodeCounts(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		const Vec2* posIn = simulation->pos[simulation->inputIndex];
+
+		// Add up the chunk's node counts, masses and mass moments, along with the leaves starting in the chunk
+		ScanChunk chunk { 0, 0, 0, 0, 0, 0, 0 };
+		for(size_t i = begin; i != end; ++i) {
+			int32_t firstLevel, lastLevel;
+			GetNodeLevels((int32_t)simulation->treeDepth, simulation->keys[0], simulation->treeParticleCount, i, firstLevel, lastLevel);
+			if(lastLevel >= firstLevel)
+				chunk.nodeCount += (uint32_t)(lastLevel - firstLevel + 1);
+
+			// Add the leaf started by the particle to the tree stats, counting every deepest cell with at least two particles, the same way the dense GPU build does
+			if(lastLevel == (int32_t)simulation->treeDepth && firstLevel <= lastLevel) {
+				uint32_t occupancy = (uint32_t)(GetCellEnd((int32_t)simulation->treeDepth, simulation->keys[0], simulation->treeParticleCount, i, lastLevel) - i);
+				if(occupancy > chunk.maxOccupancy)
+					chunk.maxOccupancy = occupancy;
+				++chunk.leafCount;
+				chunk.leafParticleCount += occupancy;
+			}
+
+			uint32_t srcIndex = simulation->indices[0][i];
+			double mass = simulation->mass[srcIndex];
+			chunk.mass += mass;
+			chunk.momentX += mass * posIn[srcIndex].x;
+			chunk.momentY += mass * posIn[srcIndex].y;
+		}
+
+		simulation->scanChunks[begin / simulation->scanGrainSize] = chunk;
+	}
+	void CpuBarnesHutSimulation::ScanNodeCounts(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		const Vec2* posIn = simulation->pos[simulation->inputIndex];
+
+		// Write the exclusive prefix sums, starting from the chunk's offsets
+		ScanChunk chunk = simulation->scanChunks[begin / simulation->scanGrainSize];
+		for(size_t i = begin; i != end; ++i) {
+			simulation->nodeOffsets[i] = chunk.nodeCount;
+			simulation->massSums[i] = chunk.mass;
+			simulation->momentXSums[i] = chunk.momentX;
+			simulation->momentYSums[i] = chunk.momentY;
+
+			int32_t firstLevel, lastLevel;
+			GetNodeLevels((int32_t)simulation->treeDepth, simulation->keys[0], simulation->treeParticleCount, i, firstLevel, lastLevel);
+			if(lastLevel >= firstLevel)
+				chunk.nodeCount += (uint32_t)(lastLevel - firstLevel + 1);
+
+			uint32_t srcIndex = simulation->indices[0][i];
+			double mass = simulation->mass[srcIndex];
+			chunk.mass += mass;
+			chunk.momentX += mass * posIn[srcIndex].x;
+			chunk.momentY += mass * posIn[srcIndex].y;
+		}
+	}
+	void CpuBarnesHutSimulation::WriteTree(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		const Vec2* posIn = simulation->pos[simulation->inputIndex];
+		const uint32_t* keys = simulation->keys[0];
+		size_t keyCount = simulation->treeParticleCount;
+
+		for(size_t i = begin; i != end; ++i) {
+			// Every entry is preceded by all particles before it and by all nodes starting at or before it
+			int32_t firstLevel, lastLevel;
+			GetNodeLevels((int32_t)simulation->treeDepth, keys, keyCount, i, firstLevel, lastLevel);
+			size_t start = i + simulation->nodeOffsets[i];
+
+			// Write the nodes starting at the current particle, from the outermost one inwards
+			for(int32_t level = firstLevel; level <= lastLevel; ++level) {
+				size_t cellEnd = GetCellEnd((int32_t)simulation->treeDepth, keys, keyCount, i, level);
+				size_t nodeIndex = start + (size_t)(level - firstLevel);
+
+				// Get the node's mass and center of mass from the prefix sums
+				double mass = simulation->massSums[cellEnd] - simulation->massSums[i];
+				double momentX = simulation->momentXSums[cellEnd] - simulation->momentXSums[i];
+				double momentY = simulation->momentYSums[cellEnd] - simulation->momentYSums[i];
+				if(mass != 0) {
+					momentX /= mass;
+					momentY /= mass;
+				}
+
+				// Calculate the radius
+				float radius = simulation->simulationSize * simulation->simulationSize * 2;
+				radius /= (float)(1 << (level << 1));
+
+				// Write the node's info; its subtree holds all particles and nodes in the cell, minus its ancestors starting at the same particle
+				simulation->counts[nodeIndex] = (uint32_t)(cellEnd - i + simulation->nodeOffsets[cellEnd] - simulation->nodeOffsets[i]) - (uint32_t)(level - firstLevel);
+				simulation->radiuses[nodeIndex] = radius;
+				simulation->nodePos[nodeIndex] = { (float)momentX, (float)momentY };
+				simulation->nodeMass[nodeIndex] = (float)mass;
+			}
+
+			// Write the particle's info after its nodes
+			size_t particleIndex = start + ((lastLevel >= firstLevel) ? (size_t)(lastLevel - firstLevel + 1) : 0);
+			uint32_t srcIndex = simulation->indices[0][i];
+
+			simulation->counts[particleIndex] = 1;
+			simulation->radiuses[particleIndex] = 0;
+			simulation->nodePos[particleIndex] = posIn[srcIndex];
+			simulation->nodeMass[particleIndex] = simulation->mass[srcIndex];
+		}
+	}
+	void CpuBarnesHutSimulation::ComputeForces(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		CpuBarnesHutSimulation* simulation = (CpuBarnesHutSimulation*)userData;
+		const Vec2* posIn = simulation->pos[simulation->inputIndex];
+		const Vec2* velIn = simulation->vel[simulation->inputIndex];
+		Vec2* posOut = simulation->pos[simulation->inputIndex ^ 1];
+		Vec2* velOut = simulation->vel[simulation->inputIndex ^ 1];
+
+		const uint32_t* counts = simulation->counts;
+		const float* radiuses = simulation->radiuses;
+		const Vec2* nodePos = simulation->nodePos;
+		const float* nodeMass = simulation->nodeMass;
+		uint32_t treeSize = counts[0];
+
+		ParticleSystem* particleSystem = simulation->particleSystem;
+		float simulationTime = particleSystem->GetSimulationTime() * particleSystem->GetSimulationSpeed();
+		float softeningLenSqr = particleSystem->GetSofteningLen() * particleSystem->GetSofteningLen();
+		float accuracyParameterSqr = particleSystem->GetAccuracyParameter() * particleSystem->GetAccuracyParameter();
+
+		for(size_t group = begin; group != end; ++group) {
+			// Load the group's particles, padding the last group with copies of the last particle
+			uint32_t srcIndices[GROUP_SIZE];
+			float posX[GROUP_SIZE], posY[GROUP_SIZE];
+			float accelX[GROUP_SIZE], accelY[GROUP_SIZE];
+
+			for(size_t i = 0; i != GROUP_SIZE; ++i) {
+				size_t sortedIndex = group * GROUP_SIZE + i;
+				if(sortedIndex >= simulation->treeParticleCount)
+					sortedIndex = simulation->treeParticleCount - 1;
+
+				srcIndices[i] = simulation->indices[0][sortedIndex];
+				posX[i] = posIn[srcIndices[i]].x;
+				posY[i] = posIn[srcIndices[i]].y;
+			}
+
+			// Traverse the tree with the entire group in lockstep, opening a node if any particle is too close to it
+#if defined(__AVX512F__)
+			__m512 groupPosX = _mm512_loadu_ps(posX);
+			__m512 groupPosY = _mm512_loadu_ps(posY);
+			__m512 sumX = _mm512_setzero_ps();
+			__m512 sumY = _mm512_setzero_ps();
+
+			__m512 softening = _mm512_set1_ps(softeningLenSqr);
+			__m512 accuracy = _mm512_set1_ps(accuracyParameterSqr);
+			__m512 half = _mm512_set1_ps(0.5f);
+			__m512 threeHalves = _mm512_set1_ps(1.5f);
+
+			uint32_t ind = 0;
+			while(ind < treeSize) {
+				// Check if every particle is far enough
+				__m512 distX = _mm512_sub_ps(_mm512_set1_ps(nodePos[ind].x), groupPosX);
+				__m512 distY = _mm512_sub_ps(_mm512_set1_ps(nodePos[ind].y), groupPosY);
+				__m512 distSqr = _mm512_fmadd_ps(distX, distX, _mm512_fmadd_ps(distY, distY, softening));
+
+				if(_mm512_cmp_ps_mask(_mm512_set1_ps(radiuses[ind]), _mm512_mul_ps(distSqr, accuracy), _CMP_LE_OQ) == 0xFFFF) {
+					// Apply the force and move on to the next node
+					__m512 dist = _mm512_rsqrt14_ps(distSqr);
+					dist = _mm512_mul_ps(dist, _mm512_fnmadd_ps(_mm512_mul_ps(half, distSqr), _mm512_mul_ps(dist, dist), threeHalves));
+
+					__m512 factor = _mm512_mul_ps(_mm512_set1_ps(nodeMass[ind]), _mm512_mul_ps(dist, _mm512_mul_ps(dist, dist)));
+					sumX = _mm512_fmadd_ps(distX, factor, sumX);
+					sumY = _mm512_fmadd_ps(distY, factor, sumY);
+
+					ind += counts[ind];
+				} else {
+					// Move on to the first child node
+					++ind;
+				}
+			}
+
+			_mm512_storeu_ps(accelX, sumX);
+			_mm512_storeu_ps(accelY, sumY);
+#elif defined(__AVX2__) && defined(__FMA__)
+			__m256 groupPosX = _mm256_loadu_ps(posX);
+			__m256 groupPosY = _mm256_loadu_ps(posY);
+			__m256 sumX = _mm256_setzero_ps();
+			__m256 sumY = _mm256_setzero_ps();
+
+			__m256 softening = _mm256_set1_ps(softeningLenSqr);
+			__m256 accuracy = _mm256_set1_ps(accuracyParameterSqr);
+			__m256 half = _mm256_set1_ps(0.5f);
+			__m256 threeHalves = _mm256_set1_ps(1.5f);
+
+			uint32_t ind = 0;
+			while(ind < treeSize) {
+				// Check if every particle is far enough
+				__m256 distX = _mm256_sub_ps(_mm256_set1_ps(nodePos[ind].x), groupPosX);
+				__m256 distY = _mm256_sub_ps(_mm256_set1_ps(nodePos[ind].y), groupPosY);
+				__m256 distSqr = _mm256_fmadd_ps(distX, distX, _mm256_fmadd_ps(distY, distY, softening));
+
+				if(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_set1_ps(radiuses[ind]), _mm256_mul_ps(distSqr, accuracy), _CMP_LE_OQ)) == 0xFF) {
+					// Apply the force and move on to the next node
+					__m256 dist = _mm256_rsqrt_ps(distSqr);
+					dist = _mm256_mul_ps(dist, _mm256_fnmadd_ps(_mm256_mul_ps(half, distSqr), _mm256_mul_ps(dist, dist), threeHalves));
+
+					__m256 factor = _mm256_mul_ps(_mm256_set1_ps(nodeMass[ind]), _mm256_mul_ps(dist, _mm256_mul_ps(dist, dist)));
+					sumX = _mm256_fmadd_ps(distX, factor, sumX);
+					sumY = _mm256_fmadd_ps(distY, factor, sumY);
+
+					ind += counts[ind];
+				} else {
+					// Move on to the first child node
+					++ind;
+				}
+			}
+
+			_mm256_storeu_ps(accelX, sumX);
+			_mm256_storeu_ps(accelY, sumY);
+#else
+			float sumX = 0, sumY = 0;
+
+			uint32_t ind = 0;
+			while(ind < treeSize) {
+				// Check if the particle is far enough
+				float distX = nodePos[ind].x - posX[0];
+				float distY = nodePos[ind].y - posY[0];
+				float distSqr = distX * distX + distY * distY + softeningLenSqr;
+
+				if(radiuses[ind] <= distSqr * accuracyParameterSqr) {
+					// Apply the force and move on to the next node
+					float dist = 1.0f / sqrtf(distSqr);
+					float factor = nodeMass[ind] * dist * dist * dist;
+					sumX += distX * factor;
+					sumY += distY * factor;
+
+					ind += counts[ind];
+				} else {
+					// Move on to the first child node
+					++ind;
+				}
+			}
+
+			accelX[0] = sumX;
+			accelY[0] = sumY;
+#endif
+
+			// Calculate the new positions and velocities of the group's real particles
+			for(size_t i = 0; i != GROUP_SIZE && group * GROUP_SIZE + i < simulation->treeParticleCount; ++i) {
+				uint32_t srcIndex = srcIndices[i];
+				Vec2 vel = velIn[srcIndex];
+				Vec2 newVel { vel.x + accelX[i] * (particleSystem->GetGravitationalConst() * simulationTime), vel.y + accelY[i] * (particleSystem->GetGravitationalConst() * simulationTime) };
+
+				posOut[srcIndex] = { posX[i] + (vel.x + newVel.x) * (0.5f * simulationTime), posY[i] + (vel.y + newVel.y) * (0.5f * simulationTime) };
+				velOut[srcIndex] = newVel;
+			}
+		}
+	}
+
+	void CpuBarnesHutSimulation::GetSimulationBounds() {
+		// Reset every thread's bounds
+		for(uint32_t i = 0; i != threadPool->GetThreadCount(); ++i) {
+			threadBounds[i << 1] = { INFINITY, INFINITY };
+			threadBounds[(i << 1) + 1] = { -INFINITY, -INFINITY };
+		}
+
+		// Calculate every thread's bounds and merge them
+		threadPool->ParallelFor(particleSystem->GetAlignedParticleCount(), keyGrainSize, ComputeBounds, this);
+
+		Vec2 boundsMin { INFINITY, INFINITY };
+		Vec2 boundsMax { -INFINITY, -INFINITY };
+		for(uint32_t i = 0; i != threadPool->GetThreadCount(); ++i) {
+			boundsMin = { fminf(boundsMin.x, threadBounds[i << 1].x), fminf(boundsMin.y, threadBounds[i << 1].y) };
+			boundsMax = { fmaxf(boundsMax.x, threadBounds[(i << 1) + 1].x), fmaxf(boundsMax.y, threadBounds[(i << 1) + 1].y) };
+		}
+
+		// Exit the function if no particles were found
+		if(boundsMin.x > boundsMax.x) {
+			simulationCenter = { 0, 0 };
+			simulationSize = MIN_SIMULATION_SIZE;
+			return;
+		}
+
+		// Pad the bounds slightly, so that the particles on their upper edges still fall inside the tree, the same way the GPU simulation does
+		simulationCenter = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f };
+		simulationSize = fmaxf(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y) * (0.5f + 0.5f / (float)(1 << treeDepth));
+		if(simulationSize < MIN_SIMULATION_SIZE)
+			simulationSize = MIN_SIMULATION_SIZE;
+	}
+	void CpuBarnesHutSimulation::SortKeys() {
+		// Sort the keys with a stable least significant digit radix sort, covering the invalid key's bit as well
+		uint32_t passCount = ((treeDepth << 1) + RADIX_BITS) / RADIX_BITS;
+		for(uint32_t pass = 0; pass != passCount; ++pass) {
+			// Count every chunk's digits
+			digitShift = pass * RADIX_BITS;
+			threadPool->ParallelFor(particleSystem->GetAlignedParticleCount(), keyGrainSize, CountKeyDigits, this);
+
+			// Turn the digit counts into every chunk's digit offsets
+			uint32_t offset = 0;
+			for(uint32_t digit = 0; digit != RADIX_SIZE; ++digit) {
+				for(size_t chunk = 0; chunk != keyChunkCount; ++chunk) {
+					uint32_t count = digitOffsets[chunk * RADIX_SIZE + digit];
+					digitOffsets[chunk * RADIX_SIZE + digit] = offset;
+					offset += count;
+				}
+			}
+
+			// Scatter the keys and swap the key arrays
+			threadPool->ParallelFor(particleSystem->GetAlignedParticleCount(), keyGrainSize, ScatterKeys, this);
+
+			uint32_t* auxKeys = keys[0];
+			keys[0] = keys[1];
+			keys[1] = auxKeys;
+
+			uint32_t* auxIndices = indices[0];
+			indices[0] = indices[1];
+			indices[1] = auxIndices;
+		}
+	}
+	void CpuBarnesHutSimulation::BuildTree() {
+		// Compute every particle's key and sort the particles along the Morton curve
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		GetSimulationBounds();
+		threadPool->ParallelFor(alignedParticleCount, keyGrainSize, ComputeKeys, this);
+		SortKeys();
+
+		// Find the number of particles inside the tree, as removed particles are sorted last
+		uint32_t invalidKey = 1 << (treeDepth << 1);
+		size_t low = 0, high = alignedParticleCount;
+		while(low != high) {
+			size_t middle = (low + high) >> 1;
+			if(keys[0][middle] < invalidKey) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		treeParticleCount = low;
+
+		if(!treeParticleCount) {
+			counts[0] = 0;
+			return;
+		}
+
+		// Calculate the prefix sums of the node counts and mass moments
+		scanGrainSize = (treeParticleCount + threadPool->GetThreadCount() * 4 - 1) / (threadPool->GetThreadCount() * 4);
+		if(scanGrainSize < MIN_GRAIN_SIZE)
+			scanGrainSize = MIN_GRAIN_SIZE;
+		scanChunkCount = (treeParticleCount + scanGrainSize - 1) / scanGrainSize;
+
+		threadPool->ParallelFor(treeParticleCount, scanGrainSize, SumNodeCounts, this);
+
+		ScanChunk total { 0, 0, 0, 0, 0, 0, 0 };
+		for(size_t i = 0; i != scanChunkCount; ++i) {
+			ScanChunk chunk = scanChunks[i];
+			scanChunks[i] = total;
+
+			total.nodeCount += chunk.nodeCount;
+			total.mass += chunk.mass;
+			total.momentX += chunk.momentX;
+			total.momentY += chunk.momentY;
+
+			// Add the chunk's leaves to the tree stats
+			if(chunk.maxOccupancy > treeStats.maxOccupancy)
+				treeStats.maxOccupancy = chunk.maxOccupancy;
+			treeStats.leafCount += chunk.leafCount;
+			treeStats.particleCount += chunk.leafParticleCount;
+		}
+
+		threadPool->ParallelFor(treeParticleCount, scanGrainSize, ScanNodeCounts, this);
+
+		nodeOffsets[treeParticleCount] = total.nodeCount;
+		massSums[treeParticleCount] = total.mass;
+		momentXSums[treeParticleCount] = total.momentX;
+		momentYSums[treeParticleCount] = total.momentY;
+
+		// Grow the tree arrays, if required
+		size_t treeSize = treeParticleCount + total.nodeCount;
+		if(treeSize > treeCapacity) {
+			treeCapacity = treeSize + (treeSize >> 2);
+
+			counts = (uint32_t*)realloc(counts, treeCapacity * sizeof(uint32_t));
+			radiuses = (float*)realloc(radiuses, treeCapacity * sizeof(float));
+			nodePos = (Vec2*)realloc(nodePos, treeCapacity * sizeof(Vec2));
+			nodeMass = (float*)realloc(nodeMass, treeCapacity * sizeof(float));
+			if(!counts || !radiuses || !nodePos || !nodeMass)
+				GSIM_THROW_EXCEPTION("Failed to reallocate CPU Barnes-Hut tree arrays!");
+		}
+
+		// Write the flattened tree
+		threadPool->ParallelFor(treeParticleCount, TREE_GRAIN_SIZE, WriteTree, this);
+	}
+
+	// Public functions
+	size_t CpuBarnesHutSimulation::GetRequiredParticleAlignment() {
+		return PARTICLE_ALIGNMENT;
+	}
+
+	CpuBarnesHutSimulation::CpuBarnesHutSimulation(ThreadPool* threadPool, ParticleSystem* particleSystem, uint32_t treeDepth) : threadPool(threadPool), particleSystem(particleSystem), treeDepth(treeDepth) {
+		// Choose the tree depth, if it wasn't given, the same way the GPU simulation does
+		if(!this->treeDepth)
+			this->treeDepth = BarnesHutSimulation::GetDefaultTreeDepth(particleSystem->GetParticleCount());
+		if(this->treeDepth > BarnesHutSimulation::MAX_TREE_DEPTH)
+			GSIM_THROW_EXCEPTION("Invalid Barnes-Hut tree depth requested! The maximum supported depth is %u.", BarnesHutSimulation::MAX_TREE_DEPTH);
+
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		// Allocate the particle arrays
+		pos[0] = (Vec2*)malloc(alignedParticleCount * sizeof(Vec2) * 4);
+		mass = (float*)malloc(alignedParticleCount * sizeof(float));
+		if(!pos[0] || !mass)
+			GSIM_THROW_EXCEPTION("Failed to allocate CPU Barnes-Hut particle arrays!");
+
+		pos[1] = pos[0] + alignedParticleCount;
+		vel[0] = pos[1] + alignedParticleCount;
+		vel[1] = vel[0] + alignedParticleCount;
+
+		// Allocate every thread's bounds
+		threadBounds = (Vec2*)malloc(threadPool->GetThreadCount() * sizeof(Vec2) * 2);
+		if(!threadBounds)
+			GSIM_THROW_EXCEPTION("Failed to allocate CPU Barnes-Hut particle arrays!");
+
+		// Split the particles into chunks for the key sort
+		keyGrainSize = (alignedParticleCount + threadPool->GetThreadCount() * 4 - 1) / (threadPool->GetThreadCount() * 4);
+		if(keyGrainSize < MIN_GRAIN_SIZE)
+			keyGrainSize = MIN_GRAIN_SIZE;
+		keyChunkCount = (alignedParticleCount + keyGrainSize - 1) / keyGrainSize;
+
+		// Allocate the sort and scan arrays
+		keys[0] = (uint32_t*)malloc(alignedParticleCount * sizeof(uint32_t) * 4);
+		digitOffsets = (uint32_t*)malloc(keyChunkCount * RADIX_SIZE * sizeof(uint32_t));
+		nodeOffsets = (uint32_t*)malloc((alignedParticleCount + 1) * sizeof(uint32_t));
+		massSums = (double*)malloc((alignedParticleCount + 1) * sizeof(double) * 3);
+		scanChunks = (ScanChunk*)malloc((alignedParticleCount + MIN_GRAIN_SIZE - 1) / MIN_GRAIN_SIZE * sizeof(ScanChunk));
+		if(!keys[0] || !digitOffsets || !nodeOffsets || !massSums || !scanChunks)
+			GSIM_THROW_EXCEPTION("Failed to allocate CPU Barnes-Hut tree build arrays!");
+
+		keys[1] = keys[0] + alignedParticleCount;
+		indices[0] = keys[1] + alignedParticleCount;
+		indices[1] = indices[0] + alignedParticleCount;
+		momentXSums = massSums + alignedParticleCount + 1;
+		momentYSums = momentXSums + alignedParticleCount + 1;
+
+		// Allocate the tree arrays with room for one node per particle
+		treeCapacity = alignedParticleCount << 1;
+
+		counts = (uint32_t*)malloc(treeCapacity * sizeof(uint32_t));
+		radiuses = (float*)malloc(treeCapacity * sizeof(float));
+		nodePos = (Vec2*)malloc(treeCapacity * sizeof(Vec2));
+		nodeMass = (float*)malloc(treeCapacity * sizeof(float));
+		if(!counts || !radiuses || !nodePos || !nodeMass)
+			GSIM_THROW_EXCEPTION("Failed to allocate CPU Barnes-Hut tree arrays!");
+	}
+
+	void CpuBarnesHutSimulation::RunSimulations(uint32_t simulationCount) {
+		// Exit the function if no simulations were requested
+		if(!simulationCount)
+			return;
+
+		// Copy the particle system's arrays
+		ParticleSystem::ParticleArrays arrays = particleSystem->GetArrays();
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		for(size_t i = 0; i != alignedParticleCount; ++i) {
+			pos[inputIndex][i] = arrays.pos[i];
+			vel[inputIndex][i] = arrays.vel[i];
+			mass[i] = arrays.mass[i];
+		}
+
+		// Reset the tree stats, so that they accumulate over every simulation
+		treeStats = {};
+		treeStatsStepCount = simulationCount;
+
+		// Run every simulation
+		for(uint32_t i = 0; i != simulationCount; ++i) {
+			// Build the tree and traverse it for every group of particles
+			BuildTree();
+			if(treeParticleCount)
+				threadPool->ParallelFor((treeParticleCount + GROUP_SIZE - 1) / GROUP_SIZE, FORCE_GRAIN_SIZE, ComputeForces, this);
+
+			inputIndex ^= 1;
+		}
+
+		// Write the new particle infos back to the particle system
+		for(size_t i = 0; i != alignedParticleCount; ++i) {
+			arrays.pos[i] = pos[inputIndex][i];
+			arrays.vel[i] = vel[inputIndex][i];
+			arrays.mass[i] = mass[i];
+		}
+	}
+
+	CpuBarnesHutSimulation::~CpuBarnesHutSimulation() {
+		// Free all arrays, keeping in mind that the sort might have swapped the key arrays
+		free(pos[0]);
+		free(mass);
+		free(threadBounds);
+		free(keys[0] < keys[1] ? keys[0] : keys[1]);
+		free(digitOffsets);
+		free(nodeOffsets);
+		free(massSums);
+		free(scanChunks);
+		free(counts);
+		free(radiuses);
+		free(nodePos);
+		free(nodeMass);
+	}
+}
\ No newline at end of file
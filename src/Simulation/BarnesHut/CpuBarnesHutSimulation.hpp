@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Particles/ParticleSystem.hpp"
+#include "Platform/ThreadPool.hpp"
+#include "Simulation/BarnesHut/BarnesHutSimulation.hpp"
+#include <stdint.h>
+
+namespace gsim {
+	/// @brief A particle simulation which uses the Barnes-Hut algorithm on all CPU cores.
+	class CpuBarnesHutSimulation {
+	public:
+		/// @brief Gets the particle alignment required for the simulation to run.
+		/// @return The particle alignment required for the simulation to run.
+		static size_t GetRequiredParticleAlignment();
+
+		CpuBarnesHutSimulation() = delete;
+		CpuBarnesHutSimulation(const CpuBarnesHutSimulation&) = delete;
+		CpuBarnesHutSimulation(CpuBarnesHutSimulation&&) noexcept = delete;
+
+		/// @brief Creates a particle simulation which uses the Barnes-Hut algorithm on all CPU cores.
+		/// @param threadPool The thread pool to run the simulation on.
+		/// @param particleSystem The particle system whose particles to simulate.
+		/// @param treeDepth The depth of the simulation's quadtree, or 0 to choose it from the particle count.
+		CpuBarnesHutSimulation(ThreadPool* threadPool, ParticleSystem* particleSystem, uint32_t treeDepth);
+
+		CpuBarnesHutSimulation& operator=(const CpuBarnesHutSimulation&) = delete;
+		CpuBarnesHutSimulation& operator=(CpuBarnesHutSimulation&&) noexcept = delete;
+
+		/// @brief Gets the thread pool the simulation runs on.
+		/// @return A pointer to the thread pool.
+		ThreadPool* GetThreadPool() {
+			return threadPool;
+		}
+		/// @brief Gets the thread pool the simulation runs on.
+		/// @return A const pointer to the thread pool.
+		const ThreadPool* GetThreadPool() const {
+			return threadPool;
+		}
+		/// @brief Gets the particle system whose particles to simulate.
+		/// @return A pointer to the particle system object.
+		ParticleSystem* GetParticleSystem() {
+			return particleSystem;
+		}
+		/// @brief Gets the particle system whose particles to simulate.
+		/// @return A const pointer to the particle system object.
+		const ParticleSystem* GetParticleSystem() const {
+			return particleSystem;
+		}
+		/// @brief Gets the depth of the simulation's quadtree.
+		/// @return The depth of the simulation's quadtree.
+		uint32_t GetTreeDepth() const {
+			return treeDepth;
+		}
+		/// @brief Gets the leaf statistics of the last simulations, accumulated over all of their steps. Only the leaf occupancy is gathered.
+		/// @return The tree statistics, with no leaves if none were gathered yet.
+		const BarnesHutSimulation::TreeStats& GetTreeStats() const {
+			return treeStats;
+		}
+		/// @brief Gets the number of steps the leaf statistics were accumulated over.
+		/// @return The number of simulations last run, or 0 if none were run yet.
+		uint32_t GetTreeStatsStepCount() const {
+			return treeStatsStepCount;
+		}
+
+		/// @brief Runs the given number of simulations.
+		/// @param simulationCount The number of simulations to run.
+		void RunSimulations(uint32_t simulationCount);
+
+		/// @brief Destroys the Barnes-Hut simulation.
+		~CpuBarnesHutSimulation();
+	private:
+		struct ScanChunk {
+			uint32_t nodeCount;
+			double mass;
+			double momentX;
+			double momentY;
+			uint32_t maxOccupancy;
+			uint32_t leafCount;
+			uint32_t leafParticleCount;
+		};
+
+		static void ComputeBounds(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void ComputeKeys(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void CountKeyDigits(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void ScatterKeys(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void SumNodeCounts(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void ScanNodeCounts(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void WriteTree(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+		static void ComputeForces(void* userData, size_t begin, size_t end, uint32_t threadIndex);
+
+		void GetSimulationBounds();
+		void SortKeys();
+		void BuildTree();
+
+		ThreadPool* threadPool;
+		ParticleSystem* particleSystem;
+		uint32_t treeDepth;
+
+		Vec2* pos[2];
+		Vec2* vel[2];
+		float* mass;
+		uint32_t inputIndex = 0;
+
+		Vec2* threadBounds;
+		Vec2 simulationCenter;
+		float simulationSize;
+
+		uint32_t* keys[2];
+		uint32_t* indices[2];
+		uint32_t* digitOffsets;
+		size_t keyGrainSize;
+		size_t keyChunkCount;
+		uint32_t digitShift;
+		size_t treeParticleCount;
+
+		uint32_t* nodeOffsets;
+		double* massSums;
+		double* momentXSums;
+		double* momentYSums;
+		ScanChunk* scanChunks;
+		size_t scanGrainSize;
+		size_t scanChunkCount;
+
+		uint32_t* counts;
+		float* radiuses;
+		Vec2* nodePos;
+		float* nodeMass;
+		size_t treeCapacity = 0;
+
+		BarnesHutSimulation::TreeStats treeStats{};
+		uint32_t treeStatsStepCount = 0;
+	};
+}
\ No newline at end of file
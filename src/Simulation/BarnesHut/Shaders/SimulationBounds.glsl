@@ -0,0 +1,27 @@
+// Shared by the passes that place particles in the tree, which must all agree on the simulation's bounds.
+// Requires the including shader to declare the TREE_SIZE specialization constant and the bounds buffer's bounds member.
+
+const float MIN_SIMULATION_SIZE = 0.001;
+
+// Converts the given sortable bounds value back to a float
+float SortableToFloat(uint value) {
+	return uintBitsToFloat((value & 0x80000000) != 0 ? value & 0x7fffffff : ~value);
+}
+
+// Gets the center and half-size of the square covering the simulation's bounds
+void GetSimulationBounds(out vec2 center, out float size) {
+	// Exit the function if no particles were found
+	if(bounds.x > bounds.z || bounds.y > bounds.w) {
+		center = vec2(0);
+		size = MIN_SIMULATION_SIZE;
+		return;
+	}
+
+	// Decode the bounds
+	vec2 boundsMin = vec2(SortableToFloat(bounds.x), SortableToFloat(bounds.y));
+	vec2 boundsMax = vec2(SortableToFloat(bounds.z), SortableToFloat(bounds.w));
+
+	// Pad the bounds slightly, so that the particles on their upper edges still fall inside the tree
+	center = (boundsMin + boundsMax) * 0.5;
+	size = max(max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y) * (0.5 + 0.5 / TREE_SIZE), MIN_SIMULATION_SIZE);
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "CpuDirectSimulation.hpp"
+#include "Debug/Exception.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+namespace gsim {
+	// Constants
+	const size_t PARTICLE_ALIGNMENT = 16;
+	const size_t GRAIN_SIZE = 64;
+	const size_t TILE_SIZE = 1024;
+
+	// Structs
+	struct SimulationStep {
+		const float* posXIn;
+		const float* posYIn;
+		float* posXOut;
+		float* posYOut;
+		float* velX;
+		float* velY;
+		const float* mass;
+		size_t particleCount;
+		float simulationTime;
+		float gravitationalConst;
+		float softeningLenSqr;
+	};
+
+	// Internal helper functions
+	static void AccumulateTile(const SimulationStep* step, size_t begin, size_t end, size_t tileBegin, size_t tileEnd, float* accelX, float* accelY) {
+#if defined(__AVX512F__)
+		// Broadcast the constants used by every interaction
+		__m512 softeningLenSqr = _mm512_set1_ps(step->softeningLenSqr);
+		__m512 half = _mm512_set1_ps(0.5f);
+		__m512 threeHalves = _mm512_set1_ps(1.5f);
+
+		for(size_t i = begin; i != end; i += 16) {
+			// Load the current particles' positions and accelerations
+			__m512 posX = _mm512_loadu_ps(step->posXIn + i);
+			__m512 posY = _mm512_loadu_ps(step->posYIn + i);
+			__m512 sumX = _mm512_loadu_ps(accelX + i - begin);
+			__m512 sumY = _mm512_loadu_ps(accelY + i - begin);
+
+			for(size_t j = tileBegin; j != tileEnd; ++j) {
+				// Calculate the distance between the particles
+				__m512 distX = _mm512_sub_ps(_mm512_set1_ps(step->posXIn[j]), posX);
+				__m512 distY = _mm512_sub_ps(_mm512_set1_ps(step->posYIn[j]), posY);
+				__m512 distSqr = _mm512_fmadd_ps(distX, distX, _mm512_fmadd_ps(distY, distY, softeningLenSqr));
+
+				// Approximate the inverse square root and refine it with one Newton-Raphson iteration
+				__m512 dist = _mm512_rsqrt14_ps(distSqr);
+				dist = _mm512_mul_ps(dist, _mm512_fnmadd_ps(_mm512_mul_ps(half, distSqr), _mm512_mul_ps(dist, dist), threeHalves));
+
+				// Add the interaction's acceleration to the particles' total accelerations
+				__m512 factor = _mm512_mul_ps(_mm512_set1_ps(step->mass[j]), _mm512_mul_ps(dist, _mm512_mul_ps(dist, dist)));
+				sumX = _mm512_fmadd_ps(distX, factor, sumX);
+				sumY = _mm512_fmadd_ps(distY, factor, sumY);
+			}
+
+			// Store the new accelerations
+			_mm512_storeu_ps(accelX + i - begin, sumX);
+			_mm512_storeu_ps(accelY + i - begin, sumY);
+		}
+#elif defined(__AVX2__) && defined(__FMA__)
+		// Broadcast the constants used by every interaction
+		__m256 softeningLenSqr = _mm256_set1_ps(step->softeningLenSqr);
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 threeHalves = _mm256_set1_ps(1.5f);
+
+		for(size_t i = begin; i != end; i += 8) {
+			// Load the current particles' positions and accelerations
+			__m256 posX = _mm256_loadu_ps(step->posXIn + i);
+			__m256 posY = _mm256_loadu_ps(step->posYIn + i);
+			__m256 sumX = _mm256_loadu_ps(accelX + i - begin);
+			__m256 sumY = _mm256_loadu_ps(accelY + i - begin);
+
+			for(size_t j = tileBegin; j != tileEnd; ++j) {
+				// Calculate the distance between the particles
+				__m256 distX = _mm256_sub_ps(_mm256_set1_ps(step->posXIn[j]), posX);
+				__m256 distY = _mm256_sub_ps(_mm256_set1_ps(step->posYIn[j]), posY);
+				__m256 distSqr = _mm256_fmadd_ps(distX, distX, _mm256_fmadd_ps(distY, distY, softeningLenSqr));
+
+				// Approximate the inverse square root and refine it with one Newton-Raphson iteration
+				__m256 dist = _mm256_rsqrt_ps(distSqr);
+				dist = _mm256_mul_ps(dist, _mm256_fnmadd_ps(_mm256_mul_ps(half, distSqr), _mm256_mul_ps(dist, dist), threeHalves));
+
+				// Add the interaction's acceleration to the particles' total accelerations
+				__m256 factor = _mm256_mul_ps(_mm256_set1_ps(step->mass[j]), _mm256_mul_ps(dist, _mm256_mul_ps(dist, dist)));
+				sumX = _mm256_fmadd_ps(distX, factor, sumX);
+				sumY = _mm256_fmadd_ps(distY, factor, sumY);
+			}
+
+			// Store the new accelerations
+			_mm256_storeu_ps(accelX + i - begin, sumX);
+			_mm256_storeu_ps(accelY + i - begin, sumY);
+		}
+#else
+		for(size_t i = begin; i != end; ++i) {
+			// Load the current particle's position and acceleration
+			float posX = step->posXIn[i];
+			float posY = step->posYIn[i];
+			float sumX = accelX[i - begin];
+			float sumY = accelY[i - begin];
+
+			for(size_t j = tileBegin; j != tileEnd; ++j) {
+				// Calculate the distance between the particles
+				float distX = step->posXIn[j] - posX;
+				float distY = step->posYIn[j] - posY;
+				float dist = 1.0f / sqrtf(distX * distX + distY * distY + step->softeningLenSqr);
+
+				// Add the interaction's acceleration to the particle's total acceleration
+				float factor = step->mass[j] * dist * dist * dist;
+				sumX += distX * factor;
+				sumY += distY * factor;
+			}
+
+			// Store the new acceleration
+			accelX[i - begin] = sumX;
+			accelY[i - begin] = sumY;
+		}
+#endif
+	}
+	static void SimulateGrain(const SimulationStep* step, size_t begin, size_t end) {
+		// Accumulate the grain's accelerations one L1-sized tile of particles at a time
+		float accelX[GRAIN_SIZE] { };
+		float accelY[GRAIN_SIZE] { };
+
+		for(size_t tileBegin = 0; tileBegin < step->particleCount; tileBegin += TILE_SIZE) {
+			size_t tileEnd = tileBegin + TILE_SIZE;
+			if(tileEnd > step->particleCount)
+				tileEnd = step->particleCount;
+
+			AccumulateTile(step, begin, end, tileBegin, tileEnd, accelX, accelY);
+		}
+
+		// Set the new particles' velocities and positions
+		float velFactor = step->simulationTime * step->gravitationalConst;
+		float posFactor = step->simulationTime * 0.5f;
+
+		for(size_t i = begin; i != end; ++i) {
+			float newVelX = step->velX[i] + accelX[i - begin] * velFactor;
+			float newVelY = step->velY[i] + accelY[i - begin] * velFactor;
+
+			step->posXOut[i] = step->posXIn[i] + (step->velX[i] + newVelX) * posFactor;
+			step->posYOut[i] = step->posYIn[i] + (step->velY[i] + newVelY) * posFactor;
+			step->velX[i] = newVelX;
+			step->velY[i] = newVelY;
+		}
+	}
+	static void SimulateRange(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		// Get the simulation step's info
+		const SimulationStep* step = (const SimulationStep*)userData;
+
+		// Simulate the range one grain at a time, as the accelerations are accumulated in grain-sized arrays
+		for(size_t grainBegin = begin; grainBegin < end; grainBegin += GRAIN_SIZE) {
+			size_t grainEnd = grainBegin + GRAIN_SIZE;
+			if(grainEnd > end)
+				grainEnd = end;
+
+			SimulateGrain(step, grainBegin, grainEnd);
+		}
+	}
+
+	// Public functions
+	size_t CpuDirectSimulation::GetRequiredParticleAlignment() {
+		return PARTICLE_ALIGNMENT;
+	}
+
+	CpuDirectSimulation::CpuDirectSimulation(ThreadPool* threadPool, ParticleSystem* particleSystem) : threadPool(threadPool), particleSystem(particleSystem) {
+		// Allocate all split component arrays in a single block
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		posX[0] = (float*)malloc(alignedParticleCount * sizeof(float) * 7);
+		if(!posX[0])
+			GSIM_THROW_EXCEPTION("Failed to allocate CPU simulation particle arrays!");
+
+		posY[0] = posX[0] + alignedParticleCount;
+		posX[1] = posY[0] + alignedParticleCount;
+		posY[1] = posX[1] + alignedParticleCount;
+		velX = posY[1] + alignedParticleCount;
+		velY = velX + alignedParticleCount;
+		mass = velY + alignedParticleCount;
+	}
+
+	void CpuDirectSimulation::RunSimulations(uint32_t simulationCount) {
+		// Exit the function if no simulations were requested
+		if(!simulationCount)
+			return;
+
+		// Split the particle system's arrays into separate components, for easier vectorization
+		ParticleSystem::ParticleArrays arrays = particleSystem->GetArrays();
+		size_t alignedParticleCount = particleSystem->GetAlignedParticleCount();
+
+		for(size_t i = 0; i != alignedParticleCount; ++i) {
+			posX[0][i] = arrays.pos[i].x;
+			posY[0][i] = arrays.pos[i].y;
+			velX[i] = arrays.vel[i].x;
+			velY[i] = arrays.vel[i].y;
+			mass[i] = arrays.mass[i];
+		}
+
+		// Run every simulation, swapping the position arrays between steps
+		uint32_t inputIndex = 0;
+		for(uint32_t i = 0; i != simulationCount; ++i) {
+			SimulationStep step {
+				.posXIn = posX[inputIndex],
+				.posYIn = posY[inputIndex],
+				.posXOut = posX[inputIndex ^ 1],
+				.posYOut = posY[inputIndex ^ 1],
+				.velX = velX,
+				.velY = velY,
+				.mass = mass,
+				.particleCount = alignedParticleCount,
+				.simulationTime = particleSystem->GetSimulationTime(),
+				.gravitationalConst = particleSystem->GetGravitationalConst(),
+				.softeningLenSqr = particleSystem->GetSofteningLen() * particleSystem->GetSofteningLen()
+			};
+
+			threadPool->ParallelFor(alignedParticleCount, GRAIN_SIZE, SimulateRange, &step);
+			inputIndex ^= 1;
+		}
+
+		// Write the new particle infos back to the particle system
+		for(size_t i = 0; i != alignedParticleCount; ++i) {
+			arrays.pos[i] = { posX[inputIndex][i], posY[inputIndex][i] };
+			arrays.vel[i] = { velX[i], velY[i] };
+		}
+	}
+
+	CpuDirectSimulation::~CpuDirectSimulation() {
+		// Free the particle arrays
+		free(posX[0]);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Particles/ParticleSystem.hpp"
+#include "Platform/ThreadPool.hpp"
+#include <stdint.h>
+
+namespace gsim {
+	/// @brief A particle simulation which uses the direct sum method on all CPU cores.
+	class CpuDirectSimulation {
+	public:
+		/// @brief Gets the particle alignment required for the simulation to run.
+		/// @return The particle alignment required for the simulation to run.
+		static size_t GetRequiredParticleAlignment();
+
+		CpuDirectSimulation() = delete;
+		CpuDirectSimulation(const CpuDirectSimulation&) = delete;
+		CpuDirectSimulation(CpuDirectSimulation&&) noexcept = delete;
+
+		/// @brief Creates a particle simulation which uses the direct sum method on all CPU cores.
+		/// @param threadPool The thread pool to run the simulation on.
+		/// @param particleSystem The particle system whose particles to simulate.
+		CpuDirectSimulation(ThreadPool* threadPool, ParticleSystem* particleSystem);
+
+		CpuDirectSimulation& operator=(const CpuDirectSimulation&) = delete;
+		CpuDirectSimulation& operator=(CpuDirectSimulation&&) noexcept = delete;
+
+		/// @brief Gets the thread pool the simulation runs on.
+		/// @return A pointer to the thread pool.
+		ThreadPool* GetThreadPool() {
+			return threadPool;
+		}
+		/// @brief Gets the thread pool the simulation runs on.
+		/// @return A const pointer to the thread pool.
+		const ThreadPool* GetThreadPool() const {
+			return threadPool;
+		}
+		/// @brief Gets the particle system whose particles to simulate.
+		/// @return A pointer to the particle system object.
+		ParticleSystem* GetParticleSystem() {
+			return particleSystem;
+		}
+		/// @brief Gets the particle system whose particles to simulate.
+		/// @return A const pointer to the particle system object.
+		const ParticleSystem* GetParticleSystem() const {
+			return particleSystem;
+		}
+
+		/// @brief Runs the given number of simulations.
+		/// @param simulationCount The number of simulations to run.
+		void RunSimulations(uint32_t simulationCount);
+
+		/// @brief Destroys the direct simulation.
+		~CpuDirectSimulation();
+	private:
+		ThreadPool* threadPool;
+		ParticleSystem* particleSystem;
+
+		float* posX[2];
+		float* posY[2];
+		float* velX;
+		float* velY;
+		float* mass;
+	};
+}
\ No newline at end of file
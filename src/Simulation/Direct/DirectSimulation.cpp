@@ -22,13 +22,89 @@ namespace gsim {
 #include "Shaders/SimShader.comp.u32"
 	};
 
+	// Internal helper functions
+	void DirectSimulation::RecordBatch(VkCommandBuffer commandBuffer, uint32_t simulationCount) {
+		// Reset the command buffer
+		VkResult result = vkResetCommandBuffer(commandBuffer, 0);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to reset Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+		
+		// Set the command buffer begin info
+		VkCommandBufferBeginInfo beginInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+			.pInheritanceInfo = nullptr
+		};
+
+		// Begin recording the command buffer
+		result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+		
+		// Bind the compute pipeline
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		// Set the memory barrier info
+		VkMemoryBarrier memoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+		};
+
+		// Record every simulation, swapping the batch's own copies of the compute indices
+		size_t inputIndex = particleSystem->GetComputeInputIndex();
+		size_t outputIndex = particleSystem->GetComputeOutputIndex();
+		for(uint32_t i = 0; i != simulationCount; ++i) {
+			// Bind the descriptor sets
+			VkDescriptorSet commandSets[] { descriptorSets[inputIndex], descriptorSets[outputIndex], massDescriptorSet };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 3, commandSets, 0, nullptr);
+
+			// Run the shader
+			vkCmdDispatch(commandBuffer, (uint32_t)(particleSystem->GetAlignedParticleCount() / WORKGROUP_SIZE), 1, 1);
+
+			// Add the pipeline barrier
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			// Get the new indices
+			size_t aux = inputIndex;
+			inputIndex = outputIndex;
+			outputIndex = aux;
+		}
+
+		// Make the last simulation's output visible to the host, if it reads the particle buffers' mapped memory directly
+		if(particleSystem->GetBufferMemoryMapped()) {
+			VkMemoryBarrier hostBarrier {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.pNext = nullptr,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// End recording the command buffer
+		result = vkEndCommandBuffer(commandBuffer);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to end recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+	}
+	bool DirectSimulation::IsBatchInFlight(uint32_t batchIndex) const {
+		// Check if any submission in flight runs the batch
+		for(uint32_t i = 0; i != submissionRing->GetSubmissionCount(); ++i)
+			if(submittedBatches[i] == batchIndex)
+				return true;
+		
+		return false;
+	}
+
 	// Public functions
 	size_t DirectSimulation::GetRequiredParticleAlignment() {
 		return WORKGROUP_SIZE;
 	}
 
-	DirectSimulation::DirectSimulation(VulkanDevice* device, ParticleSystem* particleSystem) : device(device), particleSystem(particleSystem) {
-		// Set the descriptor set layout bindings
+	DirectSimulation::DirectSimulation(VulkanDevice* device, ParticleSystem* particleSystem, uint32_t submissionCount) : device(device), particleSystem(particleSystem) {
+		// Set the descriptor set layout bindings, with the positions and velocities rotated with the particle buffer sets and the masses in their own set, as the simulation never writes them
 		VkDescriptorSetLayoutBinding setLayoutBindings[] {
 			{
 				.binding = 0,
@@ -43,13 +119,6 @@ namespace gsim {
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				.pImmutableSamplers = nullptr
-			},
-			{
-				.binding = 2,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-				.pImmutableSamplers = nullptr
 			}
 		};
 
@@ -58,7 +127,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.bindingCount = 3,
+			.bindingCount = 2,
 			.pBindings = setLayoutBindings
 		};
 
@@ -67,10 +136,27 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan particle buffer descriptor set layout! Error code: %s", string_VkResult(result));
 		
-		// Set the descriptor pool size
+		// Set the mass descriptor set layout info, reusing the first binding
+		VkDescriptorSetLayoutCreateInfo massSetLayoutInfo {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.bindingCount = 1,
+			.pBindings = setLayoutBindings
+		};
+
+		// Create the mass descriptor set layout
+		result = vkCreateDescriptorSetLayout(device->GetDevice(), &massSetLayoutInfo, nullptr, &massSetLayout);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan particle mass descriptor set layout! Error code: %s", string_VkResult(result));
+		
+		// Set the descriptor pool size, with one descriptor set per particle buffer set and one for the masses
+		uint32_t bufferSetCount = particleSystem->GetBufferSetCount();
+		uint32_t descriptorCount = (bufferSetCount << 1) + 1;
+
 		VkDescriptorPoolSize descriptorPoolSize {
 			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 9
+			.descriptorCount = descriptorCount
 		};
 
 		// Set the descriptor pool create info
@@ -78,7 +164,7 @@ namespace gsim {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.maxSets = 3,
+			.maxSets = bufferSetCount + 1,
 			.poolSizeCount = 1,
 			.pPoolSizes = &descriptorPoolSize
 		};
@@ -88,25 +174,33 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan compute pipeline descriptor pool! Error code: %s", string_VkResult(result));
 		
-		// Set the descriptor set alloc info
-		VkDescriptorSetLayout setLayouts[] { setLayout, setLayout, setLayout };
+		// Set the descriptor set alloc info, with the mass set last
+		VkDescriptorSetLayout setLayouts[ParticleSystem::MAX_BUFFER_SET_COUNT + 1];
+		for(uint32_t i = 0; i != bufferSetCount; ++i)
+			setLayouts[i] = setLayout;
+		setLayouts[bufferSetCount] = massSetLayout;
 
 		VkDescriptorSetAllocateInfo descriptorSetInfo {
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 			.pNext = nullptr,
 			.descriptorPool = descriptorPool,
-			.descriptorSetCount = 3,
+			.descriptorSetCount = bufferSetCount + 1,
 			.pSetLayouts = setLayouts
 		};
 
 		// Allocate the descriptor sets
-		result = vkAllocateDescriptorSets(device->GetDevice(), &descriptorSetInfo, descriptorSets);
+		VkDescriptorSet allocatedSets[ParticleSystem::MAX_BUFFER_SET_COUNT + 1];
+		result = vkAllocateDescriptorSets(device->GetDevice(), &descriptorSetInfo, allocatedSets);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan particle buffer descriptor sets! Error code: %s", string_VkResult(result));
 		
-		// Set the descriptor buffer infos
-		VkDescriptorBufferInfo descriptorBufferInfos[9];
-		for(size_t i = 0, ind = 0; i != 3; ++i) {
+		for(uint32_t i = 0; i != bufferSetCount; ++i)
+			descriptorSets[i] = allocatedSets[i];
+		massDescriptorSet = allocatedSets[bufferSetCount];
+		
+		// Set the descriptor buffer infos, taking the first set's masses, as every set holds the same masses
+		VkDescriptorBufferInfo descriptorBufferInfos[(ParticleSystem::MAX_BUFFER_SET_COUNT << 1) + 1];
+		for(size_t i = 0, ind = 0; i != bufferSetCount; ++i) {
 			descriptorBufferInfos[ind].buffer = particleSystem->GetBuffers()[i].posBuffer;
 			descriptorBufferInfos[ind].offset = 0;
 			descriptorBufferInfos[ind].range = VK_WHOLE_SIZE;
@@ -115,19 +209,18 @@ namespace gsim {
 			descriptorBufferInfos[ind].offset = 0;
 			descriptorBufferInfos[ind].range = VK_WHOLE_SIZE;
 			++ind;
-			descriptorBufferInfos[ind].buffer = particleSystem->GetBuffers()[i].massBuffer;
-			descriptorBufferInfos[ind].offset = 0;
-			descriptorBufferInfos[ind].range = VK_WHOLE_SIZE;
-			++ind;
 		}
+		descriptorBufferInfos[descriptorCount - 1].buffer = particleSystem->GetBuffers()[0].massBuffer;
+		descriptorBufferInfos[descriptorCount - 1].offset = 0;
+		descriptorBufferInfos[descriptorCount - 1].range = VK_WHOLE_SIZE;
 
 		// Set the descriptor set writes
-		VkWriteDescriptorSet descriptorSetWrites[9];
-		for(size_t i = 0, ind = 0; i != 3; ++i) {
-			for(size_t j = 0; j != 3; ++j, ++ind) {
+		VkWriteDescriptorSet descriptorSetWrites[(ParticleSystem::MAX_BUFFER_SET_COUNT << 1) + 1];
+		for(size_t i = 0, ind = 0; i != bufferSetCount + 1; ++i) {
+			for(size_t j = 0; j != 2 && ind != descriptorCount; ++j, ++ind) {
 				descriptorSetWrites[ind].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 				descriptorSetWrites[ind].pNext = nullptr;
-				descriptorSetWrites[ind].dstSet = descriptorSets[i];
+				descriptorSetWrites[ind].dstSet = allocatedSets[i];
 				descriptorSetWrites[ind].dstBinding = (uint32_t)j;
 				descriptorSetWrites[ind].dstArrayElement = 0;
 				descriptorSetWrites[ind].descriptorCount = 1;
@@ -139,7 +232,7 @@ namespace gsim {
 		}
 
 		// Update the descriptor sets
-		vkUpdateDescriptorSets(device->GetDevice(), 9, descriptorSetWrites, 0, nullptr);
+		vkUpdateDescriptorSets(device->GetDevice(), descriptorCount, descriptorSetWrites, 0, nullptr);
 		
 		// Set the shader module create info
 		VkShaderModuleCreateInfo shaderModuleInfo {
@@ -155,13 +248,15 @@ namespace gsim {
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan simulation shader module! Error code: %s", string_VkResult(result));
 		
-		// Set the pipeline layout create info
+		// Set the pipeline layout create info, with the input and output particle sets followed by the mass set
+		VkDescriptorSetLayout pipelineSetLayouts[] { setLayout, setLayout, massSetLayout };
+
 		VkPipelineLayoutCreateInfo layoutInfo {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 			.pNext = nullptr,
 			.flags = 0,
-			.setLayoutCount = 2,
-			.pSetLayouts = setLayouts,
+			.setLayoutCount = 3,
+			.pSetLayouts = pipelineSetLayouts,
 			.pushConstantRangeCount = 0,
 			.pPushConstantRanges = nullptr
 		};
@@ -236,22 +331,15 @@ namespace gsim {
 			.basePipelineIndex = -1
 		};
 
-		// Create the pipeline
-		result = vkCreateComputePipelines(device->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+		// Create the pipeline through the device's pipeline cache
+		result = vkCreateComputePipelines(device->GetDevice(), device->GetPipelineCache()->GetPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan simulation compute pipeline! Error code: %s", string_VkResult(result));
 		
-		// Set the fence create info
-		VkFenceCreateInfo fenceInfo {
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT
-		};
-
-		// Create the fence
-		result = vkCreateFence(device->GetDevice(), &fenceInfo, nullptr, &simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to create Vulkan simulation synchronization fence! Error code: %s", string_VkResult(result));
+		// Create the submission ring, with no batches in flight
+		submissionRing = new VulkanSubmissionRing(device, submissionCount);
+		for(uint32_t i = 0; i != VulkanSubmissionRing::MAX_SUBMISSION_COUNT; ++i)
+			submittedBatches[i] = UINT32_MAX;
 		
 		// Set the command buffer alloc info
 		VkCommandBufferAllocateInfo allocInfo {
@@ -259,110 +347,91 @@ namespace gsim {
 			.pNext = nullptr,
 			.commandPool = device->GetComputeCommandPool(),
 			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 2
+			.commandBufferCount = RECORDED_BATCH_COUNT
 		};
 
 		// Allocate the command buffers
+		VkCommandBuffer commandBuffers[RECORDED_BATCH_COUNT];
 		result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, commandBuffers);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan simulation command buffers! Error code: %s", string_VkResult(result));
+		
+		// Set the recorded batches, leaving them all empty
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT; ++i) {
+			recordedBatches[i] = {
+				.commandBuffer = commandBuffers[i],
+				.inputIndex = SIZE_MAX,
+				.outputIndex = SIZE_MAX,
+				.simulationCount = 0
+			};
+		}
 	}
 
 	void DirectSimulation::RunSimulations(uint32_t simulationCount) {
-		// Set the new command buffer index
-		commandBufferIndex ^= 1;
-		VkCommandBuffer commandBuffer = commandBuffers[commandBufferIndex];
-
-		// Reset the command buffer
-		VkResult result = vkResetCommandBuffer(commandBuffer, 0);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to reset Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
-		
-		// Set the command buffer begin info
-		VkCommandBufferBeginInfo beginInfo {
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.pNext = nullptr,
-			.flags = 0,
-			.pInheritanceInfo = nullptr
-		};
-
-		// Begin recording the command buffer
-		result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
-		
-		// Bind the compute pipeline
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-
-		// Set the memory barrier info
-		VkMemoryBarrier memoryBarrier {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-			.pNext = nullptr,
-			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
-		};
-
-		// Record every simulation
-		for(uint32_t i = 0; i != simulationCount; ++i) {
-			// Bind the descriptor sets
-			VkDescriptorSet commandSets[] { descriptorSets[particleSystem->GetComputeInputIndex()], descriptorSets[particleSystem->GetComputeOutputIndex()] };
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 2, commandSets, 0, nullptr);
+		// Exit the function if no simulations will be run
+		if(!simulationCount)
+			return;
+
+		// Acquire the next submission, waiting for its previous batch to finish
+		uint32_t submissionIndex = submissionRing->AcquireSubmission();
+		submittedBatches[submissionIndex] = UINT32_MAX;
+
+		// Look for a recorded batch starting from the same buffers with the same number of simulations
+		size_t inputIndex = particleSystem->GetComputeInputIndex();
+		size_t outputIndex = particleSystem->GetComputeOutputIndex();
+
+		uint32_t batchIndex = UINT32_MAX;
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT && batchIndex == UINT32_MAX; ++i) {
+			const RecordedBatch& batch = recordedBatches[i];
+			if(batch.inputIndex == inputIndex && batch.outputIndex == outputIndex && batch.simulationCount == simulationCount)
+				batchIndex = i;
+		}
 
-			// Run the shader
-			vkCmdDispatch(commandBuffer, (uint32_t)(particleSystem->GetAlignedParticleCount() / WORKGROUP_SIZE), 1, 1);
+		// Record the batch if it wasn't recorded yet, replacing the oldest batch that isn't in flight
+		if(batchIndex == UINT32_MAX) {
+			batchIndex = nextRecordedBatch;
+			while(IsBatchInFlight(batchIndex))
+				batchIndex = (batchIndex + 1) % RECORDED_BATCH_COUNT;
+			nextRecordedBatch = (batchIndex + 1) % RECORDED_BATCH_COUNT;
 
-			// Add the pipeline barrier
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			RecordedBatch& batch = recordedBatches[batchIndex];
+			RecordBatch(batch.commandBuffer, simulationCount);
 
-			// Get the new indices
-			particleSystem->NextComputeIndices();
+			batch.inputIndex = inputIndex;
+			batch.outputIndex = outputIndex;
+			batch.simulationCount = simulationCount;
 		}
 
-		// End recording the command buffer
-		result = vkEndCommandBuffer(commandBuffer);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to end recording Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
-
-		// Wait for the simulation fence
-		result = vkWaitForFences(device->GetDevice(), 1, &simulationFence, VK_TRUE, UINT64_MAX);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to wait for Vulkan simulation fence! Error code: %s", string_VkResult(result));
-		
-		// Reset the simulation fence
-		result = vkResetFences(device->GetDevice(), 1, &simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to reset Vulkan simulation fence! Error code: %s", string_VkResult(result));
+		// Get the new indices
+		for(uint32_t i = 0; i != simulationCount; ++i)
+			particleSystem->NextComputeIndices();
 
-		// Set the submit info
-		VkSubmitInfo submitInfo {
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = nullptr,
-			.waitSemaphoreCount = 0,
-			.pWaitSemaphores = nullptr,
-			.pWaitDstStageMask = nullptr,
-			.commandBufferCount = 1,
-			.pCommandBuffers = commandBuffers + commandBufferIndex,
-			.signalSemaphoreCount = 0,
-			.pSignalSemaphores = nullptr
-		};
+		// Submit the batch, once the transfers reading the particle buffers finish
+		submissionRing->Submit(submissionIndex, 1, &recordedBatches[batchIndex].commandBuffer, particleSystem->GetTransferTimeline(), particleSystem->GetTransferTimelineValue());
+		submittedBatches[submissionIndex] = batchIndex;
 
-		// Submit the command buffer to the compute queue
-		result = vkQueueSubmit(device->GetComputeQueue(), 1, &submitInfo, simulationFence);
-		if(result != VK_SUCCESS)
-			GSIM_THROW_EXCEPTION("Failed to submit Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+		// Let the graphics wait for the batch on the GPU before reading its buffers
+		particleSystem->SetComputeTimeline(submissionRing->GetTimelineSemaphore(), submissionRing->GetSubmittedValue());
+	}
+	void DirectSimulation::WaitForSimulations() {
+		// Wait for all batches in flight
+		submissionRing->WaitIdle();
+		for(uint32_t i = 0; i != VulkanSubmissionRing::MAX_SUBMISSION_COUNT; ++i)
+			submittedBatches[i] = UINT32_MAX;
 	}
 
 	DirectSimulation::~DirectSimulation() {
-		// Wait for the simulation fence
-		vkWaitForFences(device->GetDevice(), 1, &simulationFence, VK_TRUE, UINT64_MAX);
+		// Destroy the submission ring, waiting for all batches in flight
+		delete submissionRing;
 
 		// Destroy the pipeline's objects
-		vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 2, commandBuffers);
-		vkDestroyFence(device->GetDevice(), simulationFence, nullptr);
+		for(uint32_t i = 0; i != RECORDED_BATCH_COUNT; ++i)
+			vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), 1, &recordedBatches[i].commandBuffer);
 		vkDestroyPipeline(device->GetDevice(), pipeline, nullptr);
 		vkDestroyPipelineLayout(device->GetDevice(), pipelineLayout, nullptr);
 		vkDestroyShaderModule(device->GetDevice(), shaderModule, nullptr);
 		vkDestroyDescriptorPool(device->GetDevice(), descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(device->GetDevice(), massSetLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device->GetDevice(), setLayout, nullptr);
 	}
 }
\ No newline at end of file
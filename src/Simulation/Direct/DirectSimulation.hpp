@@ -2,6 +2,7 @@
 
 #include "Particles/ParticleSystem.hpp"
 #include "Vulkan/VulkanDevice.hpp"
+#include "Vulkan/VulkanSubmissionRing.hpp"
 #include <stdint.h>
 #include <vulkan/vk_platform.h>
 #include <vulkan/vulkan_core.h>
@@ -10,6 +11,9 @@ namespace gsim {
 	/// @brief A particle simulation which uses the direct sum method.
 	class DirectSimulation {
 	public:
+		/// @brief The number of simulation batches whose recorded command buffers are kept for resubmission, enough for one to never be in flight.
+		static const uint32_t RECORDED_BATCH_COUNT = VulkanSubmissionRing::MAX_SUBMISSION_COUNT;
+
 		/// @brief Gets the particle alignment required for the simulation to run.
 		/// @return The particle alignment required for the simulation to run.
 		static size_t GetRequiredParticleAlignment();
@@ -21,7 +25,8 @@ namespace gsim {
 		/// @brief Creates a particle simulation which uses the direct sum method.
 		/// @param device The Vulkan device to create the compute pipeline in.
 		/// @param particleSystem The particle system whose particles to simulate.
-		DirectSimulation(VulkanDevice* device, ParticleSystem* particleSystem);
+		/// @param submissionCount The number of simulation batches that may be in flight at the same time.
+		DirectSimulation(VulkanDevice* device, ParticleSystem* particleSystem, uint32_t submissionCount);
 
 		DirectSimulation& operator=(const DirectSimulation&) = delete;
 		DirectSimulation& operator=(DirectSimulation&&) noexcept = delete;
@@ -52,31 +57,51 @@ namespace gsim {
 		VkPipeline GetPipeline() {
 			return pipeline;
 		}
-		/// @brief Gets the Vulkan fence used to synchronize simulations.
-		/// @return A handle to the Vulkan fence used to synchronize simulations.
-		VkFence GetSimulationFence() {
-			return simulationFence;
+		/// @brief Gets the ring of simulation batch submissions.
+		/// @return A pointer to the submission ring object.
+		VulkanSubmissionRing* GetSubmissionRing() {
+			return submissionRing;
+		}
+		/// @brief Gets the ring of simulation batch submissions.
+		/// @return A const pointer to the submission ring object.
+		const VulkanSubmissionRing* GetSubmissionRing() const {
+			return submissionRing;
 		}
 
-		/// @brief Runs the given number of simulations.
+		/// @brief Runs the given number of simulations, only waiting for earlier simulations once the submission ring is full.
 		/// @param simulationCount The number of simulations to run.
 		void RunSimulations(uint32_t simulationCount);
+		/// @brief Waits for all simulations in flight to finish.
+		void WaitForSimulations();
 
 		/// @brief Destroys the direct simulation.
 		~DirectSimulation();
 	private:
+		struct RecordedBatch {
+			VkCommandBuffer commandBuffer;
+			size_t inputIndex;
+			size_t outputIndex;
+			uint32_t simulationCount;
+		};
+
+		void RecordBatch(VkCommandBuffer commandBuffer, uint32_t simulationCount);
+		bool IsBatchInFlight(uint32_t batchIndex) const;
+
 		VulkanDevice* device;
 		ParticleSystem* particleSystem;
 
 		VkDescriptorSetLayout setLayout;
+		VkDescriptorSetLayout massSetLayout;
 		VkDescriptorPool descriptorPool;
-		VkDescriptorSet descriptorSets[3];
+		VkDescriptorSet descriptorSets[ParticleSystem::MAX_BUFFER_SET_COUNT];
+		VkDescriptorSet massDescriptorSet;
 		VkShaderModule shaderModule;
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 
-		VkFence simulationFence;
-		VkCommandBuffer commandBuffers[2];
-		uint32_t commandBufferIndex = 0;
+		VulkanSubmissionRing* submissionRing;
+		RecordedBatch recordedBatches[RECORDED_BATCH_COUNT];
+		uint32_t nextRecordedBatch = 0;
+		uint32_t submittedBatches[VulkanSubmissionRing::MAX_SUBMISSION_COUNT];
 	};
 }
\ No newline at end of file
@@ -13,10 +13,10 @@
 namespace gsim {
 	// Constants
 	static const char* const REQUIRED_DEVICE_EXTENSIONS[] {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-		VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME
+		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 	static const size_t REQUIRED_DEVICE_EXTENSION_COUNT = sizeof(REQUIRED_DEVICE_EXTENSIONS) / sizeof(const char*);
+	static const size_t MAX_DEVICE_EXTENSION_COUNT = REQUIRED_DEVICE_EXTENSION_COUNT + 2;
 
 	// Internal functions
 	static VulkanDevice::QueueFamilyIndices FindQueueFamilyIndices(VkPhysicalDevice physicalDevice, VulkanSurface* surface) {
@@ -110,12 +110,51 @@ namespace gsim {
 
 		return indices;
 	}
+	static bool CheckExtensionSupport(VkPhysicalDevice physicalDevice, const char* extension) {
+		// Get the number of supported extensions
+		uint32_t supportedExtensionCount;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, nullptr);
+
+		// Allocate the supported extension array
+		VkExtensionProperties* supportedExtensions = (VkExtensionProperties*)malloc(supportedExtensionCount * sizeof(VkExtensionProperties));
+		if(!supportedExtensions)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan supported device extensions array!");
+		
+		// Get all supported extensions
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, supportedExtensions);
+
+		// Check if the extension is in the supported extensions array
+		bool supported = false;
+		for(uint32_t i = 0; i != supportedExtensionCount && !supported; ++i)
+			supported = !strncmp(extension, supportedExtensions[i].extensionName, VK_MAX_EXTENSION_NAME_SIZE);
+
+		// Free the supported extension array
+		free(supportedExtensions);
+
+		return supported;
+	}
 	static bool CheckPhysicalDeviceSupport(VkPhysicalDevice physicalDevice, VulkanSurface* surface, VkPhysicalDeviceProperties2& properties2) {
-		// Check if the physical device's version is high enough
+		// Check if the physical device's version is high enough for timeline semaphores, which are core since Vulkan 1.2
 		VkPhysicalDeviceProperties properties;
 		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-		if(properties.apiVersion <= VK_API_VERSION_1_1)
+		if(properties.apiVersion < VK_API_VERSION_1_2)
+			return false;
+
+		// Check if the physical device supports timeline semaphores
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+			.pNext = nullptr,
+			.timelineSemaphore = VK_FALSE
+		};
+		VkPhysicalDeviceFeatures2 features2 {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &timelineSemaphoreFeatures,
+			.features = {}
+		};
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		if(!timelineSemaphoreFeatures.timelineSemaphore)
 			return false;
 
 		// Get the physical device's full properties
@@ -162,7 +201,7 @@ namespace gsim {
 	}
 	
 	// Public functions
-	VulkanDevice::VulkanDevice(VulkanInstance* instance, VulkanSurface* surface) : instance(instance), physicalDevice(VK_NULL_HANDLE) {
+	VulkanDevice::VulkanDevice(VulkanInstance* instance, VulkanSurface* surface, const char* pipelineCacheDir) : instance(instance), physicalDevice(VK_NULL_HANDLE) {
 		// Get the number of physical devices
 		uint32_t physicalDeviceCount;
 		vkEnumeratePhysicalDevices(instance->GetInstance(), &physicalDeviceCount, nullptr);
@@ -175,10 +214,14 @@ namespace gsim {
 		// Get all physical devices
 		vkEnumeratePhysicalDevices(instance->GetInstance(), &physicalDeviceCount, physicalDevices);
 
-		// Set the subgroup properties info struct
+		// Set the ID and subgroup properties info structs
+		VkPhysicalDeviceIDProperties idProperties {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+			.pNext = nullptr
+		};
 		VkPhysicalDeviceSubgroupProperties subgroupProperties {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
-			.pNext = nullptr
+			.pNext = &idProperties
 		};
 		VkPhysicalDeviceProperties2 properties2 {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
@@ -194,8 +237,9 @@ namespace gsim {
 			// Set the new best physical device
 			physicalDevice = physicalDevices[i];
 
-			// Ste the physical device's properties and subgroup size
+			// Ste the physical device's properties, UUID and subgroup size
 			properties = properties2.properties;
+			memcpy(deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
 			subgroupSize = subgroupProperties.subgroupSize;
 
 			// Exit the loop if the current supported device is discrete
@@ -215,6 +259,25 @@ namespace gsim {
 		vkGetPhysicalDeviceFeatures(physicalDevice, &features);
 		indices = FindQueueFamilyIndices(physicalDevice, surface);
 
+		// Check if the physical device supports float atomic addition on storage buffers, which is optional
+		VkPhysicalDeviceShaderAtomicFloatFeaturesEXT supportedAtomicFloatFeatures {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT,
+			.pNext = nullptr
+		};
+		VkPhysicalDeviceFeatures2 supportedFeatures2 {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &supportedAtomicFloatFeatures
+		};
+
+		floatAtomicsSupported = CheckExtensionSupport(physicalDevice, VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME);
+		if(floatAtomicsSupported) {
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+			floatAtomicsSupported = supportedAtomicFloatFeatures.shaderBufferFloat32AtomicAdd;
+		}
+
+		// Check if the physical device reports its memory budgets, which is optional
+		memoryBudgetSupported = CheckExtensionSupport(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
 		// Get the number of queue families
 		uint32_t familyCount;
 		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
@@ -273,7 +336,7 @@ namespace gsim {
 			}
 		}
 
-		// Set the required float atomic features
+		// Set the float atomic features, enabled only if they are supported
 		VkPhysicalDeviceShaderAtomicFloatFeaturesEXT atomicFloatFeatures {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT,
 			.pNext = nullptr,
@@ -291,17 +354,34 @@ namespace gsim {
     		.sparseImageFloat32AtomicAdd = VK_FALSE
 		};
 
+		// Set the timeline semaphore features, which every selected device supports
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+			.pNext = floatAtomicsSupported ? &atomicFloatFeatures : nullptr,
+			.timelineSemaphore = VK_TRUE
+		};
+
+		// Set the enabled extensions, adding the optional extensions if they are supported
+		const char* enabledExtensions[MAX_DEVICE_EXTENSION_COUNT];
+		uint32_t enabledExtensionCount = 0;
+		for(size_t i = 0; i != REQUIRED_DEVICE_EXTENSION_COUNT; ++i)
+			enabledExtensions[enabledExtensionCount++] = REQUIRED_DEVICE_EXTENSIONS[i];
+		if(floatAtomicsSupported)
+			enabledExtensions[enabledExtensionCount++] = VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME;
+		if(memoryBudgetSupported)
+			enabledExtensions[enabledExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+
 		// Set the device's create info
 		VkDeviceCreateInfo createInfo {
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = &atomicFloatFeatures,
+			.pNext = &timelineSemaphoreFeatures,
 			.flags = 0,
 			.queueCreateInfoCount = queueInfoCount,
 			.pQueueCreateInfos = queueInfos,
 			.enabledLayerCount = 0,
 			.ppEnabledLayerNames = nullptr,
-			.enabledExtensionCount = REQUIRED_DEVICE_EXTENSION_COUNT,
-			.ppEnabledExtensionNames = REQUIRED_DEVICE_EXTENSIONS,
+			.enabledExtensionCount = enabledExtensionCount,
+			.ppEnabledExtensionNames = enabledExtensions,
 			.pEnabledFeatures = &features
 		};
 
@@ -365,6 +445,12 @@ namespace gsim {
 		result = vkCreateCommandPool(device, &computeCommandPoolInfo, nullptr, &computeCommandPool);
 		if(result != VK_SUCCESS)
 			GSIM_THROW_EXCEPTION("Failed to create Vulkan compute command pool! Error code: %s", string_VkResult(result));
+
+		// Create the memory allocator
+		memoryAllocator = new VulkanMemoryAllocator(this);
+
+		// Create the pipeline cache
+		pipelineCache = new VulkanPipelineCache(this, pipelineCacheDir);
 	}
 
 	void VulkanDevice::LogDeviceInfo(Logger* logger) {
@@ -374,6 +460,10 @@ namespace gsim {
 		// Log the Vulkan version in use
 		logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan version: %u.%u.%u", VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion), VK_API_VERSION_PATCH(properties.apiVersion));
 
+		// Log the optional features in use
+		logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan device float atomics: %s", floatAtomicsSupported ? "supported" : "unsupported");
+		logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan device memory budget: %s", memoryBudgetSupported ? "supported" : "unsupported");
+
 		// Log the queue family indices
 		if(indices.graphicsIndex != UINT32_MAX) {
 			logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan device queue family indices: graphics - %u, present - %u, transfer - %u, compute - %u (%u unique)", indices.graphicsIndex, indices.presentIndex, indices.transferIndex, indices.computeIndex, (uint32_t)indexArrSize);
@@ -399,6 +489,12 @@ namespace gsim {
 	}
 
 	VulkanDevice::~VulkanDevice() {
+		// Destroy the pipeline cache
+		delete pipelineCache;
+
+		// Destroy the memory allocator, freeing all remaining device memory
+		delete memoryAllocator;
+
 		// Destroy all command pools
 		if(graphicsCommandPool)
 			vkDestroyCommandPool(device, graphicsCommandPool, nullptr);
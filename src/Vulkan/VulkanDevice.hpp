@@ -2,6 +2,8 @@
 
 #include "Debug/Logger.hpp"
 #include "VulkanInstance.hpp"
+#include "VulkanMemoryAllocator.hpp"
+#include "VulkanPipelineCache.hpp"
 #include "VulkanSurface.hpp"
 #include <stdint.h>
 #include <vulkan/vk_platform.h>
@@ -30,7 +32,8 @@ namespace gsim {
 		/// @brief Creates a Vulkan device.
 		/// @param instance The Vulkan instance to create the device in.
 		/// @param surface The Vulkan surface the device should support, or a nullptr if rendering is not required.
-		VulkanDevice(VulkanInstance* instance, VulkanSurface* surface);
+		/// @param pipelineCacheDir The existing directory the device's pipeline cache is stored in, or a nullptr to keep it in memory only.
+		VulkanDevice(VulkanInstance* instance, VulkanSurface* surface, const char* pipelineCacheDir);
 
 		VulkanDevice& operator=(const VulkanDevice&) = delete;
 		VulkanDevice& operator=(VulkanDevice&&) = delete;
@@ -76,11 +79,36 @@ namespace gsim {
 		const VkPhysicalDeviceFeatures& GetPhysicalDeviceFeatures() const {
 			return features;
 		}
+		/// @brief Gets the Vulkan physical device's UUID.
+		/// @return A pointer to the VK_UUID_SIZE bytes of the physical device's UUID.
+		const uint8_t* GetDeviceUUID() const {
+			return deviceUUID;
+		}
 		/// @brief Gets the Vulkan physical device's subgroup size.
 		/// @return The Vulkan physical device's subgroup size.
 		uint32_t GetSubgroupSize() const {
 			return subgroupSize;
 		}
+		/// @brief Checks if the Vulkan device supports float atomic addition on storage buffers.
+		/// @return True if float atomic addition is supported and enabled, otherwise false.
+		bool GetFloatAtomicsSupported() const {
+			return floatAtomicsSupported;
+		}
+		/// @brief Checks if the Vulkan device reports its memory heaps' budgets.
+		/// @return True if VK_EXT_memory_budget is supported and enabled, otherwise false.
+		bool GetMemoryBudgetSupported() const {
+			return memoryBudgetSupported;
+		}
+		/// @brief Gets the memory allocator all of the device's buffer memory is allocated with.
+		/// @return A pointer to the Vulkan memory allocator.
+		VulkanMemoryAllocator* GetMemoryAllocator() {
+			return memoryAllocator;
+		}
+		/// @brief Gets the pipeline cache all of the device's pipelines are created with.
+		/// @return A pointer to the Vulkan pipeline cache.
+		VulkanPipelineCache* GetPipelineCache() {
+			return pipelineCache;
+		}
 
 		/// @brief Gets the size of the array containing all unique queue family indices.
 		/// @return The size of the array containing all unique queue family indices.
@@ -151,7 +179,10 @@ namespace gsim {
 		VkPhysicalDeviceProperties properties;
 		VkPhysicalDeviceMemoryProperties memoryProperties;
 		VkPhysicalDeviceFeatures features;
+		uint8_t deviceUUID[VK_UUID_SIZE];
 		uint32_t subgroupSize;
+		bool floatAtomicsSupported;
+		bool memoryBudgetSupported;
 
 		uint32_t indexArrSize = 0;
 		uint32_t indexArr[4];
@@ -164,5 +195,8 @@ namespace gsim {
 		VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
 		VkCommandPool transferCommandPool;
 		VkCommandPool computeCommandPool;
+
+		VulkanMemoryAllocator* memoryAllocator;
+		VulkanPipelineCache* pipelineCache;
 	};
 }
\ No newline at end of file
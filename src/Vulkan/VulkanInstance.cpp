@@ -61,7 +61,7 @@ namespace gsim {
 		
 		uint32_t version;
 		pfn_vkEnumerateInstanceVersion(&version);
-		if(version < VK_API_VERSION_1_1)
+		if(version < VK_API_VERSION_1_2)
 			GSIM_THROW_EXCEPTION("Vulkan instance version is too low!");
 
 		// Get the number of supported extensions and layers
@@ -0,0 +1,334 @@
+#include "VulkanMemoryAllocator.hpp"
+#include "VulkanDevice.hpp"
+#include "Debug/Exception.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <bit>
+
+namespace gsim {
+	// Constants
+	const uint32_t MIN_POOLED_SHIFT = 8;
+	const VkDeviceSize MAX_POOLED_SIZE = (VkDeviceSize)1 << (MIN_POOLED_SHIFT + VulkanMemoryAllocator::SIZE_CLASS_COUNT - 1);
+	const VkDeviceSize POOL_BLOCK_SIZE = 16 << 20;
+	const uint32_t MAX_BLOCK_SLOT_COUNT = 64;
+	const VkDeviceSize MAX_KEPT_SCRATCH_SIZE = 256 << 20;
+	const VkDeviceSize ESTIMATED_BUDGET_PERCENT = 80;
+	const VkDeviceSize BUDGET_WARNING_PERCENT = 90;
+
+	// Structs
+	struct VulkanMemoryAllocator::PoolBlock {
+		VkDeviceMemory memory;
+		uint8_t* mappedData;
+		uint64_t freeMask;
+		uint64_t fullMask;
+		uint32_t classIndex;
+		uint32_t slotCount;
+		PoolBlock* next;
+	};
+
+	// Internal helper functions
+	static double GetSizeMiB(VkDeviceSize size) {
+		return (double)size / (1 << 20);
+	}
+
+	VkResult VulkanMemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, VkDeviceMemory& memory, void*& mappedData) {
+		// Set the memory alloc info
+		VkMemoryAllocateInfo allocInfo {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.allocationSize = size,
+			.memoryTypeIndex = memoryTypeIndex
+		};
+
+		// Allocate the memory
+		VkResult result = vkAllocateMemory(device->GetDevice(), &allocInfo, nullptr, &memory);
+		if(result != VK_SUCCESS)
+			return result;
+
+		// Map host visible memory for its whole lifetime, as sub-allocations can't be mapped individually
+		mappedData = nullptr;
+		if(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			result = vkMapMemory(device->GetDevice(), memory, 0, VK_WHOLE_SIZE, 0, &mappedData);
+			if(result != VK_SUCCESS) {
+				vkFreeMemory(device->GetDevice(), memory, nullptr);
+				return result;
+			}
+		}
+
+		// Add the memory to its heap's allocated size
+		heapAllocatedSizes[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+		++deviceMemoryCount;
+
+		return VK_SUCCESS;
+	}
+	void VulkanMemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, void* mappedData) {
+		// Unmap and free the memory
+		if(mappedData)
+			vkUnmapMemory(device->GetDevice(), memory);
+		vkFreeMemory(device->GetDevice(), memory, nullptr);
+
+		// Remove the memory from its heap's allocated size
+		heapAllocatedSizes[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] -= size;
+		--deviceMemoryCount;
+	}
+	VkResult VulkanMemoryAllocator::AllocateUnlocked(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation) {
+		// Get the allocation's minimum slot size, which also keeps the slot aligned
+		VkDeviceSize classSize = (requirements.size > requirements.alignment) ? requirements.size : requirements.alignment;
+		if(classSize < ((VkDeviceSize)1 << MIN_POOLED_SHIFT))
+			classSize = (VkDeviceSize)1 << MIN_POOLED_SHIFT;
+
+		// Give sizes above the largest size class their own device memory
+		VkResult result;
+		if(classSize > MAX_POOLED_SIZE) {
+			VkDeviceMemory memory;
+			void* mappedData;
+			result = AllocateDeviceMemory(requirements.size, memoryTypeIndex, memory, mappedData);
+			if(result != VK_SUCCESS)
+				return result;
+
+			allocation = {
+				.memory = memory,
+				.offset = 0,
+				.size = requirements.size,
+				.mappedData = mappedData,
+				.memoryTypeIndex = memoryTypeIndex,
+				.usage = usage,
+				.block = nullptr,
+				.slot = 0,
+				.scratch = false
+			};
+			AddUsage(usage, requirements.size);
+
+			return VK_SUCCESS;
+		}
+
+		// Round the size up to its size class
+		uint32_t classIndex = (uint32_t)std::bit_width(classSize - 1) - MIN_POOLED_SHIFT;
+		classSize = (VkDeviceSize)1 << (classIndex + MIN_POOLED_SHIFT);
+
+		// Find a block of the size class with a free slot
+		PoolBlock* block = pools[memoryTypeIndex][classIndex];
+		while(block && !block->freeMask)
+			block = block->next;
+
+		// Add a new block to the size class if all of its blocks are full
+		if(!block) {
+			block = (PoolBlock*)malloc(sizeof(PoolBlock));
+			if(!block)
+				GSIM_THROW_EXCEPTION("Failed to allocate Vulkan memory pool block!");
+
+			uint32_t slotCount = (uint32_t)(POOL_BLOCK_SIZE / classSize);
+			if(slotCount > MAX_BLOCK_SLOT_COUNT)
+				slotCount = MAX_BLOCK_SLOT_COUNT;
+
+			void* mappedData;
+			result = AllocateDeviceMemory(classSize * slotCount, memoryTypeIndex, block->memory, mappedData);
+			if(result != VK_SUCCESS) {
+				free(block);
+				return result;
+			}
+
+			block->mappedData = (uint8_t*)mappedData;
+			block->fullMask = (slotCount == 64) ? UINT64_MAX : ((uint64_t)1 << slotCount) - 1;
+			block->freeMask = block->fullMask;
+			block->classIndex = classIndex;
+			block->slotCount = slotCount;
+			block->next = pools[memoryTypeIndex][classIndex];
+			pools[memoryTypeIndex][classIndex] = block;
+		}
+
+		// Take the block's first free slot
+		uint32_t slot = (uint32_t)std::countr_zero(block->freeMask);
+		block->freeMask &= ~((uint64_t)1 << slot);
+
+		allocation = {
+			.memory = block->memory,
+			.offset = slot * classSize,
+			.size = requirements.size,
+			.mappedData = block->mappedData ? block->mappedData + slot * classSize : nullptr,
+			.memoryTypeIndex = memoryTypeIndex,
+			.usage = usage,
+			.block = block,
+			.slot = slot,
+			.scratch = false
+		};
+		AddUsage(usage, requirements.size);
+
+		return VK_SUCCESS;
+	}
+	void VulkanMemoryAllocator::GetHeapBudget(uint32_t heapIndex, VkDeviceSize& heapUsage, VkDeviceSize& heapBudget) {
+		// Estimate the budget from the heap's size if the device can't report it, counting only the allocator's own memory as used
+		if(!memoryBudgetSupported) {
+			heapUsage = heapAllocatedSizes[heapIndex];
+			heapBudget = memoryProperties.memoryHeaps[heapIndex].size / 100 * ESTIMATED_BUDGET_PERCENT;
+			return;
+		}
+
+		// Get the heap's current usage and budget, which also account for other processes
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+			.pNext = nullptr
+		};
+		VkPhysicalDeviceMemoryProperties2 memoryProperties2 {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+			.pNext = &budgetProperties
+		};
+		vkGetPhysicalDeviceMemoryProperties2(device->GetPhysicalDevice(), &memoryProperties2);
+
+		heapUsage = budgetProperties.heapUsage[heapIndex];
+		heapBudget = budgetProperties.heapBudget[heapIndex];
+	}
+	void VulkanMemoryAllocator::AddUsage(MemoryUsage usage, VkDeviceSize size) {
+		usageSizes[usage] += size;
+		if(usageSizes[usage] > peakUsageSizes[usage])
+			peakUsageSizes[usage] = usageSizes[usage];
+	}
+
+	// Public functions
+	VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanDevice* device) : device(device), memoryProperties(device->GetPhysicalDeviceMemoryProperties()), memoryBudgetSupported(device->GetMemoryBudgetSupported()) { }
+
+	VkResult VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return AllocateUnlocked(requirements, memoryTypeIndex, usage, allocation);
+	}
+	VkResult VulkanMemoryAllocator::AllocateScratch(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Fall back to a regular allocation if the scratch memory is already aliased
+		ScratchMemory& scratch = scratchMemory[memoryTypeIndex];
+		if(scratch.inUse)
+			return AllocateUnlocked(requirements, memoryTypeIndex, usage, allocation);
+
+		// Grow the scratch memory if it is too small, as it is otherwise kept for the next transient use
+		if(scratch.size < requirements.size) {
+			if(scratch.memory)
+				FreeDeviceMemory(scratch.memory, scratch.size, memoryTypeIndex, scratch.mappedData);
+			scratch.memory = VK_NULL_HANDLE;
+			scratch.size = 0;
+
+			VkResult result = AllocateDeviceMemory(requirements.size, memoryTypeIndex, scratch.memory, scratch.mappedData);
+			if(result != VK_SUCCESS) {
+				scratch.memory = VK_NULL_HANDLE;
+				return result;
+			}
+			scratch.size = requirements.size;
+		}
+
+		// Alias the scratch memory, which starts at offset 0 and thus satisfies any alignment
+		scratch.inUse = true;
+		allocation = {
+			.memory = scratch.memory,
+			.offset = 0,
+			.size = requirements.size,
+			.mappedData = scratch.mappedData,
+			.memoryTypeIndex = memoryTypeIndex,
+			.usage = usage,
+			.block = nullptr,
+			.slot = 0,
+			.scratch = true
+		};
+		AddUsage(usage, requirements.size);
+
+		return VK_SUCCESS;
+	}
+	void VulkanMemoryAllocator::Free(Allocation& allocation) {
+		// Exit the function if nothing was allocated
+		if(!allocation.memory)
+			return;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		usageSizes[allocation.usage] -= allocation.size;
+
+		if(allocation.scratch) {
+			// Release the scratch memory, keeping it allocated unless it is too large to hold on to
+			ScratchMemory& scratch = scratchMemory[allocation.memoryTypeIndex];
+			scratch.inUse = false;
+
+			if(scratch.size > MAX_KEPT_SCRATCH_SIZE) {
+				FreeDeviceMemory(scratch.memory, scratch.size, allocation.memoryTypeIndex, scratch.mappedData);
+				scratch = {};
+			}
+		} else if(allocation.block) {
+			// Release the allocation's slot
+			PoolBlock* block = allocation.block;
+			block->freeMask |= (uint64_t)1 << allocation.slot;
+
+			// Free the block once all of its slots are free
+			if(block->freeMask == block->fullMask) {
+				PoolBlock** iter = &pools[allocation.memoryTypeIndex][block->classIndex];
+				while(*iter != block)
+					iter = &(*iter)->next;
+				*iter = block->next;
+
+				FreeDeviceMemory(block->memory, ((VkDeviceSize)1 << (block->classIndex + MIN_POOLED_SHIFT)) * block->slotCount, allocation.memoryTypeIndex, block->mappedData);
+				free(block);
+			}
+		} else {
+			// Free the allocation's own device memory
+			FreeDeviceMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex, allocation.mappedData);
+		}
+
+		allocation = {};
+	}
+
+	bool VulkanMemoryAllocator::CheckBudget(uint32_t memoryTypeIndex, VkDeviceSize size) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		VkDeviceSize heapUsage, heapBudget;
+		GetHeapBudget(memoryProperties.memoryTypes[memoryTypeIndex].heapIndex, heapUsage, heapBudget);
+		return heapUsage + size <= heapBudget;
+	}
+	VkDeviceSize VulkanMemoryAllocator::GetUsageSize(MemoryUsage usage) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return usageSizes[usage];
+	}
+
+	void VulkanMemoryAllocator::LogMemoryUsage(Logger* logger) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Log the memory used by every subsystem
+		logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan memory usage: particles - %.2f MiB, simulation - %.2f MiB, snapshots - %.2f MiB, staging - %.2f MiB (%.2f MiB peak)", GetSizeMiB(usageSizes[MEMORY_USAGE_PARTICLES]), GetSizeMiB(usageSizes[MEMORY_USAGE_SIMULATION]), GetSizeMiB(usageSizes[MEMORY_USAGE_SNAPSHOTS]), GetSizeMiB(usageSizes[MEMORY_USAGE_STAGING]), GetSizeMiB(peakUsageSizes[MEMORY_USAGE_STAGING]));
+
+		// Log the device memory allocations backing them
+		VkDeviceSize scratchSize = 0;
+		for(uint32_t i = 0; i != memoryProperties.memoryTypeCount; ++i)
+			scratchSize += scratchMemory[i].size;
+		logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan device memory allocations: %u, %.2f MiB kept as transient scratch memory", deviceMemoryCount, GetSizeMiB(scratchSize));
+
+		// Log every heap's budget, skipping host heaps the allocator doesn't use
+		for(uint32_t i = 0; i != memoryProperties.memoryHeapCount; ++i) {
+			bool deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+			if(!deviceLocal && !heapAllocatedSizes[i])
+				continue;
+
+			VkDeviceSize heapUsage, heapBudget;
+			GetHeapBudget(i, heapUsage, heapBudget);
+			logger->LogMessage(Logger::MESSAGE_LEVEL_INFO, "Vulkan memory heap %u (%s): %.2f MiB allocated by the simulator, %.2f of %.2f MiB budget used%s", i, deviceLocal ? "device local" : "host", GetSizeMiB(heapAllocatedSizes[i]), GetSizeMiB(heapUsage), GetSizeMiB(heapBudget), memoryBudgetSupported ? "" : " (estimated)");
+
+			// Warn if the heap is close to running out
+			if(heapBudget && heapUsage > heapBudget / 100 * BUDGET_WARNING_PERCENT)
+				logger->LogMessage(Logger::MESSAGE_LEVEL_WARNING, "Vulkan memory heap %u is %.0f%% full, so the run may run out of device memory!", i, (double)heapUsage * 100 / heapBudget);
+		}
+	}
+
+	VulkanMemoryAllocator::~VulkanMemoryAllocator() {
+		// Free all pool blocks
+		for(uint32_t i = 0; i != memoryProperties.memoryTypeCount; ++i) {
+			for(uint32_t j = 0; j != SIZE_CLASS_COUNT; ++j) {
+				PoolBlock* block = pools[i][j];
+				while(block) {
+					PoolBlock* next = block->next;
+					FreeDeviceMemory(block->memory, ((VkDeviceSize)1 << (block->classIndex + MIN_POOLED_SHIFT)) * block->slotCount, i, block->mappedData);
+					free(block);
+					block = next;
+				}
+			}
+		}
+
+		// Free all scratch memory
+		for(uint32_t i = 0; i != memoryProperties.memoryTypeCount; ++i) {
+			if(scratchMemory[i].memory)
+				FreeDeviceMemory(scratchMemory[i].memory, scratchMemory[i].size, i, scratchMemory[i].mappedData);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Debug/Logger.hpp"
+#include <stdint.h>
+#include <mutex>
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+namespace gsim {
+	class VulkanDevice;
+
+	/// @brief A manager for a Vulkan device's memory, sub-allocating small allocations from shared blocks and tracking the memory used by every subsystem.
+	class VulkanMemoryAllocator {
+	public:
+		/// @brief An enum containing all subsystems memory is allocated for.
+		enum MemoryUsage {
+			/// @brief The memory of the particle buffers.
+			MEMORY_USAGE_PARTICLES,
+			/// @brief The memory of the simulations' own buffers.
+			MEMORY_USAGE_SIMULATION,
+			/// @brief The memory of the snapshot writer's staging buffers.
+			MEMORY_USAGE_SNAPSHOTS,
+			/// @brief The memory of transient staging buffers used for uploads and readbacks.
+			MEMORY_USAGE_STAGING,
+			/// @brief The number of memory usages.
+			MEMORY_USAGE_COUNT
+		};
+
+		/// @brief A device memory block shared by all pooled allocations of the same memory type and size class.
+		struct PoolBlock;
+
+		/// @brief A struct containing a range of device memory given out by the allocator.
+		struct Allocation {
+			/// @brief The device memory the allocation lies in.
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			/// @brief The allocation's offset in its device memory, which resources must be bound at.
+			VkDeviceSize offset = 0;
+			/// @brief The allocation's requested size.
+			VkDeviceSize size = 0;
+			/// @brief A pointer to the allocation's host-mapped memory, or nullptr if its memory type isn't host visible.
+			void* mappedData = nullptr;
+			/// @brief The index of the allocation's memory type.
+			uint32_t memoryTypeIndex = UINT32_MAX;
+			/// @brief The subsystem the allocation was made for.
+			MemoryUsage usage = MEMORY_USAGE_COUNT;
+			/// @brief The pool block the allocation was taken from, or nullptr if it isn't pooled.
+			PoolBlock* block = nullptr;
+			/// @brief The allocation's slot in its pool block.
+			uint32_t slot = 0;
+			/// @brief True if the allocation aliases its memory type's scratch memory, otherwise false.
+			bool scratch = false;
+		};
+
+		/// @brief The number of power of two size classes pooled allocations are rounded up to.
+		static const uint32_t SIZE_CLASS_COUNT = 15;
+
+		VulkanMemoryAllocator() = delete;
+		VulkanMemoryAllocator(const VulkanMemoryAllocator&) = delete;
+		VulkanMemoryAllocator(VulkanMemoryAllocator&&) noexcept = delete;
+
+		/// @brief Creates a memory allocator for the given Vulkan device.
+		/// @param device The Vulkan device to allocate memory from.
+		VulkanMemoryAllocator(VulkanDevice* device);
+
+		VulkanMemoryAllocator& operator=(const VulkanMemoryAllocator&) = delete;
+		VulkanMemoryAllocator& operator=(VulkanMemoryAllocator&&) = delete;
+
+		/// @brief Allocates memory, sub-allocating small sizes from shared blocks and giving large sizes their own device memory. Host visible memory is returned mapped.
+		/// @param requirements The memory requirements of the resources bound to the allocation.
+		/// @param memoryTypeIndex The index of the memory type to allocate from.
+		/// @param usage The subsystem the allocation is made for.
+		/// @param allocation A reference to the struct to write the allocation's info to.
+		/// @return VK_SUCCESS if the memory was allocated, otherwise the error returned by Vulkan.
+		VkResult Allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation);
+		/// @brief Allocates transient memory aliasing the memory type's scratch memory, which is kept between uses instead of being allocated every time, unless it grows too large. Falls back to a regular allocation if the scratch memory is already in use.
+		/// @param requirements The memory requirements of the resources bound to the allocation.
+		/// @param memoryTypeIndex The index of the memory type to allocate from.
+		/// @param usage The subsystem the allocation is made for.
+		/// @param allocation A reference to the struct to write the allocation's info to.
+		/// @return VK_SUCCESS if the memory was allocated, otherwise the error returned by Vulkan.
+		VkResult AllocateScratch(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation);
+		/// @brief Frees the given allocation. The resources bound to it must no longer be in use.
+		/// @param allocation A reference to the allocation to free, which is reset.
+		void Free(Allocation& allocation);
+
+		/// @brief Checks if the memory type's heap has room for the given size within its budget.
+		/// @param memoryTypeIndex The index of the memory type to check.
+		/// @param size The size that would be allocated.
+		/// @return True if the size fits in the heap's budget, otherwise false.
+		bool CheckBudget(uint32_t memoryTypeIndex, VkDeviceSize size);
+		/// @brief Gets the size of the memory currently allocated for the given subsystem.
+		/// @param usage The subsystem to get the allocated size of.
+		/// @return The size of the memory currently allocated for the subsystem.
+		VkDeviceSize GetUsageSize(MemoryUsage usage);
+
+		/// @brief Logs the memory used by every subsystem and every heap's budget to the given logger.
+		/// @param logger The logger to log the memory usage to.
+		void LogMemoryUsage(Logger* logger);
+
+		/// @brief Frees all of the allocator's device memory.
+		~VulkanMemoryAllocator();
+	private:
+		struct ScratchMemory {
+			VkDeviceMemory memory;
+			VkDeviceSize size;
+			void* mappedData;
+			bool inUse;
+		};
+
+		VkResult AllocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, VkDeviceMemory& memory, void*& mappedData);
+		void FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, void* mappedData);
+		VkResult AllocateUnlocked(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MemoryUsage usage, Allocation& allocation);
+		void GetHeapBudget(uint32_t heapIndex, VkDeviceSize& heapUsage, VkDeviceSize& heapBudget);
+		void AddUsage(MemoryUsage usage, VkDeviceSize size);
+
+		VulkanDevice* device;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		bool memoryBudgetSupported;
+
+		PoolBlock* pools[VK_MAX_MEMORY_TYPES][SIZE_CLASS_COUNT]{};
+		ScratchMemory scratchMemory[VK_MAX_MEMORY_TYPES]{};
+
+		VkDeviceSize usageSizes[MEMORY_USAGE_COUNT]{};
+		VkDeviceSize peakUsageSizes[MEMORY_USAGE_COUNT]{};
+		VkDeviceSize heapAllocatedSizes[VK_MAX_MEMORY_HEAPS]{};
+		uint32_t deviceMemoryCount = 0;
+
+		std::mutex mutex;
+	};
+}
\ No newline at end of file
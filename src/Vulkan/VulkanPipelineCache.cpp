@@ -0,0 +1,227 @@
+#include "VulkanPipelineCache.hpp"
+#include "VulkanDevice.hpp"
+#include "Debug/Exception.hpp"
+#include "Platform/AtomicFile.hpp"
+#include "Platform/ThreadPool.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+namespace gsim {
+	// Constants
+	static const char CACHE_FILE_PREFIX[] = "pipelines_";
+	static const char CACHE_FILE_SUFFIX[] = ".cache";
+
+	// Structs
+	struct PipelineCreateData {
+		VkDevice device;
+		VkPipelineCache pipelineCache;
+		const VkComputePipelineCreateInfo* pipelineInfos;
+		VkPipeline* pipelines;
+		VkResult* results;
+	};
+
+	// Internal helper functions
+	static void CreatePipelineRange(void* userData, size_t begin, size_t end, uint32_t threadIndex) {
+		// Create every pipeline in the range on its own, so that the driver compiles them in parallel
+		PipelineCreateData* createData = (PipelineCreateData*)userData;
+		for(size_t i = begin; i != end; ++i)
+			createData->results[i] = vkCreateComputePipelines(createData->device, createData->pipelineCache, 1, createData->pipelineInfos + i, nullptr, createData->pipelines + i);
+	}
+	void* VulkanPipelineCache::LoadCacheData(size_t& dataSize) {
+		// Open the cache file, if it exists
+		dataSize = 0;
+		FILE* file = fopen(filePath, "rb");
+		if(!file)
+			return nullptr;
+
+		// Get the file's size
+		long fileSize = -1;
+		if(!fseek(file, 0, SEEK_END))
+			fileSize = ftell(file);
+		if(fileSize < (long)sizeof(VkPipelineCacheHeaderVersionOne) || fseek(file, 0, SEEK_SET)) {
+			fclose(file);
+			return nullptr;
+		}
+
+		// Read the whole file
+		void* data = malloc((size_t)fileSize);
+		if(!data) {
+			fclose(file);
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan pipeline cache data!");
+		}
+		size_t readSize = fread(data, 1, (size_t)fileSize, file);
+		fclose(file);
+		if(readSize != (size_t)fileSize) {
+			free(data);
+			return nullptr;
+		}
+
+		// Discard the data if its header doesn't match the device, as another driver may have written it to the same directory
+		VkPipelineCacheHeaderVersionOne header;
+		memcpy(&header, data, sizeof(VkPipelineCacheHeaderVersionOne));
+
+		const VkPhysicalDeviceProperties& properties = device->GetPhysicalDeviceProperties();
+		if(header.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) || header.headerSize > (uint32_t)fileSize || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendorID != properties.vendorID || header.deviceID != properties.deviceID || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+			free(data);
+			return nullptr;
+		}
+
+		dataSize = (size_t)fileSize;
+		return data;
+	}
+
+	// Public functions
+	VulkanPipelineCache::VulkanPipelineCache(VulkanDevice* device, const char* cacheDir) : device(device) {
+		void* initialData = nullptr;
+		size_t initialDataSize = 0;
+
+		if(cacheDir) {
+			// Allocate the cache file's path
+			size_t cacheDirLen = strlen(cacheDir);
+			size_t filePathSize = cacheDirLen + 1 + sizeof(CACHE_FILE_PREFIX) - 1 + (VK_UUID_SIZE << 1) + 1 + 8 + sizeof(CACHE_FILE_SUFFIX);
+			filePath = (char*)malloc(filePathSize);
+			if(!filePath)
+				GSIM_THROW_EXCEPTION("Failed to allocate Vulkan pipeline cache file path!");
+
+			// Set the cache file's path, keyed by the device's UUID and driver version, so that every device and driver update gets its own file
+			char* pathEnd = filePath + snprintf(filePath, filePathSize, "%s/%s", cacheDir, CACHE_FILE_PREFIX);
+			const uint8_t* deviceUUID = device->GetDeviceUUID();
+			for(uint32_t i = 0; i != VK_UUID_SIZE; ++i)
+				pathEnd += snprintf(pathEnd, filePathSize - (pathEnd - filePath), "%02x", (uint32_t)deviceUUID[i]);
+			snprintf(pathEnd, filePathSize - (pathEnd - filePath), "_%08x%s", device->GetPhysicalDeviceProperties().driverVersion, CACHE_FILE_SUFFIX);
+
+			// Load the cache file's data
+			initialData = LoadCacheData(initialDataSize);
+		}
+
+		// Set the pipeline cache create info
+		VkPipelineCacheCreateInfo createInfo {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.initialDataSize = initialDataSize,
+			.pInitialData = initialData
+		};
+
+		// Create the pipeline cache
+		VkResult result = vkCreatePipelineCache(device->GetDevice(), &createInfo, nullptr, &pipelineCache);
+
+		// Retry with an empty cache if the driver rejected the loaded data
+		if(result != VK_SUCCESS && initialData) {
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			initialDataSize = 0;
+
+			result = vkCreatePipelineCache(device->GetDevice(), &createInfo, nullptr, &pipelineCache);
+		}
+
+		// Free the loaded data, as the driver copies it
+		free(initialData);
+
+		if(result != VK_SUCCESS) {
+			free(filePath);
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan pipeline cache! Error code: %s", string_VkResult(result));
+		}
+
+		loadedSize = initialDataSize;
+		savedSize = initialDataSize;
+	}
+
+	VkResult VulkanPipelineCache::CreateComputePipelines(uint32_t pipelineCount, const VkComputePipelineCreateInfo* pipelineInfos, VkPipeline* pipelines) {
+		// Create the pipeline on the calling thread if there is only one
+		if(pipelineCount == 1)
+			return vkCreateComputePipelines(device->GetDevice(), pipelineCache, 1, pipelineInfos, nullptr, pipelines);
+
+		// Allocate the result array
+		VkResult* results = (VkResult*)malloc(pipelineCount * sizeof(VkResult));
+		if(!results)
+			return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+		// Create the pipelines on at most one thread per pipeline; the pipeline cache is internally synchronized
+		uint32_t threadCount = std::thread::hardware_concurrency();
+		if(!threadCount || threadCount > pipelineCount)
+			threadCount = pipelineCount;
+
+		PipelineCreateData createData {
+			.device = device->GetDevice(),
+			.pipelineCache = pipelineCache,
+			.pipelineInfos = pipelineInfos,
+			.pipelines = pipelines,
+			.results = results
+		};
+
+		{
+			ThreadPool threadPool(threadCount);
+			threadPool.ParallelFor(pipelineCount, 1, CreatePipelineRange, &createData);
+		}
+
+		// Find the first failed pipeline
+		VkResult result = VK_SUCCESS;
+		for(uint32_t i = 0; i != pipelineCount && result == VK_SUCCESS; ++i)
+			result = results[i];
+
+		// Destroy the created pipelines if any pipeline failed
+		if(result != VK_SUCCESS) {
+			for(uint32_t i = 0; i != pipelineCount; ++i) {
+				if(results[i] == VK_SUCCESS)
+					vkDestroyPipeline(device->GetDevice(), pipelines[i], nullptr);
+				pipelines[i] = VK_NULL_HANDLE;
+			}
+		}
+
+		// Free the result array
+		free(results);
+
+		return result;
+	}
+	bool VulkanPipelineCache::Save() {
+		// Exit the function if the cache has no file
+		if(!filePath)
+			return false;
+
+		// Get the cache data's size, exiting the function if the cache didn't grow, as all pipelines were then found in it
+		size_t dataSize;
+		VkResult result = vkGetPipelineCacheData(device->GetDevice(), pipelineCache, &dataSize, nullptr);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to get Vulkan pipeline cache data size! Error code: %s", string_VkResult(result));
+		if(dataSize <= savedSize)
+			return false;
+
+		// Open the cache file atomically, so that concurrent jobs sharing the directory never load a partial file
+		AtomicFile file(filePath);
+
+		// Allocate and get the cache data
+		void* data = malloc(dataSize);
+		if(!data)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan pipeline cache data!");
+
+		result = vkGetPipelineCacheData(device->GetDevice(), pipelineCache, &dataSize, data);
+		if(result != VK_SUCCESS) {
+			free(data);
+			GSIM_THROW_EXCEPTION("Failed to get Vulkan pipeline cache data! Error code: %s", string_VkResult(result));
+		}
+
+		// Write the data and replace the old cache file
+		size_t writtenSize = fwrite(data, 1, dataSize, file.GetFile());
+		free(data);
+		if(writtenSize != dataSize)
+			GSIM_THROW_EXCEPTION("Failed to write Vulkan pipeline cache file \"%s\"!", filePath);
+
+		file.Commit();
+
+		savedSize = dataSize;
+		return true;
+	}
+
+	VulkanPipelineCache::~VulkanPipelineCache() {
+		// Destroy the pipeline cache
+		vkDestroyPipelineCache(device->GetDevice(), pipelineCache, nullptr);
+
+		// Free the cache file's path
+		free(filePath);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+namespace gsim {
+	class VulkanDevice;
+
+	/// @brief A Vulkan pipeline cache shared by all of a device's pipelines, optionally loaded from and saved to a file keyed by the device's UUID and driver version.
+	class VulkanPipelineCache {
+	public:
+		VulkanPipelineCache() = delete;
+		VulkanPipelineCache(const VulkanPipelineCache&) = delete;
+		VulkanPipelineCache(VulkanPipelineCache&&) noexcept = delete;
+
+		/// @brief Creates a pipeline cache for the given Vulkan device, loading the device's cache file from the given directory if it exists and matches the device.
+		/// @param device The Vulkan device to create the pipeline cache for.
+		/// @param cacheDir The existing directory the cache file is stored in, or nullptr to keep the cache in memory only.
+		VulkanPipelineCache(VulkanDevice* device, const char* cacheDir);
+
+		VulkanPipelineCache& operator=(const VulkanPipelineCache&) = delete;
+		VulkanPipelineCache& operator=(VulkanPipelineCache&&) = delete;
+
+		/// @brief Gets the Vulkan pipeline cache.
+		/// @return A handle to the Vulkan pipeline cache.
+		VkPipelineCache GetPipelineCache() {
+			return pipelineCache;
+		}
+		/// @brief Gets the path of the cache file.
+		/// @return The path of the cache file, or nullptr if the cache is kept in memory only.
+		const char* GetFilePath() const {
+			return filePath;
+		}
+		/// @brief Gets the size of the data loaded from the cache file.
+		/// @return The size of the loaded data, or 0 if no matching cache file was found.
+		size_t GetLoadedSize() const {
+			return loadedSize;
+		}
+
+		/// @brief Creates the given compute pipelines on worker threads, one pipeline per thread at a time, through the pipeline cache.
+		/// @param pipelineCount The number of pipelines to create.
+		/// @param pipelineInfos An array of the pipelines' create infos.
+		/// @param pipelines An array to write the created pipelines to. Left null if any pipeline failed to be created.
+		/// @return VK_SUCCESS if all pipelines were created, otherwise the first error returned by Vulkan.
+		VkResult CreateComputePipelines(uint32_t pipelineCount, const VkComputePipelineCreateInfo* pipelineInfos, VkPipeline* pipelines);
+		/// @brief Writes the pipeline cache to its file, if it grew since it was loaded or last saved.
+		/// @return True if the cache file was written, otherwise false.
+		bool Save();
+
+		/// @brief Destroys the pipeline cache.
+		~VulkanPipelineCache();
+	private:
+		void* LoadCacheData(size_t& dataSize);
+
+		VulkanDevice* device;
+		VkPipelineCache pipelineCache;
+
+		char* filePath = nullptr;
+		size_t loadedSize = 0;
+		size_t savedSize = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include "VulkanSubmissionRing.hpp"
+#include "Debug/Exception.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+namespace gsim {
+	// Internal helper functions
+	void VulkanSubmissionRing::CreateQueryPool() {
+		// Get the compute queue family's properties
+		uint32_t queueFamilyCount;
+		vkGetPhysicalDeviceQueueFamilyProperties(device->GetPhysicalDevice(), &queueFamilyCount, nullptr);
+
+		VkQueueFamilyProperties* queueFamilies = (VkQueueFamilyProperties*)malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+		if(!queueFamilies)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan queue family properties array!");
+
+		vkGetPhysicalDeviceQueueFamilyProperties(device->GetPhysicalDevice(), &queueFamilyCount, queueFamilies);
+		uint32_t timestampValidBits = queueFamilies[device->GetQueueFamilyIndices().computeIndex].timestampValidBits;
+		free(queueFamilies);
+
+		// Exit the function if the compute queue doesn't support timestamps
+		if(!timestampValidBits)
+			return;
+		timestampMask = timestampValidBits == 64 ? UINT64_MAX : ((uint64_t)1 << timestampValidBits) - 1;
+
+		// Set the query pool create info, with a starting and an ending timestamp for every submission
+		VkQueryPoolCreateInfo queryPoolInfo {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = submissionCount << 1,
+			.pipelineStatistics = 0
+		};
+
+		// Create the query pool
+		VkResult result = vkCreateQueryPool(device->GetDevice(), &queryPoolInfo, nullptr, &queryPool);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan submission timestamp query pool! Error code: %s", string_VkResult(result));
+	}
+	void VulkanSubmissionRing::RecordTimestampCommands() {
+		// Set the command buffer alloc info
+		VkCommandBufferAllocateInfo allocInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = nullptr,
+			.commandPool = device->GetComputeCommandPool(),
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = submissionCount
+		};
+
+		// Allocate the command buffers
+		VkResult result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, beginCommandBuffers);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan submission timestamp command buffers! Error code: %s", string_VkResult(result));
+
+		result = vkAllocateCommandBuffers(device->GetDevice(), &allocInfo, endCommandBuffers);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to allocate Vulkan submission timestamp command buffers! Error code: %s", string_VkResult(result));
+
+		// Set the command buffer begin info
+		VkCommandBufferBeginInfo beginInfo {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.pInheritanceInfo = nullptr
+		};
+
+		for(uint32_t i = 0; i != submissionCount; ++i) {
+			// Record the submission's starting timestamp, resetting both of its queries first
+			result = vkBeginCommandBuffer(beginCommandBuffers[i], &beginInfo);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan submission timestamp command buffer! Error code: %s", string_VkResult(result));
+
+			vkCmdResetQueryPool(beginCommandBuffers[i], queryPool, i << 1, 2);
+			vkCmdWriteTimestamp(beginCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, i << 1);
+
+			result = vkEndCommandBuffer(beginCommandBuffers[i]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to end recording Vulkan submission timestamp command buffer! Error code: %s", string_VkResult(result));
+
+			// Record the submission's ending timestamp
+			result = vkBeginCommandBuffer(endCommandBuffers[i], &beginInfo);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to begin recording Vulkan submission timestamp command buffer! Error code: %s", string_VkResult(result));
+
+			vkCmdWriteTimestamp(endCommandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (i << 1) + 1);
+
+			result = vkEndCommandBuffer(endCommandBuffers[i]);
+			if(result != VK_SUCCESS)
+				GSIM_THROW_EXCEPTION("Failed to end recording Vulkan submission timestamp command buffer! Error code: %s", string_VkResult(result));
+		}
+	}
+	void VulkanSubmissionRing::FinishSubmission(uint32_t submissionIndex) {
+		// Set the semaphore wait info
+		VkSemaphoreWaitInfo waitInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &timelineSemaphore,
+			.pValues = submissionValues + submissionIndex
+		};
+
+		// Wait for the timeline semaphore to reach the submission's value
+		VkResult result = vkWaitSemaphores(device->GetDevice(), &waitInfo, UINT64_MAX);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to wait for Vulkan simulation timeline semaphore! Error code: %s", string_VkResult(result));
+
+		pending[submissionIndex] = false;
+
+		// Exit the function if the submissions aren't timed
+		if(queryPool == VK_NULL_HANDLE)
+			return;
+
+		// Get the submission's timestamps
+		uint64_t timestamps[2];
+		result = vkGetQueryPoolResults(device->GetDevice(), queryPool, submissionIndex << 1, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to get Vulkan submission timestamps! Error code: %s", string_VkResult(result));
+
+		uint64_t begin = timestamps[0] & timestampMask;
+		uint64_t end = timestamps[1] & timestampMask;
+
+		// Add the gap since the previous submission ended; its work may still overlap the start of this submission, in which case the GPU wasn't idle
+		double timestampPeriod = device->GetPhysicalDeviceProperties().limits.timestampPeriod * 1e-9;
+		if(timingStats.submissionCount && begin > lastEndTimestamp) {
+			double idleTime = (begin - lastEndTimestamp) * timestampPeriod;
+			timingStats.idleTime += idleTime;
+			if(idleTime > timingStats.maxIdleTime)
+				timingStats.maxIdleTime = idleTime;
+		}
+
+		// Add the submission's own runtime, without the part overlapping the previous submission
+		if(timingStats.submissionCount && begin < lastEndTimestamp)
+			begin = lastEndTimestamp;
+		if(end > begin)
+			timingStats.busyTime += (end - begin) * timestampPeriod;
+
+		lastEndTimestamp = end;
+		++timingStats.submissionCount;
+	}
+
+	// Public functions
+	VulkanSubmissionRing::VulkanSubmissionRing(VulkanDevice* device, uint32_t submissionCount) : device(device), submissionCount(submissionCount) {
+		// Check if the given submission count is valid
+		if(!submissionCount || submissionCount > MAX_SUBMISSION_COUNT)
+			GSIM_THROW_EXCEPTION("Invalid Vulkan submission count %u! The count must be between 1 and %u.", submissionCount, MAX_SUBMISSION_COUNT);
+
+		// Set the timeline semaphore create info
+		VkSemaphoreTypeCreateInfo semaphoreTypeInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.pNext = nullptr,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0
+		};
+		VkSemaphoreCreateInfo semaphoreInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &semaphoreTypeInfo,
+			.flags = 0
+		};
+
+		// Create the timeline semaphore
+		VkResult result = vkCreateSemaphore(device->GetDevice(), &semaphoreInfo, nullptr, &timelineSemaphore);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to create Vulkan simulation timeline semaphore! Error code: %s", string_VkResult(result));
+
+		// Create the timestamp queries and their commands, if supported
+		CreateQueryPool();
+		if(queryPool != VK_NULL_HANDLE)
+			RecordTimestampCommands();
+	}
+
+	uint32_t VulkanSubmissionRing::AcquireSubmission() {
+		// Wait for the slot's previous submission to finish, if it is still in flight
+		uint32_t submissionIndex = nextSubmission;
+		if(pending[submissionIndex])
+			FinishSubmission(submissionIndex);
+
+		return submissionIndex;
+	}
+	void VulkanSubmissionRing::Submit(uint32_t submissionIndex, uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers, VkSemaphore waitSemaphore, uint64_t waitValue) {
+		// Set the timeline semaphore's next value, signaled once the submission finishes
+		submissionValues[submissionIndex] = ++submittedValue;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo {
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreValueCount = 0,
+			.pWaitSemaphoreValues = nullptr,
+			.signalSemaphoreValueCount = 1,
+			.pSignalSemaphoreValues = submissionValues + submissionIndex
+		};
+
+		// Set the submit infos, wrapping the given command buffers between the submission's timestamps
+		VkSubmitInfo submitInfos[3];
+		uint32_t submitCount = 0;
+
+		if(queryPool != VK_NULL_HANDLE) {
+			submitInfos[submitCount++] = {
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = nullptr,
+				.waitSemaphoreCount = 0,
+				.pWaitSemaphores = nullptr,
+				.pWaitDstStageMask = nullptr,
+				.commandBufferCount = 1,
+				.pCommandBuffers = beginCommandBuffers + submissionIndex,
+				.signalSemaphoreCount = 0,
+				.pSignalSemaphores = nullptr
+			};
+		}
+		submitInfos[submitCount++] = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = nullptr,
+			.pWaitDstStageMask = nullptr,
+			.commandBufferCount = commandBufferCount,
+			.pCommandBuffers = commandBuffers,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = nullptr
+		};
+		if(queryPool != VK_NULL_HANDLE) {
+			submitInfos[submitCount++] = {
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = nullptr,
+				.waitSemaphoreCount = 0,
+				.pWaitSemaphores = nullptr,
+				.pWaitDstStageMask = nullptr,
+				.commandBufferCount = 1,
+				.pCommandBuffers = endCommandBuffers + submissionIndex,
+				.signalSemaphoreCount = 0,
+				.pSignalSemaphores = nullptr
+			};
+		}
+
+		// Wait for the given timeline semaphore before the submit info holding the given command buffers, if requested, as a semaphore wait only covers the commands of its own batch
+		uint32_t mainIndex = queryPool != VK_NULL_HANDLE ? 1 : 0;
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkTimelineSemaphoreSubmitInfo waitTimelineInfo {
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreValueCount = 1,
+			.pWaitSemaphoreValues = &waitValue,
+			.signalSemaphoreValueCount = 0,
+			.pSignalSemaphoreValues = nullptr
+		};
+
+		if(waitSemaphore != VK_NULL_HANDLE && waitValue) {
+			submitInfos[mainIndex].pNext = &waitTimelineInfo;
+			submitInfos[mainIndex].waitSemaphoreCount = 1;
+			submitInfos[mainIndex].pWaitSemaphores = &waitSemaphore;
+			submitInfos[mainIndex].pWaitDstStageMask = &waitStage;
+
+			// Share the timeline info if the submit info is also the last one
+			if(mainIndex == submitCount - 1) {
+				timelineInfo.waitSemaphoreValueCount = 1;
+				timelineInfo.pWaitSemaphoreValues = &waitValue;
+			}
+		}
+
+		// Signal the timeline semaphore at the end of the last submit info
+		submitInfos[submitCount - 1].pNext = &timelineInfo;
+		submitInfos[submitCount - 1].signalSemaphoreCount = 1;
+		submitInfos[submitCount - 1].pSignalSemaphores = &timelineSemaphore;
+
+		// Submit the command buffers to the compute queue
+		VkResult result = vkQueueSubmit(device->GetComputeQueue(), submitCount, submitInfos, VK_NULL_HANDLE);
+		if(result != VK_SUCCESS)
+			GSIM_THROW_EXCEPTION("Failed to submit Vulkan simulation command buffer! Error code: %s", string_VkResult(result));
+
+		// Move on to the next submission slot
+		pending[submissionIndex] = true;
+		nextSubmission = (submissionIndex + 1) % submissionCount;
+	}
+	void VulkanSubmissionRing::WaitIdle() {
+		// Finish all submissions in flight, starting from the oldest one
+		for(uint32_t i = 0; i != submissionCount; ++i) {
+			uint32_t submissionIndex = (nextSubmission + i) % submissionCount;
+			if(pending[submissionIndex])
+				FinishSubmission(submissionIndex);
+		}
+	}
+
+	VulkanSubmissionRing::~VulkanSubmissionRing() {
+		// Wait for all submissions in flight
+		VkSemaphoreWaitInfo waitInfo {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.pNext = nullptr,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &timelineSemaphore,
+			.pValues = &submittedValue
+		};
+		vkWaitSemaphores(device->GetDevice(), &waitInfo, UINT64_MAX);
+
+		// Destroy the timestamp objects, if they were created
+		if(queryPool != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), submissionCount, beginCommandBuffers);
+			vkFreeCommandBuffers(device->GetDevice(), device->GetComputeCommandPool(), submissionCount, endCommandBuffers);
+			vkDestroyQueryPool(device->GetDevice(), queryPool, nullptr);
+		}
+
+		// Destroy the timeline semaphore
+		vkDestroySemaphore(device->GetDevice(), timelineSemaphore, nullptr);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include <stdint.h>
+#include <vulkan/vk_platform.h>
+#include <vulkan/vulkan_core.h>
+
+namespace gsim {
+	/// @brief A ring of compute queue submissions that may be in flight at the same time, each signaling the next value of a timeline semaphore and timed on the GPU.
+	class VulkanSubmissionRing {
+	public:
+		/// @brief A struct containing the GPU timings of all finished submissions.
+		struct TimingStats {
+			/// @brief The number of timed submissions.
+			uint64_t submissionCount;
+			/// @brief The total time, in seconds, the GPU spent executing the submissions.
+			double busyTime;
+			/// @brief The total time, in seconds, the GPU spent idle between two consecutive submissions.
+			double idleTime;
+			/// @brief The longest time, in seconds, the GPU spent idle between two consecutive submissions.
+			double maxIdleTime;
+		};
+
+		/// @brief The maximum number of submissions that may be in flight at the same time.
+		static const uint32_t MAX_SUBMISSION_COUNT = 8;
+		/// @brief The default number of submissions that may be in flight at the same time.
+		static const uint32_t DEFAULT_SUBMISSION_COUNT = 3;
+
+		VulkanSubmissionRing() = delete;
+		VulkanSubmissionRing(const VulkanSubmissionRing&) = delete;
+		VulkanSubmissionRing(VulkanSubmissionRing&&) noexcept = delete;
+
+		/// @brief Creates a ring of compute queue submissions.
+		/// @param device The Vulkan device whose compute queue to submit to.
+		/// @param submissionCount The number of submissions that may be in flight at the same time, at most MAX_SUBMISSION_COUNT.
+		VulkanSubmissionRing(VulkanDevice* device, uint32_t submissionCount);
+
+		VulkanSubmissionRing& operator=(const VulkanSubmissionRing&) = delete;
+		VulkanSubmissionRing& operator=(VulkanSubmissionRing&&) = delete;
+
+		/// @brief Gets the Vulkan device whose compute queue is submitted to.
+		/// @return A pointer to the Vulkan device wrapper object.
+		VulkanDevice* GetDevice() {
+			return device;
+		}
+		/// @brief Gets the Vulkan device whose compute queue is submitted to.
+		/// @return A const pointer to the Vulkan device wrapper object.
+		const VulkanDevice* GetDevice() const {
+			return device;
+		}
+		/// @brief Gets the number of submissions that may be in flight at the same time.
+		/// @return The number of submissions that may be in flight at the same time.
+		uint32_t GetSubmissionCount() const {
+			return submissionCount;
+		}
+		/// @brief Gets the timeline semaphore signaled by the submissions.
+		/// @return A handle to the Vulkan timeline semaphore.
+		VkSemaphore GetTimelineSemaphore() {
+			return timelineSemaphore;
+		}
+		/// @brief Gets the timeline semaphore value signaled once the last submission finishes.
+		/// @return The last submission's timeline semaphore value, or 0 if nothing was submitted yet.
+		uint64_t GetSubmittedValue() const {
+			return submittedValue;
+		}
+		/// @brief Checks if the submissions are timed on the GPU.
+		/// @return True if the compute queue supports timestamps, otherwise false.
+		bool GetTimestampsSupported() const {
+			return queryPool != VK_NULL_HANDLE;
+		}
+		/// @brief Gets the GPU timings of all finished submissions.
+		/// @return A struct containing the GPU timings, with no submissions if timestamps aren't supported.
+		const TimingStats& GetTimingStats() const {
+			return timingStats;
+		}
+
+		/// @brief Acquires the next submission slot, waiting for its previous submission to finish.
+		/// @return The index of the acquired submission slot.
+		uint32_t AcquireSubmission();
+		/// @brief Submits the given command buffers to the compute queue in the acquired submission slot.
+		/// @param submissionIndex The index of the acquired submission slot.
+		/// @param commandBufferCount The number of command buffers to submit.
+		/// @param commandBuffers The command buffers to submit, in order.
+		/// @param waitSemaphore A timeline semaphore the submission waits for on the GPU before running, or VK_NULL_HANDLE to not wait.
+		/// @param waitValue The timeline semaphore value to wait for. No wait is done if it is 0.
+		void Submit(uint32_t submissionIndex, uint32_t commandBufferCount, const VkCommandBuffer* commandBuffers, VkSemaphore waitSemaphore, uint64_t waitValue);
+		/// @brief Waits for all submissions in flight to finish.
+		void WaitIdle();
+
+		/// @brief Destroys the submission ring.
+		~VulkanSubmissionRing();
+	private:
+		void CreateQueryPool();
+		void RecordTimestampCommands();
+		void FinishSubmission(uint32_t submissionIndex);
+
+		VulkanDevice* device;
+		uint32_t submissionCount;
+
+		VkSemaphore timelineSemaphore;
+		uint64_t submittedValue = 0;
+		uint64_t submissionValues[MAX_SUBMISSION_COUNT]{};
+		bool pending[MAX_SUBMISSION_COUNT]{};
+		uint32_t nextSubmission = 0;
+
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		VkCommandBuffer beginCommandBuffers[MAX_SUBMISSION_COUNT];
+		VkCommandBuffer endCommandBuffers[MAX_SUBMISSION_COUNT];
+		uint64_t timestampMask;
+		uint64_t lastEndTimestamp = 0;
+		TimingStats timingStats{};
+	};
+}
\ No newline at end of file